@@ -0,0 +1,16 @@
+
+#include "bench.h"
+#include "bench_planner.h"
+#include "bench_forecast.h"
+#include "bench_control.h"
+
+volatile uint32_t lBenchSink = 0;
+
+int main()
+{
+    bench_planner();
+    bench_forecast();
+    bench_control();
+    
+    return 0;
+}
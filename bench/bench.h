@@ -0,0 +1,29 @@
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#define BENCH_ITERATIONS 1000000
+
+static inline uint64_t bench_NowNs()
+{
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return ((uint64_t)spec.tv_sec * 1000000000ULL) + (uint64_t)spec.tv_nsec;
+}
+
+//Keeps results alive so the compiler can't optimise the work away.
+extern volatile uint32_t lBenchSink;
+
+#define PRINT_BENCH_RESULT(name, iterations, ns) \
+    do { \
+        printf("    %-40s %10u iterations %10.1f ns/op\n", \
+               name, \
+               (uint32_t)(iterations), \
+               (double)(ns) / (double)(iterations)); \
+    } while (0)
+
+#endif /* BENCH_H */
@@ -0,0 +1,56 @@
+
+#include "bench.h"
+#include "bench_control.h"
+#include "control.h"
+#include <string.h>
+
+static void bench_control_Step()
+{
+    struct Controller controller;
+    struct SystemStatus status;
+    struct OverloadConfig config;
+    struct ControlSample sample;
+    struct ControlActions actions;
+    
+    overload_DefaultConfig(&config);
+    control_Initialise(&controller, &config);
+    memset(&status, 0x00, sizeof(struct SystemStatus));
+    memset(&sample, 0x00, sizeof(struct ControlSample));
+    status.nBatterySoc = 20;
+    status.nBatteryVolts = 5120;
+    
+    //One sample per second through whole days, so every switch and re-plan is in there.
+    uint64_t llStart = bench_NowNs();
+    
+    for(uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        sample.time.slNow = (int32_t)i;
+        sample.time.llNowMs = (int64_t)i * 1000;
+        sample.time.lHour = (i / 3600) % 24;
+        sample.time.lMin = (i / 60) % 60;
+        
+        for(int j = 0; j < INVERTER_COUNT; j++)
+        {
+            sample.inverters[j].nOutputWatts = (uint16_t)(i % 50000);
+            sample.nChargeAmps[j] = (uint16_t)(i % 300);
+        }
+        
+        control_Step(&controller, &status, &sample, &actions);
+        
+        for(uint8_t j = 0; j < actions.cCount; j++)
+            control_Apply(&status, &actions.actions[j]);
+            
+        lBenchSink += actions.cCount;
+    }
+    
+    PRINT_BENCH_RESULT("control_Step (1Hz samples)", BENCH_ITERATIONS, bench_NowNs() - llStart);
+}
+
+void bench_control()
+{
+    printf("---=== Control benchmarks ===---\n");
+    
+    bench_control_Step();
+    
+    printf("--------------------------------\n\n");
+}
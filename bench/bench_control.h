@@ -0,0 +1,7 @@
+
+#ifndef BENCH_CONTROL_H
+#define BENCH_CONTROL_H
+
+void bench_control();
+
+#endif
@@ -0,0 +1,50 @@
+
+#include "bench.h"
+#include "bench_forecast.h"
+#include "forecast.h"
+
+static void bench_forecast_Sample()
+{
+    struct LoadForecast forecast;
+    forecast_Initialise(&forecast);
+    
+    //One sample every 10 seconds, walking round the week.
+    uint64_t llStart = bench_NowNs();
+    
+    for(uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        int32_t t = (int32_t)i * 10;
+        int lSlot = (t / FORECAST_SLOT_S) % FORECAST_SLOTS;
+        lBenchSink += forecast_Sample(&forecast, t, lSlot, (float)(i % 5000));
+    }
+    
+    PRINT_BENCH_RESULT("forecast_Sample", BENCH_ITERATIONS, bench_NowNs() - llStart);
+}
+
+static void bench_forecast_Next24hKwh()
+{
+    struct LoadForecast forecast;
+    forecast_Initialise(&forecast);
+    
+    for(int32_t t = 0; t < 7 * 24 * 3600; t += 60)
+        forecast_Sample(&forecast, t, (t / FORECAST_SLOT_S) % FORECAST_SLOTS, 1000.0f);
+    
+    uint64_t llStart = bench_NowNs();
+    
+    for(uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        lBenchSink += (uint32_t)forecast_Next24hKwh(&forecast, i % FORECAST_SLOTS);
+    }
+    
+    PRINT_BENCH_RESULT("forecast_Next24hKwh", BENCH_ITERATIONS, bench_NowNs() - llStart);
+}
+
+void bench_forecast()
+{
+    printf("---=== Forecast benchmarks ===---\n");
+    
+    bench_forecast_Sample();
+    bench_forecast_Next24hKwh();
+    
+    printf("---------------------------------\n\n");
+}
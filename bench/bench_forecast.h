@@ -0,0 +1,7 @@
+
+#ifndef BENCH_FORECAST_H
+#define BENCH_FORECAST_H
+
+void bench_forecast();
+
+#endif
@@ -0,0 +1,76 @@
+
+#include "bench.h"
+#include "bench_planner.h"
+#include "planner.h"
+#include "utils.h"
+#include <string.h>
+
+static void bench_planner_CalculateAmps()
+{
+    uint64_t llStart = bench_NowNs();
+    
+    for(uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        lBenchSink += planner_CalculateAmps(i % 101, 4800 + (i % 800), 15 + (i % 360), 0.8f);
+    }
+    
+    PRINT_BENCH_RESULT("planner_CalculateAmps", BENCH_ITERATIONS, bench_NowNs() - llStart);
+}
+
+static void bench_planner_Update()
+{
+    struct ChargePlanner planner;
+    struct SystemStatus status;
+    uint16_t chargeAmps[INVERTER_COUNT];
+    
+    memset(&status, 0x00, sizeof(struct SystemStatus));
+    status.nBatterySoc = 20;
+    status.nBatteryVolts = 5120;
+    status.nBattchgAmps = 250;
+    
+    for(uint8_t i = 0; i < INVERTER_COUNT; i++)
+        chargeAmps[i] = status.nBattchgAmps;
+    
+    planner_Start(&planner, &status, 0, 360);
+    
+    //One sample per second, re-planning every PLANNER_REPLAN_S as it would overnight.
+    uint64_t llStart = bench_NowNs();
+    
+    for(uint32_t i = 1; i <= BENCH_ITERATIONS; i++)
+    {
+        status.nBatterySoc = 20 + ((i / 600) % 80);
+        lBenchSink += planner_Update(&planner, &status, chargeAmps, (int32_t)i, 360 - (int)((i / 60) % 360));
+    }
+    
+    PRINT_BENCH_RESULT("planner_Update (1Hz samples)", BENCH_ITERATIONS, bench_NowNs() - llStart);
+}
+
+static void bench_utils_GetOffpeakChargingAmps()
+{
+    struct SystemStatus status;
+    
+    memset(&status, 0x00, sizeof(struct SystemStatus));
+    status.nOffPeakChargeKwh = 50;
+    
+    uint64_t llStart = bench_NowNs();
+    
+    for(uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        status.nAcchgegyToday = 50 + (i % 100);
+        status.nBattuseToday = i % 300;
+        lBenchSink += utils_GetOffpeakChargingAmps(&status);
+    }
+    
+    PRINT_BENCH_RESULT("utils_GetOffpeakChargingAmps", BENCH_ITERATIONS, bench_NowNs() - llStart);
+}
+
+void bench_planner()
+{
+    printf("---=== Planner benchmarks ===---\n");
+    
+    bench_planner_CalculateAmps();
+    bench_planner_Update();
+    bench_utils_GetOffpeakChargingAmps();
+    
+    printf("--------------------------------\n\n");
+}
@@ -0,0 +1,7 @@
+
+#ifndef BENCH_PLANNER_H
+#define BENCH_PLANNER_H
+
+void bench_planner();
+
+#endif
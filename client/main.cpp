@@ -27,6 +27,35 @@ void _tcpclient_ReceiveStatus(uint8_t* pStatus, uint32_t lLength)
     }
 }
 
+void _tcpclient_ReceiveEvent(uint8_t* pEvent, uint32_t lLength)
+{
+    struct SystemEvent event;
+    memcpy(&event, pEvent, sizeof(event));
+
+    qDebug() << "Event" << event.nEventID << "at" << event.slTime << "value" << event.nValue << "was" << event.nPrevious;
+}
+
+void _tcpclient_ReceiveCommandResult(uint8_t* pResult, uint32_t lLength)
+{
+    struct CommandResult result;
+    memcpy(&result, pResult, sizeof(result));
+
+    qDebug() << "Command" << result.lCommandId << (result.nResult == COMMAND_RESULT_DONE ? "done in" : "refused after")
+             << result.lLatencyUs / 1000.0 << "ms";
+}
+
+void _tcpclient_ReceiveSchedule(uint8_t* pSchedule, uint32_t lLength)
+{
+    struct ScheduleList list;
+    memcpy(&list, pSchedule, sizeof(list));
+
+    for (int i = 0; i < list.nCount && i < SCHEDULE_MAX_ENTRIES; i++)
+    {
+        qDebug() << "Schedule" << list.entries[i].lScheduleId << "command" << list.entries[i].nCommandID
+                 << "at" << list.entries[i].slStart << "for" << list.entries[i].slDuration << "s every" << list.entries[i].slPeriod << "s";
+    }
+}
+
 void networkThread() {
     // Initialize the TCP client and set the callback
     if (!tcpclient_init())
@@ -35,15 +64,9 @@ void networkThread() {
         return;
     }
 
-    // Run the network operations in a loop
+    // Status is pushed by the server as it changes, so there's nothing to poll
     while (!bQuit) {
-        if(tcpclient_GetConnected())
-        {
-            tcpclient_SendCommand(COMMAND_REQUEST_STATUS);
-        }
-
-        // Sleep or perform other operations
-        QThread::sleep(1);  // Adjust sleep as needed
+        QThread::sleep(1);
     }
 }
 
@@ -29,6 +29,7 @@ MainWindow::MainWindow(QWidget *parent, SystemStatus* statusPtr)
     connect(ui->btnBatteries, &QPushButton::clicked, this, &MainWindow::Batteries_clicked);
 
     PrepareStateChange();
+    DeclareInterest();
 }
 
 MainWindow::~MainWindow()
@@ -56,6 +57,46 @@ void MainWindow::PrepareStateChange()
     ui->lbl08->setVisible(false);
 }
 
+void MainWindow::DeclareInterest()
+{
+    //The inverter state is always shown. The server only polls the rest while some page wants them.
+    uint32_t lFields = STATUS_FIELD_BIT(STATUS_FIELD_INVERTER_STATE);
+
+    switch(uiState)
+    {
+        case UIState::Information:
+            lFields |= STATUS_FIELD_BIT(STATUS_FIELD_LOAD_PERCENT) | STATUS_FIELD_BIT(STATUS_FIELD_OUTPUT_WATTS) |
+                       STATUS_FIELD_BIT(STATUS_FIELD_OUTPUT_APPPWR) | STATUS_FIELD_BIT(STATUS_FIELD_AC_USE_WATTS) |
+                       STATUS_FIELD_BIT(STATUS_FIELD_BATTUSE_TODAY) | STATUS_FIELD_BIT(STATUS_FIELD_AC_USE_TODAY);
+            break;
+        case UIState::Charging:
+            lFields |= STATUS_FIELD_BIT(STATUS_FIELD_ACCHGEGY_TODAY) | STATUS_FIELD_BIT(STATUS_FIELD_BATTCHG_AMPS);
+            break;
+        case UIState::Solar:
+            lFields |= STATUS_FIELD_BIT(STATUS_FIELD_SOLAR_VOLTS) | STATUS_FIELD_BIT(STATUS_FIELD_SOLAR_WATTS) |
+                       STATUS_FIELD_BIT(STATUS_FIELD_SOLAR_TODAY);
+            break;
+        case UIState::Health:
+            lFields |= STATUS_FIELD_BIT(STATUS_FIELD_INVERTER_TEMP) | STATUS_FIELD_BIT(STATUS_FIELD_DCDC_TEMP) |
+                       STATUS_FIELD_BIT(STATUS_FIELD_BUCK1_TEMP) | STATUS_FIELD_BIT(STATUS_FIELD_BUCK2_TEMP) |
+                       STATUS_FIELD_BIT(STATUS_FIELD_INV_FANSPEED) | STATUS_FIELD_BIT(STATUS_FIELD_BUS_VOLTS) |
+                       STATUS_FIELD_BIT(STATUS_FIELD_OUTPUT_AMPS) | STATUS_FIELD_BIT(STATUS_FIELD_INVERTER_AMPS);
+            break;
+        case UIState::AC:
+            lFields |= STATUS_FIELD_BIT(STATUS_FIELD_GRID_VOLTS) | STATUS_FIELD_BIT(STATUS_FIELD_GRID_FREQ) |
+                       STATUS_FIELD_BIT(STATUS_FIELD_AC_OUT_VOLTS) | STATUS_FIELD_BIT(STATUS_FIELD_AC_OUT_FREQ) |
+                       STATUS_FIELD_BIT(STATUS_FIELD_AC_INPUT_WATTS);
+            break;
+        case UIState::Batteries:
+            lFields |= STATUS_FIELD_BIT(STATUS_FIELD_BATTERY_VOLTS) | STATUS_FIELD_BIT(STATUS_FIELD_AC_CHARGE_WATTS) |
+                       STATUS_FIELD_BIT(STATUS_FIELD_BATTUSE_WATTS) | STATUS_FIELD_BIT(STATUS_FIELD_BATT_WATTS) |
+                       STATUS_FIELD_BIT(STATUS_FIELD_BATTERY_SOC);
+            break;
+    }
+
+    tcpclient_SetInterest(lFields);
+}
+
 void MainWindow::updateStatus()
 {
     if(nSystemState != status->nSystemState)
@@ -173,12 +214,14 @@ void MainWindow::updateStatus()
             ui->lbl03->setVisible(true);
             ui->lbl04->setVisible(true);
             ui->lbl05->setVisible(true);
+            ui->lbl06->setVisible(true);
 
-            ui->lbl01->setText(QString("Planned Charging Amps: %1 A").arg(utils_GetOffpeakChargingAmps(status)));
+            ui->lbl01->setText(QString("Planned Charging Amps: %1 A").arg(status->nChargeCurrent));
             ui->lbl02->setText(QString("Off-peak Charge Completed: %1").arg(strChargeComplete));
             ui->lbl03->setText(QString("Off-peak Charge Amount: %1 kWh").arg(status->nOffPeakChargeKwh / 10.0));
             ui->lbl04->setText(QString("AC Charge Energy Today: %1 kWh").arg(status->nAcchgegyToday / 10.0));
             ui->lbl05->setText(QString("Battery Charge Amps: %1 A").arg(status->nBattchgAmps / 10.0));
+            ui->lbl06->setText(QString("Forecast Use (24h): %1 kWh").arg(status->nForecastKwh / 10.0));
         }
         break;
 
@@ -238,11 +281,13 @@ void MainWindow::updateStatus()
             ui->lbl02->setVisible(true);
             ui->lbl03->setVisible(true);
             ui->lbl04->setVisible(true);
+            ui->lbl05->setVisible(true);
 
             ui->lbl01->setText(QString("Battery Volts: %1 V").arg(status->nBatteryVolts / 100.0));
             ui->lbl02->setText(QString("AC Charge Watts: %1 W").arg(status->nAcChargeWattsL / 10.0));
             ui->lbl03->setText(QString("Battery Use Watts: %1 W").arg(status->nBattUseWatts / 10.0));
             ui->lbl04->setText(QString("Battery Watts: %1 W").arg(status->nBattWatts / 10.0));
+            ui->lbl05->setText(QString("Battery SoC: %1%").arg(status->nBatterySoc));
         }
         break;
     }
@@ -270,34 +315,40 @@ void MainWindow::General_clicked()
 {
     uiState = UIState::Information;
     PrepareStateChange();
+    DeclareInterest();
 }
 
 void MainWindow::Charging_clicked()
 {
     uiState = UIState::Charging;
     PrepareStateChange();
+    DeclareInterest();
 }
 
 void MainWindow::Solar_clicked()
 {
     uiState = UIState::Solar;
     PrepareStateChange();
+    DeclareInterest();
 }
 
 void MainWindow::Health_clicked()
 {
     uiState = UIState::Health;
     PrepareStateChange();
+    DeclareInterest();
 }
 
 void MainWindow::AC_clicked()
 {
     uiState = UIState::AC;
     PrepareStateChange();
+    DeclareInterest();
 }
 
 void MainWindow::Batteries_clicked()
 {
     uiState = UIState::Batteries;
     PrepareStateChange();
+    DeclareInterest();
 }
@@ -50,6 +50,7 @@ private slots:
 
 private:
     void PrepareStateChange();
+    void DeclareInterest();
     Ui::MainWindow *ui;
     SystemStatus *status;
     uint16_t nSystemState;
@@ -17,6 +17,8 @@ const int server_port = 20069;
 
 struct sdfComms sdcComms;
 
+uint32_t lInterest = STATUS_FIELD_ALL; //Status fields on show, declared again on every connection.
+
 enum ClientState
 {
     INIT,
@@ -45,6 +47,24 @@ void objectReceived_callback(struct sdfComms* psdcComms, uint16_t nObjectID, uin
             _tcpclient_ReceiveStatus(pcData, nLength);
         }
         break;
+        
+        case OBJECT_EVENT:
+        {
+            _tcpclient_ReceiveEvent(pcData, nLength);
+        }
+        break;
+        
+        case OBJECT_COMMAND_RESULT:
+        {
+            _tcpclient_ReceiveCommandResult(pcData, nLength);
+        }
+        break;
+        
+        case OBJECT_SCHEDULE:
+        {
+            _tcpclient_ReceiveSchedule(pcData, nLength);
+        }
+        break;
     
         default: printf("Socket sent unknown object %u.\n", nObjectID);
     }
@@ -52,7 +72,17 @@ void objectReceived_callback(struct sdfComms* psdcComms, uint16_t nObjectID, uin
 
 void commandReceived_callback(struct sdfComms* psdcComms, uint16_t nCommandID)
 {
-    printf("Server sent us command ID %u unexpectedly.\n", nCommandID);
+    switch(nCommandID)
+    {
+        case COMMAND_HEARTBEAT:
+        {
+            //Still here.
+            Comms_SendCommand(psdcComms, COMMAND_HEARTBEAT);
+        }
+        break;
+        
+        default: printf("Server sent us command ID %u unexpectedly.\n", nCommandID);
+    }
 }
 
 bool lengthCheck_callback(struct sdfComms* psdcComms, uint16_t nObjectID, uint16_t nLength)
@@ -64,6 +94,24 @@ bool lengthCheck_callback(struct sdfComms* psdcComms, uint16_t nObjectID, uint16
             return (nLength == sizeof(struct SystemStatus));
         }
         break;
+        
+        case OBJECT_EVENT:
+        {
+            return (nLength == sizeof(struct SystemEvent));
+        }
+        break;
+        
+        case OBJECT_COMMAND_RESULT:
+        {
+            return (nLength == sizeof(struct CommandResult));
+        }
+        break;
+        
+        case OBJECT_SCHEDULE:
+        {
+            return (nLength == sizeof(struct ScheduleList));
+        }
+        break;
     
         default: printf("Socket requested length check for unknown object %u.\n", nObjectID);
     }
@@ -121,6 +169,12 @@ void *handle_client(void *arg)
                     break;
                 }
                 
+                //The server always has something to say inside the timeout, if only a heartbeat.
+                struct timeval tv;
+                tv.tv_sec = COMMS_TIMEOUT;
+                tv.tv_usec = 0;
+                setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
+                
                 Comms_Initialise(&sdcComms,
                                  lConnections++,
                                  transmit_callback,
@@ -131,6 +185,13 @@ void *handle_client(void *arg)
                                  
                 printf("Comms initialised. Going to processing.\n");
                 clientState = PROCESS;
+                
+                //Ask to be told about events and status changes as they happen.
+                Comms_SendCommand(&sdcComms, COMMAND_SUBSCRIBE_EVENTS);
+                Comms_SendCommand(&sdcComms, COMMAND_SUBSCRIBE_STATUS);
+                
+                //Only what's on show needs polling.
+                Comms_SendObject(&sdcComms, OBJECT_INTEREST, sizeof(uint32_t), (uint8_t*)&lInterest);
             }
             break;
             
@@ -185,6 +246,26 @@ void tcpclient_SendCommand(uint16_t nCommandID)
     Comms_SendCommand(&sdcComms, nCommandID);
 }
 
+void tcpclient_AddSchedule(const struct ScheduledCommand* pCommand)
+{
+    Comms_SendObject(&sdcComms, OBJECT_SCHEDULE_ADD, sizeof(struct ScheduledCommand), (uint8_t*)pCommand);
+}
+
+void tcpclient_CancelSchedule(uint32_t lScheduleId)
+{
+    Comms_SendObject(&sdcComms, OBJECT_SCHEDULE_CANCEL, sizeof(uint32_t), (uint8_t*)&lScheduleId);
+}
+
+void tcpclient_SetInterest(uint32_t lFields)
+{
+    lInterest = lFields;
+    
+    if(PROCESS == clientState)
+    {
+        Comms_SendObject(&sdcComms, OBJECT_INTEREST, sizeof(uint32_t), (uint8_t*)&lInterest);
+    }
+}
+
 bool tcpclient_init()
 {
     if(0 != pthread_create(&clientThread, NULL, &handle_client, NULL))
@@ -4,11 +4,18 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include "system_defs.h"
 
 bool tcpclient_GetConnected();
 void tcpclient_SendCommand(uint16_t nCommandID);
+void tcpclient_AddSchedule(const struct ScheduledCommand* pCommand);
+void tcpclient_CancelSchedule(uint32_t lScheduleId);
+void tcpclient_SetInterest(uint32_t lFields);
 bool tcpclient_init();
 
 extern void _tcpclient_ReceiveStatus(uint8_t* pStatus, uint32_t lLength);
+extern void _tcpclient_ReceiveEvent(uint8_t* pEvent, uint32_t lLength);
+extern void _tcpclient_ReceiveCommandResult(uint8_t* pResult, uint32_t lLength);
+extern void _tcpclient_ReceiveSchedule(uint8_t* pSchedule, uint32_t lLength);
 
 #endif
@@ -0,0 +1,119 @@
+
+#include <string.h>
+#include "balance.h"
+
+static uint16_t balance_Clamp(const struct ChargeBalancer* pBalancer, int32_t slAmps)
+{
+    int32_t slMin = (int32_t)pBalancer->nPlanAmps - BALANCE_MAX_TRIM;
+    int32_t slMax = (int32_t)pBalancer->nPlanAmps + BALANCE_MAX_TRIM;
+    
+    if(slMin < CHARGE_MIN_AMPS)
+        slMin = CHARGE_MIN_AMPS;
+        
+    if(slMax > GW_CFG_UTIL_AMPS_MAX)
+        slMax = GW_CFG_UTIL_AMPS_MAX;
+        
+    if(slAmps < slMin)
+        return (uint16_t)slMin;
+        
+    if(slAmps > slMax)
+        return (uint16_t)slMax;
+        
+    return (uint16_t)slAmps;
+}
+
+void balance_Start(struct ChargeBalancer* pBalancer, uint8_t cCount, uint16_t nPlanAmps, int32_t slNow)
+{
+    memset(pBalancer, 0x00, sizeof(struct ChargeBalancer));
+    pBalancer->bActive = true;
+    pBalancer->cCount = cCount < INVERTER_COUNT ? cCount : INVERTER_COUNT;
+    pBalancer->nPlanAmps = nPlanAmps;
+    
+    for(uint8_t i = 0; i < pBalancer->cCount; i++)
+    {
+        pBalancer->nLimits[i] = balance_Clamp(pBalancer, nPlanAmps);
+        pBalancer->slLastAdjust[i] = slNow;
+    }
+}
+
+void balance_SetPlan(struct ChargeBalancer* pBalancer, uint16_t nPlanAmps)
+{
+    int32_t slShift = (int32_t)nPlanAmps - pBalancer->nPlanAmps;
+    pBalancer->nPlanAmps = nPlanAmps;
+    
+    for(uint8_t i = 0; i < pBalancer->cCount; i++)
+        pBalancer->nLimits[i] = balance_Clamp(pBalancer, (int32_t)pBalancer->nLimits[i] + slShift);
+}
+
+void balance_Stop(struct ChargeBalancer* pBalancer)
+{
+    pBalancer->bActive = false;
+}
+
+uint8_t balance_Update(struct ChargeBalancer* pBalancer, const uint16_t* pnMeasured, int32_t slNow)
+{
+    if(!pBalancer->bActive || 0 == pBalancer->cCount)
+        return 0;
+        
+    int32_t slTarget = (int32_t)pBalancer->nPlanAmps * 10;
+    int32_t slTotal = 0;
+    uint16_t nMin = 0xFFFF;
+    uint16_t nMax = 0;
+    
+    for(uint8_t i = 0; i < pBalancer->cCount; i++)
+    {
+        slTotal += pnMeasured[i];
+        
+        if(pnMeasured[i] < nMin)
+            nMin = pnMeasured[i];
+            
+        if(pnMeasured[i] > nMax)
+            nMax = pnMeasured[i];
+    }
+    
+    //On plan and even enough. Leave the bus alone.
+    int32_t slTotalError = slTarget * pBalancer->cCount - slTotal;
+    
+    if(slTotalError <= BALANCE_DEADBAND * pBalancer->cCount &&
+       slTotalError >= -BALANCE_DEADBAND * pBalancer->cCount &&
+       nMax - nMin <= BALANCE_SPREAD)
+    {
+        return 0;
+    }
+    
+    uint8_t cChanged = 0;
+    
+    for(uint8_t i = 0; i < pBalancer->cCount; i++)
+    {
+        int32_t slError = slTarget - pnMeasured[i];
+        
+        if(slNow - pBalancer->slLastAdjust[i] < BALANCE_INTERVAL_S ||
+           (slError <= BALANCE_DEADBAND && slError >= -BALANCE_DEADBAND))
+        {
+            continue;
+        }
+        
+        //Whole amps, at least one, at most the step limit.
+        int32_t slStep = slError / 10;
+        
+        if(0 == slStep)
+            slStep = slError > 0 ? 1 : -1;
+            
+        if(slStep > BALANCE_MAX_STEP)
+            slStep = BALANCE_MAX_STEP;
+        else if(slStep < -BALANCE_MAX_STEP)
+            slStep = -BALANCE_MAX_STEP;
+            
+        uint16_t nLimit = balance_Clamp(pBalancer, (int32_t)pBalancer->nLimits[i] + slStep);
+        
+        if(nLimit != pBalancer->nLimits[i])
+        {
+            pBalancer->nLimits[i] = nLimit;
+            pBalancer->slLastAdjust[i] = slNow;
+            pBalancer->lAdjustments++;
+            cChanged |= (uint8_t)(1 << i);
+        }
+    }
+    
+    return cChanged;
+}
@@ -0,0 +1,49 @@
+
+//Closed-loop charge current balancer for paralleled inverters.
+//Trims each inverter's utility charge current limit from its measured battery charge current, so
+//the total meets the plan with every unit pulling its share. Deadbands and a per-unit settling
+//interval keep the number of bus writes down.
+
+#ifndef BALANCE_H
+#define BALANCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "spf5000es_defs.h"
+#include "system_defs.h"
+
+#define BALANCE_DEADBAND      10   /* 0.1A. Per-unit error ignored below this. */
+#define BALANCE_SPREAD        20   /* 0.1A. Spread between units tolerated while the total is on plan. */
+#define BALANCE_MAX_STEP      2    /* A. Largest change to one unit's limit per adjustment. */
+#define BALANCE_MAX_TRIM      10   /* A. Furthest a unit's limit may be trimmed away from the plan. */
+#define BALANCE_INTERVAL_S    30   /* Minimum time between adjustments of the same unit, to let it settle. */
+
+struct ChargeBalancer
+{
+    bool bActive;
+    uint8_t cCount;                         //Number of inverters being balanced.
+    uint16_t nPlanAmps;                     //Planned per-inverter current, A.
+    uint16_t nLimits[INVERTER_COUNT];       //Utility charge current limit per inverter, A.
+    int32_t slLastAdjust[INVERTER_COUNT];
+    uint32_t lAdjustments;
+};
+
+/**
+ * Start balancing cCount inverters, all limited to nPlanAmps to begin with.
+ */
+void balance_Start(struct ChargeBalancer* pBalancer, uint8_t cCount, uint16_t nPlanAmps, int32_t slNow);
+
+/**
+ * Move to a new plan, keeping each unit's trim.
+ */
+void balance_SetPlan(struct ChargeBalancer* pBalancer, uint16_t nPlanAmps);
+
+void balance_Stop(struct ChargeBalancer* pBalancer);
+
+/**
+ * Adjust the limits from each inverter's raw BATTCHG_AMPS (0.1A).
+ * Returns a bit mask of the inverters whose limits changed and need writing.
+ */
+uint8_t balance_Update(struct ChargeBalancer* pBalancer, const uint16_t* pnMeasured, int32_t slNow);
+
+#endif
@@ -0,0 +1,94 @@
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "broadcast.h"
+
+#define BROADCAST_ALL ((1 << INVERTER_COUNT) - 1)
+
+static int64_t broadcast_NowUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+//Whether the addressed inverter has the values.
+static bool broadcast_Verify(struct Transport* pTransport, int lAddress, int lCount, const uint16_t* pValues)
+{
+    uint16_t regs[GW_HREG_COUNT];
+
+    return lCount == transport_ReadRegisters(pTransport, lAddress, lCount, regs) &&
+           0 == memcmp(regs, pValues, lCount * sizeof(uint16_t));
+}
+
+int broadcast_Write(struct Transport* pTransport, int lAddress, int lCount, const uint16_t* pValues, struct BroadcastResult* pResult)
+{
+    memset(pResult, 0x00, sizeof(struct BroadcastResult));
+
+    if(lAddress < 0 || lCount < 1 || lAddress + lCount > GW_HREG_COUNT)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int64_t llStartUs = broadcast_NowUs();
+
+    //If it couldn't even be sent, the sweep finds nobody has it and they're all written in turn.
+    if(-1 != transport_BroadcastRegisters(pTransport, lAddress, lCount, pValues))
+    {
+        usleep(BROADCAST_TURNAROUND_US);
+
+        while(BROADCAST_ALL != pResult->cAgreed && pResult->cSweeps < BROADCAST_SWEEPS)
+        {
+            if(pResult->cSweeps++)
+                usleep(BROADCAST_SWEEP_WAIT_US);
+
+            for(int i = 0; i < INVERTER_COUNT; i++)
+            {
+                if(pResult->cAgreed & (1 << i))
+                    continue;
+
+                transport_SetSlave(pTransport, INVERTER_1_ID + i);
+
+                if(broadcast_Verify(pTransport, lAddress, lCount, pValues))
+                {
+                    pResult->cAgreed |= 1 << i;
+                    pResult->lWindowUs = broadcast_NowUs() - llStartUs;
+                }
+            }
+        }
+    }
+
+    int lError = 0;
+
+    for(int i = 0; i < INVERTER_COUNT; i++)
+    {
+        if(pResult->cAgreed & (1 << i))
+            continue;
+
+        transport_SetSlave(pTransport, INVERTER_1_ID + i);
+        pResult->cReaddressed |= 1 << i;
+
+        int rc = 1 == lCount ? transport_WriteRegister(pTransport, lAddress, pValues[0]) :
+                               transport_WriteRegisters(pTransport, lAddress, lCount, pValues);
+
+        if(-1 == rc)
+            lError = errno;
+        else if(!broadcast_Verify(pTransport, lAddress, lCount, pValues))
+            lError = EIO;
+
+        pResult->lWindowUs = broadcast_NowUs() - llStartUs;
+    }
+
+    transport_SetSlave(pTransport, INVERTER_1_ID);
+
+    if(lError)
+    {
+        errno = lError;
+        return -1;
+    }
+
+    return 0;
+}
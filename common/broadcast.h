@@ -0,0 +1,36 @@
+
+//Broadcast writes.
+//Paralleled inverters told one at a time disagree about their mode or charge limit for as long as
+//it takes to get round them all, which is when they trip on bus voltage. A broadcast (slave 0) puts
+//the change on every inverter in one frame. Nothing answers a broadcast, so each inverter is then
+//read back in a quick sweep, timing how long they could have disagreed for, and any that still
+//hasn't taken it is written to in turn as before.
+
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <stdint.h>
+#include "transport.h"
+#include "spf5000es_defs.h"
+#include "system_defs.h"
+
+#define BROADCAST_TURNAROUND_US 150000   /* For the inverters to act on it before the first is asked. The bus gap everywhere else. */
+#define BROADCAST_SWEEPS        3        /* Passes over the inverters before writing to the stragglers. */
+#define BROADCAST_SWEEP_WAIT_US 20000    /* Between passes. */
+
+struct BroadcastResult
+{
+    uint32_t lWindowUs;       //From the broadcast until the last inverter read back the change.
+    uint8_t cSweeps;          //Passes made.
+    uint8_t cAgreed;          //Inverters that took the broadcast, as a mask.
+    uint8_t cReaddressed;     //Inverters that had to be written in turn, as a mask.
+};
+
+/**
+ * Broadcast holding registers, then verify every inverter has them, writing to any that doesn't.
+ * Leaves the transport addressing the master. Returns 0 once every inverter reads back the change,
+ * or -1 with errno set if one still doesn't.
+ */
+int broadcast_Write(struct Transport* pTransport, int lAddress, int lCount, const uint16_t* pValues, struct BroadcastResult* pResult);
+
+#endif
@@ -0,0 +1,275 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "capture.h"
+
+#define CAPTURE_EXCEPTION_MAX 0x0B    /* Highest exception code libmodbus gives an errno. */
+#define CAPTURE_CRC_SIZE      2       /* RTU checksum on the end of a frame off the wire. */
+
+//How each record starts in the file. The frames follow, only as long as they are.
+struct CaptureFileRecord
+{
+    int64_t llTimeUs;
+    uint32_t lDurationUs;
+    int32_t lError;
+    uint16_t nRequest;
+    uint16_t nResponse;
+};
+
+static uint16_t capture_Word(uint8_t* pFrame, uint16_t nLength, uint16_t nValue)
+{
+    pFrame[nLength++] = nValue >> 8;
+    pFrame[nLength++] = nValue & 0xFF;
+    return nLength;
+}
+
+//As many of the values as fit after nLength, each big endian.
+static uint16_t capture_Words(uint8_t* pFrame, uint16_t nLength, const uint16_t* pValues, uint16_t nCount)
+{
+    for(uint16_t i = 0; i < nCount && NULL != pValues && nLength + 2 <= CAPTURE_FRAME_MAX; i++)
+        nLength = capture_Word(pFrame, nLength, pValues[i]);
+
+    return nLength;
+}
+
+uint16_t capture_Request(const struct CaptureCall* pCall, uint8_t* pFrame)
+{
+    uint16_t nLength = 0;
+
+    pFrame[nLength++] = pCall->cSlave;
+    pFrame[nLength++] = pCall->cFunction;
+
+    switch(pCall->cFunction)
+    {
+        case CAPTURE_FC_READ_HOLDING:
+        case CAPTURE_FC_READ_INPUT:
+            nLength = capture_Word(pFrame, nLength, pCall->nReadAddress);
+            nLength = capture_Word(pFrame, nLength, pCall->nReadCount);
+            break;
+
+        case CAPTURE_FC_WRITE_SINGLE:
+            nLength = capture_Word(pFrame, nLength, pCall->nWriteAddress);
+            nLength = capture_Words(pFrame, nLength, pCall->pValues, 1);
+            break;
+
+        case CAPTURE_FC_WRITE_MULTIPLE:
+            nLength = capture_Word(pFrame, nLength, pCall->nWriteAddress);
+            nLength = capture_Word(pFrame, nLength, pCall->nWriteCount);
+            pFrame[nLength++] = (uint8_t)(pCall->nWriteCount * 2);
+            nLength = capture_Words(pFrame, nLength, pCall->pValues, pCall->nWriteCount);
+            break;
+
+        case CAPTURE_FC_WRITE_AND_READ:
+            nLength = capture_Word(pFrame, nLength, pCall->nReadAddress);
+            nLength = capture_Word(pFrame, nLength, pCall->nReadCount);
+            nLength = capture_Word(pFrame, nLength, pCall->nWriteAddress);
+            nLength = capture_Word(pFrame, nLength, pCall->nWriteCount);
+            pFrame[nLength++] = (uint8_t)(pCall->nWriteCount * 2);
+            nLength = capture_Words(pFrame, nLength, pCall->pValues, pCall->nWriteCount);
+            break;
+
+        default: {}
+    }
+
+    return nLength;
+}
+
+uint16_t capture_Response(const struct CaptureCall* pCall, int lError, uint8_t* pFrame)
+{
+    uint16_t nLength = 0;
+
+    //Nothing answers a broadcast, whatever happened.
+    if(RTU_BROADCAST == pCall->cSlave)
+        return 0;
+
+    if(0 != lError)
+    {
+        if(lError <= RTU_ERRNO_BASE || lError > RTU_ERRNO_BASE + CAPTURE_EXCEPTION_MAX)
+            return 0;
+
+        pFrame[nLength++] = pCall->cSlave;
+        pFrame[nLength++] = pCall->cFunction | CAPTURE_FC_EXCEPTION;
+        pFrame[nLength++] = (uint8_t)(lError - RTU_ERRNO_BASE);
+        return nLength;
+    }
+
+    pFrame[nLength++] = pCall->cSlave;
+    pFrame[nLength++] = pCall->cFunction;
+
+    switch(pCall->cFunction)
+    {
+        case CAPTURE_FC_READ_HOLDING:
+        case CAPTURE_FC_READ_INPUT:
+        case CAPTURE_FC_WRITE_AND_READ:
+            pFrame[nLength++] = (uint8_t)(pCall->nReadCount * 2);
+            nLength = capture_Words(pFrame, nLength, pCall->pDest, pCall->nReadCount);
+            break;
+
+        case CAPTURE_FC_WRITE_SINGLE:
+            nLength = capture_Word(pFrame, nLength, pCall->nWriteAddress);
+            nLength = capture_Words(pFrame, nLength, pCall->pValues, 1);
+            break;
+
+        case CAPTURE_FC_WRITE_MULTIPLE:
+            nLength = capture_Word(pFrame, nLength, pCall->nWriteAddress);
+            nLength = capture_Word(pFrame, nLength, pCall->nWriteCount);
+            break;
+
+        default: {}
+    }
+
+    return nLength;
+}
+
+//As much of a frame off the wire as fits, less its checksum if it's a whole frame. Returns the length kept.
+static uint16_t capture_Wire(const uint8_t* pWire, uint16_t nWire, bool bWhole, uint8_t* pFrame)
+{
+    uint16_t nLength = bWhole && nWire >= CAPTURE_CRC_SIZE ? nWire - CAPTURE_CRC_SIZE : nWire;
+
+    if(nLength > CAPTURE_FRAME_MAX)
+        nLength = CAPTURE_FRAME_MAX;
+
+    if(nLength)
+        memcpy(pFrame, pWire, nLength);
+
+    return nLength;
+}
+
+void capture_Initialise(struct Capture* pCapture)
+{
+    memset(pCapture, 0x00, sizeof(struct Capture));
+    pthread_mutex_init(&pCapture->mutex, NULL);
+}
+
+void capture_Add(struct Capture* pCapture, const struct CaptureCall* pCall, const struct CaptureFrames* pFrames,
+                 int lError, uint32_t lDurationUs)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    pthread_mutex_lock(&pCapture->mutex);
+
+    struct CaptureRecord* pRecord = &pCapture->records[pCapture->lNext];
+    pRecord->llTimeUs = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 - lDurationUs;
+    pRecord->lDurationUs = lDurationUs;
+    pRecord->lError = lError;
+    if(NULL != pFrames)
+    {
+        //A response that failed short of an exception is kept as it came, checksum or not.
+        bool bAnswered = 0 == lError || (lError > RTU_ERRNO_BASE && lError <= RTU_ERRNO_BASE + CAPTURE_EXCEPTION_MAX);
+        pRecord->nRequest = capture_Wire(pFrames->pRequest, pFrames->nRequest, true, pRecord->request);
+        pRecord->nResponse = capture_Wire(pFrames->pResponse, pFrames->nResponse, bAnswered, pRecord->response);
+    }
+    else
+    {
+        pRecord->nRequest = capture_Request(pCall, pRecord->request);
+        pRecord->nResponse = capture_Response(pCall, lError, pRecord->response);
+    }
+
+    pCapture->lNext = (pCapture->lNext + 1) % CAPTURE_MAX_RECORDS;
+    pCapture->lTotal++;
+
+    if(pCapture->lCount < CAPTURE_MAX_RECORDS)
+        pCapture->lCount++;
+
+    pthread_mutex_unlock(&pCapture->mutex);
+}
+
+uint16_t capture_ResponseRegisters(const struct CaptureRecord* pRecord, uint16_t* pDest, uint16_t nMax)
+{
+    uint16_t nCount = 0;
+
+    if(0 != pRecord->lError || pRecord->nResponse < 3)
+        return 0;
+
+    switch(pRecord->response[1])
+    {
+        case CAPTURE_FC_READ_HOLDING:
+        case CAPTURE_FC_READ_INPUT:
+        case CAPTURE_FC_WRITE_AND_READ:
+        {
+            nCount = pRecord->response[2] / 2;
+
+            if(3 + nCount * 2 > pRecord->nResponse)
+                nCount = (pRecord->nResponse - 3) / 2;
+
+            if(nCount > nMax)
+                nCount = nMax;
+
+            for(uint16_t i = 0; i < nCount; i++)
+                pDest[i] = (uint16_t)(pRecord->response[3 + i * 2] << 8 | pRecord->response[4 + i * 2]);
+        }
+        break;
+
+        default: {}
+    }
+
+    return nCount;
+}
+
+bool capture_Save(struct Capture* pCapture, const char* pcPath)
+{
+    uint32_t lVersion = CAPTURE_VERSION;
+    FILE* file = fopen(pcPath, "wb");
+
+    if(NULL == file)
+        return false;
+
+    pthread_mutex_lock(&pCapture->mutex);
+
+    bool bResult = (1 == fwrite(&lVersion, sizeof(lVersion), 1, file));
+    uint32_t lSlot = (pCapture->lNext + CAPTURE_MAX_RECORDS - pCapture->lCount) % CAPTURE_MAX_RECORDS;
+
+    for(uint32_t i = 0; i < pCapture->lCount && bResult; i++)
+    {
+        const struct CaptureRecord* pRecord = &pCapture->records[(lSlot + i) % CAPTURE_MAX_RECORDS];
+        struct CaptureFileRecord header = { pRecord->llTimeUs, pRecord->lDurationUs, pRecord->lError, pRecord->nRequest, pRecord->nResponse };
+
+        bResult = (1 == fwrite(&header, sizeof(header), 1, file)) &&
+                  (pRecord->nRequest == fwrite(pRecord->request, 1, pRecord->nRequest, file)) &&
+                  (pRecord->nResponse == fwrite(pRecord->response, 1, pRecord->nResponse, file));
+    }
+
+    pthread_mutex_unlock(&pCapture->mutex);
+    fclose(file);
+
+    return bResult;
+}
+
+bool capture_Load(struct CaptureRecord* pRecords, uint32_t lMax, uint32_t* pCount, const char* pcPath)
+{
+    uint32_t lVersion = 0;
+    struct CaptureFileRecord header;
+    FILE* file = fopen(pcPath, "rb");
+
+    *pCount = 0;
+
+    if(NULL == file)
+        return false;
+
+    bool bResult = (1 == fread(&lVersion, sizeof(lVersion), 1, file)) && CAPTURE_VERSION == lVersion;
+
+    while(bResult && *pCount < lMax && 1 == fread(&header, sizeof(header), 1, file))
+    {
+        struct CaptureRecord* pRecord = &pRecords[*pCount];
+
+        bResult = header.nRequest <= CAPTURE_FRAME_MAX && header.nResponse <= CAPTURE_FRAME_MAX &&
+                  (header.nRequest == fread(pRecord->request, 1, header.nRequest, file)) &&
+                  (header.nResponse == fread(pRecord->response, 1, header.nResponse, file));
+
+        if(bResult)
+        {
+            pRecord->llTimeUs = header.llTimeUs;
+            pRecord->lDurationUs = header.lDurationUs;
+            pRecord->lError = header.lError;
+            pRecord->nRequest = header.nRequest;
+            pRecord->nResponse = header.nResponse;
+            (*pCount)++;
+        }
+    }
+
+    fclose(file);
+
+    return bResult;
+}
@@ -0,0 +1,106 @@
+
+//Bus capture.
+//Every transaction through the transport is kept in a bounded ring as the frames that crossed the
+//bus: slave address and PDU, without the RTU checksum or TCP header, so captures look the same
+//whichever backend made them. A backend that has the bytes off the wire (the native RTU master)
+//hands them over as they were. libmodbus doesn't, so its frames are rebuilt from each call and
+//its result, which is what was sent and answered byte for byte. Failures keep their errno, and
+//MODBUS exceptions their exception response. The ring is always on, and can be dumped
+//at any time to a compact file of timestamped records that the capture transport plays back.
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "rtu.h"
+
+#define CAPTURE_MAX_RECORDS   512
+#define CAPTURE_FRAME_MAX     (RTU_PDU_MAX + 1)   /* Slave address and PDU. */
+#define CAPTURE_VERSION       1                   /* Bump if the file layout changes. */
+
+#define CAPTURE_FC_READ_HOLDING    0x03
+#define CAPTURE_FC_READ_INPUT      0x04
+#define CAPTURE_FC_WRITE_SINGLE    0x06
+#define CAPTURE_FC_WRITE_MULTIPLE  0x10
+#define CAPTURE_FC_WRITE_AND_READ  0x17
+#define CAPTURE_FC_EXCEPTION       0x80           /* Set on the function code of an exception response. */
+
+//One transaction as the transport was asked for it.
+struct CaptureCall
+{
+    uint8_t cSlave;
+    uint8_t cFunction;                //CAPTURE_FC_*.
+    uint16_t nReadAddress;
+    uint16_t nReadCount;
+    const uint16_t* pDest;            //What was read, if it didn't fail.
+    uint16_t nWriteAddress;
+    uint16_t nWriteCount;
+    const uint16_t* pValues;
+};
+
+//One transaction's frames as they crossed the wire, RTU checksum and all.
+struct CaptureFrames
+{
+    const uint8_t* pRequest;
+    uint16_t nRequest;
+    const uint8_t* pResponse;
+    uint16_t nResponse;               //Whatever came back, even if it was no use.
+};
+
+struct CaptureRecord
+{
+    int64_t llTimeUs;                 //Wall clock when the request went out.
+    uint32_t lDurationUs;
+    int32_t lError;                   //errno if it failed, zero if not.
+    uint16_t nRequest;
+    uint16_t nResponse;               //Zero for broadcasts and anything unanswered.
+    uint8_t request[CAPTURE_FRAME_MAX];
+    uint8_t response[CAPTURE_FRAME_MAX];
+};
+
+struct Capture
+{
+    pthread_mutex_t mutex;            //Dumped from other threads.
+    struct CaptureRecord records[CAPTURE_MAX_RECORDS];
+    uint32_t lNext;                   //Slot the next record goes in.
+    uint32_t lCount;                  //Records held.
+    uint32_t lTotal;                  //Ever captured.
+};
+
+void capture_Initialise(struct Capture* pCapture);
+
+/**
+ * The request frame for pCall. Returns its length.
+ */
+uint16_t capture_Request(const struct CaptureCall* pCall, uint8_t* pFrame);
+
+/**
+ * The response frame to pCall, given how it went. Returns its length, zero if nothing answered.
+ */
+uint16_t capture_Response(const struct CaptureCall* pCall, int lError, uint8_t* pFrame);
+
+/**
+ * Keep a transaction, pushing out the oldest once the ring's full. Its frames are taken from
+ * pFrames if the backend had them, and rebuilt from pCall if it's NULL.
+ */
+void capture_Add(struct Capture* pCapture, const struct CaptureCall* pCall, const struct CaptureFrames* pFrames,
+                 int lError, uint32_t lDurationUs);
+
+/**
+ * The registers in a read's response, up to nMax. Returns how many, or zero if it has none.
+ */
+uint16_t capture_ResponseRegisters(const struct CaptureRecord* pRecord, uint16_t* pDest, uint16_t nMax);
+
+/**
+ * Write the ring to pcPath, oldest first. Returns false if it couldn't be written.
+ */
+bool capture_Save(struct Capture* pCapture, const char* pcPath);
+
+/**
+ * Read up to lMax records from pcPath. Returns false if there's no usable file.
+ */
+bool capture_Load(struct CaptureRecord* pRecords, uint32_t lMax, uint32_t* pCount, const char* pcPath);
+
+#endif
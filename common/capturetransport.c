@@ -0,0 +1,243 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "capturetransport.h"
+
+//The capture's record of the same request, searching on from the last match and round once.
+static const struct CaptureRecord* capturetransport_Match(struct CaptureTransport* pPlayback, const struct CaptureCall* pCall)
+{
+    uint8_t request[CAPTURE_FRAME_MAX];
+    uint16_t nRequest = capture_Request(pCall, request);
+
+    for(uint32_t i = 0; i < pPlayback->lCount; i++)
+    {
+        uint32_t lIndex = (pPlayback->lNext + i) % pPlayback->lCount;
+        const struct CaptureRecord* pRecord = &pPlayback->records[lIndex];
+
+        if(pRecord->nRequest == nRequest && 0 == memcmp(pRecord->request, request, nRequest))
+        {
+            pPlayback->lNext = (lIndex + 1) % pPlayback->lCount;
+
+            if(0 == pPlayback->lNext)
+                pPlayback->lLaps++;
+
+            return pRecord;
+        }
+    }
+
+    return NULL;
+}
+
+//Keep what's in range of lCount registers at lAddress.
+static void capturetransport_Store(uint16_t* pRegs, int lSpace, int lAddress, int lCount, const uint16_t* pValues)
+{
+    for(int i = 0; i < lCount; i++)
+    {
+        if(lAddress + i >= 0 && lAddress + i < lSpace)
+            pRegs[lAddress + i] = pValues[i];
+    }
+}
+
+//Keep what a write wrote, on every inverter for a broadcast.
+static void capturetransport_Written(struct CaptureTransport* pPlayback, const struct CaptureCall* pCall)
+{
+    for(int i = 0; i < INVERTER_COUNT && pCall->nWriteCount > 0; i++)
+    {
+        if(RTU_BROADCAST == pCall->cSlave || INVERTER_1_ID + i == pCall->cSlave)
+            capturetransport_Store(pPlayback->holdingRegs[i], GW_HREG_COUNT, pCall->nWriteAddress, pCall->nWriteCount, pCall->pValues);
+    }
+}
+
+static uint16_t* capturetransport_Registers(struct CaptureTransport* pPlayback, const struct CaptureCall* pCall, int lUnit, int* pSpace)
+{
+    if(CAPTURE_FC_READ_INPUT == pCall->cFunction)
+    {
+        *pSpace = CAPTURETRANSPORT_INPUT_SPACE;
+        return pPlayback->inputRegs[lUnit];
+    }
+
+    *pSpace = GW_HREG_COUNT;
+    return pPlayback->holdingRegs[lUnit];
+}
+
+static int capturetransport_Transact(struct CaptureTransport* pPlayback, const struct CaptureCall* pCall, uint16_t* pDest)
+{
+    int lUnit = pCall->cSlave - INVERTER_1_ID;
+    int lSpace = 0;
+
+    if(!pPlayback->bLoaded)
+    {
+        errno = ENOTCONN;
+        return -1;
+    }
+
+    const struct CaptureRecord* pRecord = capturetransport_Match(pPlayback, pCall);
+
+    if(pPlayback->bDebug)
+    {
+        printf("Capture: function 0x%02X to slave %d, %s\n", pCall->cFunction, pCall->cSlave,
+               NULL == pRecord ? "not captured" : (0 != pRecord->lError ? "failed" : "answered"));
+    }
+
+    if(NULL != pRecord)
+    {
+        pPlayback->lMatched++;
+
+        if(0 != pRecord->lError)
+        {
+            errno = pRecord->lError;
+            return -1;
+        }
+
+        capturetransport_Written(pPlayback, pCall);
+
+        if(0 == pCall->nReadCount)
+            return pCall->nWriteCount;
+
+        if(pCall->nReadCount != capture_ResponseRegisters(pRecord, pDest, pCall->nReadCount))
+        {
+            errno = EIO;
+            return -1;
+        }
+
+        if(lUnit >= 0 && lUnit < INVERTER_COUNT)
+        {
+            uint16_t* pRegs = capturetransport_Registers(pPlayback, pCall, lUnit, &lSpace);
+            capturetransport_Store(pRegs, lSpace, pCall->nReadAddress, pCall->nReadCount, pDest);
+        }
+
+        return pCall->nReadCount;
+    }
+
+    //Not in the capture. Carry on from what it did have.
+    pPlayback->lUnmatched++;
+
+    if(RTU_BROADCAST == pCall->cSlave)
+    {
+        capturetransport_Written(pPlayback, pCall);
+        return pCall->nWriteCount;
+    }
+
+    if(lUnit < 0 || lUnit >= INVERTER_COUNT)
+    {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    uint16_t* pRegs = capturetransport_Registers(pPlayback, pCall, lUnit, &lSpace);
+
+    if((pCall->nWriteCount > 0 && pCall->nWriteAddress + pCall->nWriteCount > GW_HREG_COUNT) ||
+       (pCall->nReadCount > 0 && pCall->nReadAddress + pCall->nReadCount > lSpace))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    capturetransport_Written(pPlayback, pCall);
+
+    if(0 == pCall->nReadCount)
+        return pCall->nWriteCount;
+
+    memcpy(pDest, &pRegs[pCall->nReadAddress], pCall->nReadCount * sizeof(uint16_t));
+    return pCall->nReadCount;
+}
+
+static int capturetransport_Connect(void* pContext)
+{
+    struct CaptureTransport* pPlayback = pContext;
+
+    pPlayback->bLoaded = capture_Load(pPlayback->records, CAPTURE_MAX_RECORDS, &pPlayback->lCount, pPlayback->path) &&
+                         pPlayback->lCount > 0;
+    pPlayback->lNext = 0;
+
+    if(!pPlayback->bLoaded)
+    {
+        errno = ENODATA;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void capturetransport_Free(void* pContext)
+{
+    ((struct CaptureTransport*)pContext)->bLoaded = false;
+}
+
+static int capturetransport_SetSlave(void* pContext, int lSlave)
+{
+    ((struct CaptureTransport*)pContext)->lSlave = lSlave;
+    return 0;
+}
+
+static void capturetransport_SetDebug(void* pContext, bool bDebug)
+{
+    ((struct CaptureTransport*)pContext)->bDebug = bDebug;
+}
+
+static int capturetransport_ReadInput(void* pContext, int lAddress, int lCount, uint16_t* pDest)
+{
+    struct CaptureTransport* pPlayback = pContext;
+    struct CaptureCall call = { pPlayback->lSlave, CAPTURE_FC_READ_INPUT, lAddress, lCount, NULL, 0, 0, NULL };
+    return capturetransport_Transact(pPlayback, &call, pDest);
+}
+
+static int capturetransport_ReadHolding(void* pContext, int lAddress, int lCount, uint16_t* pDest)
+{
+    struct CaptureTransport* pPlayback = pContext;
+    struct CaptureCall call = { pPlayback->lSlave, CAPTURE_FC_READ_HOLDING, lAddress, lCount, NULL, 0, 0, NULL };
+    return capturetransport_Transact(pPlayback, &call, pDest);
+}
+
+static int capturetransport_WriteSingle(void* pContext, int lAddress, uint16_t nValue)
+{
+    struct CaptureTransport* pPlayback = pContext;
+    struct CaptureCall call = { pPlayback->lSlave, CAPTURE_FC_WRITE_SINGLE, 0, 0, NULL, lAddress, 1, &nValue };
+    return capturetransport_Transact(pPlayback, &call, NULL);
+}
+
+static int capturetransport_WriteMultiple(void* pContext, int lAddress, int lCount, const uint16_t* pValues)
+{
+    struct CaptureTransport* pPlayback = pContext;
+    struct CaptureCall call = { pPlayback->lSlave, CAPTURE_FC_WRITE_MULTIPLE, 0, 0, NULL, lAddress, lCount, pValues };
+    return capturetransport_Transact(pPlayback, &call, NULL);
+}
+
+static int capturetransport_WriteAndRead(void* pContext, int lWriteAddress, int lWriteCount, const uint16_t* pValues,
+                                         int lReadAddress, int lReadCount, uint16_t* pDest)
+{
+    struct CaptureTransport* pPlayback = pContext;
+    struct CaptureCall call = { pPlayback->lSlave, CAPTURE_FC_WRITE_AND_READ, lReadAddress, lReadCount, NULL, lWriteAddress, lWriteCount, pValues };
+    return capturetransport_Transact(pPlayback, &call, pDest);
+}
+
+static int capturetransport_Broadcast(void* pContext, int lAddress, int lCount, const uint16_t* pValues)
+{
+    struct CaptureCall call = { RTU_BROADCAST, 1 == lCount ? CAPTURE_FC_WRITE_SINGLE : CAPTURE_FC_WRITE_MULTIPLE, 0, 0, NULL, lAddress, lCount, pValues };
+    return capturetransport_Transact(pContext, &call, NULL);
+}
+
+static const struct TransportOps captureOps =
+{
+    capturetransport_Connect,
+    capturetransport_Free,
+    capturetransport_SetSlave,
+    capturetransport_SetDebug,
+    capturetransport_ReadInput,
+    capturetransport_ReadHolding,
+    capturetransport_WriteSingle,
+    capturetransport_WriteMultiple,
+    capturetransport_WriteAndRead,
+    capturetransport_Broadcast,
+    rtu_StrError,
+    NULL
+};
+
+void capturetransport_Initialise(struct Transport* pTransport, struct CaptureTransport* pPlayback, const char* pPath)
+{
+    memset(pPlayback, 0x00, sizeof(struct CaptureTransport));
+    snprintf(pPlayback->path, sizeof(pPlayback->path), "%s", pPath);
+
+    transport_Initialise(pTransport, TRANSPORT_CAPTURE, pPath, &captureOps, pPlayback);
+}
@@ -0,0 +1,44 @@
+
+//Capture replay transport.
+//Plays a bus capture back to the server: each request is answered with the response the capture
+//holds for the same request frame, searching on from the last one matched and going round again
+//at the end, so the server sees the field's values, exceptions and timeouts in the field's order.
+//Requests the capture doesn't have, because the server has gone its own way, are answered from
+//the registers seen so far, and writes always take. Nothing waits, so it goes at full speed.
+
+#ifndef CAPTURETRANSPORT_H
+#define CAPTURETRANSPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "transport.h"
+#include "capture.h"
+#include "spf5000es_defs.h"
+#include "system_defs.h"
+
+#define CAPTURETRANSPORT_PATH_MAX    256
+#define CAPTURETRANSPORT_INPUT_SPACE 720     /* Input addresses that can be read. */
+
+struct CaptureTransport
+{
+    char path[CAPTURETRANSPORT_PATH_MAX];
+    bool bLoaded;
+    int lSlave;
+    bool bDebug;
+    struct CaptureRecord records[CAPTURE_MAX_RECORDS];
+    uint32_t lCount;
+    uint32_t lNext;                           //Where the search for the next request starts.
+    uint16_t inputRegs[INVERTER_COUNT][CAPTURETRANSPORT_INPUT_SPACE];   //As last seen.
+    uint16_t holdingRegs[INVERTER_COUNT][GW_HREG_COUNT];
+    uint32_t lMatched;                        //Requests answered from the capture.
+    uint32_t lUnmatched;                      //And from the registers, as the capture didn't have them.
+    uint32_t lLaps;                           //Times round the capture.
+};
+
+/**
+ * Set up pTransport to play back the capture file at pPath, keeping its state in pPlayback.
+ * The file isn't read until it's connected.
+ */
+void capturetransport_Initialise(struct Transport* pTransport, struct CaptureTransport* pPlayback, const char* pPath);
+
+#endif
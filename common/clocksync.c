@@ -0,0 +1,100 @@
+
+#include <string.h>
+#include <time.h>
+#include "clocksync.h"
+
+void clocksync_Initialise(struct ClockSync* pSync)
+{
+    memset(pSync, 0x00, sizeof(struct ClockSync));
+}
+
+bool clocksync_Due(const struct ClockSync* pSync, int32_t slNow)
+{
+    return 0 == pSync->lChecks || slNow - pSync->slLastCheck >= CLOCKSYNC_CHECK_S;
+}
+
+int32_t clocksync_FromRegisters(const uint16_t* pRegs)
+{
+    uint16_t nYear = pRegs[GW_HREG_TIME_Y - GW_HREG_TIME_Y];
+    
+    if(nYear < 100)
+        nYear += 2000;
+        
+    struct tm timeinfo;
+    memset(&timeinfo, 0x00, sizeof(timeinfo));
+    timeinfo.tm_year = nYear - 1900;
+    timeinfo.tm_mon = pRegs[GW_HREG_TIME_MO - GW_HREG_TIME_Y] - 1;
+    timeinfo.tm_mday = pRegs[GW_HREG_TIME_D - GW_HREG_TIME_Y];
+    timeinfo.tm_hour = pRegs[GW_HREG_TIME_H - GW_HREG_TIME_Y];
+    timeinfo.tm_min = pRegs[GW_HREG_TIME_MI - GW_HREG_TIME_Y];
+    timeinfo.tm_sec = pRegs[GW_HREG_TIME_S - GW_HREG_TIME_Y];
+    timeinfo.tm_isdst = -1;
+    
+    if(nYear < 2000 || nYear > 2099 ||
+       timeinfo.tm_mon < 0 || timeinfo.tm_mon > 11 ||
+       timeinfo.tm_mday < 1 || timeinfo.tm_mday > 31 ||
+       timeinfo.tm_hour > 23 || timeinfo.tm_min > 59 || timeinfo.tm_sec > 59)
+    {
+        return -1;
+    }
+    
+    return (int32_t)mktime(&timeinfo);
+}
+
+void clocksync_ToRegisters(int32_t slTime, bool bShortYear, uint16_t* pRegs)
+{
+    time_t rawtime = slTime;
+    struct tm timeinfo;
+    localtime_r(&rawtime, &timeinfo);
+    
+    pRegs[GW_HREG_TIME_Y - GW_HREG_TIME_Y] = (uint16_t)(timeinfo.tm_year + 1900 - (bShortYear ? 2000 : 0));
+    pRegs[GW_HREG_TIME_MO - GW_HREG_TIME_Y] = (uint16_t)(timeinfo.tm_mon + 1);
+    pRegs[GW_HREG_TIME_D - GW_HREG_TIME_Y] = (uint16_t)timeinfo.tm_mday;
+    pRegs[GW_HREG_TIME_H - GW_HREG_TIME_Y] = (uint16_t)timeinfo.tm_hour;
+    pRegs[GW_HREG_TIME_MI - GW_HREG_TIME_Y] = (uint16_t)timeinfo.tm_min;
+    pRegs[GW_HREG_TIME_S - GW_HREG_TIME_Y] = (uint16_t)timeinfo.tm_sec;
+}
+
+uint8_t clocksync_Measure(struct ClockSync* pSync, const uint16_t* pRegs, int32_t slBefore, int32_t slAfter)
+{
+    int32_t slInverter = clocksync_FromRegisters(pRegs);
+    
+    pSync->slLastCheck = slAfter;
+    pSync->lChecks++;
+    
+    //Even a nonsense date says how the year's kept, for setting it right.
+    pSync->bShortYear = pRegs[0] < 100;
+    
+    if(slInverter < 0)
+        return CLOCKSYNC_INVALID;
+        
+    //Compare against the middle of the read.
+    int32_t slServer = slBefore + (slAfter - slBefore) / 2;
+    pSync->slLastDrift = slInverter - slServer;
+    
+    if(!pSync->bReference)
+    {
+        pSync->bReference = true;
+        pSync->slRefTime = slServer;
+        pSync->slRefDrift = pSync->slLastDrift;
+    }
+    else if(slServer > pSync->slRefTime)
+    {
+        pSync->fltDriftPerDay = (float)(pSync->slLastDrift - pSync->slRefDrift) * 86400.0f / (float)(slServer - pSync->slRefTime);
+    }
+    
+    if(pSync->slLastDrift > CLOCKSYNC_MAX_DRIFT_S || pSync->slLastDrift < -CLOCKSYNC_MAX_DRIFT_S)
+        return CLOCKSYNC_CORRECT;
+        
+    return CLOCKSYNC_OK;
+}
+
+void clocksync_Corrected(struct ClockSync* pSync, int32_t slNow)
+{
+    //Start measuring the rate afresh from a clock that's right.
+    pSync->lCorrections++;
+    pSync->bReference = true;
+    pSync->slRefTime = slNow;
+    pSync->slRefDrift = 0;
+    pSync->slLastDrift = 0;
+}
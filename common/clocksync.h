@@ -0,0 +1,61 @@
+
+//Inverter clock synchronisation.
+//The inverter's own utility charge hours run off its clock, so it has to agree with the server's.
+//Its clock is read as one block of six holding registers, compared with the server's local time,
+//and rewritten as one block when it has drifted too far.
+
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "spf5000es_defs.h"
+
+#define CLOCKSYNC_REG_COUNT   (GW_HREG_TIME_S - GW_HREG_TIME_Y + 1)
+#define CLOCKSYNC_CHECK_S     3600   /* How often to measure the drift. */
+#define CLOCKSYNC_MAX_DRIFT_S 30     /* Correct the inverter's clock when it's further out than this. */
+
+#define CLOCKSYNC_OK       0   /* Close enough. */
+#define CLOCKSYNC_CORRECT  1   /* Drifted too far. Rewrite the inverter's clock. */
+#define CLOCKSYNC_INVALID  2   /* The registers don't hold a sensible date. */
+
+struct ClockSync
+{
+    int32_t slLastCheck;
+    int32_t slLastDrift;          //Inverter minus server, seconds.
+    uint32_t lChecks;
+    uint32_t lCorrections;
+    bool bShortYear;              //Inverter keeps the year as two digits.
+    
+    //Drift rate since the clock was last set.
+    bool bReference;
+    int32_t slRefTime;
+    int32_t slRefDrift;
+    float fltDriftPerDay;         //Seconds gained per day.
+};
+
+void clocksync_Initialise(struct ClockSync* pSync);
+bool clocksync_Due(const struct ClockSync* pSync, int32_t slNow);
+
+/**
+ * Convert the six time registers to a time_t in local time. Returns -1 if they don't make a sensible date.
+ */
+int32_t clocksync_FromRegisters(const uint16_t* pRegs);
+
+/**
+ * Fill the six time registers with slTime in local time, with a two or four digit year.
+ */
+void clocksync_ToRegisters(int32_t slTime, bool bShortYear, uint16_t* pRegs);
+
+/**
+ * Measure the drift from registers read between server times slBefore and slAfter.
+ * Returns CLOCKSYNC_OK, CLOCKSYNC_CORRECT or CLOCKSYNC_INVALID.
+ */
+uint8_t clocksync_Measure(struct ClockSync* pSync, const uint16_t* pRegs, int32_t slBefore, int32_t slAfter);
+
+/**
+ * Call once the inverter's clock has been rewritten at slNow.
+ */
+void clocksync_Corrected(struct ClockSync* pSync, int32_t slNow);
+
+#endif
@@ -0,0 +1,76 @@
+
+#include "cmdqueue.h"
+
+void cmdqueue_Initialise(struct CommandQueue* pQueue)
+{
+    for(unsigned int i = 0; i < CMDQUEUE_SIZE; i++)
+        atomic_init(&pQueue->slots[i].lSequence, i);
+        
+    atomic_init(&pQueue->lTail, 0);
+    atomic_init(&pQueue->lDropped, 0);
+    pQueue->lHead = 0;
+}
+
+uint32_t cmdqueue_Push(struct CommandQueue* pQueue, uint16_t nCommandID, uint16_t nParam, uint16_t nOrigin, int64_t llNowUs)
+{
+    unsigned int lPos = atomic_load_explicit(&pQueue->lTail, memory_order_relaxed);
+    struct CommandSlot* pSlot;
+    
+    //Claim a position. A slot is free to push to when its sequence matches the position.
+    for(;;)
+    {
+        pSlot = &pQueue->slots[lPos & CMDQUEUE_MASK];
+        int lDiff = (int)(atomic_load_explicit(&pSlot->lSequence, memory_order_acquire) - lPos);
+        
+        if(0 == lDiff)
+        {
+            if(atomic_compare_exchange_weak_explicit(&pQueue->lTail, &lPos, lPos + 1,
+                                                     memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if(lDiff < 0)
+        {
+            //Still holding a command from a lap ago. Full.
+            atomic_fetch_add_explicit(&pQueue->lDropped, 1, memory_order_relaxed);
+            return 0;
+        }
+        else
+        {
+            //Another producer got here first.
+            lPos = atomic_load_explicit(&pQueue->lTail, memory_order_relaxed);
+        }
+    }
+    
+    //Positions are claimed in order, so they make good IDs. Skip zero when they wrap.
+    uint32_t lCommandId = (uint32_t)lPos + 1;
+    
+    if(0 == lCommandId)
+        lCommandId = 1;
+    
+    pSlot->command.lCommandId = lCommandId;
+    pSlot->command.nCommandID = nCommandID;
+    pSlot->command.nParam = nParam;
+    pSlot->command.nOrigin = nOrigin;
+    pSlot->command.llEnqueuedUs = llNowUs;
+    
+    //Hand it over to the consumer.
+    atomic_store_explicit(&pSlot->lSequence, lPos + 1, memory_order_release);
+    
+    return lCommandId;
+}
+
+bool cmdqueue_Pop(struct CommandQueue* pQueue, struct QueuedCommand* pCommand)
+{
+    struct CommandSlot* pSlot = &pQueue->slots[pQueue->lHead & CMDQUEUE_MASK];
+    
+    if(atomic_load_explicit(&pSlot->lSequence, memory_order_acquire) != pQueue->lHead + 1)
+        return false;
+        
+    *pCommand = pSlot->command;
+    
+    //Free the slot for the push one lap ahead.
+    atomic_store_explicit(&pSlot->lSequence, pQueue->lHead + CMDQUEUE_SIZE, memory_order_release);
+    pQueue->lHead++;
+    
+    return true;
+}
@@ -0,0 +1,55 @@
+
+//Bounded lock-free command queue.
+//Any number of threads (TCP clients, the console) push commands, and the MODBUS thread alone pops
+//them, in the order they were pushed. Each command gets an ID so it can be followed to completion.
+
+#ifndef CMDQUEUE_H
+#define CMDQUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define CMDQUEUE_SIZE 16              /* Must be a power of two. */
+#define CMDQUEUE_MASK (CMDQUEUE_SIZE - 1)
+
+#define CMDQUEUE_ORIGIN_CONSOLE  0xFFFF /* Pushed from the console rather than a TCP client. */
+#define CMDQUEUE_ORIGIN_SCHEDULE 0xFFFE /* Pushed by the scheduler. */
+#define CMDQUEUE_ORIGIN_GATEWAY  0xFFFD /* Pushed by a MODBUS TCP write through the gateway. */
+
+struct QueuedCommand
+{
+    uint32_t lCommandId;              //Unique, increasing in queue order. Never zero.
+    uint16_t nCommandID;              //What to do. COMMAND_* for requests from clients.
+    uint16_t nParam;
+    uint16_t nOrigin;                 //Client slot that asked, or CMDQUEUE_ORIGIN_*.
+    int64_t llEnqueuedUs;             //Monotonic time it was pushed.
+};
+
+struct CommandSlot
+{
+    atomic_uint lSequence;            //Tells producers and the consumer whose turn the slot is.
+    struct QueuedCommand command;
+};
+
+struct CommandQueue
+{
+    struct CommandSlot slots[CMDQUEUE_SIZE];
+    atomic_uint lTail;                //Next position to push. Shared by producers.
+    unsigned int lHead;               //Next position to pop. Consumer only.
+    atomic_uint lDropped;             //Pushes refused because the queue was full.
+};
+
+void cmdqueue_Initialise(struct CommandQueue* pQueue);
+
+/**
+ * Push a command from any thread. Returns its command ID, or zero if the queue is full.
+ */
+uint32_t cmdqueue_Push(struct CommandQueue* pQueue, uint16_t nCommandID, uint16_t nParam, uint16_t nOrigin, int64_t llNowUs);
+
+/**
+ * Pop the oldest command. Only ever call from the one consumer thread. Returns false when empty.
+ */
+bool cmdqueue_Pop(struct CommandQueue* pQueue, struct QueuedCommand* pCommand);
+
+#endif
@@ -9,9 +9,28 @@
 #define COMMAND_REQUEST_GRID    0x0002
 #define COMMAND_REQUEST_BATTS   0x0003
 #define COMMAND_REQUEST_BOOST   0x0004
+#define COMMAND_SUBSCRIBE_EVENTS 0x0005
+#define COMMAND_REQUEST_SCHEDULE 0x0006
+#define COMMAND_CHARGE_AMPS     0x0007 /* Scheduled/console only, as it needs amps. Zero amps goes back to the plan. */
+#define COMMAND_SUBSCRIBE_STATUS 0x0008 /* OBJECT_STATUS now, then pushed whenever it changes. */
+#define COMMAND_HEARTBEAT       0x0009 /* Sent to a client that's gone quiet, which answers with the same. */
+
+/* Connection upkeep */
+#define COMMS_HEARTBEAT_INTERVAL 10 /* Seconds a client can be quiet before the server checks it's there. */
+#define COMMS_TIMEOUT            30 /* Seconds without hearing anything before either end gives up on the other. */
 
 /* Objects */
 #define OBJECT_STATUS           0x0001
+#define OBJECT_EVENT            0x0002
+#define OBJECT_COMMAND_RESULT   0x0003
+#define OBJECT_SCHEDULE         0x0004 /* ScheduleList. */
+#define OBJECT_SCHEDULE_ADD     0x0005 /* ScheduledCommand. */
+#define OBJECT_SCHEDULE_CANCEL  0x0006 /* uint32_t schedule ID. */
+#define OBJECT_FAULT_QUERY      0x0007 /* FaultQuery. Answered with OBJECT_FAULT_LIST. */
+#define OBJECT_FAULT_LIST       0x0008 /* FaultList. */
+#define OBJECT_FAULT_CAPTURE_QUERY 0x0009 /* uint32_t fault ID. Answered with OBJECT_FAULT_CAPTURE. */
+#define OBJECT_FAULT_CAPTURE    0x000A /* FaultCapture. */
+#define OBJECT_INTEREST         0x000B /* uint32_t of STATUS_FIELD_BIT()s shown. Clients that never send one get everything. */
 
 extern void GetStatus(uint8_t** ppStatus, uint32_t* pLength);
 extern void ReceiveStatus(uint8_t* pStatus, uint32_t lLength);
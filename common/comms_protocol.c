@@ -106,15 +106,17 @@ void Comms_Receive(struct sdfComms* psdcComms, uint8_t* pcData, uint16_t nLength
             
             case COMMS_STATE_PAYLOAD:
             {
-                uint8_t cBytesLeft = nLength - i;
+                uint16_t nBytesLeft = nLength - i;
                 
-                if(cBytesLeft > psdcComms->nReceivingLength)
-                    cBytesLeft = psdcComms->nReceivingLength;
+                if(nBytesLeft > psdcComms->nReceivingLength)
+                    nBytesLeft = psdcComms->nReceivingLength;
                     
-                memcpy(&psdcComms->pcPayload[psdcComms->nPayloadWrite], &pcData[i], cBytesLeft);
-                psdcComms->nPayloadWrite += cBytesLeft;
-                psdcComms->nReceivingLength -= cBytesLeft;
-                i += cBytesLeft;
+                memcpy(&psdcComms->pcPayload[psdcComms->nPayloadWrite], &pcData[i], nBytesLeft);
+                psdcComms->nPayloadWrite += nBytesLeft;
+                psdcComms->nReceivingLength -= nBytesLeft;
+                
+                //The loop steps past the last of them.
+                i += nBytesLeft - 1;
                 
                 if(0 == psdcComms->nReceivingLength)
                 {
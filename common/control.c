@@ -0,0 +1,305 @@
+
+#include <string.h>
+#include <time.h>
+#include "control.h"
+#include "comms_defs.h"
+#include "gridquality.h"
+#include "utils.h"
+
+void control_Initialise(struct Controller* pController, const struct OverloadConfig* pOverloadConfig)
+{
+    memset(pController, 0x00, sizeof(struct Controller));
+    overload_Initialise(&pController->overload, pOverloadConfig);
+}
+
+void control_Clock(struct ControlTime* pTime, int32_t slNow, int64_t llNowMs)
+{
+    time_t rawtime = slNow;
+    struct tm timeinfo;
+    localtime_r(&rawtime, &timeinfo);
+
+    pTime->slNow = slNow;
+    pTime->llNowMs = llNowMs;
+    pTime->lHour = timeinfo.tm_hour;
+    pTime->lMin = timeinfo.tm_min;
+}
+
+bool control_IsPeak(int lHour, int lMin)
+{
+    return (lHour > SYSTEM_END_OFF_PEAK_H ||
+            (lHour == SYSTEM_END_OFF_PEAK_H && lMin >= SYSTEM_END_OFF_PEAK_M)) &&
+           (lHour < SYSTEM_START_OFF_PEAK_H ||
+            (lHour == SYSTEM_START_OFF_PEAK_H && lMin <= SYSTEM_START_OFF_PEAK_M));
+}
+
+static void control_Add(struct ControlActions* pActions, uint8_t cAction, uint8_t cReason, uint16_t nState, uint16_t nChargeCurrent)
+{
+    if(pActions->cCount < CONTROL_MAX_ACTIONS)
+    {
+        struct ControlAction* pAction = &pActions->actions[pActions->cCount++];
+        pAction->cAction = cAction;
+        pAction->cReason = cReason;
+        pAction->nState = nState;
+        pAction->nChargeCurrent = nChargeCurrent;
+        pAction->cInverters = 0xFF;
+    }
+}
+
+//Switch state, starting or stopping anything that goes with it.
+static void control_Switch(struct Controller* pController, struct ControlActions* pActions, uint8_t cReason,
+                           uint16_t nState, uint16_t nChargeCurrent, int32_t slNow)
+{
+    pController->slModeWriteTime = slNow;
+    pController->bManualAmps = false;
+
+    if(SYSTEM_STATE_OFF_PEAK == nState)
+        balance_Start(&pController->balancer, INVERTER_COUNT, nChargeCurrent, slNow);
+    else
+        balance_Stop(&pController->balancer);
+
+    control_Add(pActions, CONTROL_SWITCH, cReason, nState, nChargeCurrent);
+}
+
+//Would be on batteries with the overload engine tripped. Not while riding out an outage on them, as
+//there's no grid to go to.
+static bool control_Overloaded(const struct Controller* pController, uint16_t nState)
+{
+    return SYSTEM_STATE_PEAK == nState && pController->overload.bTripped && !pController->bOutageBatts;
+}
+
+static uint16_t control_PlanOffPeak(struct Controller* pController, struct SystemStatus* pStatus, const struct ControlTime* pTime)
+{
+    return planner_Start(&pController->planner, pStatus, pTime->slNow, utils_MinutesUntilOffPeakEnd(pTime->lHour, pTime->lMin));
+}
+
+void control_Step(struct Controller* pController,
+                  struct SystemStatus* pStatus,
+                  const struct ControlSample* pSample,
+                  struct ControlActions* pActions)
+{
+    const struct ControlTime* pTime = &pSample->time;
+    uint16_t nState = pStatus->nSystemState;
+    bool bSwitched = false;
+
+    pActions->cCount = 0;
+
+    //Overload protection, judged on every inverter's load first.
+    if(OVERLOAD_RELEASE == overload_Evaluate(&pController->overload, pSample->inverters, INVERTER_COUNT, pTime->llNowMs))
+    {
+        if(pController->bOverloadBypass && SYSTEM_STATE_BYPASS == nState)
+        {
+            nState = SYSTEM_STATE_PEAK;
+            bSwitched = true;
+            control_Switch(pController, pActions, CONTROL_REASON_OVERLOAD_CLEARED, nState, 0, pTime->slNow);
+        }
+
+        pController->bOverloadBypass = false;
+    }
+
+    //For as long as it's tripped, not only on the sample that tripped it. Only batteries are at risk.
+    if(control_Overloaded(pController, nState))
+    {
+        nState = SYSTEM_STATE_BYPASS;
+        bSwitched = true;
+        pController->bOverloadBypass = true;
+        overload_SwitchIssued(&pController->overload, pTime->llNowMs);
+        control_Switch(pController, pActions, CONTROL_REASON_OVERLOAD, nState, 0, pTime->slNow);
+    }
+
+    //Back to the grid once it's stayed up after an outage.
+    if(pController->bRestorePending && pTime->slNow - pController->slRestoredTime >= CONTROL_RESTORE_HOLD_S)
+    {
+        if(pController->bOutageBatts && SYSTEM_STATE_PEAK == nState)
+        {
+            nState = SYSTEM_STATE_BYPASS;
+            bSwitched = true;
+            control_Switch(pController, pActions, CONTROL_REASON_RESTORED, nState, 0, pTime->slNow);
+        }
+
+        pController->bRestorePending = false;
+        pController->bOutageBatts = false;
+    }
+
+    //Incremental re-planning of the off-peak charge current as the SoC comes up.
+    if(SYSTEM_STATE_OFF_PEAK == nState && !pController->bManualAmps)
+    {
+        if(planner_Update(&pController->planner, pStatus, pSample->nChargeAmps,
+                          pTime->slNow, utils_MinutesUntilOffPeakEnd(pTime->lHour, pTime->lMin)))
+        {
+            balance_SetPlan(&pController->balancer, pController->planner.nAmps);
+            control_Add(pActions, CONTROL_CHARGE, CONTROL_REASON_REPLAN, nState, pController->planner.nAmps);
+        }
+    }
+
+    //Peak/off-peak switching.
+    if(control_IsPeak(pTime->lHour, pTime->lMin))
+    {
+        if(SYSTEM_STATE_OFF_PEAK == nState)
+        {
+            //Straight to the grid if the load's already too much for the batteries.
+            bool bOverloaded = control_Overloaded(pController, SYSTEM_STATE_PEAK);
+
+            nState = bOverloaded ? SYSTEM_STATE_BYPASS : SYSTEM_STATE_PEAK;
+            bSwitched = true;
+            pController->bOverloadBypass = bOverloaded;
+
+            if(bOverloaded)
+                overload_SwitchIssued(&pController->overload, pTime->llNowMs);
+
+            control_Switch(pController, pActions, bOverloaded ? CONTROL_REASON_OVERLOAD : CONTROL_REASON_PEAK, nState, 0, pTime->slNow);
+        }
+    }
+    else if(SYSTEM_STATE_OFF_PEAK != nState)
+    {
+        nState = SYSTEM_STATE_OFF_PEAK;
+        bSwitched = true;
+        control_Switch(pController, pActions, CONTROL_REASON_OFF_PEAK, nState,
+                       control_PlanOffPeak(pController, pStatus, pTime), pTime->slNow);
+    }
+
+    //Trim each inverter's limit so they share the planned current.
+    if(pController->balancer.bActive)
+    {
+        uint8_t cBalanced = balance_Update(&pController->balancer, pSample->nChargeAmps, pTime->slNow);
+
+        if(cBalanced)
+        {
+            control_Add(pActions, CONTROL_BALANCE, CONTROL_REASON_TRIM, nState, pController->balancer.nPlanAmps);
+            pActions->actions[pActions->cCount - 1].cInverters = cBalanced;
+        }
+    }
+
+    //Final state check. (Note: inverter mode is read back from inverter on next pass).
+    if(!bSwitched && pTime->slNow > pController->slModeWriteTime + CHECK_MODE_TIMEOUT)
+    {
+        control_Add(pActions, CONTROL_RECONCILE, CONTROL_REASON_CHECK, nState, 0);
+    }
+}
+
+void control_Grid(struct Controller* pController,
+                  struct SystemStatus* pStatus,
+                  uint8_t cGridResult,
+                  int32_t slNow,
+                  struct ControlActions* pActions)
+{
+    pActions->cCount = 0;
+
+    if(GRIDQUALITY_OUTAGE == cGridResult)
+    {
+        pController->bRestorePending = false;
+
+        //Bypassed to a grid that's gone. Run on batteries rather than waiting to see what the grid does next.
+        if(SYSTEM_STATE_BYPASS == pStatus->nSystemState)
+        {
+            pController->bOutageBatts = true;
+            control_Switch(pController, pActions, CONTROL_REASON_OUTAGE, SYSTEM_STATE_PEAK, 0, slNow);
+        }
+    }
+    else if(GRIDQUALITY_RESTORED == cGridResult && pController->bOutageBatts)
+    {
+        pController->bRestorePending = true;
+        pController->slRestoredTime = slNow;
+    }
+}
+
+uint16_t control_Command(struct Controller* pController,
+                         struct SystemStatus* pStatus,
+                         uint16_t nCommandID,
+                         uint16_t nParam,
+                         const struct ControlTime* pTime,
+                         struct ControlActions* pActions)
+{
+    uint16_t nState = pStatus->nSystemState;
+
+    pActions->cCount = 0;
+
+    if(COMMAND_CHARGE_AMPS == nCommandID)
+    {
+        if(0 == nParam)
+        {
+            //Back to the planner if it's running, or to whatever the state had before.
+            if(SYSTEM_STATE_OFF_PEAK == nState)
+                control_Switch(pController, pActions, CONTROL_REASON_COMMAND, nState, control_PlanOffPeak(pController, pStatus, pTime), pTime->slNow);
+            else if(pController->bManualAmps)
+                control_Add(pActions, CONTROL_CHARGE, CONTROL_REASON_COMMAND, nState, pController->nStateAmps);
+
+            pController->bManualAmps = false;
+        }
+        else if(nParam < CHARGE_MIN_AMPS || nParam > GW_CFG_UTIL_AMPS_MAX)
+        {
+            return COMMAND_RESULT_REFUSED;
+        }
+        else
+        {
+            //Held until the next switch, or until asked to go back to the plan.
+            if(!pController->bManualAmps)
+                pController->nStateAmps = pStatus->nChargeCurrent;
+
+            balance_Stop(&pController->balancer);
+            pController->bManualAmps = true;
+            control_Add(pActions, CONTROL_CHARGE, CONTROL_REASON_COMMAND, nState, nParam);
+        }
+
+        return COMMAND_RESULT_DONE;
+    }
+
+    //Manual switching isn't allowed during off-peak.
+    if(SYSTEM_STATE_OFF_PEAK == nState)
+        return COMMAND_RESULT_REFUSED;
+
+    switch(nCommandID)
+    {
+        case COMMAND_REQUEST_GRID: nState = SYSTEM_STATE_BYPASS; break;
+        case COMMAND_REQUEST_BATTS: nState = SYSTEM_STATE_PEAK; break;
+        case COMMAND_REQUEST_BOOST: nState = SYSTEM_STATE_BOOST; break;
+        default: return COMMAND_RESULT_REFUSED;
+    }
+
+    //The user knows best. Stop any overload hold or outage from overriding them.
+    overload_Reset(&pController->overload);
+    pController->bOverloadBypass = false;
+    pController->bOutageBatts = false;
+    pController->bRestorePending = false;
+
+    //Free sessions etc. Smash those amps in!
+    control_Switch(pController, pActions, CONTROL_REASON_COMMAND, nState,
+                   SYSTEM_STATE_BOOST == nState ? GW_CFG_UTIL_AMPS_MAX : 0, pTime->slNow);
+
+    return COMMAND_RESULT_DONE;
+}
+
+void control_Apply(struct SystemStatus* pStatus, const struct ControlAction* pAction)
+{
+    switch(pAction->cAction)
+    {
+        case CONTROL_SWITCH:
+        {
+            //Store the morning's AC charge energy so any boost charging can be accounted for later,
+            //however off-peak ended.
+            //TO DO: Stop guessing and read the other inverters!
+            if(SYSTEM_STATE_OFF_PEAK == pStatus->nSystemState && SYSTEM_STATE_OFF_PEAK != pAction->nState)
+                pStatus->nOffPeakChargeKwh = pStatus->nAcchgegyToday * INVERTER_COUNT;
+
+            pStatus->nSystemState = pAction->nState;
+
+            if(SYSTEM_STATE_OFF_PEAK == pAction->nState || SYSTEM_STATE_BOOST == pAction->nState)
+                pStatus->nChargeCurrent = pAction->nChargeCurrent;
+        }
+        break;
+
+        case CONTROL_CHARGE:
+        {
+            pStatus->nChargeCurrent = pAction->nChargeCurrent;
+        }
+        break;
+    }
+}
+
+uint16_t control_ChargeLimit(const struct Controller* pController, const struct SystemStatus* pStatus, uint8_t cInverter)
+{
+    //While balancing, each inverter's limit carries its own trim.
+    if(pController->balancer.bActive && cInverter < pController->balancer.cCount)
+        return pController->balancer.nLimits[cInverter];
+
+    return pStatus->nChargeCurrent;
+}
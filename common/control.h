@@ -0,0 +1,134 @@
+
+//Switching and charging policy.
+//Every decision about what the system should do is made here, from the readings, commands, grid
+//events and the time, and listed as actions for the caller to carry out. Nothing here reads a clock
+//or does any I/O: the time comes in with each call, so the server, the replay tool and the tests
+//all run exactly the same decisions on whatever clock suits them.
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "system_defs.h"
+#include "planner.h"
+#include "overload.h"
+#include "balance.h"
+
+#define CONTROL_MAX_ACTIONS     6
+#define CONTROL_RESTORE_HOLD_S  120   /* Stay on batteries this long after the grid comes back from an outage, in case it goes again. */
+
+//Actions.
+#define CONTROL_SWITCH     0   /* Switch to nState. nChargeCurrent applies when it charges. */
+#define CONTROL_CHARGE     1   /* Charge at nChargeCurrent from now on. */
+#define CONTROL_RECONCILE  2   /* Check the inverter's holding registers are still as they should be. */
+#define CONTROL_BALANCE    3   /* Write the balancer's limits to the inverters in cInverters. */
+
+//Reasons.
+#define CONTROL_REASON_OVERLOAD          0
+#define CONTROL_REASON_OVERLOAD_CLEARED  1
+#define CONTROL_REASON_PEAK              2
+#define CONTROL_REASON_OFF_PEAK          3
+#define CONTROL_REASON_REPLAN            4
+#define CONTROL_REASON_CHECK             5
+#define CONTROL_REASON_COMMAND           6
+#define CONTROL_REASON_OUTAGE            7
+#define CONTROL_REASON_RESTORED          8
+#define CONTROL_REASON_TRIM              9
+
+struct ControlAction
+{
+    uint8_t cAction;
+    uint8_t cReason;
+    uint16_t nState;
+    uint16_t nChargeCurrent;
+    uint8_t cInverters;                             //Bit per inverter, for CONTROL_BALANCE.
+};
+
+struct ControlActions
+{
+    uint8_t cCount;
+    struct ControlAction actions[CONTROL_MAX_ACTIONS];
+};
+
+struct ControlTime
+{
+    int32_t slNow;                                  //Wall clock.
+    int64_t llNowMs;                                //Monotonic.
+    int lHour;                                      //Local time.
+    int lMin;
+};
+
+struct ControlSample
+{
+    struct ControlTime time;                        //When the inverters were sampled.
+    struct OverloadSample inverters[INVERTER_COUNT];
+    uint16_t nChargeAmps[INVERTER_COUNT];           //Raw BATTCHG_AMPS (0.1A).
+};
+
+struct Controller
+{
+    struct ChargePlanner planner;
+    struct OverloadEngine overload;
+    struct ChargeBalancer balancer;
+    bool bOverloadBypass;                           //Bypassed because of overload, not by request.
+    bool bOutageBatts;                              //On batteries because of a grid outage, not by request.
+    bool bRestorePending;                           //The grid came back. Waiting to be sure before going back to it.
+    bool bManualAmps;                               //Charge current set by hand. Don't re-plan over it.
+    uint16_t nStateAmps;                            //What the state had before the charge current was set by hand.
+    int32_t slRestoredTime;
+    int32_t slModeWriteTime;                        //When the state was last switched.
+};
+
+void control_Initialise(struct Controller* pController, const struct OverloadConfig* pOverloadConfig);
+
+/**
+ * Fill in the local time from the wall clock.
+ */
+void control_Clock(struct ControlTime* pTime, int32_t slNow, int64_t llNowMs);
+
+/**
+ * Decide what to do about one sample. pStatus is only read, and must reflect every action
+ * carried out so far. Switches within the step are taken into account by the later decisions.
+ */
+void control_Step(struct Controller* pController,
+                  struct SystemStatus* pStatus,
+                  const struct ControlSample* pSample,
+                  struct ControlActions* pActions);
+
+/**
+ * React to a GRIDQUALITY_* result, as soon as it's known.
+ */
+void control_Grid(struct Controller* pController,
+                  struct SystemStatus* pStatus,
+                  uint8_t cGridResult,
+                  int32_t slNow,
+                  struct ControlActions* pActions);
+
+/**
+ * Decide what to do about a COMMAND_REQUEST_* or COMMAND_CHARGE_AMPS command.
+ * Returns COMMAND_RESULT_DONE, or COMMAND_RESULT_REFUSED with no actions.
+ */
+uint16_t control_Command(struct Controller* pController,
+                         struct SystemStatus* pStatus,
+                         uint16_t nCommandID,
+                         uint16_t nParam,
+                         const struct ControlTime* pTime,
+                         struct ControlActions* pActions);
+
+/**
+ * Update the status to reflect an action once it's been carried out.
+ */
+void control_Apply(struct SystemStatus* pStatus, const struct ControlAction* pAction);
+
+/**
+ * The charge current limit to write to inverter cInverter (0 is the master).
+ */
+uint16_t control_ChargeLimit(const struct Controller* pController, const struct SystemStatus* pStatus, uint8_t cInverter);
+
+/**
+ * Whether the time falls in the peak period.
+ */
+bool control_IsPeak(int lHour, int lMin);
+
+#endif
@@ -0,0 +1,139 @@
+
+#include <string.h>
+#include "events.h"
+
+void events_Initialise(struct EventEngine* pEngine, EventRaised eventRaised)
+{
+    memset(pEngine, 0x00, sizeof(struct EventEngine));
+    pEngine->eventRaised = eventRaised;
+}
+
+bool events_Add(struct EventEngine* pEngine,
+                uint16_t nEventID,
+                uint8_t cType,
+                uint16_t nField,
+                uint16_t nThreshold,
+                uint16_t nParam)
+{
+    if(pEngine->cCount >= EVENTS_MAX_DETECTORS || nField + sizeof(uint16_t) > sizeof(struct SystemStatus))
+        return false;
+        
+    struct EventDetector* pDetector = &pEngine->detectors[pEngine->cCount++];
+    memset(pDetector, 0x00, sizeof(struct EventDetector));
+    pDetector->nEventID = nEventID;
+    pDetector->cType = cType;
+    pDetector->nField = nField;
+    pDetector->nThreshold = nThreshold;
+    pDetector->nParam = nParam;
+    
+    return true;
+}
+
+static void events_Raise(struct EventEngine* pEngine, struct EventDetector* pDetector, uint16_t nValue, int32_t slNow)
+{
+    struct SystemEvent event;
+    event.slTime = slNow;
+    event.nEventID = pDetector->nEventID;
+    event.nValue = nValue;
+    event.nPrevious = pDetector->nLast;
+    event.nReserved = 0;
+    
+    pEngine->lEvents++;
+    pEngine->eventRaised(pEngine, &event);
+}
+
+//Debounced level crossing. Raises when the level flips to bRaiseWhenAbove.
+static bool events_Level(struct EventDetector* pDetector, uint16_t nValue, bool bRaiseWhenAbove)
+{
+    bool bAbove = nValue > pDetector->nThreshold;
+    
+    if(bAbove == pDetector->bAbove)
+    {
+        pDetector->nCount = 0;
+        return false;
+    }
+    
+    if(++pDetector->nCount < pDetector->nParam)
+        return false;
+        
+    pDetector->bAbove = bAbove;
+    pDetector->nCount = 0;
+    
+    return bAbove == bRaiseWhenAbove;
+}
+
+void events_Process(struct EventEngine* pEngine, const struct SystemStatus* pStatus, int32_t slNow)
+{
+    const uint8_t* pcStatus = (const uint8_t*)pStatus;
+    
+    for(uint8_t i = 0; i < pEngine->cCount; i++)
+    {
+        struct EventDetector* pDetector = &pEngine->detectors[i];
+        uint16_t nValue;
+        memcpy(&nValue, &pcStatus[pDetector->nField], sizeof(uint16_t));
+        
+        //First sample only sets the baseline.
+        if(!pDetector->bPrimed)
+        {
+            pDetector->bPrimed = true;
+            pDetector->bAbove = nValue > pDetector->nThreshold;
+            pDetector->nLast = nValue;
+            pDetector->slLastTime = slNow;
+            pDetector->slSince = slNow;
+            continue;
+        }
+        
+        bool bRaise = false;
+        
+        switch(pDetector->cType)
+        {
+            case DETECT_CHANGE:
+            {
+                bRaise = (nValue != pDetector->nLast);
+            }
+            break;
+            
+            case DETECT_RISE:
+            {
+                bRaise = events_Level(pDetector, nValue, true);
+            }
+            break;
+            
+            case DETECT_FALL:
+            {
+                bRaise = events_Level(pDetector, nValue, false);
+            }
+            break;
+            
+            case DETECT_RATE:
+            {
+                int32_t slElapsed = slNow - pDetector->slLastTime;
+                
+                if(slElapsed > 0 && nValue > pDetector->nLast)
+                    bRaise = ((uint32_t)(nValue - pDetector->nLast) / (uint32_t)slElapsed) > pDetector->nThreshold;
+            }
+            break;
+            
+            case DETECT_STUCK:
+            {
+                if(nValue != pDetector->nLast)
+                {
+                    pDetector->slSince = slNow;
+                    pDetector->bFired = false;
+                }
+                else if(!pDetector->bFired && slNow - pDetector->slSince >= pDetector->nParam)
+                {
+                    pDetector->bFired = true;
+                    bRaise = true;
+                }
+            }
+            break;
+        }
+        
+        if(bRaise)
+            events_Raise(pEngine, pDetector, nValue, slNow);
+            
+        pDetector->nLast = nValue;
+        pDetector->slLastTime = slNow;
+    }
+}
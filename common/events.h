@@ -0,0 +1,71 @@
+
+//Streaming event detectors over the SystemStatus sample stream.
+//Detectors are declared per uint16_t field of SystemStatus and all evaluated in one pass per sample,
+//using state preallocated in the engine. Events are timestamped and handed to a callback.
+
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "system_defs.h"
+
+#define EVENTS_MAX_DETECTORS 16
+
+#define DETECT_CHANGE   0   /* Any change in value. */
+#define DETECT_RISE     1   /* Rose above nThreshold, staying there for nParam samples (0 or 1 for a plain edge). */
+#define DETECT_FALL     2   /* Fell to nThreshold or below, staying there for nParam samples. */
+#define DETECT_RATE     3   /* Rose by more than nThreshold per second. */
+#define DETECT_STUCK    4   /* Hasn't changed for nParam seconds. */
+
+#define EVENT_FIELD(field) ((uint16_t)offsetof(struct SystemStatus, field))
+
+struct EventDetector
+{
+    uint16_t nEventID;
+    uint8_t cType;
+    uint16_t nField;          //Byte offset of a uint16_t field in SystemStatus. Use EVENT_FIELD().
+    uint16_t nThreshold;
+    uint16_t nParam;
+    
+    //Running state.
+    bool bPrimed;             //Has seen at least one sample.
+    bool bAbove;              //Debounced level, for rise/fall.
+    bool bFired;              //Stuck already reported.
+    uint16_t nLast;           //Value on the last sample.
+    uint16_t nCount;          //Consecutive samples on the other side of the threshold.
+    int32_t slLastTime;       //Time of the last sample.
+    int32_t slSince;          //Time the value last changed.
+};
+
+struct EventEngine;
+
+typedef void (*EventRaised)(struct EventEngine* pEngine, const struct SystemEvent* pEvent);
+
+struct EventEngine
+{
+    uint8_t cCount;
+    struct EventDetector detectors[EVENTS_MAX_DETECTORS];
+    EventRaised eventRaised;
+    uint32_t lEvents;         //Total events raised.
+};
+
+void events_Initialise(struct EventEngine* pEngine, EventRaised eventRaised);
+
+/**
+ * Declare a detector. Returns false if the engine is full.
+ */
+bool events_Add(struct EventEngine* pEngine,
+                uint16_t nEventID,
+                uint8_t cType,
+                uint16_t nField,
+                uint16_t nThreshold,
+                uint16_t nParam);
+
+/**
+ * Evaluate every detector against one sample, raising events through the callback.
+ */
+void events_Process(struct EventEngine* pEngine, const struct SystemStatus* pStatus, int32_t slNow);
+
+#endif
@@ -0,0 +1,334 @@
+
+#include <stdio.h>
+#include <string.h>
+#include "faults.h"
+
+//From the manual's fault and warning reference codes.
+static const char* const faultNames[FAULTS_CODES] =
+{
+    [1]  = "Fan locked while inverter off",
+    [2]  = "Over temperature",
+    [3]  = "Battery voltage too high",
+    [4]  = "Battery voltage too low",
+    [5]  = "Output short circuit or converter over temperature",
+    [6]  = "Output voltage too high",
+    [7]  = "Overload time out",
+    [8]  = "Bus voltage too high",
+    [9]  = "Bus soft start failed",
+    [51] = "Over current or surge",
+    [52] = "Bus voltage too low",
+    [53] = "Inverter soft start failed",
+    [55] = "Over DC voltage in AC output",
+    [56] = "Battery connection open",
+    [57] = "Current sensor failed",
+    [58] = "Output voltage too low"
+};
+
+static const char* const warningNames[FAULTS_CODES] =
+{
+    [1]  = "Fan locked while inverter on",
+    [2]  = "Over temperature",
+    [3]  = "Battery over-charged",
+    [4]  = "Low battery",
+    [7]  = "Overload",
+    [10] = "Output power derating",
+    [15] = "PV energy low",
+    [16] = "High AC input during bus soft start"
+};
+
+void faults_Initialise(struct Faults* pFaults, FaultRecorded recorded)
+{
+    memset(pFaults, 0x00, sizeof(struct Faults));
+    pFaults->lNextId = 1;
+    pFaults->recorded = recorded;
+}
+
+const char* faults_Describe(uint8_t cKind, uint16_t nCode)
+{
+    const char* pName = NULL;
+
+    if(nCode < FAULTS_CODES)
+        pName = FAULT_KIND_FAULT == cKind ? faultNames[nCode] : warningNames[nCode];
+
+    return pName ? pName : "Unknown";
+}
+
+static struct FaultRecord* faults_Slot(struct Faults* pFaults, uint32_t lFaultId)
+{
+    return &pFaults->records[(lFaultId - 1) % FAULTS_MAX_RECORDS];
+}
+
+static const struct FaultRecord* faults_Held(const struct Faults* pFaults, uint32_t lFaultId)
+{
+    if(0 == lFaultId || lFaultId >= pFaults->lNextId)
+        return NULL;
+
+    const struct FaultRecord* pRecord = &pFaults->records[(lFaultId - 1) % FAULTS_MAX_RECORDS];
+    return pRecord->lFaultId == lFaultId ? pRecord : NULL;
+}
+
+//File a record under its ID, linking it to the last with the same code.
+static void faults_Index(struct Faults* pFaults, const struct FaultRecord* pRecord)
+{
+    uint32_t* pLast = &pFaults->lLastByCode[pRecord->cKind][pRecord->cCode];
+
+    *faults_Slot(pFaults, pRecord->lFaultId) = *pRecord;
+    pFaults->lPrevSameCode[(pRecord->lFaultId - 1) % FAULTS_MAX_RECORDS] = *pLast;
+    *pLast = pRecord->lFaultId;
+    pFaults->lNextId = pRecord->lFaultId + 1;
+}
+
+static uint32_t faults_Add(struct Faults* pFaults, uint8_t cInverter, uint8_t cKind, uint16_t nCode,
+                           bool bCleared, uint16_t nBits, uint16_t nDtc, int32_t slNow)
+{
+    struct FaultRecord record;
+    const struct FaultRecord* pLast = faults_Held(pFaults, pFaults->lNextId - 1);
+
+    record.lFaultId = pFaults->lNextId;
+    record.slTime = (pLast && pLast->slTime > slNow) ? pLast->slTime : slNow;    //Never backwards, so time stays searchable.
+    record.cInverter = cInverter;
+    record.cKind = cKind;
+    record.cCode = nCode < FAULTS_CODES ? (uint8_t)nCode : FAULTS_CODES - 1;
+    record.bCleared = bCleared;
+    record.nBits = nBits;
+    record.nDtc = nDtc;
+
+    faults_Index(pFaults, &record);
+
+    if(pFaults->recorded)
+        pFaults->recorded(pFaults, &record);
+
+    return record.lFaultId;
+}
+
+static void faults_StartCapture(struct Faults* pFaults, uint32_t lFaultId, uint8_t cInverter, int64_t llNowMs)
+{
+    struct FaultsInverter* pInverter = &pFaults->inverters[cInverter];
+    struct FaultCapture* pCapture = &pFaults->captures[pFaults->cNextCapture];
+
+    pFaults->llCaptureMs[pFaults->cNextCapture] = llNowMs;
+    pFaults->cNextCapture = (pFaults->cNextCapture + 1) % FAULTS_MAX_CAPTURES;
+
+    memset(pCapture, 0x00, sizeof(struct FaultCapture));
+    pCapture->lFaultId = lFaultId;
+    pCapture->cInverter = cInverter;
+
+    //Oldest first, ending with the sample the fault was seen on.
+    for(uint8_t i = 0; i < pInverter->cRecentCount; i++)
+    {
+        uint8_t cSlot = (pInverter->cRecent + FAULT_PRE_SAMPLES - pInverter->cRecentCount + i) % FAULT_PRE_SAMPLES;
+        pCapture->samples[i] = pInverter->recent[cSlot];
+        pCapture->samples[i].slOffsetMs = (int32_t)(pInverter->llRecentMs[cSlot] - llNowMs);
+    }
+
+    pCapture->cPre = pInverter->cRecentCount;
+}
+
+void faults_Sample(struct Faults* pFaults, uint8_t cInverter, const uint16_t* pInputRegs, int32_t slNow, int64_t llNowMs)
+{
+    if(cInverter >= INVERTER_COUNT)
+        return;
+
+    struct FaultsInverter* pInverter = &pFaults->inverters[cInverter];
+    struct FaultSample sample;
+
+    sample.slOffsetMs = 0;
+    sample.nOutputWatts = pInputRegs[OUTPUT_WATTS_L];
+    sample.nLoadPercent = pInputRegs[LOAD_PERCENT];
+    sample.nBusVolts = pInputRegs[BUS_VOLTS];
+    sample.nBatteryVolts = pInputRegs[BATTERY_VOLTS];
+    sample.nGridVolts = pInputRegs[GRID_VOLTS];
+    sample.nBattchgAmps = pInputRegs[BATTCHG_AMPS];
+
+    //What happened next, for faults still short of their samples.
+    for(int i = 0; i < FAULTS_MAX_CAPTURES; i++)
+    {
+        struct FaultCapture* pCapture = &pFaults->captures[i];
+
+        if(pCapture->lFaultId && pCapture->cInverter == cInverter && pCapture->cPost < FAULT_POST_SAMPLES)
+        {
+            struct FaultSample* pSample = &pCapture->samples[pCapture->cPre + pCapture->cPost++];
+            *pSample = sample;
+            pSample->slOffsetMs = (int32_t)(llNowMs - pFaults->llCaptureMs[i]);
+        }
+    }
+
+    //And what led up to any fault to come.
+    pInverter->recent[pInverter->cRecent] = sample;
+    pInverter->llRecentMs[pInverter->cRecent] = llNowMs;
+    pInverter->cRecent = (pInverter->cRecent + 1) % FAULT_PRE_SAMPLES;
+
+    if(pInverter->cRecentCount < FAULT_PRE_SAMPLES)
+        pInverter->cRecentCount++;
+
+    static const uint8_t cValueRegs[FAULTS_KINDS] = { FAULTVALUE, WARNVALUE };
+    static const uint8_t cBitRegs[FAULTS_KINDS] = { FAULTBIT, WARNBIT };
+
+    for(uint8_t cKind = 0; cKind < FAULTS_KINDS; cKind++)
+    {
+        uint16_t nValue = pInputRegs[cValueRegs[cKind]];
+        uint16_t nBits = pInputRegs[cBitRegs[cKind]];
+        bool bActive = nValue || nBits;
+
+        //Anything already showing when first seen counts as raised then.
+        if(pInverter->bPrimed ? (nValue != pInverter->nValue[cKind] || nBits != pInverter->nBits[cKind]) : bActive)
+        {
+            uint32_t lFaultId = faults_Add(pFaults, cInverter, cKind, bActive ? nValue : pInverter->nValue[cKind],
+                                           !bActive, nBits, pInputRegs[DTC], slNow);
+
+            if(FAULT_KIND_FAULT == cKind && bActive)
+                faults_StartCapture(pFaults, lFaultId, cInverter, llNowMs);
+        }
+
+        pInverter->nValue[cKind] = nValue;
+        pInverter->nBits[cKind] = nBits;
+    }
+
+    pInverter->bPrimed = true;
+}
+
+static bool faults_Matches(const struct FaultRecord* pRecord, const struct FaultQuery* pQuery)
+{
+    return (FAULT_ANY_KIND == pQuery->cKind || pRecord->cKind == pQuery->cKind) &&
+           (FAULT_ANY_CODE == pQuery->nCode || pRecord->cCode == pQuery->nCode);
+}
+
+static void faults_List(struct FaultList* pList, const struct FaultRecord* pRecord)
+{
+    if(pList->nCount < FAULT_LIST_MAX)
+        pList->records[pList->nCount++] = *pRecord;
+
+    pList->nMatches++;
+}
+
+void faults_Query(const struct Faults* pFaults, const struct FaultQuery* pQuery, struct FaultList* pList)
+{
+    memset(pList, 0x00, sizeof(struct FaultList));
+
+    if(pFaults->lNextId <= 1)
+        return;
+
+    //Newest record no later than slTo. IDs are in time order, so it's a binary search over what's held.
+    uint32_t lLow = pFaults->lNextId > FAULTS_MAX_RECORDS ? pFaults->lNextId - FAULTS_MAX_RECORDS : 1;
+    uint32_t lHigh = pFaults->lNextId - 1;
+    uint32_t lNewest = 0;
+
+    while(lLow <= lHigh)
+    {
+        uint32_t lMid = lLow + (lHigh - lLow) / 2;
+        const struct FaultRecord* pRecord = faults_Held(pFaults, lMid);
+
+        if(pRecord && pRecord->slTime <= pQuery->slTo)
+        {
+            lNewest = lMid;
+            lLow = lMid + 1;
+        }
+        else
+        {
+            lHigh = lMid - 1;
+        }
+    }
+
+    if(FAULT_ANY_CODE == pQuery->nCode || pQuery->nCode >= FAULTS_CODES)
+    {
+        //No code to go on. Everything back to slFrom.
+        for(uint32_t lId = lNewest; lId; lId--)
+        {
+            const struct FaultRecord* pRecord = faults_Held(pFaults, lId);
+
+            if(NULL == pRecord || pRecord->slTime < pQuery->slFrom)
+                break;
+
+            if(faults_Matches(pRecord, pQuery))
+                faults_List(pList, pRecord);
+        }
+
+        return;
+    }
+
+    //Down each kind's chain for the code, newest first across both.
+    uint32_t lCursor[FAULTS_KINDS];
+
+    for(uint8_t cKind = 0; cKind < FAULTS_KINDS; cKind++)
+    {
+        lCursor[cKind] = (FAULT_ANY_KIND == pQuery->cKind || cKind == pQuery->cKind) ? pFaults->lLastByCode[cKind][pQuery->nCode] : 0;
+
+        while(lCursor[cKind] > lNewest)
+            lCursor[cKind] = pFaults->lPrevSameCode[(lCursor[cKind] - 1) % FAULTS_MAX_RECORDS];
+    }
+
+    for(;;)
+    {
+        uint8_t cKind = lCursor[FAULT_KIND_FAULT] > lCursor[FAULT_KIND_WARNING] ? FAULT_KIND_FAULT : FAULT_KIND_WARNING;
+        const struct FaultRecord* pRecord = faults_Held(pFaults, lCursor[cKind]);
+
+        if(NULL == pRecord || pRecord->slTime < pQuery->slFrom)
+            break;
+
+        faults_List(pList, pRecord);
+        lCursor[cKind] = pFaults->lPrevSameCode[(lCursor[cKind] - 1) % FAULTS_MAX_RECORDS];
+    }
+}
+
+bool faults_Capture(const struct Faults* pFaults, uint32_t lFaultId, struct FaultCapture* pCapture)
+{
+    for(int i = 0; i < FAULTS_MAX_CAPTURES; i++)
+    {
+        if(lFaultId && pFaults->captures[i].lFaultId == lFaultId)
+        {
+            *pCapture = pFaults->captures[i];
+            return true;
+        }
+    }
+
+    memset(pCapture, 0x00, sizeof(struct FaultCapture));
+    return false;
+}
+
+bool faults_Append(const struct FaultRecord* pRecord, const char* pcPath)
+{
+    uint32_t lVersion = FAULTS_VERSION;
+    FILE* file = fopen(pcPath, "ab");
+
+    if(NULL == file)
+        return false;
+
+    //A new file starts with its version.
+    bool bResult = (0 != ftell(file) || 1 == fwrite(&lVersion, sizeof(lVersion), 1, file)) &&
+                   (1 == fwrite(pRecord, sizeof(struct FaultRecord), 1, file));
+    fclose(file);
+
+    return bResult;
+}
+
+bool faults_Load(struct Faults* pFaults, const char* pcPath)
+{
+    uint32_t lVersion = 0;
+    FILE* file = fopen(pcPath, "rb");
+
+    if(NULL == file)
+        return false;
+
+    if(1 != fread(&lVersion, sizeof(lVersion), 1, file) || FAULTS_VERSION != lVersion)
+    {
+        fclose(file);
+        return false;
+    }
+
+    //Only the newest are held.
+    fseek(file, 0, SEEK_END);
+    long lRecords = (ftell(file) - (long)sizeof(lVersion)) / (long)sizeof(struct FaultRecord);
+    long lSkip = lRecords > FAULTS_MAX_RECORDS ? lRecords - FAULTS_MAX_RECORDS : 0;
+    fseek(file, (long)sizeof(lVersion) + lSkip * (long)sizeof(struct FaultRecord), SEEK_SET);
+
+    struct FaultRecord record;
+
+    while(1 == fread(&record, sizeof(record), 1, file))
+    {
+        if(record.lFaultId >= pFaults->lNextId && record.cKind < FAULTS_KINDS)
+            faults_Index(pFaults, &record);
+    }
+
+    fclose(file);
+    return true;
+}
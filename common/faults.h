@@ -0,0 +1,88 @@
+
+//Inverter fault and warning history.
+//Every inverter's FAULTVALUE, WARNVALUE, FAULTBIT, WARNBIT and DTC are compared with the last pass,
+//and any change becomes a compact record, named through the manual's code tables. Records are held
+//in a ring in the order seen, so time range queries are a binary search, and each links back to
+//the last with the same code, so code queries only visit matching records. Every fault also
+//captures the samples leading up to and following it, to help diagnose inrush trips.
+
+#ifndef FAULTS_H
+#define FAULTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "spf5000es_defs.h"
+#include "system_defs.h"
+
+#define FAULTS_MAX_RECORDS   256      /* Records held in memory. Older ones only survive in the file. */
+#define FAULTS_MAX_CAPTURES  8        /* Most recent faults with their samples kept. */
+#define FAULTS_CODES         256
+#define FAULTS_KINDS         2
+#define FAULTS_VERSION       1        /* Bump if the persisted layout changes. */
+
+//Fault codes named in the manual. 08 and 52 are the usual ones after a motor's inrush.
+#define FAULTS_CODE_BUS_HIGH 8
+#define FAULTS_CODE_BUS_LOW  52
+
+struct FaultsInverter
+{
+    bool bPrimed;
+    uint16_t nValue[FAULTS_KINDS];            //FAULTVALUE and WARNVALUE on the last pass.
+    uint16_t nBits[FAULTS_KINDS];             //FAULTBIT and WARNBIT.
+    struct FaultSample recent[FAULT_PRE_SAMPLES];
+    int64_t llRecentMs[FAULT_PRE_SAMPLES];    //Monotonic time of each.
+    uint8_t cRecent;                          //Next slot in recent.
+    uint8_t cRecentCount;
+};
+
+struct Faults;
+
+typedef void (*FaultRecorded)(struct Faults* pFaults, const struct FaultRecord* pRecord);
+
+struct Faults
+{
+    struct FaultRecord records[FAULTS_MAX_RECORDS];
+    uint32_t lPrevSameCode[FAULTS_MAX_RECORDS];           //ID of the previous record with the same kind and code, or zero.
+    uint32_t lLastByCode[FAULTS_KINDS][FAULTS_CODES];      //ID of the latest record for each kind and code, or zero.
+    uint32_t lNextId;
+    struct FaultsInverter inverters[INVERTER_COUNT];
+    struct FaultCapture captures[FAULTS_MAX_CAPTURES];
+    int64_t llCaptureMs[FAULTS_MAX_CAPTURES];             //Monotonic time of each capture's fault.
+    uint8_t cNextCapture;
+    FaultRecorded recorded;
+};
+
+void faults_Initialise(struct Faults* pFaults, FaultRecorded recorded);
+
+/**
+ * Compare one inverter's input registers with the last pass, recording and calling back for any
+ * change of fault or warning, and feeding the samples around any recent faults.
+ */
+void faults_Sample(struct Faults* pFaults, uint8_t cInverter, const uint16_t* pInputRegs, int32_t slNow, int64_t llNowMs);
+
+/**
+ * Fill pList with the newest records matching pQuery.
+ */
+void faults_Query(const struct Faults* pFaults, const struct FaultQuery* pQuery, struct FaultList* pList);
+
+/**
+ * The samples around fault lFaultId. Returns false, with lFaultId zero, if they're no longer held.
+ */
+bool faults_Capture(const struct Faults* pFaults, uint32_t lFaultId, struct FaultCapture* pCapture);
+
+/**
+ * The manual's description of a fault or warning code.
+ */
+const char* faults_Describe(uint8_t cKind, uint16_t nCode);
+
+/**
+ * Append a record to the binary history file.
+ */
+bool faults_Append(const struct FaultRecord* pRecord, const char* pcPath);
+
+/**
+ * Re-index the newest records from the binary history file. Returns false if there's no usable file.
+ */
+bool faults_Load(struct Faults* pFaults, const char* pcPath);
+
+#endif
@@ -0,0 +1,123 @@
+
+#include <stdio.h>
+#include <string.h>
+#include "forecast.h"
+
+void forecast_Initialise(struct LoadForecast* pForecast)
+{
+    memset(pForecast, 0x00, sizeof(struct LoadForecast));
+    pForecast->lVersion = FORECAST_VERSION;
+    pForecast->slSlot = -1;
+}
+
+int forecast_SlotOf(int lWday, int lHour, int lMin)
+{
+    return (lWday * 48) + (lHour * 2) + (lMin / 30);
+}
+
+static void forecast_CompleteSlot(struct LoadForecast* pForecast)
+{
+    int32_t slSlot = pForecast->slSlot;
+    
+    //Don't learn from slots that were barely sampled (e.g. restarted near the end).
+    if(pForecast->slSlotCovered < FORECAST_SLOT_S / 2)
+        return;
+        
+    //Scale up to a whole slot if part of it was missed.
+    float fltWh = pForecast->fltSlotWh * (float)FORECAST_SLOT_S / (float)pForecast->slSlotCovered;
+    
+    if(pForecast->cSeen[slSlot])
+    {
+        float fltOld = pForecast->fltProfileWh[slSlot];
+        pForecast->fltProfileWh[slSlot] = (FORECAST_ALPHA * fltWh) + ((1.0f - FORECAST_ALPHA) * fltOld);
+        pForecast->fltSeenWh += pForecast->fltProfileWh[slSlot] - fltOld;
+    }
+    else
+    {
+        pForecast->cSeen[slSlot] = 1;
+        pForecast->nSeen++;
+        pForecast->fltProfileWh[slSlot] = fltWh;
+        pForecast->fltSeenWh += fltWh;
+    }
+}
+
+bool forecast_Sample(struct LoadForecast* pForecast, int32_t slNow, int lSlot, float fltWatts)
+{
+    bool bCompleted = false;
+    
+    if(lSlot < 0 || lSlot >= FORECAST_SLOTS)
+        return false;
+        
+    int32_t slElapsed = slNow - pForecast->slLastSample;
+    pForecast->slLastSample = slNow;
+    
+    if(lSlot != pForecast->slSlot)
+    {
+        if(pForecast->slSlot >= 0)
+        {
+            forecast_CompleteSlot(pForecast);
+            bCompleted = true;
+        }
+        
+        pForecast->slSlot = lSlot;
+        pForecast->fltSlotWh = 0.0f;
+        pForecast->slSlotCovered = 0;
+    }
+    
+    if(slElapsed > 0 && slElapsed <= FORECAST_MAX_SAMPLE_S)
+    {
+        pForecast->fltSlotWh += fltWatts * (float)slElapsed / 3600.0f;
+        pForecast->slSlotCovered += slElapsed;
+    }
+    
+    return bCompleted;
+}
+
+float forecast_Next24hKwh(struct LoadForecast* pForecast, int lSlot)
+{
+    float fltWh = 0.0f;
+    float fltUnseenWh = pForecast->nSeen > 0 ? pForecast->fltSeenWh / (float)pForecast->nSeen : 0.0f;
+    
+    for(int i = 0; i < 48; i++)
+    {
+        int lIndex = (lSlot + i) % FORECAST_SLOTS;
+        fltWh += pForecast->cSeen[lIndex] ? pForecast->fltProfileWh[lIndex] : fltUnseenWh;
+    }
+    
+    return fltWh / 1000.0f;
+}
+
+bool forecast_Save(struct LoadForecast* pForecast, const char* pcPath)
+{
+    FILE* file = fopen(pcPath, "wb");
+    
+    if(NULL == file)
+        return false;
+        
+    bool bResult = (1 == fwrite(pForecast, sizeof(struct LoadForecast), 1, file));
+    fclose(file);
+    
+    return bResult;
+}
+
+bool forecast_Load(struct LoadForecast* pForecast, const char* pcPath)
+{
+    struct LoadForecast loaded;
+    FILE* file = fopen(pcPath, "rb");
+    
+    if(NULL == file)
+        return false;
+        
+    bool bResult = (1 == fread(&loaded, sizeof(struct LoadForecast), 1, file));
+    fclose(file);
+    
+    if(!bResult || FORECAST_VERSION != loaded.lVersion)
+        return false;
+        
+    //Carry on from the profile, but start accumulating afresh.
+    memcpy(pForecast, &loaded, sizeof(struct LoadForecast));
+    pForecast->slSlot = -1;
+    pForecast->slLastSample = 0;
+    
+    return true;
+}
@@ -0,0 +1,52 @@
+
+//Incremental household load forecaster.
+//Keeps an exponentially smoothed energy profile for every half hour of the week,
+//updated in O(1) per sample, and small enough to persist to disk whenever a slot completes.
+
+#ifndef FORECAST_H
+#define FORECAST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FORECAST_SLOTS          (7 * 48)  /* Half hours in a week. */
+#define FORECAST_SLOT_S         1800      /* Seconds in a slot. */
+#define FORECAST_ALPHA          0.2f      /* Weight of the newest week in each slot's profile. */
+#define FORECAST_MAX_SAMPLE_S   60        /* Longest gap between samples that will be integrated. */
+#define FORECAST_VERSION        1         /* Bump if the persisted layout changes. */
+
+struct LoadForecast
+{
+    uint32_t lVersion;
+    int32_t slSlot;                          //Slot currently being accumulated, or -1.
+    int32_t slLastSample;                    //Time of the last sample.
+    int32_t slSlotCovered;                   //Seconds of the current slot that have been sampled.
+    float fltSlotWh;                         //Energy used so far in the current slot.
+    float fltSeenWh;                         //Sum of the profiles of all seen slots, for filling unseen ones.
+    uint16_t nSeen;                          //Number of slots seen at least once.
+    uint8_t cSeen[FORECAST_SLOTS];           //Whether each slot has been seen.
+    float fltProfileWh[FORECAST_SLOTS];      //Smoothed energy use for each slot.
+};
+
+void forecast_Initialise(struct LoadForecast* pForecast);
+
+/**
+ * Slot index for a local time. lWday is 0-6 from Sunday, as in struct tm.
+ */
+int forecast_SlotOf(int lWday, int lHour, int lMin);
+
+/**
+ * Integrate a load sample. Returns true when a slot was completed and folded into the profile,
+ * which is a good time to persist.
+ */
+bool forecast_Sample(struct LoadForecast* pForecast, int32_t slNow, int lSlot, float fltWatts);
+
+/**
+ * Forecast energy use (kWh) over the next 24 hours, starting with lSlot.
+ */
+float forecast_Next24hKwh(struct LoadForecast* pForecast, int lSlot);
+
+bool forecast_Save(struct LoadForecast* pForecast, const char* pcPath);
+bool forecast_Load(struct LoadForecast* pForecast, const char* pcPath);
+
+#endif
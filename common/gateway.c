@@ -0,0 +1,390 @@
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "gateway.h"
+#include "comms_defs.h"
+
+static int64_t gateway_NowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//Wait on the gateway's condition until llDeadlineMs. Returns false on timing out.
+static bool gateway_Wait(struct Gateway* pGateway, int64_t llDeadlineMs)
+{
+    struct timespec ts;
+    ts.tv_sec = llDeadlineMs / 1000;
+    ts.tv_nsec = (llDeadlineMs % 1000) * 1000000;
+
+    return ETIMEDOUT != pthread_cond_timedwait(&pGateway->cond, &pGateway->mutex, &ts);
+}
+
+void gateway_Initialise(struct Gateway* pGateway, int32_t lMaxAgeMs, struct CommandQueue* pCommands, void (*pWake)())
+{
+    pthread_condattr_t attr;
+
+    memset(pGateway, 0x00, sizeof(struct Gateway));
+    pGateway->lMaxAgeMs = lMaxAgeMs;
+    pGateway->pCommands = pCommands;
+    pGateway->pWake = pWake;
+
+    pthread_mutex_init(&pGateway->mutex, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&pGateway->cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void gateway_Store(struct Gateway* pGateway, uint8_t cUnit, bool bHolding, uint16_t nAddress, uint16_t nCount,
+                          const uint16_t* pValues, int64_t llNowMs)
+{
+    struct GatewayUnit* pUnit = &pGateway->units[cUnit];
+    uint16_t nSpace = bHolding ? GW_HREG_COUNT : GATEWAY_INPUT_SPACE;
+
+    if(cUnit >= INVERTER_COUNT || nAddress >= nSpace)
+        return;
+
+    if(nAddress + nCount > nSpace)
+        nCount = nSpace - nAddress;
+
+    memcpy(bHolding ? &pUnit->holdingRegs[nAddress] : &pUnit->inputRegs[nAddress], pValues, nCount * sizeof(uint16_t));
+
+    for(uint16_t i = 0; i < nCount; i++)
+    {
+        if(bHolding)
+            pUnit->llHoldingMs[nAddress + i] = llNowMs;
+        else
+            pUnit->llInputMs[nAddress + i] = llNowMs;
+    }
+}
+
+void gateway_Update(struct Gateway* pGateway, uint8_t cUnit, bool bHolding, uint16_t nAddress, uint16_t nCount,
+                    const uint16_t* pValues, int64_t llNowMs)
+{
+    pthread_mutex_lock(&pGateway->mutex);
+    gateway_Store(pGateway, cUnit, bHolding, nAddress, nCount, pValues, llNowMs);
+    pthread_mutex_unlock(&pGateway->mutex);
+}
+
+static bool gateway_Fresh(const struct Gateway* pGateway, uint8_t cUnit, bool bHolding, uint16_t nAddress, uint16_t nCount, int64_t llNowMs)
+{
+    const int64_t* pStamps = bHolding ? pGateway->units[cUnit].llHoldingMs : pGateway->units[cUnit].llInputMs;
+
+    for(uint16_t i = nAddress; i < nAddress + nCount; i++)
+    {
+        if(0 == pStamps[i] || llNowMs - pStamps[i] > pGateway->lMaxAgeMs)
+            return false;
+    }
+
+    return true;
+}
+
+//Queue a fetch covering the range, widening one already queued for the inverter if the
+//result still fits in one read. Returns the ID of the fetch to wait on, or zero if there's no room.
+static uint32_t gateway_Queue(struct Gateway* pGateway, uint8_t cUnit, bool bHolding, uint16_t nAddress, uint16_t nCount)
+{
+    uint16_t nEnd = nAddress + nCount;
+
+    for(uint8_t i = 0; i < pGateway->cFetches; i++)
+    {
+        struct GatewayFetch* pFetch = &pGateway->fetches[i];
+        uint16_t nFetchEnd = pFetch->nAddress + pFetch->nCount;
+
+        if(pFetch->cUnit != cUnit || pFetch->bHolding != bHolding)
+            continue;
+
+        //Already on its way.
+        if(pFetch->nAddress <= nAddress && nFetchEnd >= nEnd)
+        {
+            pGateway->lCoalesced++;
+            return pFetch->lId;
+        }
+
+        uint16_t nStart = pFetch->nAddress < nAddress ? pFetch->nAddress : nAddress;
+        uint16_t nWidened = nFetchEnd > nEnd ? nFetchEnd : nEnd;
+
+        if(!pFetch->bTaken && nWidened - nStart <= GATEWAY_MAX_READ)
+        {
+            pFetch->nAddress = nStart;
+            pFetch->nCount = nWidened - nStart;
+            pGateway->lCoalesced++;
+            return pFetch->lId;
+        }
+    }
+
+    if(pGateway->cFetches >= GATEWAY_MAX_FETCHES)
+        return 0;
+
+    struct GatewayFetch* pFetch = &pGateway->fetches[pGateway->cFetches++];
+    pFetch->lId = ++pGateway->lLastFetchId;
+    pFetch->cUnit = cUnit;
+    pFetch->bHolding = bHolding;
+    pFetch->nAddress = nAddress;
+    pFetch->nCount = nCount;
+    pFetch->bTaken = false;
+
+    return pFetch->lId;
+}
+
+static uint16_t gateway_Read(struct Gateway* pGateway, uint8_t cUnit, bool bHolding, uint16_t nAddress, uint16_t nCount,
+                             uint8_t* pResponse, uint8_t* pcException)
+{
+    uint16_t nSpace = bHolding ? GW_HREG_COUNT : GATEWAY_INPUT_SPACE;
+    int64_t llNowMs = gateway_NowMs();
+
+    if(nCount < 1 || nCount > GATEWAY_MAX_READ || nAddress + nCount > nSpace)
+    {
+        *pcException = GATEWAY_EX_ILLEGAL_ADDRESS;
+        return 0;
+    }
+
+    if(gateway_Fresh(pGateway, cUnit, bHolding, nAddress, nCount, llNowMs))
+    {
+        pGateway->lHits++;
+    }
+    else
+    {
+        pGateway->lMisses++;
+
+        uint32_t lId = gateway_Queue(pGateway, cUnit, bHolding, nAddress, nCount);
+
+        if(0 == lId)
+        {
+            *pcException = GATEWAY_EX_DEVICE_BUSY;
+            return 0;
+        }
+
+        if(pGateway->pWake)
+            pGateway->pWake();
+
+        int64_t llDeadlineMs = llNowMs + GATEWAY_TIMEOUT_MS;
+
+        while(!gateway_Fresh(pGateway, cUnit, bHolding, nAddress, nCount, llNowMs))
+        {
+            if(pGateway->lDoneFetchId >= lId || !gateway_Wait(pGateway, llDeadlineMs))
+            {
+                pGateway->lFailed++;
+                *pcException = GATEWAY_EX_TARGET_FAILED;
+                return 0;
+            }
+        }
+    }
+
+    const uint16_t* pRegs = bHolding ? pGateway->units[cUnit].holdingRegs : pGateway->units[cUnit].inputRegs;
+    pResponse[1] = (uint8_t)(nCount * 2);
+
+    for(uint16_t i = 0; i < nCount; i++)
+    {
+        pResponse[2 + i * 2] = (uint8_t)(pRegs[nAddress + i] >> 8);
+        pResponse[3 + i * 2] = (uint8_t)pRegs[nAddress + i];
+    }
+
+    return 2 + nCount * 2;
+}
+
+//A write is a request of the control layer, which decides what the inverters actually get.
+//Only the system-wide settings can be asked for, and only of the master. Returns an exception, or zero.
+static uint8_t gateway_Write(struct Gateway* pGateway, uint8_t cUnit, uint16_t nAddress, uint16_t nValue)
+{
+    uint16_t nCommandID;
+
+    if(NULL == pGateway->pCommands)
+        return GATEWAY_EX_ILLEGAL_FUNCTION;
+
+    if(0 != cUnit)
+        return GATEWAY_EX_ILLEGAL_ADDRESS;
+
+    switch(nAddress)
+    {
+        case GW_HREG_CFG_MODE:
+        {
+            if(GW_CFG_MODE_GRID == nValue)
+                nCommandID = COMMAND_REQUEST_GRID;
+            else if(GW_CFG_MODE_BATTS == nValue)
+                nCommandID = COMMAND_REQUEST_BATTS;
+            else
+                return GATEWAY_EX_ILLEGAL_VALUE;
+
+            nValue = 0;
+        }
+        break;
+
+        case GW_HREG_MAX_UTIL_AMPS:
+        {
+            //Zero goes back to the plan.
+            if(nValue > GW_CFG_UTIL_AMPS_MAX)
+                return GATEWAY_EX_ILLEGAL_VALUE;
+
+            nCommandID = COMMAND_CHARGE_AMPS;
+        }
+        break;
+
+        default: return GATEWAY_EX_ILLEGAL_ADDRESS;
+    }
+
+    int64_t llNowMs = gateway_NowMs();
+    uint32_t lCommandId = cmdqueue_Push(pGateway->pCommands, nCommandID, nValue, CMDQUEUE_ORIGIN_GATEWAY, llNowMs * 1000);
+
+    if(0 == lCommandId)
+        return GATEWAY_EX_DEVICE_BUSY;
+
+    pGateway->lWrites++;
+
+    if(pGateway->pWake)
+        pGateway->pWake();
+
+    struct GatewayResult* pResult = &pGateway->results[lCommandId % GATEWAY_RESULTS];
+
+    while(pResult->lCommandId != lCommandId)
+    {
+        if(!gateway_Wait(pGateway, llNowMs + GATEWAY_TIMEOUT_MS))
+        {
+            pGateway->lFailed++;
+            return GATEWAY_EX_TARGET_FAILED;
+        }
+    }
+
+    return COMMAND_RESULT_DONE == pResult->nResult ? 0 : GATEWAY_EX_DEVICE_FAILURE;
+}
+
+uint16_t gateway_Request(struct Gateway* pGateway, uint8_t cUnitId, const uint8_t* pRequest, uint16_t nLength, uint8_t* pResponse)
+{
+    uint8_t cFunction = nLength > 0 ? pRequest[0] : 0;
+    uint8_t cException = 0;
+    uint16_t nResponse = 0;
+    int lUnit = (0 == cUnitId || GATEWAY_UNIT_SELF == cUnitId) ? 0 : cUnitId - INVERTER_1_ID;
+
+    #define WORD(offset) ((uint16_t)((pRequest[offset] << 8) | pRequest[(offset) + 1]))
+
+    pResponse[0] = cFunction;
+
+    pthread_mutex_lock(&pGateway->mutex);
+    pGateway->lRequests++;
+
+    if(lUnit < 0 || lUnit >= INVERTER_COUNT)
+    {
+        cException = GATEWAY_EX_TARGET_FAILED;
+    }
+    else
+    {
+        switch(cFunction)
+        {
+            case GATEWAY_FC_READ_HOLDING:
+            case GATEWAY_FC_READ_INPUT:
+            {
+                if(nLength != 5)
+                    cException = GATEWAY_EX_ILLEGAL_VALUE;
+                else
+                    nResponse = gateway_Read(pGateway, lUnit, GATEWAY_FC_READ_HOLDING == cFunction, WORD(1), WORD(3), pResponse, &cException);
+            }
+            break;
+
+            case GATEWAY_FC_WRITE_SINGLE:
+            {
+                if(nLength != 5)
+                    cException = GATEWAY_EX_ILLEGAL_VALUE;
+                else if(0 == (cException = gateway_Write(pGateway, lUnit, WORD(1), WORD(3))))
+                {
+                    //Echoes the request.
+                    memcpy(pResponse, pRequest, 5);
+                    nResponse = 5;
+                }
+            }
+            break;
+
+            case GATEWAY_FC_WRITE_MULTIPLE:
+            {
+                //One register at a time, as each is a command of its own.
+                if(nLength < 6 || pRequest[5] != WORD(3) * 2 || nLength != 6 + pRequest[5])
+                    cException = GATEWAY_EX_ILLEGAL_VALUE;
+                else if(1 != WORD(3))
+                    cException = GATEWAY_EX_ILLEGAL_ADDRESS;
+                else if(0 == (cException = gateway_Write(pGateway, lUnit, WORD(1), WORD(6))))
+                {
+                    memcpy(pResponse, pRequest, 5);
+                    nResponse = 5;
+                }
+            }
+            break;
+
+            default:
+            {
+                cException = GATEWAY_EX_ILLEGAL_FUNCTION;
+            }
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&pGateway->mutex);
+
+    #undef WORD
+
+    if(cException)
+    {
+        pResponse[0] = cFunction | 0x80;
+        pResponse[1] = cException;
+        nResponse = 2;
+    }
+
+    return nResponse;
+}
+
+bool gateway_TakeFetch(struct Gateway* pGateway, struct GatewayFetch* pFetch)
+{
+    bool bTaken = false;
+
+    pthread_mutex_lock(&pGateway->mutex);
+
+    //Kept in ID order, so the first not yet taken is the oldest.
+    for(uint8_t i = 0; i < pGateway->cFetches && !bTaken; i++)
+    {
+        if(!pGateway->fetches[i].bTaken)
+        {
+            pGateway->fetches[i].bTaken = true;
+            pGateway->lFetches++;
+            *pFetch = pGateway->fetches[i];
+            bTaken = true;
+        }
+    }
+
+    pthread_mutex_unlock(&pGateway->mutex);
+
+    return bTaken;
+}
+
+void gateway_FetchDone(struct Gateway* pGateway, const struct GatewayFetch* pFetch, const uint16_t* pValues, int64_t llNowMs)
+{
+    pthread_mutex_lock(&pGateway->mutex);
+
+    if(NULL != pValues)
+        gateway_Store(pGateway, pFetch->cUnit, pFetch->bHolding, pFetch->nAddress, pFetch->nCount, pValues, llNowMs);
+
+    pGateway->lDoneFetchId = pFetch->lId;
+
+    for(uint8_t i = 0; i < pGateway->cFetches; i++)
+    {
+        if(pGateway->fetches[i].lId == pFetch->lId)
+        {
+            memmove(&pGateway->fetches[i], &pGateway->fetches[i + 1], (pGateway->cFetches - i - 1) * sizeof(struct GatewayFetch));
+            pGateway->cFetches--;
+            break;
+        }
+    }
+
+    pthread_cond_broadcast(&pGateway->cond);
+    pthread_mutex_unlock(&pGateway->mutex);
+}
+
+void gateway_CommandResult(struct Gateway* pGateway, uint32_t lCommandId, uint16_t nResult)
+{
+    pthread_mutex_lock(&pGateway->mutex);
+
+    pGateway->results[lCommandId % GATEWAY_RESULTS].lCommandId = lCommandId;
+    pGateway->results[lCommandId % GATEWAY_RESULTS].nResult = nResult;
+
+    pthread_cond_broadcast(&pGateway->cond);
+    pthread_mutex_unlock(&pGateway->mutex);
+}
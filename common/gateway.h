@@ -0,0 +1,123 @@
+
+//MODBUS gateway.
+//Answers MODBUS register requests for every inverter from the latest register image, so any
+//number of readers can poll without touching the serial bus. Reads of anything missing or stale
+//queue a fetch for the MODBUS thread, and misses on the same inverter are merged into one
+//serial transaction. Writes, if allowed, become commands for the control layer rather than
+//going to the inverters directly.
+
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "cmdqueue.h"
+#include "spf5000es_defs.h"
+#include "system_defs.h"
+
+#define GATEWAY_INPUT_SPACE      720     /* Input registers cached per inverter. Past the map, only fetched on demand. */
+#define GATEWAY_MAX_AGE_MS       15000   /* Cached registers older than this are fetched again. */
+#define GATEWAY_TIMEOUT_MS       3000    /* Longest a request waits on a fetch or command. */
+#define GATEWAY_MAX_FETCHES      8
+#define GATEWAY_MAX_READ         MODEL_MAX_READ /* Registers in one MODBUS read. */
+#define GATEWAY_RESULTS          8       /* Command results kept for waiting writers. */
+
+#define GATEWAY_UNIT_SELF        0xFF    /* MODBUS TCP "this device". Taken as the master, as is unit 0. */
+
+//Function codes served.
+#define GATEWAY_FC_READ_HOLDING    0x03
+#define GATEWAY_FC_READ_INPUT      0x04
+#define GATEWAY_FC_WRITE_SINGLE    0x06
+#define GATEWAY_FC_WRITE_MULTIPLE  0x10
+
+//Exceptions.
+#define GATEWAY_EX_ILLEGAL_FUNCTION 0x01
+#define GATEWAY_EX_ILLEGAL_ADDRESS  0x02
+#define GATEWAY_EX_ILLEGAL_VALUE    0x03
+#define GATEWAY_EX_DEVICE_FAILURE   0x04 /* The control layer refused a write. */
+#define GATEWAY_EX_DEVICE_BUSY      0x06 /* No room to queue a fetch or command. */
+#define GATEWAY_EX_TARGET_FAILED    0x0B /* No such inverter, or it didn't answer in time. */
+
+#define GATEWAY_PDU_MAX 253
+
+struct GatewayFetch
+{
+    uint32_t lId;                     //Fetches complete in ID order.
+    uint8_t cUnit;                    //Inverter index, from zero.
+    bool bHolding;
+    uint16_t nAddress;
+    uint16_t nCount;
+    bool bTaken;                      //On the bus now. Can't be widened any more.
+};
+
+struct GatewayUnit
+{
+    uint16_t inputRegs[GATEWAY_INPUT_SPACE];
+    uint16_t holdingRegs[GW_HREG_COUNT];
+    int64_t llInputMs[GATEWAY_INPUT_SPACE];   //When each was read. Zero if never.
+    int64_t llHoldingMs[GW_HREG_COUNT];
+};
+
+struct GatewayResult
+{
+    uint32_t lCommandId;
+    uint16_t nResult;
+};
+
+struct Gateway
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;              //Broadcast when a fetch or command completes.
+    struct GatewayUnit units[INVERTER_COUNT];
+    struct GatewayFetch fetches[GATEWAY_MAX_FETCHES];
+    uint8_t cFetches;
+    uint32_t lLastFetchId;
+    uint32_t lDoneFetchId;
+    struct GatewayResult results[GATEWAY_RESULTS];
+    int32_t lMaxAgeMs;
+    struct CommandQueue* pCommands;   //Where writes go. NULL if they're refused.
+    void (*pWake)();                  //Wakes the MODBUS thread for a fetch or command.
+    uint32_t lRequests;
+    uint32_t lHits;
+    uint32_t lMisses;
+    uint32_t lCoalesced;              //Misses served by a fetch that was already queued.
+    uint32_t lFetches;                //Serial transactions.
+    uint32_t lFailed;                 //Requests that timed out or whose fetch failed.
+    uint32_t lWrites;
+};
+
+/**
+ * Set up the gateway. Writes become commands on pCommands, or are refused if it's NULL.
+ */
+void gateway_Initialise(struct Gateway* pGateway, int32_t lMaxAgeMs, struct CommandQueue* pCommands, void (*pWake)());
+
+/**
+ * Store registers read by the MODBUS thread for inverter cUnit, counted from zero.
+ */
+void gateway_Update(struct Gateway* pGateway, uint8_t cUnit, bool bHolding, uint16_t nAddress, uint16_t nCount,
+                    const uint16_t* pValues, int64_t llNowMs);
+
+/**
+ * Serve one request PDU for MODBUS unit cUnitId into pResponse, which must have room for
+ * GATEWAY_PDU_MAX bytes. Blocks for up to GATEWAY_TIMEOUT_MS on a fetch or command.
+ * Returns the response PDU length.
+ */
+uint16_t gateway_Request(struct Gateway* pGateway, uint8_t cUnitId, const uint8_t* pRequest, uint16_t nLength, uint8_t* pResponse);
+
+/**
+ * Take the oldest queued fetch, for the MODBUS thread to carry out. Returns false if there are none.
+ */
+bool gateway_TakeFetch(struct Gateway* pGateway, struct GatewayFetch* pFetch);
+
+/**
+ * Complete a fetch with the registers read, or NULL if the read failed.
+ */
+void gateway_FetchDone(struct Gateway* pGateway, const struct GatewayFetch* pFetch, const uint16_t* pValues, int64_t llNowMs);
+
+/**
+ * Pass on the result of a command queued by the gateway, for the writer waiting on it.
+ */
+void gateway_CommandResult(struct Gateway* pGateway, uint32_t lCommandId, uint16_t nResult);
+
+#endif
@@ -0,0 +1,117 @@
+
+#include <string.h>
+#include "gridquality.h"
+
+void gridquality_Initialise(struct GridQuality* pQuality)
+{
+    memset(pQuality, 0x00, sizeof(struct GridQuality));
+}
+
+static uint8_t gridquality_Bin(uint16_t nBeyond, uint16_t nPerBin)
+{
+    uint16_t nBin = nBeyond / nPerBin;
+    
+    return nBin < GRIDQUALITY_BINS ? (uint8_t)nBin : GRIDQUALITY_BINS - 1;
+}
+
+static void gridquality_Unsettled(struct GridQuality* pQuality, int64_t llNowMs)
+{
+    pQuality->bEverUnstable = true;
+    pQuality->llLastUnstableMs = llNowMs;
+}
+
+uint8_t gridquality_Sample(struct GridQuality* pQuality, uint16_t nVolts, uint16_t nFreq, int64_t llNowMs)
+{
+    pQuality->lSamples++;
+    
+    if(pQuality->bOutage)
+    {
+        gridquality_Unsettled(pQuality, llNowMs);
+        
+        //Only trust the grid again once it has been healthy for a few samples.
+        if(nVolts < GRID_SAG_VOLTS)
+        {
+            pQuality->cRestoreCount = 0;
+        }
+        else if(++pQuality->cRestoreCount >= GRID_RESTORE_SAMPLES)
+        {
+            pQuality->bOutage = false;
+            pQuality->llOutageMs += llNowMs - pQuality->llOutageStartMs;
+            return GRIDQUALITY_RESTORED;
+        }
+        
+        return GRIDQUALITY_NONE;
+    }
+    
+    if(nVolts < GRID_OUTAGE_VOLTS)
+    {
+        //Whatever was in progress is part of the outage now.
+        pQuality->bOutage = true;
+        pQuality->cRestoreCount = 0;
+        pQuality->llOutageStartMs = llNowMs;
+        pQuality->lOutages++;
+        pQuality->bSag = false;
+        pQuality->bSwell = false;
+        pQuality->bFreq = false;
+        gridquality_Unsettled(pQuality, llNowMs);
+        
+        return GRIDQUALITY_OUTAGE;
+    }
+    
+    //Sags.
+    if(nVolts < GRID_SAG_VOLTS)
+    {
+        if(!pQuality->bSag || nVolts < pQuality->nWorstSag)
+            pQuality->nWorstSag = nVolts;
+            
+        pQuality->bSag = true;
+        gridquality_Unsettled(pQuality, llNowMs);
+    }
+    else if(pQuality->bSag)
+    {
+        pQuality->bSag = false;
+        pQuality->lSags[gridquality_Bin(GRID_SAG_VOLTS - pQuality->nWorstSag, GRIDQUALITY_VOLTS_PER_BIN)]++;
+    }
+    
+    //Swells.
+    if(nVolts > GRID_SWELL_VOLTS)
+    {
+        if(!pQuality->bSwell || nVolts > pQuality->nWorstSwell)
+            pQuality->nWorstSwell = nVolts;
+            
+        pQuality->bSwell = true;
+        gridquality_Unsettled(pQuality, llNowMs);
+    }
+    else if(pQuality->bSwell)
+    {
+        pQuality->bSwell = false;
+        pQuality->lSwells[gridquality_Bin(pQuality->nWorstSwell - GRID_SWELL_VOLTS, GRIDQUALITY_VOLTS_PER_BIN)]++;
+    }
+    
+    //Frequency, either way.
+    uint16_t nFreqDeviation = nFreq > GRID_NOMINAL_FREQ ? nFreq - GRID_NOMINAL_FREQ : GRID_NOMINAL_FREQ - nFreq;
+    
+    if(nFreqDeviation > GRID_FREQ_TOLERANCE)
+    {
+        if(!pQuality->bFreq || nFreqDeviation > pQuality->nWorstFreq)
+            pQuality->nWorstFreq = nFreqDeviation;
+            
+        pQuality->bFreq = true;
+        gridquality_Unsettled(pQuality, llNowMs);
+    }
+    else if(pQuality->bFreq)
+    {
+        pQuality->bFreq = false;
+        pQuality->lFreqExcursions[gridquality_Bin(pQuality->nWorstFreq - GRID_FREQ_TOLERANCE, GRIDQUALITY_FREQ_PER_BIN)]++;
+    }
+    
+    return GRIDQUALITY_NONE;
+}
+
+bool gridquality_Unstable(const struct GridQuality* pQuality, int64_t llNowMs)
+{
+    if(pQuality->bOutage || pQuality->bSag || pQuality->bSwell || pQuality->bFreq)
+        return true;
+        
+    return pQuality->bEverUnstable && llNowMs - pQuality->llLastUnstableMs < (int64_t)GRID_FAST_HOLD_S * 1000;
+}
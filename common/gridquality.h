@@ -0,0 +1,58 @@
+
+//Grid power-quality monitor.
+//Classifies each grid voltage/frequency sample, detecting outages on the first bad sample and
+//building histograms of completed sag, swell and frequency excursions by their worst deviation.
+
+#ifndef GRIDQUALITY_H
+#define GRIDQUALITY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "system_defs.h"
+
+#define GRIDQUALITY_NONE      0   /* Nothing to report. */
+#define GRIDQUALITY_OUTAGE    1   /* The grid just went away. */
+#define GRIDQUALITY_RESTORED  2   /* The grid has been back long enough to trust. */
+
+#define GRIDQUALITY_BINS           8
+#define GRIDQUALITY_VOLTS_PER_BIN  50   /* 5V of depth beyond the limit per histogram bin. */
+#define GRIDQUALITY_FREQ_PER_BIN   10   /* 0.1Hz beyond the tolerance per histogram bin. */
+
+struct GridQuality
+{
+    //Completed excursions, binned by how far beyond the limit they went. The last bin catches everything worse.
+    uint32_t lSags[GRIDQUALITY_BINS];
+    uint32_t lSwells[GRIDQUALITY_BINS];
+    uint32_t lFreqExcursions[GRIDQUALITY_BINS];
+    uint32_t lOutages;
+    uint32_t lSamples;
+    int64_t llOutageMs;           //Total time spent in completed outages.
+    
+    //Running state.
+    bool bOutage;
+    uint8_t cRestoreCount;        //Consecutive healthy samples during an outage.
+    int64_t llOutageStartMs;
+    bool bSag;
+    bool bSwell;
+    bool bFreq;
+    uint16_t nWorstSag;           //Lowest volts in the current sag.
+    uint16_t nWorstSwell;         //Highest volts in the current swell.
+    uint16_t nWorstFreq;          //Largest deviation from nominal in the current frequency excursion.
+    bool bEverUnstable;
+    int64_t llLastUnstableMs;
+};
+
+void gridquality_Initialise(struct GridQuality* pQuality);
+
+/**
+ * Classify one sample of raw GRID_VOLTS (0.1V) and GRID_FREQ (0.01Hz) taken at monotonic time llNowMs.
+ * Returns GRIDQUALITY_NONE, GRIDQUALITY_OUTAGE or GRIDQUALITY_RESTORED.
+ */
+uint8_t gridquality_Sample(struct GridQuality* pQuality, uint16_t nVolts, uint16_t nFreq, int64_t llNowMs);
+
+/**
+ * Whether the grid is, or was recently, misbehaving and is worth sampling at a higher rate.
+ */
+bool gridquality_Unstable(const struct GridQuality* pQuality, int64_t llNowMs);
+
+#endif
@@ -0,0 +1,63 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "history.h"
+
+int history_Format(const struct HistoryRecord* pRecord, char* pLine, int lSize)
+{
+    int lLength = snprintf(pLine, lSize, "%d,%u,%u,%u,%u,%u,%u",
+                           pRecord->slTime, pRecord->nSystemState, pRecord->nBatterySoc, pRecord->nBatteryVolts,
+                           pRecord->nGridVolts, pRecord->nGridFreq, pRecord->nAcchgegyToday);
+    
+    for(int i = 0; i < INVERTER_COUNT && lLength > 0 && lLength < lSize; i++)
+    {
+        lLength += snprintf(pLine + lLength, lSize - lLength, ",%u,%u,%u",
+                            pRecord->nOutputWatts[i], pRecord->nLoadPercent[i], pRecord->nBattchgAmps[i]);
+    }
+    
+    if(lLength > 0 && lLength < lSize)
+        lLength += snprintf(pLine + lLength, lSize - lLength, "\n");
+    
+    return lLength > 0 && lLength < lSize ? lLength : 0;
+}
+
+static bool history_Next(const char** ppLine, long* pValue)
+{
+    char* pEnd;
+    *pValue = strtol(*ppLine, &pEnd, 10);
+    
+    if(pEnd == *ppLine)
+        return false;
+        
+    *ppLine = ',' == *pEnd ? pEnd + 1 : pEnd;
+    return true;
+}
+
+bool history_Parse(const char* pLine, struct HistoryRecord* pRecord)
+{
+    long values[7 + INVERTER_COUNT * 3];
+    
+    for(unsigned int i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        if(!history_Next(&pLine, &values[i]))
+            return false;
+    }
+    
+    pRecord->slTime = values[0];
+    pRecord->nSystemState = values[1];
+    pRecord->nBatterySoc = values[2];
+    pRecord->nBatteryVolts = values[3];
+    pRecord->nGridVolts = values[4];
+    pRecord->nGridFreq = values[5];
+    pRecord->nAcchgegyToday = values[6];
+    
+    for(int i = 0; i < INVERTER_COUNT; i++)
+    {
+        pRecord->nOutputWatts[i] = values[7 + i * 3];
+        pRecord->nLoadPercent[i] = values[8 + i * 3];
+        pRecord->nBattchgAmps[i] = values[9 + i * 3];
+    }
+    
+    return true;
+}
@@ -0,0 +1,42 @@
+
+//Replayable history.
+//One line of CSV per sample with everything the controller judges by, so recorded days can be
+//fed back through it. The master's readings come first, then each inverter's in turn.
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "system_defs.h"
+
+#define HISTORY_INTERVAL_S  10     /* How often the server records a line. */
+#define HISTORY_LINE_MAX    256
+
+#define HISTORY_HEADER "time,state,soc,battvolts,gridvolts,gridfreq,acchgtoday,watts[,load%,chgamps]...\n"
+
+struct HistoryRecord
+{
+    int32_t slTime;
+    uint16_t nSystemState;
+    uint16_t nBatterySoc;
+    uint16_t nBatteryVolts;
+    uint16_t nGridVolts;
+    uint16_t nGridFreq;
+    uint16_t nAcchgegyToday;
+    uint16_t nOutputWatts[INVERTER_COUNT];    //0.1W, each inverter's OUTPUT_WATTS_L.
+    uint16_t nLoadPercent[INVERTER_COUNT];
+    uint16_t nBattchgAmps[INVERTER_COUNT];    //0.1A.
+};
+
+/**
+ * Write the record as one line of CSV, newline included. Returns the length, or zero if it doesn't fit.
+ */
+int history_Format(const struct HistoryRecord* pRecord, char* pLine, int lSize);
+
+/**
+ * Read one line of CSV. Returns false for the header, or anything else that isn't a whole record.
+ */
+bool history_Parse(const char* pLine, struct HistoryRecord* pRecord);
+
+#endif
@@ -0,0 +1,463 @@
+
+#include <string.h>
+#include <time.h>
+#include "invsim.h"
+#include "clocksync.h"
+
+#define INVSIM_MAX_CHG_AMPS 100   /* Utility + solar, per the SPF5000ES manual. */
+
+static uint32_t invsim_Random(struct InvSim* pSim)
+{
+    uint32_t x = pSim->lSeed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    pSim->lSeed = x;
+    return x;
+}
+
+static void invsim_SetPair(uint16_t* pRegs, int lHigh, uint32_t lValue)
+{
+    pRegs[lHigh] = (uint16_t)(lValue >> 16);
+    pRegs[lHigh + 1] = (uint16_t)lValue;
+}
+
+static bool invsim_ChargeAllowed(const uint16_t* pHoldingRegs, int lHour)
+{
+    uint16_t nStart = pHoldingRegs[GW_HREG_UTIL_START_HOUR];
+    uint16_t nEnd = pHoldingRegs[GW_HREG_UTIL_END_HOUR];
+
+    //Both zero is any time. The end hour is inclusive.
+    if(0 == nStart && 0 == nEnd)
+        return true;
+
+    if(nStart <= nEnd)
+        return lHour >= nStart && lHour <= nEnd;
+
+    return lHour >= nStart || lHour <= nEnd;
+}
+
+void invsim_Initialise(struct InvSim* pSim, uint8_t cUnits, uint16_t nSoc, uint16_t nBaseWatts, int32_t slNow, int64_t llNowMs)
+{
+    memset(pSim, 0x00, sizeof(struct InvSim));
+
+    pSim->cUnits = cUnits < 1 ? 1 : cUnits > INVSIM_MAX_UNITS ? INVSIM_MAX_UNITS : cUnits;
+    pSim->fltBatteryWh = (float)(nSoc > 100 ? 100 : nSoc) * BATTERY_CAPACITY_WH / 100.0f;
+    pSim->nBaseWatts = nBaseWatts;
+    pSim->bGridUp = true;
+    pSim->lSeed = 0x12345678;
+    pSim->slLastNow = slNow;
+    pSim->llLastMs = llNowMs;
+    pSim->lLastDay = -1;
+
+    //As they'd most likely be found: on batteries, charging off-peak only.
+    for(uint8_t i = 0; i < pSim->cUnits; i++)
+    {
+        struct InvSimUnit* pUnit = &pSim->units[i];
+        pUnit->holdingRegs[GW_HREG_CFG_MODE] = GW_CFG_MODE_BATTS;
+        pUnit->holdingRegs[GW_HREG_UTIL_START_HOUR] = 0;
+        pUnit->holdingRegs[GW_HREG_UTIL_END_HOUR] = GW_CFG_UTIL_TIME_OFFPEAK;
+        pUnit->holdingRegs[GW_HREG_MAX_CHG_AMPS] = INVSIM_MAX_CHG_AMPS;
+        pUnit->holdingRegs[GW_HREG_MAX_UTIL_AMPS] = GW_CFG_UTIL_AMPS_MOD;
+        pUnit->bOnBatteries = true;
+    }
+
+    invsim_Advance(pSim, slNow, llNowMs);
+}
+
+float invsim_Soc(const struct InvSim* pSim)
+{
+    return 100.0f * pSim->fltBatteryWh / BATTERY_CAPACITY_WH;
+}
+
+void invsim_Surge(struct InvSim* pSim, uint16_t nWatts, int32_t lMs)
+{
+    pSim->nSurgeWatts = nWatts;
+    pSim->llSurgeUntilMs = pSim->llLastMs + lMs;
+}
+
+void invsim_SetGrid(struct InvSim* pSim, bool bUp)
+{
+    pSim->bGridUp = bUp;
+}
+
+//Move a unit's output to where its config and circumstances say it should be.
+static void invsim_Transfer(struct InvSim* pSim, struct InvSimUnit* pUnit, int64_t llNowMs)
+{
+    bool bWantBatteries = GW_CFG_MODE_GRID != pUnit->holdingRegs[GW_HREG_CFG_MODE];
+    bool bImmediate = false;
+
+    //No grid to bypass to, or nothing left in the batteries. No waiting about.
+    if(!pSim->bGridUp)
+    {
+        bImmediate = !pUnit->bOnBatteries;
+        bWantBatteries = true;
+    }
+    else if(bWantBatteries && invsim_Soc(pSim) <= INVSIM_LOW_SOC)
+    {
+        bImmediate = pUnit->bOnBatteries;
+        bWantBatteries = false;
+    }
+
+    if(bWantBatteries == pUnit->bOnBatteries)
+    {
+        pUnit->llTransferMs = 0;
+    }
+    else if(bImmediate || (0 != pUnit->llTransferMs && llNowMs >= pUnit->llTransferMs))
+    {
+        pUnit->bOnBatteries = bWantBatteries;
+        pUnit->llTransferMs = 0;
+    }
+    else if(0 == pUnit->llTransferMs)
+    {
+        pUnit->llTransferMs = llNowMs + INVSIM_TRANSFER_MS;
+    }
+
+    //Only a power cycle really clears it, but going to the grid will do here.
+    if(pUnit->bFaulted && !pUnit->bOnBatteries && pSim->bGridUp)
+    {
+        pUnit->bFaulted = false;
+        pUnit->inputRegs[FAULTVALUE] = 0;
+    }
+}
+
+void invsim_Advance(struct InvSim* pSim, int32_t slNow, int64_t llNowMs)
+{
+    int64_t llElapsedMs = llNowMs - pSim->llLastMs;
+
+    if(llElapsedMs < 0)
+        llElapsedMs = 0;
+    else if(llElapsedMs > INVSIM_MAX_STEP_MS)
+        llElapsedMs = INVSIM_MAX_STEP_MS;
+
+    float fltHours = (float)llElapsedMs / 3600000.0f;
+
+    pSim->slLastNow = slNow;
+    pSim->llLastMs = llNowMs;
+
+    //The inverter runs off its own clock.
+    time_t rawtime = slNow + pSim->slClockOffset;
+    struct tm timeinfo;
+    localtime_r(&rawtime, &timeinfo);
+
+    if(timeinfo.tm_yday != pSim->lLastDay)
+    {
+        pSim->lLastDay = timeinfo.tm_yday;
+
+        for(uint8_t i = 0; i < pSim->cUnits; i++)
+        {
+            pSim->units[i].fltAcChargeWh = 0.0f;
+            pSim->units[i].fltBattUseWh = 0.0f;
+            pSim->units[i].fltAcUseWh = 0.0f;
+        }
+    }
+
+    //Household load wanders a few percent, and the units share it equally.
+    uint32_t lHouseWatts = pSim->nBaseWatts + (pSim->nBaseWatts * (invsim_Random(pSim) % 11)) / 100;
+
+    if(llNowMs < pSim->llSurgeUntilMs)
+        lHouseWatts += pSim->nSurgeWatts;
+
+    uint32_t lUnitWatts = lHouseWatts / pSim->cUnits;
+
+    for(uint8_t i = 0; i < pSim->cUnits; i++)
+    {
+        struct InvSimUnit* pUnit = &pSim->units[i];
+        uint16_t* pRegs = pUnit->inputRegs;
+        float fltSoc = invsim_Soc(pSim);
+
+        invsim_Transfer(pSim, pUnit, llNowMs);
+
+        //Bus voltage trips if the batteries are asked for too much for too long.
+        if(pUnit->bOnBatteries && !pUnit->bFaulted && lUnitWatts > INVSIM_RATED_WATTS)
+        {
+            if(0 == pUnit->llOverloadMs)
+                pUnit->llOverloadMs = llNowMs;
+            else if(llNowMs - pUnit->llOverloadMs >= INVSIM_OVERLOAD_MS)
+            {
+                pUnit->bFaulted = true;
+                pRegs[FAULTVALUE] = INVSIM_FAULT_BUS_HIGH;
+            }
+        }
+        else
+        {
+            pUnit->llOverloadMs = 0;
+        }
+
+        uint32_t lOutWatts = lUnitWatts;
+        uint32_t lChargeWatts = 0;
+        uint16_t nChargeAmps = 0;
+        uint16_t nState;
+
+        if(pUnit->bFaulted)
+        {
+            lOutWatts = 0;
+            nState = FAULT;
+        }
+        else if(pUnit->bOnBatteries)
+        {
+            if(pSim->fltBatteryWh <= 0.0f)
+            {
+                lOutWatts = 0;
+                nState = STANDBY;
+            }
+            else
+            {
+                nState = DISCHARGE;
+            }
+
+            pSim->fltBatteryWh -= (float)lOutWatts * fltHours;
+            pUnit->fltBattUseWh += (float)lOutWatts * fltHours;
+        }
+        else
+        {
+            nState = BYPASS;
+            pUnit->fltAcUseWh += (float)lOutWatts * fltHours;
+
+            if(invsim_ChargeAllowed(pUnit->holdingRegs, timeinfo.tm_hour) && fltSoc < 100.0f)
+            {
+                nChargeAmps = pUnit->holdingRegs[GW_HREG_MAX_UTIL_AMPS];
+
+                if(nChargeAmps > pUnit->holdingRegs[GW_HREG_MAX_CHG_AMPS])
+                    nChargeAmps = pUnit->holdingRegs[GW_HREG_MAX_CHG_AMPS];
+
+                if(fltSoc > INVSIM_TAPER_SOC)
+                    nChargeAmps = (uint16_t)(nChargeAmps * (100.0f - fltSoc) / (100.0f - INVSIM_TAPER_SOC));
+            }
+
+            if(nChargeAmps > 0)
+            {
+                nState = AC_CHG_BYP;
+                lChargeWatts = (uint32_t)(nChargeAmps * (CHARGE_VOLTAGE - 2.0f));
+                pSim->fltBatteryWh += (float)lChargeWatts * fltHours * GW_WORST_CASE_CHARGE_EFFICIENCY;
+                pUnit->fltAcChargeWh += (float)lChargeWatts * fltHours;
+            }
+        }
+
+        if(!pSim->bGridUp && !pUnit->bOnBatteries)
+            lOutWatts = 0;
+
+        if(pSim->fltBatteryWh < 0.0f)
+            pSim->fltBatteryWh = 0.0f;
+        else if(pSim->fltBatteryWh > BATTERY_CAPACITY_WH)
+            pSim->fltBatteryWh = BATTERY_CAPACITY_WH;
+
+        //Everything in the register map's own units. 0.1W, 0.1V, 0.01V, 0.1A, 0.1% and 0.1kWh.
+        uint16_t nBatteryVolts = (uint16_t)(MODEL_BATTERY_VOLTS * 100 + invsim_Soc(pSim) * MODEL_BATTERY_VOLTS / 6) + (nChargeAmps ? 100 : 0);
+        uint32_t lLoadPermille = lOutWatts * 1000 / INVSIM_RATED_WATTS;
+
+        pRegs[STATUS] = nState;
+        invsim_SetPair(pRegs, OUTPUT_WATTS_H, lOutWatts * 10);
+        invsim_SetPair(pRegs, OUTPUT_APPPWR_H, lOutWatts * 105 / 10);
+        invsim_SetPair(pRegs, AC_CHARGE_WATTS_H, lChargeWatts * 10);
+        invsim_SetPair(pRegs, AC_CHARGE_VA_H, lChargeWatts * 10);
+        pRegs[BATTERY_VOLTS] = nBatteryVolts;
+        pRegs[BATTERY_SOC] = (uint16_t)(invsim_Soc(pSim) + 0.5f);
+        pRegs[BUS_VOLTS] = 4000 + (uint16_t)(invsim_Random(pSim) % 50);
+        pRegs[GRID_VOLTS] = pSim->bGridUp ? 2380 + (uint16_t)(invsim_Random(pSim) % 60) : 0;
+        pRegs[GRID_FREQ] = pSim->bGridUp ? 4990 + (uint16_t)(invsim_Random(pSim) % 20) : 0;
+        pRegs[AC_OUT_VOLTS] = FAULT == nState || STANDBY == nState ? 0 : 2300;
+        pRegs[AC_OUT_FREQ] = pRegs[AC_OUT_VOLTS] ? 5000 : 0;
+        pRegs[BATT_PORT_VOLTS] = nBatteryVolts;
+        pRegs[BATT_BUS_VOLTS] = nBatteryVolts;
+        pRegs[INVERTER_TEMP] = 300 + (uint16_t)(lLoadPermille / 5);
+        pRegs[DCDC_TEMP] = 300 + (uint16_t)(lLoadPermille / 8);
+        pRegs[LOAD_PERCENT] = (uint16_t)lLoadPermille;
+        pRegs[BUCK1_TEMP] = 300;
+        pRegs[BUCK2_TEMP] = 300;
+        pRegs[OUTPUT_AMPS] = (uint16_t)(lOutWatts * 10 / 230);
+        pRegs[INVERTER_AMPS] = (uint16_t)((lOutWatts + lChargeWatts) * 10 / 230);
+        invsim_SetPair(pRegs, AC_INPUT_WATTS_H, pUnit->bOnBatteries ? 0 : (lOutWatts + lChargeWatts) * 10);
+        invsim_SetPair(pRegs, AC_INPUT_VA_H, pUnit->bOnBatteries ? 0 : (lOutWatts + lChargeWatts) * 10);
+        pRegs[FAULTBIT] = pUnit->bFaulted ? 1 : 0;
+        invsim_SetPair(pRegs, ACCHGEGY_TODAY_H, (uint32_t)(pUnit->fltAcChargeWh / GW_WH_MULTIPLIER));
+        invsim_SetPair(pRegs, BATTUSE_TODAY_H, (uint32_t)(pUnit->fltBattUseWh / GW_WH_MULTIPLIER));
+        invsim_SetPair(pRegs, AC_USE_TODAY_H, (uint32_t)(pUnit->fltAcUseWh / GW_WH_MULTIPLIER));
+        pRegs[BATTCHG_AMPS] = nChargeAmps * 10;
+        invsim_SetPair(pRegs, AC_USE_WATTS_H, pUnit->bOnBatteries ? 0 : lOutWatts * 10);
+        invsim_SetPair(pRegs, AC_USE_VA_H, pUnit->bOnBatteries ? 0 : lOutWatts * 10);
+        invsim_SetPair(pRegs, BATTUSE_WATTS_H, pUnit->bOnBatteries ? lOutWatts * 10 : 0);
+        invsim_SetPair(pRegs, BATTUSE_VA_H, pUnit->bOnBatteries ? lOutWatts * 10 : 0);
+        invsim_SetPair(pRegs, BATT_WATTS_H, pUnit->bOnBatteries ? lOutWatts * 10 : lChargeWatts * 10);
+        pRegs[SLAVE_COUNT] = pSim->cUnits - 1;
+        pRegs[INV_FANSPEED] = (uint16_t)(lLoadPermille / 10);
+        pRegs[TOTAL_CHARGE_AMPS] = nChargeAmps * 10;
+        pRegs[PARA_CHG_AMPS] = nChargeAmps * 10 * pSim->cUnits;
+
+        clocksync_ToRegisters(slNow + pSim->slClockOffset, true, &pUnit->holdingRegs[GW_HREG_TIME_Y]);
+    }
+}
+
+static bool invsim_ValidValue(uint16_t nRegister, uint16_t nValue)
+{
+    switch(nRegister)
+    {
+        case GW_HREG_CFG_MODE: return nValue <= GW_CFG_MODE_GRID;
+        case GW_HREG_UTIL_START_HOUR:
+        case GW_HREG_UTIL_END_HOUR: return nValue <= 23;
+        case GW_HREG_MAX_CHG_AMPS: return nValue <= INVSIM_MAX_CHG_AMPS;
+        case GW_HREG_MAX_UTIL_AMPS: return nValue <= GW_CFG_UTIL_AMPS_MAX;
+        default: return true;
+    }
+}
+
+//Write nCount big-endian values, all or nothing. Returns zero or an exception code.
+static uint8_t invsim_Write(struct InvSim* pSim, struct InvSimUnit* pUnit, uint16_t nAddress, uint16_t nCount, const uint8_t* pValues)
+{
+    if(nCount < 1 || nAddress + nCount > GW_HREG_COUNT)
+        return INVSIM_EX_ILLEGAL_ADDRESS;
+
+    for(uint16_t i = 0; i < nCount; i++)
+    {
+        if(!invsim_ValidValue(nAddress + i, (pValues[i * 2] << 8) | pValues[i * 2 + 1]))
+            return INVSIM_EX_ILLEGAL_VALUE;
+    }
+
+    for(uint16_t i = 0; i < nCount; i++)
+        pUnit->holdingRegs[nAddress + i] = (pValues[i * 2] << 8) | pValues[i * 2 + 1];
+
+    //Setting the clock. Every unit shares the one offset, as they keep step with the master.
+    if(nAddress <= GW_HREG_TIME_S && nAddress + nCount > GW_HREG_TIME_Y)
+    {
+        int32_t slTime = clocksync_FromRegisters(&pUnit->holdingRegs[GW_HREG_TIME_Y]);
+
+        if(slTime >= 0)
+            pSim->slClockOffset = slTime - pSim->slLastNow;
+    }
+
+    return 0;
+}
+
+static uint16_t invsim_Read(const uint16_t* pRegs, uint16_t nMapSize, uint16_t nSpace, uint16_t nAddress, uint16_t nCount, uint8_t* pResponse, uint8_t* pcException)
+{
+    if(nCount < 1 || nCount > 125 || nAddress + nCount > nSpace)
+    {
+        *pcException = INVSIM_EX_ILLEGAL_ADDRESS;
+        return 0;
+    }
+
+    pResponse[1] = (uint8_t)(nCount * 2);
+
+    for(uint16_t i = 0; i < nCount; i++)
+    {
+        uint16_t nValue = nAddress + i < nMapSize ? pRegs[nAddress + i] : 0;
+        pResponse[2 + i * 2] = (uint8_t)(nValue >> 8);
+        pResponse[3 + i * 2] = (uint8_t)nValue;
+    }
+
+    return 2 + nCount * 2;
+}
+
+static uint16_t invsim_Unit(struct InvSim* pSim, struct InvSimUnit* pUnit, const uint8_t* pRequest, uint16_t nLength, uint8_t* pResponse)
+{
+    uint8_t cFunction = pRequest[0];
+    uint8_t cException = 0;
+    uint16_t nResponse = 0;
+
+    #define WORD(offset) ((uint16_t)((pRequest[offset] << 8) | pRequest[(offset) + 1]))
+
+    pResponse[0] = cFunction;
+
+    switch(cFunction)
+    {
+        case INVSIM_FC_READ_HOLDING:
+        case INVSIM_FC_READ_INPUT:
+        {
+            if(nLength != 5)
+            {
+                cException = INVSIM_EX_ILLEGAL_VALUE;
+                break;
+            }
+
+            if(INVSIM_FC_READ_HOLDING == cFunction)
+                nResponse = invsim_Read(pUnit->holdingRegs, GW_HREG_COUNT, GW_HREG_COUNT, WORD(1), WORD(3), pResponse, &cException);
+            else
+                nResponse = invsim_Read(pUnit->inputRegs, INPUT_REGISTER_COUNT, INVSIM_INPUT_SPACE, WORD(1), WORD(3), pResponse, &cException);
+        }
+        break;
+
+        case INVSIM_FC_WRITE_SINGLE:
+        {
+            if(nLength != 5)
+            {
+                cException = INVSIM_EX_ILLEGAL_VALUE;
+                break;
+            }
+
+            //Echoes the request.
+            cException = invsim_Write(pSim, pUnit, WORD(1), 1, &pRequest[3]);
+            memcpy(pResponse, pRequest, 5);
+            nResponse = 5;
+        }
+        break;
+
+        case INVSIM_FC_WRITE_MULTIPLE:
+        {
+            if(nLength < 6 || pRequest[5] != WORD(3) * 2 || nLength != 6 + pRequest[5])
+            {
+                cException = INVSIM_EX_ILLEGAL_VALUE;
+                break;
+            }
+
+            cException = invsim_Write(pSim, pUnit, WORD(1), WORD(3), &pRequest[6]);
+            memcpy(pResponse, pRequest, 5);
+            nResponse = 5;
+        }
+        break;
+
+#if MODEL_FC_WRITE_AND_READ
+        case INVSIM_FC_WRITE_AND_READ:
+        {
+            //Written first, then read.
+            if(nLength < 10 || pRequest[9] != WORD(7) * 2 || nLength != 10 + pRequest[9])
+                cException = INVSIM_EX_ILLEGAL_VALUE;
+            else
+                cException = invsim_Write(pSim, pUnit, WORD(5), WORD(7), &pRequest[10]);
+
+            if(!cException)
+                nResponse = invsim_Read(pUnit->holdingRegs, GW_HREG_COUNT, GW_HREG_COUNT, WORD(1), WORD(3), pResponse, &cException);
+        }
+        break;
+#endif
+
+        default:
+        {
+            cException = INVSIM_EX_ILLEGAL_FUNCTION;
+        }
+        break;
+    }
+
+    #undef WORD
+
+    if(cException)
+    {
+        pSim->lExceptions++;
+        pResponse[0] = cFunction | 0x80;
+        pResponse[1] = cException;
+        nResponse = 2;
+    }
+
+    return nResponse;
+}
+
+uint16_t invsim_Request(struct InvSim* pSim, uint8_t cSlave, const uint8_t* pRequest, uint16_t nLength, uint8_t* pResponse)
+{
+    if(nLength < 1)
+        return 0;
+
+    pSim->lRequests++;
+
+    //Broadcasts are carried out by every unit, and never answered.
+    if(0 == cSlave)
+    {
+        for(uint8_t i = 0; i < pSim->cUnits; i++)
+            invsim_Unit(pSim, &pSim->units[i], pRequest, nLength, pResponse);
+
+        return 0;
+    }
+
+    if(cSlave < INVERTER_1_ID || cSlave >= INVERTER_1_ID + pSim->cUnits)
+        return 0;
+
+    return invsim_Unit(pSim, &pSim->units[cSlave - INVERTER_1_ID], pRequest, nLength, pResponse);
+}
@@ -0,0 +1,97 @@
+
+//Simulated SPF ES, of the model built for (see model_defs.h).
+//A model of paralleled inverters sharing one battery bank, serving the input and holding register
+//maps as Modbus PDUs so the server can be run end to end without any hardware. Each unit follows
+//its own holding registers: output config, utility charge hours and amps, and its clock.
+
+#ifndef INVSIM_H
+#define INVSIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "spf5000es_defs.h"
+#include "system_defs.h"
+
+#define INVSIM_MAX_UNITS       8
+#define INVSIM_RATED_WATTS     MODEL_RATED_WATTS   /* Per inverter. */
+#define INVSIM_OVERLOAD_MS     3000   /* Over the rating on batteries for this long, and it faults. */
+#define INVSIM_TRANSFER_MS     2000   /* Time taken to act on an output config change. */
+#define INVSIM_LOW_SOC         5      /* Goes to the grid on its own below this SoC when on batteries. */
+#define INVSIM_TAPER_SOC       95     /* Charge current tapers off above this SoC. */
+#define INVSIM_MAX_STEP_MS     60000  /* Longest time integrated in one go. */
+#define INVSIM_INPUT_SPACE     720    /* Input addresses that can be read. Past the documented map reads as zero. */
+
+#define INVSIM_FAULT_BUS_HIGH  8      /* "08 - Bus Voltage Too High". */
+
+//Modbus function codes served.
+#define INVSIM_FC_READ_HOLDING     0x03
+#define INVSIM_FC_READ_INPUT       0x04
+#define INVSIM_FC_WRITE_SINGLE     0x06
+#define INVSIM_FC_WRITE_MULTIPLE   0x10
+#define INVSIM_FC_WRITE_AND_READ   0x17
+
+//Modbus exceptions.
+#define INVSIM_EX_ILLEGAL_FUNCTION 0x01
+#define INVSIM_EX_ILLEGAL_ADDRESS  0x02
+#define INVSIM_EX_ILLEGAL_VALUE    0x03
+
+#define INVSIM_PDU_MAX 253
+
+struct InvSimUnit
+{
+    uint16_t inputRegs[INPUT_REGISTER_COUNT];
+    uint16_t holdingRegs[GW_HREG_COUNT];
+    bool bOnBatteries;            //Where the output's actually coming from.
+    bool bFaulted;
+    int64_t llTransferMs;         //When a pending transfer completes, or zero.
+    int64_t llOverloadMs;         //When the current overload started, or zero.
+    float fltAcChargeWh;          //Today's totals.
+    float fltBattUseWh;
+    float fltAcUseWh;
+};
+
+struct InvSim
+{
+    uint8_t cUnits;
+    struct InvSimUnit units[INVSIM_MAX_UNITS];
+    float fltBatteryWh;
+    uint16_t nBaseWatts;          //Household load, shared between the units.
+    uint16_t nSurgeWatts;         //Extra load until llSurgeUntilMs.
+    int64_t llSurgeUntilMs;
+    bool bGridUp;
+    int32_t slClockOffset;        //Inverter clock minus the real one.
+    int32_t slLastNow;
+    int64_t llLastMs;
+    int lLastDay;
+    uint32_t lSeed;
+    uint32_t lRequests;
+    uint32_t lExceptions;
+};
+
+void invsim_Initialise(struct InvSim* pSim, uint8_t cUnits, uint16_t nSoc, uint16_t nBaseWatts, int32_t slNow, int64_t llNowMs);
+
+/**
+ * Run the model up to the wall clock slNow and monotonic llNowMs, and refresh every register.
+ */
+void invsim_Advance(struct InvSim* pSim, int32_t slNow, int64_t llNowMs);
+
+/**
+ * Add nWatts of load for lMs from the last advance.
+ */
+void invsim_Surge(struct InvSim* pSim, uint16_t nWatts, int32_t lMs);
+
+void invsim_SetGrid(struct InvSim* pSim, bool bUp);
+
+/**
+ * The battery bank's state of charge, in percent.
+ */
+float invsim_Soc(const struct InvSim* pSim);
+
+/**
+ * Serve one request PDU for slave cSlave (1 is the master, 0 is broadcast) into pResponse,
+ * which must have room for INVSIM_PDU_MAX bytes. Returns the response PDU length, or zero when
+ * there's no reply: an unknown slave, or a broadcast.
+ */
+uint16_t invsim_Request(struct InvSim* pSim, uint8_t cSlave, const uint8_t* pRequest, uint16_t nLength, uint8_t* pResponse);
+
+#endif
@@ -0,0 +1,63 @@
+
+#include <string.h>
+#include "latency.h"
+
+void latency_Initialise(struct LatencyHistogram* pHistogram)
+{
+    memset(pHistogram, 0x00, sizeof(struct LatencyHistogram));
+}
+
+int latency_Bucket(uint32_t lUs)
+{
+    int lBucket = 0;
+
+    while(lUs >= 2 && lBucket < LATENCY_BUCKETS - 1)
+    {
+        lUs >>= 1;
+        lBucket++;
+    }
+
+    return lBucket;
+}
+
+void latency_Record(struct LatencyHistogram* pHistogram, uint32_t lUs)
+{
+    pHistogram->lBuckets[latency_Bucket(lUs)]++;
+    pHistogram->lCount++;
+    pHistogram->llTotalUs += lUs;
+
+    if(lUs > pHistogram->lMaxUs)
+        pHistogram->lMaxUs = lUs;
+}
+
+uint32_t latency_Percentile(const struct LatencyHistogram* pHistogram, float fltPercent)
+{
+    if(0 == pHistogram->lCount)
+        return 0;
+
+    //Ceiling of the rank, so the 100th is the last sample.
+    uint64_t llRank = (uint64_t)((double)pHistogram->lCount * fltPercent / 100.0 + 0.999999);
+    uint64_t llSeen = 0;
+
+    if(llRank < 1)
+        llRank = 1;
+
+    for(int i = 0; i < LATENCY_BUCKETS - 1; i++)
+    {
+        llSeen += pHistogram->lBuckets[i];
+
+        //No higher than anything actually seen.
+        if(llSeen >= llRank)
+            return (2u << i) - 1 < pHistogram->lMaxUs ? (2u << i) - 1 : pHistogram->lMaxUs;
+    }
+
+    return pHistogram->lMaxUs;
+}
+
+uint32_t latency_MeanUs(const struct LatencyHistogram* pHistogram)
+{
+    if(0 == pHistogram->lCount)
+        return 0;
+
+    return (uint32_t)(pHistogram->llTotalUs / pHistogram->lCount);
+}
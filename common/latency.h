@@ -0,0 +1,39 @@
+
+//Latency histogram.
+//Power-of-two buckets of microseconds, cheap enough to record from the MODBUS thread on every
+//wakeup. Bucket 0 holds anything under 2us, bucket n holds [2^n, 2^(n+1)) and the last takes
+//everything beyond.
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+#define LATENCY_BUCKETS 22                /* Up to ~2s before the last bucket. */
+
+struct LatencyHistogram
+{
+    uint32_t lBuckets[LATENCY_BUCKETS];
+    uint32_t lCount;
+    uint32_t lMaxUs;
+    uint64_t llTotalUs;
+};
+
+void latency_Initialise(struct LatencyHistogram* pHistogram);
+
+void latency_Record(struct LatencyHistogram* pHistogram, uint32_t lUs);
+
+/**
+ * The bucket lUs falls in.
+ */
+int latency_Bucket(uint32_t lUs);
+
+/**
+ * Upper bound of the bucket holding the given percentile (0-100), or the max if that's lower, in us.
+ * Zero if nothing's been recorded.
+ */
+uint32_t latency_Percentile(const struct LatencyHistogram* pHistogram, float fltPercent);
+
+uint32_t latency_MeanUs(const struct LatencyHistogram* pHistogram);
+
+#endif
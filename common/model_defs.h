@@ -0,0 +1,65 @@
+
+//Inverter model profiles.
+//Everything that differs between the Growatt SPF ES models, fixed at build time with
+//-DINVERTER_MODEL=MODEL_SPF3000ES etc. (MODEL= in the server and sim makefiles), so each build
+//folds its own limits in as constants rather than carrying and branching on all of them.
+//Defaults to the SPF5000ES.
+
+#ifndef MODEL_DEFS_H
+#define MODEL_DEFS_H
+
+#include <assert.h>
+
+#define MODEL_SPF3000ES 3000
+#define MODEL_SPF5000ES 5000
+
+#ifndef INVERTER_MODEL
+#define INVERTER_MODEL MODEL_SPF5000ES
+#endif
+
+#if INVERTER_MODEL == MODEL_SPF5000ES
+
+#define MODEL_NAME               "SPF5000ES"
+#define MODEL_RATED_WATTS        5000  /* Continuous output of one inverter. */
+#define MODEL_BATTERY_VOLTS      48    /* Nominal bank voltage. */
+#define MODEL_CHARGE_VOLTS       56.0f /* Bulk charge voltage, for turning amps into watts. */
+#define MODEL_CHG_AMPS_MAX       100   /* Total (utility + solar) charge current limit. */
+#define MODEL_UTIL_AMPS_MAX      80    /* Utility charge current limit. */
+#define MODEL_UTIL_AMPS_MOD      40    /* Steady off-peak default. */
+#define MODEL_TRIP_WATTS         4800  /* Forced to the grid at this output, before the inverter's own overload handling. */
+#define MODEL_RELEASE_WATTS      4000
+#define MODEL_INPUT_REGISTERS    90    /* Documented input register map, 0-89. */
+#define MODEL_HOLDING_REGISTERS  51    /* Documented holding register map, 0-50. */
+#define MODEL_MAX_READ           125   /* Registers in one read. */
+#define MODEL_FC_WRITE_AND_READ  1     /* Serves FC23. Probed anyway, and dropped on an illegal function. */
+
+#elif INVERTER_MODEL == MODEL_SPF3000ES
+
+#define MODEL_NAME               "SPF3000ES"
+#define MODEL_RATED_WATTS        3000
+#define MODEL_BATTERY_VOLTS      24
+#define MODEL_CHARGE_VOLTS       28.0f
+#define MODEL_CHG_AMPS_MAX       80
+#define MODEL_UTIL_AMPS_MAX      60
+#define MODEL_UTIL_AMPS_MOD      30
+#define MODEL_TRIP_WATTS         2880
+#define MODEL_RELEASE_WATTS      2400
+#define MODEL_INPUT_REGISTERS    90
+#define MODEL_HOLDING_REGISTERS  51
+#define MODEL_MAX_READ           125
+#define MODEL_FC_WRITE_AND_READ  0     /* Unconfirmed. Plain writes, verified on the next pass. */
+
+#else
+#error "Unknown INVERTER_MODEL. Use MODEL_SPF3000ES or MODEL_SPF5000ES."
+#endif
+
+//A profile that doesn't hang together fails the build rather than the inverter.
+static_assert(MODEL_UTIL_AMPS_MAX <= MODEL_CHG_AMPS_MAX, "Utility charge limit above the total charge limit");
+static_assert(MODEL_UTIL_AMPS_MOD <= MODEL_UTIL_AMPS_MAX, "Off-peak default above the utility charge limit");
+static_assert(MODEL_RELEASE_WATTS < MODEL_TRIP_WATTS, "Overload release must be below the trip");
+static_assert(MODEL_TRIP_WATTS < MODEL_RATED_WATTS, "Overload trip must be below the rating");
+static_assert(MODEL_MAX_READ >= 1 && MODEL_MAX_READ <= 125, "MODBUS reads are 1-125 registers");
+static_assert(MODEL_INPUT_REGISTERS <= MODEL_MAX_READ, "Input register map must be readable in one go");
+static_assert(MODEL_HOLDING_REGISTERS <= MODEL_MAX_READ, "Holding register image must be readable in one go");
+
+#endif
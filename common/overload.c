@@ -0,0 +1,111 @@
+
+#include <string.h>
+#include "overload.h"
+
+void overload_DefaultConfig(struct OverloadConfig* pConfig)
+{
+    pConfig->nTripWatts = OVERLOAD_TRIP_WATTS;
+    pConfig->nReleaseWatts = OVERLOAD_RELEASE_WATTS;
+    pConfig->nTripPercent = OVERLOAD_TRIP_PERCENT;
+    pConfig->nReleasePercent = OVERLOAD_RELEASE_PERCENT;
+    pConfig->lTripTotalWatts = OVERLOAD_TRIP_TOTAL_WATTS;
+    pConfig->lReleaseTotalWatts = OVERLOAD_RELEASE_TOTAL_WATTS;
+    pConfig->llHoldMs = (int64_t)OVERLOAD_HOLD_S * 1000;
+}
+
+void overload_Initialise(struct OverloadEngine* pEngine, const struct OverloadConfig* pConfig)
+{
+    memset(pEngine, 0x00, sizeof(struct OverloadEngine));
+    pEngine->config = *pConfig;
+}
+
+uint8_t overload_Evaluate(struct OverloadEngine* pEngine,
+                          const struct OverloadSample* pSamples,
+                          uint8_t cCount,
+                          int64_t llNowMs)
+{
+    const struct OverloadConfig* pConfig = &pEngine->config;
+    bool bTrip = false;
+    bool bHigh = false;
+    uint32_t lTotalWatts = 0;
+    
+    //Compare in raw 0.1 units to save dividing every sample.
+    for(uint8_t i = 0; i < cCount; i++)
+    {
+        uint32_t lWatts = pSamples[i].nOutputWatts;
+        uint32_t lPercent = pSamples[i].nLoadPercent;
+        lTotalWatts += lWatts;
+        
+        if(lWatts >= (uint32_t)pConfig->nTripWatts * 10 || lPercent >= (uint32_t)pConfig->nTripPercent * 10)
+            bTrip = true;
+            
+        if(lWatts > (uint32_t)pConfig->nReleaseWatts * 10 || lPercent > (uint32_t)pConfig->nReleasePercent * 10)
+            bHigh = true;
+    }
+    
+    if(lTotalWatts >= pConfig->lTripTotalWatts * 10)
+        bTrip = true;
+        
+    if(lTotalWatts > pConfig->lReleaseTotalWatts * 10)
+        bHigh = true;
+    
+    if(!pEngine->bTripped)
+    {
+        if(bTrip)
+        {
+            pEngine->bTripped = true;
+            pEngine->bBelowRelease = false;
+            pEngine->llHoldUntilMs = llNowMs + pConfig->llHoldMs;
+            pEngine->lTrips++;
+            return OVERLOAD_TRIP;
+        }
+    }
+    else if(bHigh)
+    {
+        //Still above the release threshold. Keep holding.
+        pEngine->llHoldUntilMs = llNowMs + pConfig->llHoldMs;
+        
+        //Counted once each time it comes back up, not on every high sample.
+        if(pEngine->bBelowRelease)
+        {
+            pEngine->bBelowRelease = false;
+            pEngine->lExtensions++;
+        }
+    }
+    else if(llNowMs < pEngine->llHoldUntilMs)
+    {
+        pEngine->bBelowRelease = true;
+    }
+    else
+    {
+        pEngine->bTripped = false;
+        pEngine->bAwaitingWrite = false;
+        return OVERLOAD_RELEASE;
+    }
+    
+    return OVERLOAD_NONE;
+}
+
+void overload_Reset(struct OverloadEngine* pEngine)
+{
+    pEngine->bTripped = false;
+    pEngine->bAwaitingWrite = false;
+}
+
+void overload_SwitchIssued(struct OverloadEngine* pEngine, int64_t llNowMs)
+{
+    pEngine->bAwaitingWrite = true;
+    pEngine->llSwitchMs = llNowMs;
+}
+
+void overload_WriteCompleted(struct OverloadEngine* pEngine, int64_t llNowMs)
+{
+    if(pEngine->bAwaitingWrite)
+    {
+        pEngine->bAwaitingWrite = false;
+        pEngine->lLastLatencyMs = (uint32_t)(llNowMs - pEngine->llSwitchMs);
+        
+        if(pEngine->lLastLatencyMs > pEngine->lMaxLatencyMs)
+            pEngine->lMaxLatencyMs = pEngine->lLastLatencyMs;
+    }
+}
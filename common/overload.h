@@ -0,0 +1,75 @@
+
+//Overload protection engine.
+//Evaluates every sample of per-inverter and total output load against trip and release
+//thresholds with hysteresis, and holds grid bypass until the load has stayed low long enough.
+
+#ifndef OVERLOAD_H
+#define OVERLOAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "system_defs.h"
+
+#define OVERLOAD_NONE     0   /* Nothing to do. */
+#define OVERLOAD_TRIP     1   /* Switch to grid bypass now. */
+#define OVERLOAD_RELEASE  2   /* Safe to return to batteries. */
+
+struct OverloadConfig
+{
+    uint16_t nTripWatts;          //Per inverter, W.
+    uint16_t nReleaseWatts;
+    uint16_t nTripPercent;        //Per inverter, % of capacity.
+    uint16_t nReleasePercent;
+    uint32_t lTripTotalWatts;     //All inverters together, W.
+    uint32_t lReleaseTotalWatts;
+    int64_t llHoldMs;             //Minimum time to hold bypass after the load was last high.
+};
+
+struct OverloadSample
+{
+    uint16_t nOutputWatts;        //Raw OUTPUT_WATTS_L (0.1W).
+    uint16_t nLoadPercent;        //Raw LOAD_PERCENT (0.1%).
+};
+
+struct OverloadEngine
+{
+    struct OverloadConfig config;
+    bool bTripped;
+    int64_t llHoldUntilMs;        //Bypass is held until at least this time.
+    int64_t llSwitchMs;           //Sample the last bypass switch was issued on.
+    bool bAwaitingWrite;          //Bypass switch issued, but its write hasn't completed yet.
+    bool bBelowRelease;           //Tripped, and the last sample was below the release thresholds.
+    uint32_t lTrips;
+    uint32_t lExtensions;         //Times the load came back above release during the hold, pushing it out.
+    uint32_t lLastLatencyMs;      //Bypass switch issued to its write completing.
+    uint32_t lMaxLatencyMs;
+};
+
+void overload_DefaultConfig(struct OverloadConfig* pConfig);
+void overload_Initialise(struct OverloadEngine* pEngine, const struct OverloadConfig* pConfig);
+
+/**
+ * Evaluate one sample from each of cCount inverters at monotonic time llNowMs.
+ * Returns OVERLOAD_NONE, OVERLOAD_TRIP or OVERLOAD_RELEASE.
+ */
+uint8_t overload_Evaluate(struct OverloadEngine* pEngine,
+                          const struct OverloadSample* pSamples,
+                          uint8_t cCount,
+                          int64_t llNowMs);
+
+/**
+ * Forget any trip in progress, e.g. when the user has manually chosen a mode.
+ */
+void overload_Reset(struct OverloadEngine* pEngine);
+
+/**
+ * Call when a bypass switch is issued because of a trip, from the sample at llNowMs.
+ */
+void overload_SwitchIssued(struct OverloadEngine* pEngine, int64_t llNowMs);
+
+/**
+ * Call when the bypass write following overload_SwitchIssued has succeeded, to record the latency.
+ */
+void overload_WriteCompleted(struct OverloadEngine* pEngine, int64_t llNowMs);
+
+#endif
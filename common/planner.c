@@ -0,0 +1,119 @@
+
+#include "planner.h"
+#include "utils.h"
+
+uint16_t planner_CalculateAmps(uint16_t nSoc, uint16_t nBatteryVolts, int lMinutesLeft, float fltEfficiency)
+{
+    //Full (or confused). Keep a trickle going so the BMS can carry on balancing.
+    if(nSoc >= 100)
+        return CHARGE_MIN_AMPS;
+    
+    //Fall back to the nominal charge voltage if the measured one is nonsense.
+    float fltVolts = (float)nBatteryVolts / 100.0f;
+    
+    if(fltVolts < PLANNER_VOLTS_MIN || fltVolts > PLANNER_VOLTS_MAX)
+        fltVolts = CHARGE_VOLTAGE;
+        
+    if(fltEfficiency < GW_WORST_CASE_CHARGE_EFFICIENCY || fltEfficiency > 1.0f)
+        fltEfficiency = GW_WORST_CASE_CHARGE_EFFICIENCY;
+    
+    int lMinutes = lMinutesLeft - PLANNER_MARGIN_MINUTES;
+    
+    if(lMinutes < PLANNER_MIN_MINUTES)
+        lMinutes = PLANNER_MIN_MINUTES;
+        
+    float fltEnergyToCharge = ((float)(100 - nSoc) / 100.0f) * (float)BATTERY_CAPACITY_WH / fltEfficiency;
+    float fltChargeCurrent = fltEnergyToCharge / fltVolts / ((float)lMinutes / 60.0f);
+    
+    //Charge current is shared by the inverters. Round up, so the plan is never short.
+    float fltPerInverter = fltChargeCurrent / (float)INVERTER_COUNT;
+    
+    if(fltPerInverter > (float)GW_CFG_UTIL_AMPS_MAX)
+        return GW_CFG_UTIL_AMPS_MAX;
+    
+    uint16_t nResult = (uint16_t)fltPerInverter;
+    
+    if((float)nResult < fltPerInverter)
+        nResult++;
+        
+    if(nResult < CHARGE_MIN_AMPS)
+        nResult = CHARGE_MIN_AMPS;
+    
+    return nResult;
+}
+
+static uint16_t planner_Plan(struct ChargePlanner* pPlanner, struct SystemStatus* pStatus, int32_t slNow, int lMinutesLeft)
+{
+    pPlanner->slLastPlan = slNow;
+    
+    //No SoC from the batteries. Best guess from the energy used, which is for the whole bank.
+    if(0 == pStatus->nBatterySoc)
+    {
+        uint16_t nResult = (utils_GetOffpeakChargingAmps(pStatus) + INVERTER_COUNT - 1) / INVERTER_COUNT;
+        
+        if(nResult < CHARGE_MIN_AMPS)
+            nResult = CHARGE_MIN_AMPS;
+        else if(nResult > GW_CFG_UTIL_AMPS_MAX)
+            nResult = GW_CFG_UTIL_AMPS_MAX;
+        
+        return nResult;
+    }
+    
+    //Measure efficiency once enough has gone in to make it meaningful.
+    if(pPlanner->fltDeliveredWh >= PLANNER_MIN_MEASURE_WH && pStatus->nBatterySoc > pPlanner->nStartSoc)
+    {
+        float fltStoredWh = ((float)(pStatus->nBatterySoc - pPlanner->nStartSoc) / 100.0f) * (float)BATTERY_CAPACITY_WH;
+        pPlanner->fltEfficiency = fltStoredWh / pPlanner->fltDeliveredWh;
+        
+        if(pPlanner->fltEfficiency > 1.0f)
+            pPlanner->fltEfficiency = 1.0f;
+        else if(pPlanner->fltEfficiency < GW_WORST_CASE_CHARGE_EFFICIENCY)
+            pPlanner->fltEfficiency = GW_WORST_CASE_CHARGE_EFFICIENCY;
+    }
+    
+    return planner_CalculateAmps(pStatus->nBatterySoc, pStatus->nBatteryVolts, lMinutesLeft, pPlanner->fltEfficiency);
+}
+
+uint16_t planner_Start(struct ChargePlanner* pPlanner, struct SystemStatus* pStatus, int32_t slNow, int lMinutesLeft)
+{
+    pPlanner->slLastSample = slNow;
+    pPlanner->nStartSoc = pStatus->nBatterySoc;
+    pPlanner->fltDeliveredWh = 0.0f;
+    pPlanner->fltEfficiency = GW_WORST_CASE_CHARGE_EFFICIENCY;
+    pPlanner->nAmps = planner_Plan(pPlanner, pStatus, slNow, lMinutesLeft);
+    
+    return pPlanner->nAmps;
+}
+
+bool planner_Update(struct ChargePlanner* pPlanner,
+                    struct SystemStatus* pStatus,
+                    const uint16_t* pChargeAmps,
+                    int32_t slNow,
+                    int lMinutesLeft)
+{
+    int32_t slElapsed = slNow - pPlanner->slLastSample;
+    pPlanner->slLastSample = slNow;
+    
+    if(slElapsed > 0 && slElapsed <= PLANNER_MAX_SAMPLE_S)
+    {
+        uint32_t lChargeAmps = 0;
+        
+        for(uint8_t i = 0; i < INVERTER_COUNT; i++)
+            lChargeAmps += pChargeAmps[i];
+        
+        //Battery volts (0.01V) * every inverter's charge amps (0.1A).
+        float fltWatts = ((float)pStatus->nBatteryVolts / 100.0f) * ((float)lChargeAmps / 10.0f);
+        pPlanner->fltDeliveredWh += fltWatts * (float)slElapsed / 3600.0f;
+    }
+    
+    if(slNow - pPlanner->slLastPlan < PLANNER_REPLAN_S)
+        return false;
+        
+    uint16_t nAmps = planner_Plan(pPlanner, pStatus, slNow, lMinutesLeft);
+    
+    if(nAmps == pPlanner->nAmps)
+        return false;
+        
+    pPlanner->nAmps = nAmps;
+    return true;
+}
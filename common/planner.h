@@ -0,0 +1,54 @@
+
+//SoC-aware off-peak charge planner.
+//Works out the lowest per-inverter utility charge current that still gets the batteries full by
+//the end of off-peak, and re-plans every few minutes as the measured SoC and efficiency come in.
+
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "spf5000es_defs.h"
+#include "system_defs.h"
+
+#define PLANNER_REPLAN_S          300   /* Seconds between re-plans during off-peak. */
+#define PLANNER_MARGIN_MINUTES    30    /* Aim to be full this long before off-peak ends, to allow for absorption. */
+#define PLANNER_MIN_MINUTES       15    /* Never plan over a shorter window than this. */
+#define PLANNER_MAX_SAMPLE_S      60    /* Longest gap between samples that will be integrated. */
+#define PLANNER_MIN_MEASURE_WH    500.0f /* Delivered energy needed before the measured efficiency is trusted. */
+#define PLANNER_VOLTS_MIN         (MODEL_BATTERY_VOLTS * 0.75f) /* Battery voltage readings outside these are nonsense. */
+#define PLANNER_VOLTS_MAX         (MODEL_BATTERY_VOLTS * 1.25f)
+
+struct ChargePlanner
+{
+    int32_t slLastSample;     //Time of the last integrated sample.
+    int32_t slLastPlan;       //Time of the last (re-)plan.
+    uint16_t nStartSoc;       //SoC when off-peak started.
+    float fltDeliveredWh;     //Energy delivered into the batteries since off-peak started.
+    float fltEfficiency;      //Measured charge efficiency (stored / delivered).
+    uint16_t nAmps;           //Planned per-inverter utility charge current.
+};
+
+/**
+ * Pure calculation of the lowest per-inverter charge current that reaches 100% SoC in lMinutesLeft.
+ * nBatteryVolts is the raw register value (0.01V).
+ */
+uint16_t planner_CalculateAmps(uint16_t nSoc, uint16_t nBatteryVolts, int lMinutesLeft, float fltEfficiency);
+
+/**
+ * Call when off-peak starts. Plans straight away and returns the planned per-inverter amps.
+ */
+uint16_t planner_Start(struct ChargePlanner* pPlanner, struct SystemStatus* pStatus, int32_t slNow, int lMinutesLeft);
+
+/**
+ * Call on every sample during off-peak. Integrates delivered energy and re-plans every PLANNER_REPLAN_S.
+ * pChargeAmps is each inverter's raw BATTCHG_AMPS (0.1A), INVERTER_COUNT long.
+ * Returns true if the planned amps changed.
+ */
+bool planner_Update(struct ChargePlanner* pPlanner,
+                    struct SystemStatus* pStatus,
+                    const uint16_t* pChargeAmps,
+                    int32_t slNow,
+                    int lMinutesLeft);
+
+#endif
@@ -0,0 +1,130 @@
+
+#include <string.h>
+#include "pollplan.h"
+
+//Indexed by STATUS_FIELD_*, as the server fills SystemStatus.
+static const uint16_t fieldRegs[STATUS_FIELD_COUNT] =
+{
+    STATUS,
+    PV1_VOLTS,
+    PV1_CHARGE_WATTS_L,
+    OUTPUT_WATTS_L,
+    OUTPUT_APPPWR_L,
+    AC_CHARGE_WATTS_L,
+    BATTERY_VOLTS,
+    BATTERY_SOC,
+    BUS_VOLTS,
+    GRID_VOLTS,
+    GRID_FREQ,
+    AC_OUT_VOLTS,
+    AC_OUT_FREQ,
+    INVERTER_TEMP,
+    DCDC_TEMP,
+    LOAD_PERCENT,
+    BUCK1_TEMP,
+    BUCK2_TEMP,
+    OUTPUT_AMPS,
+    INVERTER_AMPS,
+    AC_INPUT_WATTS_L,
+    EGY1GEN_TODAY_L,
+    ACCHGEGY_TODAY_L,
+    BATTUSE_TODAY_L,
+    AC_USE_TODAY_L,
+    BATTCHG_AMPS,
+    AC_USE_WATTS_L,
+    BATTUSE_WATTS_L,
+    BATT_WATTS_L,
+    INV_FANSPEED
+};
+
+//Control, events, planning, history and fault capture, on every inverter.
+static const uint16_t criticalRegs[] =
+{
+    STATUS,
+    OUTPUT_WATTS_L,
+    BATTERY_VOLTS,
+    BATTERY_SOC,
+    BUS_VOLTS,
+    GRID_VOLTS,
+    GRID_FREQ,
+    LOAD_PERCENT,
+    FAULTBIT,
+    WARNBIT,
+    FAULTVALUE,
+    WARNVALUE,
+    DTC,
+    ACCHGEGY_TODAY_L,
+    BATTCHG_AMPS
+};
+
+uint16_t pollplan_FieldRegister(uint8_t cField)
+{
+    return cField < STATUS_FIELD_COUNT ? fieldRegs[cField] : STATUS;
+}
+
+bool pollplan_Critical(uint16_t nAddress)
+{
+    for(size_t i = 0; i < sizeof(criticalRegs) / sizeof(criticalRegs[0]); i++)
+    {
+        if(criticalRegs[i] == nAddress)
+            return true;
+    }
+
+    return false;
+}
+
+void pollplan_Build(struct PollPlan* pPlan, uint32_t lFields)
+{
+    bool bWanted[INPUT_REGISTER_COUNT];
+
+    memset(pPlan, 0x00, sizeof(struct PollPlan));
+    pPlan->lFields = lFields & STATUS_FIELD_ALL;
+
+    for(uint16_t i = 0; i < INPUT_REGISTER_COUNT; i++)
+        bWanted[i] = pollplan_Critical(i);
+
+    for(uint8_t i = 0; i < STATUS_FIELD_COUNT; i++)
+    {
+        if(pPlan->lFields & STATUS_FIELD_BIT(i))
+            bWanted[fieldRegs[i]] = true;
+    }
+
+    uint16_t nAddress = 0;
+
+    while(nAddress < INPUT_REGISTER_COUNT)
+    {
+        if(!bWanted[nAddress])
+        {
+            nAddress++;
+            continue;
+        }
+
+        uint16_t nStart = nAddress;
+        uint16_t nEnd = nAddress + 1;
+
+        //Take in the next wanted register if it's close enough and the read stays in bounds.
+        for(uint16_t nNext = nEnd; nNext < INPUT_REGISTER_COUNT && nNext - nStart < MODEL_MAX_READ && nNext - nEnd <= POLLPLAN_MERGE_GAP; nNext++)
+        {
+            if(bWanted[nNext])
+                nEnd = nNext + 1;
+        }
+
+        pPlan->blocks[pPlan->cBlocks].nAddress = nStart;
+        pPlan->blocks[pPlan->cBlocks].nCount = nEnd - nStart;
+        pPlan->nRegisters += nEnd - nStart;
+        pPlan->cBlocks++;
+
+        nAddress = nEnd;
+    }
+}
+
+bool pollplan_Reads(const struct PollPlan* pPlan, uint16_t nAddress)
+{
+    for(uint8_t i = 0; i < pPlan->cBlocks; i++)
+    {
+        if(nAddress >= pPlan->blocks[i].nAddress && nAddress < pPlan->blocks[i].nAddress + pPlan->blocks[i].nCount)
+            return true;
+    }
+
+    return false;
+}
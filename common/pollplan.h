@@ -0,0 +1,55 @@
+
+//Demand-driven input register polling.
+//The server's own control, fault and history logic needs a fixed set of input registers every
+//pass. Everything else in SystemStatus is only read while a client has declared interest in it,
+//so registers nobody is looking at don't take up bus time. The wanted registers are coalesced
+//into as few reads as possible, reading across short gaps rather than starting another transaction.
+
+#ifndef POLLPLAN_H
+#define POLLPLAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "spf5000es_defs.h"
+#include "system_defs.h"
+
+#define POLLPLAN_MERGE_GAP   16       /* Unwanted registers read anyway to save a transaction. */
+#define POLLPLAN_MAX_BLOCKS  8
+
+static_assert((INPUT_REGISTER_COUNT + POLLPLAN_MERGE_GAP) / (POLLPLAN_MERGE_GAP + 1) <= POLLPLAN_MAX_BLOCKS, "Worst case plan doesn't fit");
+
+struct PollBlock
+{
+    uint16_t nAddress;
+    uint16_t nCount;
+};
+
+struct PollPlan
+{
+    uint32_t lFields;                 //STATUS_FIELD_BIT()s read on top of the critical registers.
+    uint16_t nRegisters;              //Read each pass, gaps included.
+    uint8_t cBlocks;
+    struct PollBlock blocks[POLLPLAN_MAX_BLOCKS];  //In address order.
+};
+
+/**
+ * The input register a STATUS_FIELD_* is read from.
+ */
+uint16_t pollplan_FieldRegister(uint8_t cField);
+
+/**
+ * Whether the server needs the input register every pass, whoever is interested.
+ */
+bool pollplan_Critical(uint16_t nAddress);
+
+/**
+ * Plan the reads for the critical registers plus those of lFields.
+ */
+void pollplan_Build(struct PollPlan* pPlan, uint32_t lFields);
+
+/**
+ * Whether the plan reads nAddress.
+ */
+bool pollplan_Reads(const struct PollPlan* pPlan, uint16_t nAddress);
+
+#endif
@@ -0,0 +1,63 @@
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "realtime.h"
+
+bool realtime_LockMemory()
+{
+    //Freed memory stays in the heap, and nothing big goes off to mmap where it'd be returned.
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+
+    return 0 == mlockall(MCL_CURRENT | MCL_FUTURE);
+}
+
+//Touch the stack the thread will use, while it's quiet, rather than on first use mid-transaction.
+static void realtime_PrefaultStack()
+{
+    volatile unsigned char stack[REALTIME_STACK_PREFAULT];
+
+    //A write per page is enough. Volatile, so it isn't optimised away.
+    for(unsigned int i = 0; i < sizeof(stack); i += 4096)
+        stack[i] = 0;
+}
+
+bool realtime_Enter(const struct RealtimeConfig* pConfig)
+{
+    int rc;
+
+    if(REALTIME_ANY_CPU != pConfig->lCpu)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(pConfig->lCpu, &cpus);
+
+        if(0 != (rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)))
+        {
+            errno = rc;
+            return false;
+        }
+    }
+
+    if(pConfig->lPriority > 0)
+    {
+        struct sched_param param;
+        memset(&param, 0x00, sizeof(param));
+        param.sched_priority = pConfig->lPriority;
+
+        if(0 != (rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)))
+        {
+            errno = rc;
+            return false;
+        }
+    }
+
+    realtime_PrefaultStack();
+
+    return true;
+}
@@ -0,0 +1,34 @@
+
+//Real-time mode.
+//Runs the calling thread under SCHED_FIFO, optionally pinned to one CPU, with every page locked
+//in memory and its stack faulted in up front, so neither the scheduler nor paging can stretch
+//bus timing or the reaction to an overload.
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stdbool.h>
+
+#define REALTIME_STACK_PREFAULT (256 * 1024)  /* Bytes of stack touched on entry. */
+#define REALTIME_ANY_CPU        -1
+
+struct RealtimeConfig
+{
+    int lPriority;                            //SCHED_FIFO priority, 1-99. Zero stays as is.
+    int lCpu;                                 //CPU to pin to, or REALTIME_ANY_CPU.
+};
+
+/**
+ * Lock all current and future pages in memory, and keep freed heap rather than handing it back,
+ * so nothing has to be faulted in later. Call once from main, before starting threads.
+ * Returns false with errno set on failure.
+ */
+bool realtime_LockMemory();
+
+/**
+ * Put the calling thread under pConfig and prefault its stack.
+ * Returns false with errno set if the policy or affinity couldn't be applied (usually privileges).
+ */
+bool realtime_Enter(const struct RealtimeConfig* pConfig);
+
+#endif
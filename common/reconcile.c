@@ -0,0 +1,101 @@
+
+#include <stddef.h>
+#include "reconcile.h"
+
+struct StateSettings
+{
+    uint16_t nSystemState;
+    uint8_t cCount;
+    struct RegisterSetting settings[RECONCILE_MAX_SETTINGS];
+};
+
+//What each system state expects of the inverter. Keep each state's settings in ascending register order.
+static const struct StateSettings ReconcileTable[] =
+{
+    { SYSTEM_STATE_PEAK,     2, { { GW_HREG_CFG_MODE,      GW_CFG_MODE_BATTS },
+                                  { GW_HREG_UTIL_END_HOUR, GW_CFG_UTIL_TIME_OFFPEAK } } },
+
+    { SYSTEM_STATE_BYPASS,   2, { { GW_HREG_CFG_MODE,      GW_CFG_MODE_GRID },
+                                  { GW_HREG_UTIL_END_HOUR, GW_CFG_UTIL_TIME_OFFPEAK } } },
+
+    { SYSTEM_STATE_OFF_PEAK, 3, { { GW_HREG_CFG_MODE,      GW_CFG_MODE_GRID },
+                                  { GW_HREG_UTIL_END_HOUR, GW_CFG_UTIL_TIME_ANY_TIME },
+                                  { GW_HREG_MAX_UTIL_AMPS, RECONCILE_CHARGE_CURRENT } } },
+
+    { SYSTEM_STATE_BOOST,    3, { { GW_HREG_CFG_MODE,      GW_CFG_MODE_GRID },
+                                  { GW_HREG_UTIL_END_HOUR, GW_CFG_UTIL_TIME_ANY_TIME },
+                                  { GW_HREG_MAX_UTIL_AMPS, RECONCILE_CHARGE_CURRENT } } }
+};
+
+#define RECONCILE_STATE_COUNT (sizeof(ReconcileTable) / sizeof(ReconcileTable[0]))
+
+uint8_t reconcile_GetDesired(uint16_t nSystemState, uint16_t nChargeCurrent, struct RegisterSetting* pDesired)
+{
+    for(uint8_t i = 0; i < RECONCILE_STATE_COUNT; i++)
+    {
+        if(ReconcileTable[i].nSystemState == nSystemState)
+        {
+            for(uint8_t j = 0; j < ReconcileTable[i].cCount; j++)
+            {
+                pDesired[j] = ReconcileTable[i].settings[j];
+
+                if(RECONCILE_CHARGE_CURRENT == pDesired[j].nValue)
+                    pDesired[j].nValue = nChargeCurrent;
+            }
+
+            return ReconcileTable[i].cCount;
+        }
+    }
+
+    return 0;
+}
+
+uint8_t reconcile_Diff(const struct RegisterSetting* pDesired,
+                       uint8_t cDesiredCount,
+                       const uint16_t* pHoldingRegs,
+                       struct ReconcileWrite* pWrites)
+{
+    uint8_t cWrites = 0;
+
+    for(uint8_t i = 0; i < cDesiredCount; i++)
+    {
+        uint16_t nRegister = pDesired[i].nRegister;
+
+        //Out of the image, or already as desired.
+        if(nRegister >= GW_HREG_COUNT || pHoldingRegs[nRegister] == pDesired[i].nValue)
+            continue;
+
+        pWrites[cWrites].nAddress = nRegister;
+        pWrites[cWrites].nCount = 1;
+        pWrites[cWrites].nValues[0] = pDesired[i].nValue;
+        cWrites++;
+    }
+
+    return cWrites;
+}
+
+bool reconcile_Owned(const struct RegisterSetting* pDesired, uint8_t cDesiredCount, const struct ReconcileWrite* pWrite)
+{
+    for(uint16_t i = 0; i < pWrite->nCount; i++)
+    {
+        bool bOwned = false;
+
+        for(uint8_t j = 0; j < cDesiredCount && !bOwned; j++)
+        {
+            bOwned = pDesired[j].nRegister == pWrite->nAddress + i && pDesired[j].nValue == pWrite->nValues[i];
+        }
+
+        if(!bOwned)
+            return false;
+    }
+
+    return true;
+}
+
+void reconcile_Apply(const struct ReconcileWrite* pWrite, uint16_t* pHoldingRegs)
+{
+    for(uint16_t i = 0; i < pWrite->nCount && pWrite->nAddress + i < GW_HREG_COUNT; i++)
+    {
+        pHoldingRegs[pWrite->nAddress + i] = pWrite->nValues[i];
+    }
+}
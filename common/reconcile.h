@@ -0,0 +1,57 @@
+
+//Desired-state reconciliation of the inverter's holding registers.
+//Each SYSTEM_STATE_* declares the holding register values it expects. The observed
+//register image is diffed against them to produce the fewest writes that will fix it.
+
+#ifndef RECONCILE_H
+#define RECONCILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "spf5000es_defs.h"
+#include "system_defs.h"
+
+#define RECONCILE_CHARGE_CURRENT 0xFFFF /* Table placeholder for the state's planned charge current. */
+#define RECONCILE_MAX_SETTINGS   4      /* Most holding registers any one state cares about. */
+
+struct RegisterSetting
+{
+    uint16_t nRegister;
+    uint16_t nValue;
+};
+
+struct ReconcileWrite
+{
+    uint16_t nAddress;                 //First holding register to write.
+    uint16_t nCount;                   //Number of contiguous registers to write.
+    uint16_t nValues[GW_HREG_COUNT];   //Values to write.
+};
+
+/**
+ * Fill pDesired with the holding register settings for nSystemState, in ascending register order.
+ * Returns the number of settings, or zero for an unknown state.
+ */
+uint8_t reconcile_GetDesired(uint16_t nSystemState, uint16_t nChargeCurrent, struct RegisterSetting* pDesired);
+
+/**
+ * Diff the desired settings against the observed holding register image (GW_HREG_COUNT long).
+ * Each setting that differs is its own single register write. pWrites must have room for cDesiredCount entries.
+ * Returns the number of writes required (zero when the inverter already matches).
+ */
+uint8_t reconcile_Diff(const struct RegisterSetting* pDesired,
+                       uint8_t cDesiredCount,
+                       const uint16_t* pHoldingRegs,
+                       struct ReconcileWrite* pWrites);
+
+/**
+ * Whether every register pWrite covers is one of the desired settings, written with its setting.
+ * Only then is the write right for any inverter in that state, whatever its own image holds.
+ */
+bool reconcile_Owned(const struct RegisterSetting* pDesired, uint8_t cDesiredCount, const struct ReconcileWrite* pWrite);
+
+/**
+ * Apply a completed write to the observed holding register image.
+ */
+void reconcile_Apply(const struct ReconcileWrite* pWrite, uint16_t* pHoldingRegs);
+
+#endif
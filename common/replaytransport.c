@@ -0,0 +1,274 @@
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "replaytransport.h"
+#include "clocksync.h"
+
+//Rebuild each inverter's registers from the record. Everything else reads as zero.
+static void replaytransport_Build(struct ReplayTransport* pReplay)
+{
+    const struct HistoryRecord* pRecord = &pReplay->record;
+
+    for(int i = 0; i < INVERTER_COUNT; i++)
+    {
+        uint16_t* pRegs = pReplay->inputRegs[i];
+        memset(pRegs, 0x00, sizeof(pReplay->inputRegs[i]));
+
+        if(SYSTEM_STATE_PEAK == pRecord->nSystemState)
+            pRegs[STATUS] = DISCHARGE;
+        else
+            pRegs[STATUS] = pRecord->nBattchgAmps[i] > 0 ? AC_CHG_BYP : BYPASS;
+
+        pRegs[OUTPUT_WATTS_L] = pRecord->nOutputWatts[i];
+        pRegs[BATTERY_VOLTS] = pRecord->nBatteryVolts;
+        pRegs[BATTERY_SOC] = pRecord->nBatterySoc;
+        pRegs[GRID_VOLTS] = pRecord->nGridVolts;
+        pRegs[GRID_FREQ] = pRecord->nGridFreq;
+        pRegs[AC_OUT_VOLTS] = 2300;
+        pRegs[AC_OUT_FREQ] = 5000;
+        pRegs[LOAD_PERCENT] = pRecord->nLoadPercent[i];
+        pRegs[ACCHGEGY_TODAY_L] = pRecord->nAcchgegyToday;
+        pRegs[BATTCHG_AMPS] = pRecord->nBattchgAmps[i];
+        pRegs[SLAVE_COUNT] = INVERTER_COUNT - 1;
+    }
+}
+
+bool replaytransport_Next(struct ReplayTransport* pReplay)
+{
+    char line[HISTORY_LINE_MAX];
+    bool bRewound = false;
+
+    while(true)
+    {
+        if(NULL == fgets(line, sizeof(line), pReplay->pFile))
+        {
+            //Nothing after going round once. There's nothing to serve.
+            if(bRewound)
+                return false;
+
+            rewind(pReplay->pFile);
+            bRewound = true;
+
+            if(pReplay->lRecords > 0)
+                pReplay->lLaps++;
+
+            continue;
+        }
+
+        if(history_Parse(line, &pReplay->record))
+            break;
+    }
+
+    pReplay->lRecords++;
+    pReplay->bServed = false;
+    replaytransport_Build(pReplay);
+
+    return true;
+}
+
+static int replaytransport_Connect(void* pContext)
+{
+    struct ReplayTransport* pReplay = pContext;
+
+    if(NULL == pReplay->pFile)
+        pReplay->pFile = fopen(pReplay->path, "r");
+
+    if(NULL == pReplay->pFile)
+        return -1;
+
+    if(!replaytransport_Next(pReplay))
+    {
+        errno = ENODATA;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void replaytransport_Free(void* pContext)
+{
+    struct ReplayTransport* pReplay = pContext;
+
+    if(NULL != pReplay->pFile)
+        fclose(pReplay->pFile);
+
+    pReplay->pFile = NULL;
+}
+
+static int replaytransport_SetSlave(void* pContext, int lSlave)
+{
+    ((struct ReplayTransport*)pContext)->lSlave = lSlave;
+    return 0;
+}
+
+static void replaytransport_SetDebug(void* pContext, bool bDebug)
+{
+    ((struct ReplayTransport*)pContext)->bDebug = bDebug;
+}
+
+//The inverter currently addressed, or -1 with errno set as though it didn't answer.
+static int replaytransport_Unit(const struct ReplayTransport* pReplay)
+{
+    int lUnit = pReplay->lSlave - INVERTER_1_ID;
+
+    if(NULL == pReplay->pFile || lUnit < 0 || lUnit >= INVERTER_COUNT)
+    {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    return lUnit;
+}
+
+static int replaytransport_Copy(const uint16_t* pRegs, int lMapSize, int lSpace, int lAddress, int lCount, uint16_t* pDest)
+{
+    if(lAddress < 0 || lCount < 1 || lAddress + lCount > lSpace)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for(int i = 0; i < lCount; i++)
+        pDest[i] = lAddress + i < lMapSize ? pRegs[lAddress + i] : 0;
+
+    return lCount;
+}
+
+static int replaytransport_ReadInput(void* pContext, int lAddress, int lCount, uint16_t* pDest)
+{
+    struct ReplayTransport* pReplay = pContext;
+    int lUnit = replaytransport_Unit(pReplay);
+
+    if(-1 == lUnit)
+        return -1;
+
+    //A new pass. On to the next record, once this one's been seen.
+    if(0 == lUnit && 0 == lAddress)
+    {
+        if(pReplay->bServed && !replaytransport_Next(pReplay))
+        {
+            errno = ENODATA;
+            return -1;
+        }
+
+        pReplay->bServed = true;
+    }
+
+    if(pReplay->bDebug)
+        printf("Replay: read input %d-%d from slave %d, record %u\n", lAddress, lAddress + lCount - 1, pReplay->lSlave, pReplay->lRecords);
+
+    return replaytransport_Copy(pReplay->inputRegs[lUnit], INPUT_REGISTER_COUNT, REPLAYTRANSPORT_INPUT_SPACE, lAddress, lCount, pDest);
+}
+
+static int replaytransport_ReadHolding(void* pContext, int lAddress, int lCount, uint16_t* pDest)
+{
+    struct ReplayTransport* pReplay = pContext;
+    int lUnit = replaytransport_Unit(pReplay);
+
+    if(-1 == lUnit)
+        return -1;
+
+    //The recording's time has long gone. Keep the clock on the real one, so it's never corrected.
+    clocksync_ToRegisters(time(NULL), true, &pReplay->holdingRegs[lUnit][GW_HREG_TIME_Y]);
+
+    return replaytransport_Copy(pReplay->holdingRegs[lUnit], GW_HREG_COUNT, GW_HREG_COUNT, lAddress, lCount, pDest);
+}
+
+static int replaytransport_WriteMultiple(void* pContext, int lAddress, int lCount, const uint16_t* pValues)
+{
+    struct ReplayTransport* pReplay = pContext;
+    int lUnit = replaytransport_Unit(pReplay);
+
+    if(-1 == lUnit)
+        return -1;
+
+    if(lAddress < 0 || lCount < 1 || lAddress + lCount > GW_HREG_COUNT)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(pReplay->bDebug)
+        printf("Replay: write holding %d-%d to slave %d\n", lAddress, lAddress + lCount - 1, pReplay->lSlave);
+
+    memcpy(&pReplay->holdingRegs[lUnit][lAddress], pValues, lCount * sizeof(uint16_t));
+    return lCount;
+}
+
+static int replaytransport_WriteSingle(void* pContext, int lAddress, uint16_t nValue)
+{
+    return replaytransport_WriteMultiple(pContext, lAddress, 1, &nValue);
+}
+
+static int replaytransport_WriteAndRead(void* pContext, int lWriteAddress, int lWriteCount, const uint16_t* pValues,
+                                        int lReadAddress, int lReadCount, uint16_t* pDest)
+{
+    if(-1 == replaytransport_WriteMultiple(pContext, lWriteAddress, lWriteCount, pValues))
+        return -1;
+
+    return replaytransport_ReadHolding(pContext, lReadAddress, lReadCount, pDest);
+}
+
+static int replaytransport_Broadcast(void* pContext, int lAddress, int lCount, const uint16_t* pValues)
+{
+    struct ReplayTransport* pReplay = pContext;
+
+    if(NULL == pReplay->pFile)
+    {
+        errno = ENOTCONN;
+        return -1;
+    }
+
+    if(lAddress < 0 || lCount < 1 || lAddress + lCount > GW_HREG_COUNT)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if(pReplay->bDebug)
+        printf("Replay: broadcast holding %d-%d\n", lAddress, lAddress + lCount - 1);
+
+    for(int i = 0; i < INVERTER_COUNT; i++)
+        memcpy(&pReplay->holdingRegs[i][lAddress], pValues, lCount * sizeof(uint16_t));
+
+    return lCount;
+}
+
+static const char* replaytransport_StrError(int lError)
+{
+    return strerror(lError);
+}
+
+static const struct TransportOps replayOps =
+{
+    replaytransport_Connect,
+    replaytransport_Free,
+    replaytransport_SetSlave,
+    replaytransport_SetDebug,
+    replaytransport_ReadInput,
+    replaytransport_ReadHolding,
+    replaytransport_WriteSingle,
+    replaytransport_WriteMultiple,
+    replaytransport_WriteAndRead,
+    replaytransport_Broadcast,
+    replaytransport_StrError,
+    NULL
+};
+
+void replaytransport_Initialise(struct Transport* pTransport, struct ReplayTransport* pReplay, const char* pPath)
+{
+    memset(pReplay, 0x00, sizeof(struct ReplayTransport));
+    snprintf(pReplay->path, sizeof(pReplay->path), "%s", pPath);
+    pReplay->lSlave = INVERTER_1_ID;
+
+    //As the inverters would be found.
+    for(int i = 0; i < INVERTER_COUNT; i++)
+    {
+        pReplay->holdingRegs[i][GW_HREG_CFG_MODE] = GW_CFG_MODE_BATTS;
+        pReplay->holdingRegs[i][GW_HREG_UTIL_END_HOUR] = GW_CFG_UTIL_TIME_OFFPEAK;
+        pReplay->holdingRegs[i][GW_HREG_MAX_UTIL_AMPS] = GW_CFG_UTIL_AMPS_MOD;
+    }
+
+    transport_Initialise(pTransport, TRANSPORT_REPLAY, pPath, &replayOps, pReplay);
+}
@@ -0,0 +1,48 @@
+
+//File replay transport.
+//Serves register images rebuilt from a recorded history file, stepping on a record each time
+//the master's input registers are read from the start, and going round again at the end.
+//Writes are kept, so the server sees its own config read back. No device needed, and as fast
+//as the server can go, which makes it the one to benchmark with.
+
+#ifndef REPLAYTRANSPORT_H
+#define REPLAYTRANSPORT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "transport.h"
+#include "history.h"
+#include "spf5000es_defs.h"
+#include "system_defs.h"
+
+#define REPLAYTRANSPORT_PATH_MAX    256
+#define REPLAYTRANSPORT_INPUT_SPACE 720     /* Input addresses that can be read. Past the recorded map reads as zero. */
+
+struct ReplayTransport
+{
+    char path[REPLAYTRANSPORT_PATH_MAX];
+    FILE* pFile;
+    int lSlave;
+    bool bDebug;
+    struct HistoryRecord record;              //The one being served.
+    bool bServed;                             //It's been read, so the next pass moves on.
+    uint16_t inputRegs[INVERTER_COUNT][INPUT_REGISTER_COUNT];
+    uint16_t holdingRegs[INVERTER_COUNT][GW_HREG_COUNT];
+    uint32_t lRecords;                        //Served so far.
+    uint32_t lLaps;                           //Times round the file.
+};
+
+/**
+ * Set up pTransport to replay the history file at pPath, keeping its state in pReplay.
+ * The file isn't opened until it's connected.
+ */
+void replaytransport_Initialise(struct Transport* pTransport, struct ReplayTransport* pReplay, const char* pPath);
+
+/**
+ * Step on to the next record, going round to the first at the end of the file.
+ * Returns false if the file has no records at all.
+ */
+bool replaytransport_Next(struct ReplayTransport* pReplay);
+
+#endif
@@ -0,0 +1,400 @@
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include "rtu.h"
+
+#define RTU_FC_READ_HOLDING   0x03
+#define RTU_FC_READ_INPUT     0x04
+#define RTU_FC_WRITE_SINGLE   0x06
+#define RTU_FC_WRITE_MULTIPLE 0x10
+#define RTU_FC_WRITE_AND_READ 0x17
+#define RTU_FC_EXCEPTION      0x80
+
+//CRC16/MODBUS (reflected 0xA001) of every byte value.
+static const uint16_t crcTable[256] =
+{
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+    0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+    0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+    0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+    0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+    0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040
+};
+
+uint16_t rtu_Crc16(const uint8_t* pData, uint16_t nLength)
+{
+    uint16_t nCrc = 0xFFFF;
+
+    for(uint16_t i = 0; i < nLength; i++)
+        nCrc = (nCrc >> 8) ^ crcTable[(nCrc ^ pData[i]) & 0xFF];
+
+    return nCrc;
+}
+
+void rtu_Initialise(struct RtuMaster* pMaster, int fd, int lBaud)
+{
+    memset(pMaster, 0x00, sizeof(struct RtuMaster));
+    pMaster->fd = fd;
+    pMaster->state = RTU_IDLE;
+    pMaster->llCharNs = 11 * 1000000000LL / lBaud;
+    pMaster->llT15Ns = lBaud > RTU_FAST_BAUD ? RTU_FAST_T15_NS : pMaster->llCharNs * 3 / 2;
+    pMaster->llT35Ns = lBaud > RTU_FAST_BAUD ? RTU_FAST_T35_NS : pMaster->llCharNs * 7 / 2;
+    pMaster->llResponseTimeoutNs = RTU_RESPONSE_TIMEOUT_NS;
+}
+
+static bool rtu_Fail(struct RtuMaster* pMaster, int lError)
+{
+    pMaster->state = RTU_FAILED;
+    pMaster->lError = lError;
+    return true;
+}
+
+//Write as much of the frame as the fd will take.
+static bool rtu_Send(struct RtuMaster* pMaster, int64_t llNowNs)
+{
+    ssize_t lWritten = write(pMaster->fd, pMaster->request + pMaster->nSent, pMaster->nRequest - pMaster->nSent);
+
+    if(lWritten < 0 && EAGAIN != errno && EINTR != errno)
+        return rtu_Fail(pMaster, errno);
+
+    if(lWritten > 0)
+        pMaster->nSent += lWritten;
+
+    if(pMaster->nSent < pMaster->nRequest)
+    {
+        //Still going out. Give it as long as a response.
+        if(RTU_SENDING != pMaster->state)
+            pMaster->llDeadlineNs = llNowNs + pMaster->llResponseTimeoutNs;
+
+        pMaster->state = RTU_SENDING;
+        return false;
+    }
+
+    //The last character leaves the wire about now plus the frame's length.
+    pMaster->llBusyNs = llNowNs + pMaster->nRequest * pMaster->llCharNs;
+
+    if(RTU_BROADCAST == pMaster->request[0])
+    {
+        pMaster->state = RTU_DONE;
+        return true;
+    }
+
+    pMaster->state = RTU_AWAITING;
+    pMaster->llDeadlineNs = pMaster->llBusyNs + pMaster->llResponseTimeoutNs;
+    return false;
+}
+
+int rtu_Start(struct RtuMaster* pMaster, uint8_t cSlave, const uint8_t* pPdu, uint16_t nLength, int64_t llNowNs)
+{
+    if(RTU_IDLE != pMaster->state)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    if(nLength < 1 || nLength > RTU_PDU_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pMaster->request[0] = cSlave;
+    memcpy(&pMaster->request[1], pPdu, nLength);
+
+    uint16_t nCrc = rtu_Crc16(pMaster->request, nLength + 1);
+    pMaster->request[nLength + 1] = nCrc & 0xFF;
+    pMaster->request[nLength + 2] = nCrc >> 8;
+
+    pMaster->nRequest = nLength + 3;
+    pMaster->nSent = 0;
+    pMaster->nResponse = 0;
+    pMaster->nExpected = 0;
+    pMaster->lError = 0;
+    pMaster->lTransactions++;
+
+    if(llNowNs - pMaster->llBusyNs < pMaster->llT35Ns)
+    {
+        pMaster->state = RTU_SILENCE;
+        pMaster->llDeadlineNs = pMaster->llBusyNs + pMaster->llT35Ns;
+        return 0;
+    }
+
+    rtu_Send(pMaster, llNowNs);
+
+    if(RTU_FAILED == pMaster->state)
+    {
+        errno = pMaster->lError;
+        rtu_Reset(pMaster);
+        return -1;
+    }
+
+    return 0;
+}
+
+short rtu_Events(const struct RtuMaster* pMaster)
+{
+    switch(pMaster->state)
+    {
+        case RTU_SENDING: return POLLOUT;
+        case RTU_AWAITING:
+        case RTU_RECEIVING: return POLLIN;
+        default: return 0;
+    }
+}
+
+int64_t rtu_Deadline(const struct RtuMaster* pMaster)
+{
+    switch(pMaster->state)
+    {
+        case RTU_SILENCE:
+        case RTU_SENDING:
+        case RTU_AWAITING:
+        case RTU_RECEIVING: return pMaster->llDeadlineNs;
+        default: return -1;
+    }
+}
+
+//How long the whole response is, from as much of its header as has arrived. Zero if it can't say yet.
+static uint16_t rtu_Expected(const struct RtuMaster* pMaster)
+{
+    if(pMaster->nResponse < 2)
+        return 0;
+
+    uint8_t cFunction = pMaster->response[1];
+
+    if(cFunction & RTU_FC_EXCEPTION)
+        return 5;
+
+    switch(cFunction)
+    {
+        case RTU_FC_READ_HOLDING:
+        case RTU_FC_READ_INPUT:
+        case RTU_FC_WRITE_AND_READ: return pMaster->nResponse < 3 ? 0 : 5 + pMaster->response[2];
+        case RTU_FC_WRITE_SINGLE:
+        case RTU_FC_WRITE_MULTIPLE: return 8;
+        default: return 0;    //Ended by silence, as the spec has it.
+    }
+}
+
+//Check a complete response against the request.
+static bool rtu_Check(struct RtuMaster* pMaster)
+{
+    uint16_t nLength = pMaster->nExpected;
+
+    if(nLength < 4 || nLength > pMaster->nResponse)
+        return rtu_Fail(pMaster, RTU_EBADDATA);
+
+    uint16_t nCrc = rtu_Crc16(pMaster->response, nLength - 2);
+
+    if((nCrc & 0xFF) != pMaster->response[nLength - 2] || (nCrc >> 8) != pMaster->response[nLength - 1])
+        return rtu_Fail(pMaster, RTU_EBADCRC);
+
+    if(pMaster->response[0] != pMaster->request[0])
+        return rtu_Fail(pMaster, RTU_EBADSLAVE);
+
+    if(pMaster->response[1] == (pMaster->request[1] | RTU_FC_EXCEPTION))
+        return rtu_Fail(pMaster, RTU_ERRNO_BASE + pMaster->response[2]);
+
+    if(pMaster->response[1] != pMaster->request[1])
+        return rtu_Fail(pMaster, RTU_EBADDATA);
+
+    pMaster->state = RTU_DONE;
+    return true;
+}
+
+static bool rtu_Receive(struct RtuMaster* pMaster, int64_t llNowNs)
+{
+    ssize_t lRead = read(pMaster->fd, pMaster->response + pMaster->nResponse, RTU_FRAME_MAX - pMaster->nResponse);
+
+    if(lRead < 0)
+        return EAGAIN == errno || EINTR == errno ? false : rtu_Fail(pMaster, errno);
+
+    if(0 == lRead)
+        return rtu_Fail(pMaster, EIO);
+
+    //Strictly the frame's over after 1.5 characters, but adapters make gaps of their own.
+    if(pMaster->nResponse > 0 && llNowNs - pMaster->llBusyNs > pMaster->llT15Ns + lRead * pMaster->llCharNs)
+        pMaster->lGaps++;
+
+    pMaster->nResponse += lRead;
+    pMaster->llBusyNs = llNowNs;
+    pMaster->state = RTU_RECEIVING;
+    pMaster->llDeadlineNs = llNowNs + (pMaster->llT35Ns > RTU_FRAME_GAP_NS ? pMaster->llT35Ns : RTU_FRAME_GAP_NS);
+
+    if(0 == pMaster->nExpected)
+        pMaster->nExpected = rtu_Expected(pMaster);
+
+    if(pMaster->nExpected && pMaster->nResponse >= pMaster->nExpected)
+        return rtu_Check(pMaster);
+
+    if(RTU_FRAME_MAX == pMaster->nResponse)
+        return rtu_Fail(pMaster, RTU_EBADDATA);
+
+    return false;
+}
+
+bool rtu_Service(struct RtuMaster* pMaster, short nRevents, int64_t llNowNs)
+{
+    pMaster->lWakeups++;
+
+    switch(pMaster->state)
+    {
+        case RTU_SILENCE:
+        {
+            if(llNowNs >= pMaster->llDeadlineNs)
+                return rtu_Send(pMaster, llNowNs);
+        }
+        break;
+
+        case RTU_SENDING:
+        {
+            if(nRevents & POLLOUT)
+                return rtu_Send(pMaster, llNowNs);
+        }
+        break;
+
+        case RTU_AWAITING:
+        case RTU_RECEIVING:
+        {
+            if(nRevents & POLLIN)
+            {
+                if(rtu_Receive(pMaster, llNowNs))
+                    return true;
+            }
+            else if(nRevents & (POLLERR | POLLHUP))
+            {
+                return rtu_Fail(pMaster, EIO);
+            }
+        }
+        break;
+
+        case RTU_IDLE: return false;
+        default: return true;
+    }
+
+    if(llNowNs < pMaster->llDeadlineNs)
+        return false;
+
+    //Silence ends a frame whose length the header doesn't give.
+    if(RTU_RECEIVING == pMaster->state && 0 == pMaster->nExpected)
+    {
+        pMaster->nExpected = pMaster->nResponse;
+        return rtu_Check(pMaster);
+    }
+
+    pMaster->lTimeouts++;
+    return rtu_Fail(pMaster, ETIMEDOUT);
+}
+
+const uint8_t* rtu_ResponsePdu(const struct RtuMaster* pMaster, uint16_t* pLength)
+{
+    *pLength = pMaster->nExpected - 3;
+    return &pMaster->response[1];
+}
+
+void rtu_Reset(struct RtuMaster* pMaster)
+{
+    pMaster->state = RTU_IDLE;
+    pMaster->lError = 0;
+}
+
+static int64_t rtu_NowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int rtu_Run(struct RtuMaster* pMaster)
+{
+    if(RTU_IDLE == pMaster->state)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    bool bFinished = RTU_DONE == pMaster->state || RTU_FAILED == pMaster->state;
+
+    while(!bFinished)
+    {
+        struct pollfd pfd = { pMaster->fd, rtu_Events(pMaster), 0 };
+        int64_t llWaitNs = rtu_Deadline(pMaster) - rtu_NowNs();
+        struct timespec wait = { 0, 0 };
+
+        if(llWaitNs > 0)
+        {
+            wait.tv_sec = llWaitNs / 1000000000LL;
+            wait.tv_nsec = llWaitNs % 1000000000LL;
+        }
+
+        //Nothing to wait on but time, and then the fd's left out.
+        int rc = ppoll(&pfd, pfd.events ? 1 : 0, &wait, NULL);
+
+        if(rc < 0 && EINTR != errno)
+        {
+            rtu_Fail(pMaster, errno);
+            break;
+        }
+
+        bFinished = rtu_Service(pMaster, rc > 0 ? pfd.revents : 0, rtu_NowNs());
+    }
+
+    if(RTU_FAILED == pMaster->state)
+    {
+        errno = pMaster->lError;
+        return -1;
+    }
+
+    return 0;
+}
+
+const char* rtu_StrError(int lError)
+{
+    switch(lError)
+    {
+        case RTU_ERRNO_BASE + 1: return "Illegal function";
+        case RTU_ERRNO_BASE + 2: return "Illegal data address";
+        case RTU_ERRNO_BASE + 3: return "Illegal data value";
+        case RTU_ERRNO_BASE + 4: return "Slave device or server failure";
+        case RTU_ERRNO_BASE + 5: return "Acknowledge";
+        case RTU_ERRNO_BASE + 6: return "Slave device or server is busy";
+        case RTU_ERRNO_BASE + 8: return "Memory parity error";
+        case RTU_ERRNO_BASE + 10: return "Gateway path unavailable";
+        case RTU_ERRNO_BASE + 11: return "Target device failed to respond";
+        case RTU_EBADCRC: return "Invalid CRC";
+        case RTU_EBADDATA: return "Invalid data";
+        case RTU_EBADSLAVE: return "Response not from requested slave";
+        default: return strerror(lError);
+    }
+}
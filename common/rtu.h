@@ -0,0 +1,116 @@
+
+//Native MODBUS RTU master.
+//A non-blocking state machine driven by its fd: whoever owns the loop polls for rtu_Events() until
+//rtu_Deadline(), then hands whatever happened to rtu_Service(), so nothing ever blocks on the wire.
+//The CRC is table driven, and frame timing (3.5 characters of silence before sending, gaps between
+//characters, response and frame timeouts) is all kept on CLOCK_MONOTONIC. Exceptions and framing
+//errors come back as libmodbus's errno values, so callers needn't care which master is underneath.
+
+#ifndef RTU_H
+#define RTU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RTU_FRAME_MAX            256
+#define RTU_PDU_MAX              253
+#define RTU_BROADCAST            0
+
+#define RTU_FAST_BAUD            19200     /* Above this, the timings are fixed rather than in characters. */
+#define RTU_FAST_T15_NS          750000
+#define RTU_FAST_T35_NS          1750000
+#define RTU_RESPONSE_TIMEOUT_NS  500000000 /* For the first byte of a response, as libmodbus. */
+#define RTU_FRAME_GAP_NS         20000000  /* Silence that ends a frame early. USB adapters hand bytes over in bursts. */
+
+//libmodbus's MODBUS_ENOBASE, exceptions above it by code, then its own errors.
+#define RTU_ERRNO_BASE           112345678
+#define RTU_EBADCRC              (RTU_ERRNO_BASE + 12)
+#define RTU_EBADDATA             (RTU_ERRNO_BASE + 13)
+#define RTU_EBADSLAVE            (RTU_ERRNO_BASE + 17)
+
+enum RtuState
+{
+    RTU_IDLE,
+    RTU_SILENCE,              //Waiting out 3.5 characters since the bus was last busy.
+    RTU_SENDING,              //Frame part written.
+    RTU_AWAITING,             //Sent, nothing back yet.
+    RTU_RECEIVING,
+    RTU_DONE,
+    RTU_FAILED                //lError says why.
+};
+
+struct RtuMaster
+{
+    int fd;
+    enum RtuState state;
+    int lError;
+    int64_t llCharNs;                     //One character on the wire, 11 bits.
+    int64_t llT15Ns;
+    int64_t llT35Ns;
+    int64_t llResponseTimeoutNs;
+    int64_t llBusyNs;                     //When the bus was last busy, either way.
+    int64_t llDeadlineNs;                 //When the current state times out.
+    uint8_t request[RTU_FRAME_MAX];
+    uint16_t nRequest;
+    uint16_t nSent;
+    uint8_t response[RTU_FRAME_MAX];
+    uint16_t nResponse;
+    uint16_t nExpected;                   //Length of the whole response, once its header says. Zero until then.
+    uint32_t lTransactions;
+    uint32_t lWakeups;                    //Calls to rtu_Service.
+    uint32_t lGaps;                       //Responses with a gap over 1.5 characters. Tolerated, as adapters make them.
+    uint32_t lTimeouts;
+};
+
+uint16_t rtu_Crc16(const uint8_t* pData, uint16_t nLength);
+
+/**
+ * Set up pMaster for an open, non-blocking fd at lBaud.
+ */
+void rtu_Initialise(struct RtuMaster* pMaster, int fd, int lBaud);
+
+/**
+ * Start a transaction: cSlave then the PDU (function code and data), with the CRC added here.
+ * Sends at once if the bus has been quiet long enough. A broadcast is done once it's sent.
+ * Returns -1 with errno set if one's already under way or the PDU doesn't fit.
+ */
+int rtu_Start(struct RtuMaster* pMaster, uint8_t cSlave, const uint8_t* pPdu, uint16_t nLength, int64_t llNowNs);
+
+/**
+ * The poll events the fd is waiting on, or zero if it's waiting on nothing but time (or is finished).
+ */
+short rtu_Events(const struct RtuMaster* pMaster);
+
+/**
+ * When rtu_Service must next be called even if the fd has nothing, or -1 if never.
+ */
+int64_t rtu_Deadline(const struct RtuMaster* pMaster);
+
+/**
+ * Move on with whatever poll returned for the fd (zero for a timeout). Returns true once the
+ * transaction's finished, done or failed.
+ */
+bool rtu_Service(struct RtuMaster* pMaster, short nRevents, int64_t llNowNs);
+
+/**
+ * The response's PDU, after the slave address, without the CRC. Only valid once RTU_DONE.
+ */
+const uint8_t* rtu_ResponsePdu(const struct RtuMaster* pMaster, uint16_t* pLength);
+
+/**
+ * Back to idle after a finished transaction, so the next can start.
+ */
+void rtu_Reset(struct RtuMaster* pMaster);
+
+/**
+ * Drive a started transaction to the end with a poll loop of its own, for callers without one.
+ * Returns 0 when done, or -1 with errno set. Either way, it still needs resetting.
+ */
+int rtu_Run(struct RtuMaster* pMaster);
+
+/**
+ * Describes the libmodbus style errors, and falls back to strerror.
+ */
+const char* rtu_StrError(int lError);
+
+#endif
@@ -0,0 +1,339 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "rtutransport.h"
+
+#define RTUTRANSPORT_MAX_READ  125
+#define RTUTRANSPORT_MAX_WRITE 123
+#define RTUTRANSPORT_MAX_WRITE_AND_READ 121
+
+static int64_t rtutransport_NowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static speed_t rtutransport_Speed(int lBaud)
+{
+    switch(lBaud)
+    {
+        case 1200: return B1200;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        default: return B9600;
+    }
+}
+
+static void rtutransport_Dump(const char* pDirection, const uint8_t* pFrame, uint16_t nLength)
+{
+    printf("%s", pDirection);
+
+    for(uint16_t i = 0; i < nLength; i++)
+        printf("[%.2X]", pFrame[i]);
+
+    printf("\n");
+}
+
+static int rtutransport_Connect(void* pContext)
+{
+    struct RtuTransport* pRtu = pContext;
+    struct termios tio;
+
+    if(pRtu->master.fd >= 0)
+        return 0;
+
+    int fd = open(pRtu->device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+    if(fd < 0)
+        return -1;
+
+    //Raw 8N1, no flow control.
+    if(0 != tcgetattr(fd, &tio))
+    {
+        close(fd);
+        return -1;
+    }
+
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, rtutransport_Speed(pRtu->lBaud));
+    cfsetospeed(&tio, rtutransport_Speed(pRtu->lBaud));
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+
+    if(0 != tcsetattr(fd, TCSANOW, &tio))
+    {
+        close(fd);
+        return -1;
+    }
+
+    tcflush(fd, TCIOFLUSH);
+    rtu_Initialise(&pRtu->master, fd, pRtu->lBaud);
+    return 0;
+}
+
+static void rtutransport_Free(void* pContext)
+{
+    struct RtuTransport* pRtu = pContext;
+
+    if(pRtu->master.fd >= 0)
+        close(pRtu->master.fd);
+
+    pRtu->master.fd = -1;
+}
+
+static int rtutransport_SetSlave(void* pContext, int lSlave)
+{
+    if(lSlave < 0 || lSlave > 247)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ((struct RtuTransport*)pContext)->lSlave = lSlave;
+    return 0;
+}
+
+static void rtutransport_SetDebug(void* pContext, bool bDebug)
+{
+    ((struct RtuTransport*)pContext)->bDebug = bDebug;
+}
+
+//One transaction with cSlave. Returns the response's PDU, or NULL with errno set.
+static const uint8_t* rtutransport_Transact(struct RtuTransport* pRtu, uint8_t cSlave, const uint8_t* pPdu, uint16_t nLength, uint16_t* pResponse)
+{
+    struct RtuMaster* pMaster = &pRtu->master;
+
+    if(pMaster->fd < 0)
+    {
+        errno = EBADF;
+        return NULL;
+    }
+
+    if(-1 == rtu_Start(pMaster, cSlave, pPdu, nLength, rtutransport_NowNs()))
+        return NULL;
+
+    pRtu->bFramed = true;
+
+    if(pRtu->bDebug)
+        rtutransport_Dump("", pMaster->request, pMaster->nRequest);
+
+    int rc = rtu_Run(pMaster);
+
+    if(pRtu->bDebug && pMaster->nResponse)
+        rtutransport_Dump("<", pMaster->response, pMaster->nResponse);
+
+    rtu_Reset(pMaster);
+
+    if(-1 == rc)
+    {
+        //Whatever's left of a bad or late response would only spoil the next.
+        int lError = errno;
+        tcflush(pMaster->fd, TCIFLUSH);
+        errno = lError;
+
+        return NULL;
+    }
+
+    return RTU_BROADCAST == cSlave ? pPdu : rtu_ResponsePdu(pMaster, pResponse);
+}
+
+//Registers out of a read response, checking it holds as many as were asked for.
+static int rtutransport_Registers(const uint8_t* pPdu, uint16_t nLength, int lCount, uint16_t* pDest)
+{
+    if(NULL == pPdu)
+        return -1;
+
+    if(nLength != 2 + lCount * 2 || pPdu[1] != lCount * 2)
+    {
+        errno = RTU_EBADDATA;
+        return -1;
+    }
+
+    for(int i = 0; i < lCount; i++)
+        pDest[i] = (pPdu[2 + i * 2] << 8) | pPdu[3 + i * 2];
+
+    return lCount;
+}
+
+static int rtutransport_Read(void* pContext, uint8_t cFunction, int lAddress, int lCount, uint16_t* pDest)
+{
+    struct RtuTransport* pRtu = pContext;
+    uint8_t pdu[5] = { cFunction, lAddress >> 8, lAddress & 0xFF, lCount >> 8, lCount & 0xFF };
+    uint16_t nLength = 0;
+
+    if(lCount < 1 || lCount > RTUTRANSPORT_MAX_READ)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const uint8_t* pResponse = rtutransport_Transact(pRtu, pRtu->lSlave, pdu, sizeof(pdu), &nLength);
+    return rtutransport_Registers(pResponse, nLength, lCount, pDest);
+}
+
+static int rtutransport_ReadInput(void* pContext, int lAddress, int lCount, uint16_t* pDest)
+{
+    return rtutransport_Read(pContext, 0x04, lAddress, lCount, pDest);
+}
+
+static int rtutransport_ReadHolding(void* pContext, int lAddress, int lCount, uint16_t* pDest)
+{
+    return rtutransport_Read(pContext, 0x03, lAddress, lCount, pDest);
+}
+
+//An FC06 or FC16 request's PDU for the registers. Returns its length.
+static uint16_t rtutransport_WritePdu(int lAddress, int lCount, const uint16_t* pValues, uint8_t* pPdu)
+{
+    uint16_t nLength = 0;
+
+    pPdu[nLength++] = 1 == lCount ? 0x06 : 0x10;
+    pPdu[nLength++] = lAddress >> 8;
+    pPdu[nLength++] = lAddress & 0xFF;
+
+    if(1 != lCount)
+    {
+        pPdu[nLength++] = lCount >> 8;
+        pPdu[nLength++] = lCount & 0xFF;
+        pPdu[nLength++] = lCount * 2;
+    }
+
+    for(int i = 0; i < lCount; i++)
+    {
+        pPdu[nLength++] = pValues[i] >> 8;
+        pPdu[nLength++] = pValues[i] & 0xFF;
+    }
+
+    return nLength;
+}
+
+static int rtutransport_Write(struct RtuTransport* pRtu, uint8_t cSlave, int lAddress, int lCount, const uint16_t* pValues)
+{
+    uint8_t pdu[RTU_PDU_MAX];
+    uint16_t nLength = 0;
+
+    if(lCount < 1 || lCount > RTUTRANSPORT_MAX_WRITE)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint16_t nRequest = rtutransport_WritePdu(lAddress, lCount, pValues, pdu);
+    const uint8_t* pResponse = rtutransport_Transact(pRtu, cSlave, pdu, nRequest, &nLength);
+
+    if(NULL == pResponse)
+        return -1;
+
+    //Echoes the address, and the value or count.
+    if(RTU_BROADCAST != cSlave && (nLength < 5 || 0 != memcmp(pResponse, pdu, 5)))
+    {
+        errno = RTU_EBADDATA;
+        return -1;
+    }
+
+    return lCount;
+}
+
+static int rtutransport_WriteSingle(void* pContext, int lAddress, uint16_t nValue)
+{
+    struct RtuTransport* pRtu = pContext;
+    return rtutransport_Write(pRtu, pRtu->lSlave, lAddress, 1, &nValue);
+}
+
+static int rtutransport_WriteMultiple(void* pContext, int lAddress, int lCount, const uint16_t* pValues)
+{
+    struct RtuTransport* pRtu = pContext;
+    return rtutransport_Write(pRtu, pRtu->lSlave, lAddress, lCount, pValues);
+}
+
+static int rtutransport_WriteAndRead(void* pContext, int lWriteAddress, int lWriteCount, const uint16_t* pValues,
+                                     int lReadAddress, int lReadCount, uint16_t* pDest)
+{
+    struct RtuTransport* pRtu = pContext;
+    uint8_t pdu[RTU_PDU_MAX];
+    uint16_t nRequest = 0;
+    uint16_t nLength = 0;
+
+    if(lReadCount < 1 || lReadCount > RTUTRANSPORT_MAX_READ || lWriteCount < 1 || lWriteCount > RTUTRANSPORT_MAX_WRITE_AND_READ)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pdu[nRequest++] = 0x17;
+    pdu[nRequest++] = lReadAddress >> 8;
+    pdu[nRequest++] = lReadAddress & 0xFF;
+    pdu[nRequest++] = lReadCount >> 8;
+    pdu[nRequest++] = lReadCount & 0xFF;
+    pdu[nRequest++] = lWriteAddress >> 8;
+    pdu[nRequest++] = lWriteAddress & 0xFF;
+    pdu[nRequest++] = lWriteCount >> 8;
+    pdu[nRequest++] = lWriteCount & 0xFF;
+    pdu[nRequest++] = lWriteCount * 2;
+
+    for(int i = 0; i < lWriteCount; i++)
+    {
+        pdu[nRequest++] = pValues[i] >> 8;
+        pdu[nRequest++] = pValues[i] & 0xFF;
+    }
+
+    const uint8_t* pResponse = rtutransport_Transact(pRtu, pRtu->lSlave, pdu, nRequest, &nLength);
+    return rtutransport_Registers(pResponse, nLength, lReadCount, pDest);
+}
+
+static int rtutransport_Broadcast(void* pContext, int lAddress, int lCount, const uint16_t* pValues)
+{
+    return rtutransport_Write(pContext, RTU_BROADCAST, lAddress, lCount, pValues);
+}
+
+//The master's buffers, as the last transaction left them, if it got as far as starting.
+static bool rtutransport_Frames(void* pContext, struct CaptureFrames* pFrames)
+{
+    struct RtuTransport* pRtu = pContext;
+
+    if(!pRtu->bFramed)
+        return false;
+
+    pRtu->bFramed = false;
+    pFrames->pRequest = pRtu->master.request;
+    pFrames->nRequest = pRtu->master.nRequest;
+    pFrames->pResponse = pRtu->master.response;
+    pFrames->nResponse = pRtu->master.nResponse;
+    return true;
+}
+
+static const struct TransportOps rtuOps =
+{
+    rtutransport_Connect,
+    rtutransport_Free,
+    rtutransport_SetSlave,
+    rtutransport_SetDebug,
+    rtutransport_ReadInput,
+    rtutransport_ReadHolding,
+    rtutransport_WriteSingle,
+    rtutransport_WriteMultiple,
+    rtutransport_WriteAndRead,
+    rtutransport_Broadcast,
+    rtu_StrError,
+    rtutransport_Frames
+};
+
+void rtutransport_Initialise(struct Transport* pTransport, struct RtuTransport* pRtu, const char* pDevice, int lBaud)
+{
+    memset(pRtu, 0x00, sizeof(struct RtuTransport));
+    snprintf(pRtu->device, sizeof(pRtu->device), "%s", pDevice);
+    pRtu->lBaud = lBaud;
+    pRtu->lSlave = 1;
+    pRtu->master.fd = -1;
+
+    transport_Initialise(pTransport, TRANSPORT_RTU, pDevice, &rtuOps, pRtu);
+}
@@ -0,0 +1,39 @@
+
+//Native RTU transport.
+//The register transport over the in-house RTU master (rtu.h) instead of libmodbus, picked at build
+//time with RTU=NATIVE in the server makefile. Each call drives one transaction with the master's own
+//poll loop, which sleeps on the fd and the frame's deadlines rather than blocking in read().
+
+#ifndef RTUTRANSPORT_H
+#define RTUTRANSPORT_H
+
+#include <stdbool.h>
+#include "transport.h"
+#include "rtu.h"
+
+#define RTU_MASTER_LIBMODBUS 0
+#define RTU_MASTER_NATIVE    1
+
+#ifndef RTU_MASTER
+#define RTU_MASTER RTU_MASTER_LIBMODBUS
+#endif
+
+#define RTUTRANSPORT_PATH_MAX 256
+
+struct RtuTransport
+{
+    char device[RTUTRANSPORT_PATH_MAX];
+    int lBaud;
+    int lSlave;
+    bool bDebug;
+    bool bFramed;                 //The master holds a transaction's frames not yet handed over.
+    struct RtuMaster master;
+};
+
+/**
+ * Set up pTransport for RTU on pDevice at lBaud, 8N1, keeping its state in pRtu.
+ * The device isn't opened until it's connected.
+ */
+void rtutransport_Initialise(struct Transport* pTransport, struct RtuTransport* pRtu, const char* pDevice, int lBaud);
+
+#endif
@@ -0,0 +1,311 @@
+
+#include <stdio.h>
+#include <string.h>
+#include "schedule.h"
+
+//File slot lists.
+static void schedule_Link(struct Schedule* pSchedule, uint8_t cEntry, uint8_t cLevel, uint8_t cSlot)
+{
+    struct ScheduleEntry* pEntry = &pSchedule->entries[cEntry];
+    uint8_t cHead = pSchedule->cSlots[cLevel][cSlot];
+    
+    pEntry->cLevel = cLevel;
+    pEntry->cSlot = cSlot;
+    pEntry->cPrev = SCHEDULE_NONE;
+    pEntry->cNext = cHead;
+    
+    if(SCHEDULE_NONE != cHead)
+        pSchedule->entries[cHead].cPrev = cEntry;
+        
+    pSchedule->cSlots[cLevel][cSlot] = cEntry;
+}
+
+static void schedule_Unlink(struct Schedule* pSchedule, uint8_t cEntry)
+{
+    struct ScheduleEntry* pEntry = &pSchedule->entries[cEntry];
+    
+    if(SCHEDULE_NONE != pEntry->cPrev)
+        pSchedule->entries[pEntry->cPrev].cNext = pEntry->cNext;
+    else
+        pSchedule->cSlots[pEntry->cLevel][pEntry->cSlot] = pEntry->cNext;
+        
+    if(SCHEDULE_NONE != pEntry->cNext)
+        pSchedule->entries[pEntry->cNext].cPrev = pEntry->cPrev;
+        
+    pEntry->cNext = SCHEDULE_NONE;
+    pEntry->cPrev = SCHEDULE_NONE;
+}
+
+//File an entry by how far away its expiry is. Level n slots are 64^n ticks wide.
+static void schedule_Insert(struct Schedule* pSchedule, uint8_t cEntry)
+{
+    int32_t slExpiry = pSchedule->entries[cEntry].slExpiry;
+    int32_t slDelta = slExpiry - pSchedule->slCurrent;
+    
+    //Overdue. Due on the next tick.
+    if(slDelta <= 0)
+    {
+        schedule_Link(pSchedule, cEntry, 0, (uint32_t)(pSchedule->slCurrent + 1) & SCHEDULE_SLOT_MASK);
+        return;
+    }
+    
+    //Beyond the wheel. Park it as far out as possible, to be refiled when it cascades.
+    if(slDelta >= SCHEDULE_SPAN)
+        slExpiry = pSchedule->slCurrent + SCHEDULE_SPAN - 1;
+        
+    uint8_t cLevel = 0;
+    
+    while(cLevel < SCHEDULE_LEVELS - 1 && slDelta >= (1 << (SCHEDULE_SLOT_BITS * (cLevel + 1))))
+        cLevel++;
+        
+    schedule_Link(pSchedule, cEntry, cLevel, ((uint32_t)slExpiry >> (SCHEDULE_SLOT_BITS * cLevel)) & SCHEDULE_SLOT_MASK);
+}
+
+//Detach a whole slot's list, returning its head.
+static uint8_t schedule_TakeSlot(struct Schedule* pSchedule, uint8_t cLevel, uint8_t cSlot)
+{
+    uint8_t cHead = pSchedule->cSlots[cLevel][cSlot];
+    pSchedule->cSlots[cLevel][cSlot] = SCHEDULE_NONE;
+    
+    return cHead;
+}
+
+static void schedule_Free(struct Schedule* pSchedule, uint8_t cEntry)
+{
+    pSchedule->entries[cEntry].bUsed = false;
+    pSchedule->cCount--;
+}
+
+void schedule_Initialise(struct Schedule* pSchedule, ScheduleFired fired, int32_t slNow)
+{
+    memset(pSchedule, 0x00, sizeof(struct Schedule));
+    memset(pSchedule->cSlots, SCHEDULE_NONE, sizeof(pSchedule->cSlots));
+    pSchedule->slCurrent = slNow;
+    pSchedule->lNextId = 1;
+    pSchedule->fired = fired;
+}
+
+static bool schedule_Valid(const struct ScheduledCommand* pCommand)
+{
+    if(pCommand->slDuration < 0 || pCommand->slPeriod < 0)
+        return false;
+        
+    //A repeating window has to end before it starts again.
+    if(pCommand->slPeriod > 0 && pCommand->slDuration >= pCommand->slPeriod)
+        return false;
+        
+    return true;
+}
+
+uint32_t schedule_Add(struct Schedule* pSchedule, const struct ScheduledCommand* pCommand)
+{
+    if(!schedule_Valid(pCommand))
+        return 0;
+        
+    for(uint8_t i = 0; i < SCHEDULE_MAX_ENTRIES; i++)
+    {
+        struct ScheduleEntry* pEntry = &pSchedule->entries[i];
+        
+        if(!pEntry->bUsed)
+        {
+            pEntry->command = *pCommand;
+            pEntry->command.lScheduleId = pSchedule->lNextId++;
+            pEntry->bUsed = true;
+            pEntry->bEnding = false;
+            pEntry->slExpiry = pCommand->slStart;
+            pSchedule->cCount++;
+            
+            if(0 == pSchedule->lNextId)
+                pSchedule->lNextId = 1;
+                
+            schedule_Insert(pSchedule, i);
+            
+            return pEntry->command.lScheduleId;
+        }
+    }
+    
+    return 0;
+}
+
+bool schedule_Cancel(struct Schedule* pSchedule, uint32_t lScheduleId)
+{
+    for(uint8_t i = 0; i < SCHEDULE_MAX_ENTRIES; i++)
+    {
+        if(pSchedule->entries[i].bUsed && pSchedule->entries[i].command.lScheduleId == lScheduleId)
+        {
+            schedule_Unlink(pSchedule, i);
+            schedule_Free(pSchedule, i);
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+void schedule_List(const struct Schedule* pSchedule, struct ScheduleList* pList)
+{
+    memset(pList, 0x00, sizeof(struct ScheduleList));
+    
+    for(uint8_t i = 0; i < SCHEDULE_MAX_ENTRIES; i++)
+    {
+        if(pSchedule->entries[i].bUsed)
+            pList->entries[pList->nCount++] = pSchedule->entries[i].command;
+    }
+}
+
+//An entry has come due at slNow.
+static void schedule_Expire(struct Schedule* pSchedule, uint8_t cEntry, int32_t slNow)
+{
+    struct ScheduleEntry* pEntry = &pSchedule->entries[cEntry];
+    struct ScheduledCommand* pCommand = &pEntry->command;
+    
+    if(pEntry->bEnding)
+    {
+        pSchedule->fired(pSchedule, pCommand, true);
+    }
+    else if(0 == pCommand->slDuration)
+    {
+        pSchedule->fired(pSchedule, pCommand, false);
+    }
+    else if(pCommand->slStart + pCommand->slDuration > slNow)
+    {
+        //Start the window and come back to end it.
+        pSchedule->fired(pSchedule, pCommand, false);
+        pEntry->bEnding = true;
+        pEntry->slExpiry = pCommand->slStart + pCommand->slDuration;
+        schedule_Insert(pSchedule, cEntry);
+        return;
+    }
+    
+    if(0 == pCommand->slPeriod)
+    {
+        schedule_Free(pSchedule, cEntry);
+        return;
+    }
+    
+    //Next occurrence whose window isn't already over.
+    do
+    {
+        pCommand->slStart += pCommand->slPeriod;
+    }
+    while(pCommand->slStart + (pCommand->slDuration > 0 ? pCommand->slDuration : 1) <= slNow);
+    
+    pEntry->bEnding = false;
+    pEntry->slExpiry = pCommand->slStart;
+    schedule_Insert(pSchedule, cEntry);
+}
+
+static uint32_t schedule_Tick(struct Schedule* pSchedule)
+{
+    uint32_t lTick = (uint32_t)++pSchedule->slCurrent;
+    uint32_t lExpired = 0;
+    
+    //Cascade the next slot of each higher level down as the level below wraps.
+    for(uint8_t cLevel = 1; cLevel < SCHEDULE_LEVELS; cLevel++)
+    {
+        if(0 != ((lTick >> (SCHEDULE_SLOT_BITS * (cLevel - 1))) & SCHEDULE_SLOT_MASK))
+            break;
+            
+        uint8_t cEntry = schedule_TakeSlot(pSchedule, cLevel, (lTick >> (SCHEDULE_SLOT_BITS * cLevel)) & SCHEDULE_SLOT_MASK);
+        
+        while(SCHEDULE_NONE != cEntry)
+        {
+            uint8_t cNext = pSchedule->entries[cEntry].cNext;
+            schedule_Insert(pSchedule, cEntry);
+            cEntry = cNext;
+        }
+    }
+    
+    uint8_t cEntry = schedule_TakeSlot(pSchedule, 0, lTick & SCHEDULE_SLOT_MASK);
+    
+    while(SCHEDULE_NONE != cEntry)
+    {
+        uint8_t cNext = pSchedule->entries[cEntry].cNext;
+        
+        if(pSchedule->entries[cEntry].slExpiry <= pSchedule->slCurrent)
+        {
+            schedule_Expire(pSchedule, cEntry, pSchedule->slCurrent);
+            lExpired++;
+        }
+        else
+        {
+            schedule_Insert(pSchedule, cEntry);
+        }
+        
+        cEntry = cNext;
+    }
+    
+    return lExpired;
+}
+
+uint32_t schedule_Advance(struct Schedule* pSchedule, int32_t slNow)
+{
+    uint32_t lExpired = 0;
+    
+    if(slNow - pSchedule->slCurrent > SCHEDULE_MAX_CATCHUP || slNow < pSchedule->slCurrent)
+    {
+        //Clock jumped. Refile everything from just before now, so anything overdue comes due on the next tick.
+        memset(pSchedule->cSlots, SCHEDULE_NONE, sizeof(pSchedule->cSlots));
+        pSchedule->slCurrent = slNow - 1;
+        
+        for(uint8_t i = 0; i < SCHEDULE_MAX_ENTRIES; i++)
+        {
+            if(pSchedule->entries[i].bUsed)
+                schedule_Insert(pSchedule, i);
+        }
+    }
+    
+    while(pSchedule->slCurrent < slNow)
+        lExpired += schedule_Tick(pSchedule);
+        
+    return lExpired;
+}
+
+bool schedule_Save(const struct Schedule* pSchedule, const char* pcPath)
+{
+    struct ScheduleList list;
+    uint32_t lVersion = SCHEDULE_VERSION;
+    FILE* file = fopen(pcPath, "wb");
+    
+    if(NULL == file)
+        return false;
+        
+    schedule_List(pSchedule, &list);
+    
+    bool bResult = (1 == fwrite(&lVersion, sizeof(lVersion), 1, file)) &&
+                   (1 == fwrite(&pSchedule->lNextId, sizeof(pSchedule->lNextId), 1, file)) &&
+                   (1 == fwrite(&list, sizeof(list), 1, file));
+    fclose(file);
+    
+    return bResult;
+}
+
+bool schedule_Load(struct Schedule* pSchedule, const char* pcPath)
+{
+    struct ScheduleList list;
+    uint32_t lVersion = 0;
+    uint32_t lNextId = 0;
+    FILE* file = fopen(pcPath, "rb");
+    
+    if(NULL == file)
+        return false;
+        
+    bool bResult = (1 == fread(&lVersion, sizeof(lVersion), 1, file)) &&
+                   (1 == fread(&lNextId, sizeof(lNextId), 1, file)) &&
+                   (1 == fread(&list, sizeof(list), 1, file));
+    fclose(file);
+    
+    if(!bResult || SCHEDULE_VERSION != lVersion || list.nCount > SCHEDULE_MAX_ENTRIES)
+        return false;
+        
+    //Keep the IDs clients already know about.
+    for(uint16_t i = 0; i < list.nCount; i++)
+    {
+        pSchedule->lNextId = list.entries[i].lScheduleId;
+        schedule_Add(pSchedule, &list.entries[i]);
+    }
+    
+    pSchedule->lNextId = 0 != lNextId ? lNextId : 1;
+    
+    return true;
+}
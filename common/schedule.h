@@ -0,0 +1,72 @@
+
+//Scheduler for timed commands, e.g. grid bypass from 12:00 to 14:00 every Sunday.
+//Entries live in a fixed pool, filed in a hierarchical timer wheel of one second ticks, so adding,
+//cancelling and expiring are all constant time. Entries far in the future cascade down the levels.
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "system_defs.h"
+
+#define SCHEDULE_LEVELS     4
+#define SCHEDULE_SLOT_BITS  6
+#define SCHEDULE_SLOTS      (1 << SCHEDULE_SLOT_BITS)
+#define SCHEDULE_SLOT_MASK  (SCHEDULE_SLOTS - 1)
+#define SCHEDULE_SPAN       (1 << (SCHEDULE_SLOT_BITS * SCHEDULE_LEVELS))   /* Furthest ahead the wheel reaches, ~194 days. */
+#define SCHEDULE_MAX_CATCHUP 3600    /* Ticks stepped through one by one. Any bigger jump rebuilds the wheel. */
+#define SCHEDULE_NONE       0xFF
+
+#define SCHEDULE_VERSION    1        /* Bump if the persisted layout changes. */
+
+struct ScheduleEntry
+{
+    struct ScheduledCommand command;    //slStart is always the current or next occurrence.
+    bool bUsed;
+    bool bEnding;                       //Armed for the end of its window rather than the start.
+    int32_t slExpiry;
+    uint8_t cNext;                      //Wheel slot list links, SCHEDULE_NONE terminated.
+    uint8_t cPrev;
+    uint8_t cLevel;
+    uint8_t cSlot;
+};
+
+struct Schedule;
+
+typedef void (*ScheduleFired)(struct Schedule* pSchedule, const struct ScheduledCommand* pCommand, bool bEnding);
+
+struct Schedule
+{
+    struct ScheduleEntry entries[SCHEDULE_MAX_ENTRIES];
+    uint8_t cSlots[SCHEDULE_LEVELS][SCHEDULE_SLOTS];   //Head entry of each slot's list.
+    int32_t slCurrent;                                  //Last tick processed.
+    uint32_t lNextId;
+    uint8_t cCount;
+    ScheduleFired fired;
+};
+
+void schedule_Initialise(struct Schedule* pSchedule, ScheduleFired fired, int32_t slNow);
+
+/**
+ * Add an entry, giving it a new ID. Returns the ID, or zero if it's invalid or the schedule is full.
+ */
+uint32_t schedule_Add(struct Schedule* pSchedule, const struct ScheduledCommand* pCommand);
+
+/**
+ * Remove an entry. Cancelling in the middle of its window doesn't undo it. Returns false if there's no such entry.
+ */
+bool schedule_Cancel(struct Schedule* pSchedule, uint32_t lScheduleId);
+
+void schedule_List(const struct Schedule* pSchedule, struct ScheduleList* pList);
+
+/**
+ * Run every tick up to slNow, calling back for each start and end of a window that comes due.
+ * Windows that were missed entirely are skipped. Returns the number of entries that came due.
+ */
+uint32_t schedule_Advance(struct Schedule* pSchedule, int32_t slNow);
+
+bool schedule_Save(const struct Schedule* pSchedule, const char* pcPath);
+bool schedule_Load(struct Schedule* pSchedule, const char* pcPath);
+
+#endif
@@ -0,0 +1,246 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "snapshot.h"
+
+static_assert(SNAPSHOT_MAX_WRITE <= 123, "FC16 writes are 1-123 registers");
+
+//Kept in line by the server, or in the clock's case, by time itself.
+static const uint16_t skipRegs[] =
+{
+    GW_HREG_CFG_MODE,
+    GW_HREG_UTIL_END_HOUR,
+    GW_HREG_MAX_UTIL_AMPS,
+    GW_HREG_TIME_Y,
+    GW_HREG_TIME_MO,
+    GW_HREG_TIME_D,
+    GW_HREG_TIME_H,
+    GW_HREG_TIME_MI,
+    GW_HREG_TIME_S
+};
+
+bool snapshot_Restorable(uint16_t nAddress)
+{
+    if(nAddress >= SNAPSHOT_REGISTERS)
+        return false;
+
+    for(size_t i = 0; i < sizeof(skipRegs) / sizeof(skipRegs[0]); i++)
+    {
+        if(skipRegs[i] == nAddress)
+            return false;
+    }
+
+    return true;
+}
+
+//One inverter's whole map, in reads as big as the model allows, lWaitUs apart.
+static int snapshot_Read(struct Transport* pTransport, uint16_t* pRegs, useconds_t lWaitUs)
+{
+    int lReads = 0;
+
+    for(int lAddress = 0; lAddress < SNAPSHOT_REGISTERS; lAddress += MODEL_MAX_READ)
+    {
+        int lCount = SNAPSHOT_REGISTERS - lAddress < MODEL_MAX_READ ? SNAPSHOT_REGISTERS - lAddress : MODEL_MAX_READ;
+        int rc = transport_ReadRegisters(pTransport, lAddress, lCount, &pRegs[lAddress]);
+
+        usleep(lWaitUs);
+
+        if(-1 == rc)
+            return -1;
+
+        lReads++;
+    }
+
+    return lReads;
+}
+
+int snapshot_Take(struct Snapshot* pSnapshot, struct Transport* pTransport, int32_t slNow, useconds_t lWaitUs)
+{
+    int lReads = 0;
+
+    memset(pSnapshot, 0x00, sizeof(struct Snapshot));
+    pSnapshot->slTime = slNow;
+    pSnapshot->nModel = INVERTER_MODEL;
+    pSnapshot->cInverters = INVERTER_COUNT;
+
+    for(int i = 0; i < INVERTER_COUNT && -1 != lReads; i++)
+    {
+        transport_SetSlave(pTransport, INVERTER_1_ID + i);
+        int rc = snapshot_Read(pTransport, pSnapshot->regs[i], lWaitUs);
+        lReads = -1 == rc ? -1 : lReads + rc;
+    }
+
+    transport_SetSlave(pTransport, INVERTER_1_ID);
+    return lReads;
+}
+
+uint16_t snapshot_Diff(const struct Snapshot* pFrom, const struct Snapshot* pTo, struct SnapshotDiff* pDiffs, uint16_t nMax)
+{
+    uint16_t nDiffs = 0;
+
+    for(uint8_t i = 0; i < INVERTER_COUNT; i++)
+    {
+        for(uint16_t j = 0; j < SNAPSHOT_REGISTERS; j++)
+        {
+            if(pFrom->regs[i][j] == pTo->regs[i][j])
+                continue;
+
+            if(nDiffs < nMax)
+            {
+                pDiffs[nDiffs].cInverter = i;
+                pDiffs[nDiffs].nAddress = j;
+                pDiffs[nDiffs].nFrom = pFrom->regs[i][j];
+                pDiffs[nDiffs].nTo = pTo->regs[i][j];
+            }
+
+            nDiffs++;
+        }
+    }
+
+    return nDiffs;
+}
+
+//Whether nAddress needs writing to make pCurrent match pWanted.
+static bool snapshot_Differs(const uint16_t* pWanted, const uint16_t* pCurrent, uint16_t nAddress)
+{
+    return snapshot_Restorable(nAddress) && pWanted[nAddress] != pCurrent[nAddress];
+}
+
+//Write the registers that differ as runs, merged across short gaps of restorable registers.
+//Anything an FC16 write is refused for is tried one register at a time, so one the inverter
+//won't take doesn't hold up the rest. Every write is followed by lWaitUs.
+static void snapshot_WriteRuns(struct Transport* pTransport,
+                               const uint16_t* pWanted,
+                               const uint16_t* pCurrent,
+                               useconds_t lWaitUs,
+                               struct SnapshotRestore* pResult)
+{
+    uint16_t nAddress = 0;
+
+    while(nAddress < SNAPSHOT_REGISTERS)
+    {
+        if(!snapshot_Differs(pWanted, pCurrent, nAddress))
+        {
+            nAddress++;
+            continue;
+        }
+
+        uint16_t nStart = nAddress;
+        uint16_t nEnd = nAddress + 1;
+
+        //Take in the next difference if every register up to it can be written and it's close enough.
+        for(uint16_t nNext = nEnd; nNext < SNAPSHOT_REGISTERS && nNext - nStart < SNAPSHOT_MAX_WRITE && nNext - nEnd <= SNAPSHOT_MERGE_GAP; nNext++)
+        {
+            if(!snapshot_Restorable(nNext))
+                break;
+
+            if(snapshot_Differs(pWanted, pCurrent, nNext))
+                nEnd = nNext + 1;
+        }
+
+        pResult->nWrites++;
+        int rc = transport_WriteRegisters(pTransport, nStart, nEnd - nStart, &pWanted[nStart]);
+        usleep(lWaitUs);
+
+        if(-1 == rc)
+        {
+            for(uint16_t i = nStart; i < nEnd; i++)
+            {
+                if(snapshot_Differs(pWanted, pCurrent, i))
+                {
+                    pResult->nWrites++;
+                    transport_WriteRegister(pTransport, i, pWanted[i]);
+                    usleep(lWaitUs);
+                }
+            }
+        }
+
+        nAddress = nEnd;
+    }
+}
+
+int snapshot_Restore(const struct Snapshot* pSnapshot, struct Transport* pTransport, useconds_t lWaitUs, struct SnapshotRestore* pResult)
+{
+    uint16_t current[SNAPSHOT_REGISTERS];
+    int rc = 0;
+
+    memset(pResult, 0x00, sizeof(struct SnapshotRestore));
+
+    if(INVERTER_MODEL != pSnapshot->nModel || INVERTER_COUNT != pSnapshot->cInverters)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for(int i = 0; i < INVERTER_COUNT && -1 != rc; i++)
+    {
+        const uint16_t* pWanted = pSnapshot->regs[i];
+
+        transport_SetSlave(pTransport, INVERTER_1_ID + i);
+
+        if(-1 == (rc = snapshot_Read(pTransport, current, lWaitUs)))
+            break;
+
+        for(uint16_t j = 0; j < SNAPSHOT_REGISTERS; j++)
+        {
+            if(snapshot_Differs(pWanted, current, j))
+                pResult->nChanged++;
+        }
+
+        snapshot_WriteRuns(pTransport, pWanted, current, lWaitUs, pResult);
+
+        //Everything back, to be sure it took.
+        if(-1 == (rc = snapshot_Read(pTransport, current, lWaitUs)))
+            break;
+
+        for(uint16_t j = 0; j < SNAPSHOT_REGISTERS; j++)
+        {
+            if(snapshot_Differs(pWanted, current, j))
+                pResult->nMismatched++;
+        }
+    }
+
+    int lError = -1 == rc ? errno : EIO;
+    transport_SetSlave(pTransport, INVERTER_1_ID);
+
+    if(-1 == rc || pResult->nMismatched)
+    {
+        errno = lError;
+        return -1;
+    }
+
+    return 0;
+}
+
+bool snapshot_Save(const struct Snapshot* pSnapshot, const char* pcPath)
+{
+    uint32_t lVersion = SNAPSHOT_VERSION;
+    FILE* file = fopen(pcPath, "wb");
+
+    if(NULL == file)
+        return false;
+
+    bool bResult = (1 == fwrite(&lVersion, sizeof(lVersion), 1, file)) &&
+                   (1 == fwrite(pSnapshot, sizeof(struct Snapshot), 1, file));
+    fclose(file);
+
+    return bResult;
+}
+
+bool snapshot_Load(struct Snapshot* pSnapshot, const char* pcPath)
+{
+    uint32_t lVersion = 0;
+    FILE* file = fopen(pcPath, "rb");
+
+    if(NULL == file)
+        return false;
+
+    bool bResult = (1 == fread(&lVersion, sizeof(lVersion), 1, file)) &&
+                   SNAPSHOT_VERSION == lVersion &&
+                   (1 == fread(pSnapshot, sizeof(struct Snapshot), 1, file));
+    fclose(file);
+
+    return bResult;
+}
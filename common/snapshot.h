@@ -0,0 +1,73 @@
+
+//Holding register snapshots.
+//Reads every inverter's whole holding register map in as few maximal reads as the model allows,
+//keeps it as a versioned file, diffs one snapshot against another, and restores one with batched
+//FC16 writes of only what differs, verified by reading everything back. Registers the server keeps
+//in line itself (mode, charge hours and amps, clock) are left alone on restore.
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "transport.h"
+#include "spf5000es_defs.h"
+#include "system_defs.h"
+
+#define SNAPSHOT_REGISTERS   GW_HREG_COUNT
+#define SNAPSHOT_MAX_WRITE   123      /* Registers in one FC16 write. */
+#define SNAPSHOT_MERGE_GAP   4        /* Unchanged registers written anyway to save a transaction. */
+#define SNAPSHOT_VERSION     1        /* Bump if the persisted layout changes. */
+
+struct Snapshot
+{
+    int32_t slTime;                   //When it was taken.
+    uint16_t nModel;                  //INVERTER_MODEL it was taken from.
+    uint8_t cInverters;
+    uint8_t cReserved;
+    uint16_t regs[INVERTER_COUNT][SNAPSHOT_REGISTERS];
+};
+
+struct SnapshotDiff
+{
+    uint8_t cInverter;
+    uint16_t nAddress;
+    uint16_t nFrom;
+    uint16_t nTo;
+};
+
+struct SnapshotRestore
+{
+    uint16_t nChanged;                //Registers that differed beforehand.
+    uint16_t nWrites;                 //Write transactions.
+    uint16_t nMismatched;             //Registers still different on read back.
+};
+
+/**
+ * Read every inverter's holding registers into pSnapshot, waiting lWaitUs after each read.
+ * Leaves the transport addressing the master. Returns the number of read transactions, or -1 with errno set.
+ */
+int snapshot_Take(struct Snapshot* pSnapshot, struct Transport* pTransport, int32_t slNow, useconds_t lWaitUs);
+
+/**
+ * List up to nMax registers that differ from pFrom to pTo into pDiffs. Returns how many differ in all.
+ */
+uint16_t snapshot_Diff(const struct Snapshot* pFrom, const struct Snapshot* pTo, struct SnapshotDiff* pDiffs, uint16_t nMax);
+
+/**
+ * Whether restore writes the register.
+ */
+bool snapshot_Restorable(uint16_t nAddress);
+
+/**
+ * Write pSnapshot back to the inverters and verify it, waiting lWaitUs after each read and write, filling pResult.
+ * Returns 0 if everything restorable now matches, or -1 with errno set (EINVAL for a snapshot
+ * from another model or system, EIO if registers didn't take).
+ */
+int snapshot_Restore(const struct Snapshot* pSnapshot, struct Transport* pTransport, useconds_t lWaitUs, struct SnapshotRestore* pResult);
+
+bool snapshot_Save(const struct Snapshot* pSnapshot, const char* pcPath);
+bool snapshot_Load(struct Snapshot* pSnapshot, const char* pcPath);
+
+#endif
@@ -2,6 +2,8 @@
 #ifndef SPF5000ES_DEFS_H
 #define SPF5000ES_DEFS_H
 
+#include "model_defs.h"
+
 //Growatt SPF ES Config holding register addresses.
 #define GW_HREG_CFG_MODE        1
 #define GW_HREG_UTIL_START_HOUR 5   //Hour from which utility charging allowed.
@@ -15,6 +17,7 @@
 #define GW_HREG_TIME_H          48
 #define GW_HREG_TIME_MI         49
 #define GW_HREG_TIME_S          50
+#define GW_HREG_COUNT           51  //Holding registers 0-50 are read as one image each pass.
 
 //Growatt SPF ES Config values.
 #define GW_CFG_MODE_BATTS   0
@@ -23,11 +26,11 @@
 #define GW_CFG_UTIL_TIME_ANY_TIME 0 //Charging allowed anytime if start & end.
 #define GW_CFG_UTIL_TIME_OFFPEAK  4 //Charging not allowed after 5am if end.
 
-#define GW_CFG_UTIL_AMPS_MAX 80 //Free sessions etc. Smash those amps in!
-#define GW_CFG_UTIL_AMPS_MOD 40 //Off-peak. Steady to help with balancing.
+#define GW_CFG_UTIL_AMPS_MAX MODEL_UTIL_AMPS_MAX //Free sessions etc. Smash those amps in!
+#define GW_CFG_UTIL_AMPS_MOD MODEL_UTIL_AMPS_MOD //Off-peak. Steady to help with balancing.
 
 #define GW_WORST_CASE_CHARGE_EFFICIENCY 0.8f   /* As measured, charge efficiency is never any worse than this. */
-#define GW_WH_MULTIPLIER 100.0f;               /* kWh unit representation to raw Wh. Growatt actually use deciwatt hours. */
+#define GW_WH_MULTIPLIER 100.0f                /* kWh unit representation to raw Wh. Growatt actually use deciwatt hours. */
 
 //General docs & knowledge.
 
@@ -40,9 +43,9 @@
    any time). */
 
 /* Growatt SPF 5000 ES has maximum total & utility charging currents of 100A
-   and 80A respectively. While everything else in this code will also work
-   with an SPF 3000 ES, the same maxima are 80A and 60A respectively, and
-   if you're using that inverter you'll need to make changes accordingly. */
+   and 80A respectively. Everything else in this code will also work with
+   an SPF 3000 ES, where the same maxima are 80A and 60A respectively. Build
+   with MODEL=SPF3000ES for that inverter (see model_defs.h). */
    
 /* There are two reasons to adjust the charging amps in this application:
    1) During "free" or reduced price peak time sessions, we want to cram as
@@ -149,6 +152,10 @@ enum GwInputRegisters
     INPUT_REGISTER_COUNT
 };
 
+static_assert(INPUT_REGISTER_COUNT == MODEL_INPUT_REGISTERS, "Input register map doesn't match the model");
+static_assert(GW_HREG_COUNT == MODEL_HOLDING_REGISTERS, "Holding register image doesn't match the model");
+static_assert(GW_HREG_TIME_S < GW_HREG_COUNT && GW_HREG_MAX_UTIL_AMPS < GW_HREG_COUNT, "Written registers must be in the image");
+
 enum GwInverterStatus
 {
     STANDBY = 0,
@@ -3,6 +3,7 @@
 #define SYSTEM_DEFS_H
 
 #include <stdint.h>
+#include "model_defs.h"
 
 #define SYSTEM_START_OFF_PEAK_H  23
 #define SYSTEM_START_OFF_PEAK_M  30
@@ -17,14 +18,34 @@
 #define SYSTEM_STATE_OFF_PEAK  2      /* Grid-switched and charging batteries during off-peak. */
 #define SYSTEM_STATE_BOOST     3      /* Temporarily grid-switched, charging batteries, peak time. */
 
-#define CHARGE_VOLTAGE         56.0f
+#define CHARGE_VOLTAGE         MODEL_CHARGE_VOLTS
 #define CHARGE_HOURS           6
 
-#define CHARGE_MIN_AMPS        0      /* Absolute minimum charging amps to ever set. */
+#define CHARGE_MIN_AMPS        2      /* Absolute minimum charging amps to ever set. */
+
+static_assert(CHARGE_MIN_AMPS <= MODEL_UTIL_AMPS_MOD, "Minimum charge current above the model's off-peak default");
+
+#define BATTERY_CAPACITY_WH    10240  /* Usable energy of the whole battery bank from 0-100% SoC. */
 
 #define INVERTER_COUNT 2              /* How many inverters are in parallel. */
 #define INVERTER_1_ID  1              /* The ID of the master inverter. It's assumed that subsequent ones increment from this.*/
 
+#define OVERLOAD_TRIP_WATTS       MODEL_TRIP_WATTS    /* Force grid bypass when any inverter's output reaches this. */
+#define OVERLOAD_RELEASE_WATTS    MODEL_RELEASE_WATTS /* Only return to batteries once every inverter is below this. */
+#define OVERLOAD_TRIP_PERCENT     95   /* Same again, as a percentage of any inverter's capacity. */
+#define OVERLOAD_RELEASE_PERCENT  80
+#define OVERLOAD_TRIP_TOTAL_WATTS    (OVERLOAD_TRIP_WATTS * INVERTER_COUNT)
+#define OVERLOAD_RELEASE_TOTAL_WATTS (OVERLOAD_RELEASE_WATTS * INVERTER_COUNT)
+#define OVERLOAD_HOLD_S           1800 /* Minimum time to stay bypassed, extended while the load stays high. */
+
+#define GRID_SAG_VOLTS       2070  /* 0.1V. Grid voltage below this is a sag (230V -10%). */
+#define GRID_SWELL_VOLTS     2530  /* 0.1V. Grid voltage above this is a swell (230V +10%). */
+#define GRID_OUTAGE_VOLTS    1000  /* 0.1V. Grid voltage below this is an outage. */
+#define GRID_NOMINAL_FREQ    5000  /* 0.01Hz. */
+#define GRID_FREQ_TOLERANCE  50    /* 0.01Hz. Further than this from nominal is a frequency excursion. */
+#define GRID_RESTORE_SAMPLES 3     /* Consecutive healthy samples before an outage is considered over. */
+#define GRID_FAST_HOLD_S     60    /* Keep sampling the grid fast for this long after it last misbehaved. */
+
 struct SystemStatus
 {
     //Program status.
@@ -34,8 +55,10 @@ struct SystemStatus
     uint16_t nOffPeakChargeKwh;   //The total charge energy when the inverter switched to peak this morning.
     uint16_t nChargeCurrent;      //The charge current that should be employed.
     int32_t slOffPeakChgComplete; //The time at which overnight charging was deemed to be completed.
+    uint16_t nForecastKwh;        //Forecast household energy use over the next 24 hours (0.1kWh).
         
     //Inverter status.
+    uint16_t nInverterMode;   //The inverter's output config (OPPR) holding register, GW_CFG_MODE_*.
     uint16_t nInverterState;  //The inverter's current GwInverterStatus state.
     uint16_t nSolarVolts;     //Real time solar panel voltage.
     uint16_t nSolarWatts;     //Real time solar panel output watts.
@@ -43,6 +66,7 @@ struct SystemStatus
     uint16_t nOutputApppwr;   //Output load but slightly higher. Includes non-charging inverter power?
     uint16_t nAcChargeWattsL; //Battery charging watts from the grid.
     uint16_t nBatteryVolts;   //Voltage of the batteries.
+    uint16_t nBatterySoc;     //Battery state of charge as a percentage, as reported by the BMS.
     uint16_t nBusVolts;       //Bus volts, nominally 39V-46V. For monitoring.
     uint16_t nGridVolts;      //Incoming grid voltage, whether bypassing or not. Can detect external power cuts.
     uint16_t nGridFreq;       //Incoming grid frequency, in case it's not 50Hz?
@@ -67,6 +91,151 @@ struct SystemStatus
     uint16_t nInvFanspeed;    //Real time inverter fan speed, as a percentage of max speed.
 };
 
+//The inverter fields above, in order, as bits of a client's interest set (OBJECT_INTEREST).
+//Fields the server's own control doesn't need are only polled while some client wants them.
+#define STATUS_FIELD_INVERTER_STATE  0
+#define STATUS_FIELD_SOLAR_VOLTS     1
+#define STATUS_FIELD_SOLAR_WATTS     2
+#define STATUS_FIELD_OUTPUT_WATTS    3
+#define STATUS_FIELD_OUTPUT_APPPWR   4
+#define STATUS_FIELD_AC_CHARGE_WATTS 5
+#define STATUS_FIELD_BATTERY_VOLTS   6
+#define STATUS_FIELD_BATTERY_SOC     7
+#define STATUS_FIELD_BUS_VOLTS       8
+#define STATUS_FIELD_GRID_VOLTS      9
+#define STATUS_FIELD_GRID_FREQ       10
+#define STATUS_FIELD_AC_OUT_VOLTS    11
+#define STATUS_FIELD_AC_OUT_FREQ     12
+#define STATUS_FIELD_INVERTER_TEMP   13
+#define STATUS_FIELD_DCDC_TEMP       14
+#define STATUS_FIELD_LOAD_PERCENT    15
+#define STATUS_FIELD_BUCK1_TEMP      16
+#define STATUS_FIELD_BUCK2_TEMP      17
+#define STATUS_FIELD_OUTPUT_AMPS     18
+#define STATUS_FIELD_INVERTER_AMPS   19
+#define STATUS_FIELD_AC_INPUT_WATTS  20
+#define STATUS_FIELD_SOLAR_TODAY     21
+#define STATUS_FIELD_ACCHGEGY_TODAY  22
+#define STATUS_FIELD_BATTUSE_TODAY   23
+#define STATUS_FIELD_AC_USE_TODAY    24
+#define STATUS_FIELD_BATTCHG_AMPS    25
+#define STATUS_FIELD_AC_USE_WATTS    26
+#define STATUS_FIELD_BATTUSE_WATTS   27
+#define STATUS_FIELD_BATT_WATTS      28
+#define STATUS_FIELD_INV_FANSPEED    29
+#define STATUS_FIELD_COUNT           30
+
+#define STATUS_FIELD_BIT(field)      ((uint32_t)1 << (field))
+#define STATUS_FIELD_ALL             (STATUS_FIELD_BIT(STATUS_FIELD_COUNT) - 1)
+
+#define EVENT_SYSTEM_STATE_CHANGED   0x0001 /* nSystemState changed. */
+#define EVENT_INVERTER_MODE_CHANGED  0x0002 /* nInverterMode changed. */
+#define EVENT_INVERTER_STATE_CHANGED 0x0003 /* nInverterState changed. */
+#define EVENT_CHARGING_STOPPED       0x0004 /* Battery charge current fell to (near) zero. */
+#define EVENT_GRID_LOST              0x0005 /* Grid voltage fell away. */
+#define EVENT_GRID_RESTORED          0x0006 /* Grid voltage came back. */
+#define EVENT_LOAD_SURGE             0x0007 /* Output load rose unusually quickly. */
+#define EVENT_READINGS_STUCK         0x0008 /* A reading that always wanders hasn't changed for ages. */
+#define EVENT_INVERTER_FAULT         0x0009 /* An inverter's fault code changed. nValue is the new code, zero once cleared. */
+#define EVENT_INVERTER_WARNING       0x000A /* An inverter's warning code changed. */
+
+struct SystemEvent
+{
+    int32_t slTime;           //When the event was detected.
+    uint16_t nEventID;        //EVENT_*.
+    uint16_t nValue;          //The value that raised the event.
+    uint16_t nPrevious;       //The value on the previous sample.
+    uint16_t nReserved;
+};
+
+#define SCHEDULE_MAX_ENTRIES 32
+
+struct ScheduledCommand
+{
+    uint32_t lScheduleId;     //Server's ID for the entry. Zero when asking for one to be added.
+    int32_t slStart;          //Next time it runs (time_t).
+    int32_t slDuration;       //How long it lasts before being undone, in seconds. Zero for a one-off.
+    int32_t slPeriod;         //How often it repeats, in seconds. Zero to run once.
+    uint16_t nCommandID;      //COMMAND_REQUEST_GRID, COMMAND_REQUEST_BOOST or COMMAND_CHARGE_AMPS.
+    uint16_t nParam;          //Amps, for COMMAND_CHARGE_AMPS.
+};
+
+struct ScheduleList
+{
+    uint16_t nCount;
+    uint16_t nReserved;
+    struct ScheduledCommand entries[SCHEDULE_MAX_ENTRIES];
+};
+
+#define COMMAND_RESULT_DONE     0 /* Carried out. */
+#define COMMAND_RESULT_REFUSED  1 /* Not allowed in the current system state. */
+
+struct CommandResult
+{
+    uint32_t lCommandId;      //Server's ID for the request.
+    uint32_t lLatencyUs;      //From queueing the request to the inverter write completing.
+    uint16_t nCommandID;      //COMMAND_* requested.
+    uint16_t nResult;         //COMMAND_RESULT_*.
+};
+
+#define FAULT_KIND_FAULT     0
+#define FAULT_KIND_WARNING   1
+#define FAULT_ANY_KIND       0xFF
+#define FAULT_ANY_CODE       0xFFFF
+
+#define FAULT_LIST_MAX       32     /* Most records returned by one query. */
+#define FAULT_PRE_SAMPLES    8      /* Samples kept from before each fault. */
+#define FAULT_POST_SAMPLES   4      /* And from after it. */
+
+struct FaultRecord
+{
+    uint32_t lFaultId;        //Server's ID for the record, counting up from 1.
+    int32_t slTime;           //When it was seen (time_t).
+    uint8_t cInverter;        //0 is the master.
+    uint8_t cKind;            //FAULT_KIND_*.
+    uint8_t cCode;            //FAULTVALUE or WARNVALUE. The code that cleared, when bCleared.
+    uint8_t bCleared;
+    uint16_t nBits;           //FAULTBIT or WARNBIT.
+    uint16_t nDtc;
+};
+
+struct FaultQuery
+{
+    int32_t slFrom;           //Time range, inclusive.
+    int32_t slTo;
+    uint16_t nCode;           //Or FAULT_ANY_CODE.
+    uint8_t cKind;            //Or FAULT_ANY_KIND.
+    uint8_t cReserved;
+};
+
+struct FaultList
+{
+    uint16_t nCount;
+    uint16_t nMatches;        //Matching records held, which may be more than were returned.
+    struct FaultRecord records[FAULT_LIST_MAX];  //Newest first.
+};
+
+struct FaultSample
+{
+    int32_t slOffsetMs;       //From the sample the fault was seen on.
+    uint16_t nOutputWatts;    //Raw, in the register map's own units.
+    uint16_t nLoadPercent;
+    uint16_t nBusVolts;
+    uint16_t nBatteryVolts;
+    uint16_t nGridVolts;
+    uint16_t nBattchgAmps;
+};
+
+struct FaultCapture
+{
+    uint32_t lFaultId;        //Zero if there's no capture for the record asked for.
+    uint8_t cInverter;
+    uint8_t cPre;             //Samples up to and including the fault's own.
+    uint8_t cPost;            //Samples after it, so far.
+    uint8_t cReserved;
+    struct FaultSample samples[FAULT_PRE_SAMPLES + FAULT_POST_SAMPLES];
+};
+
 void GrowattInputRegsToSystem(struct SystemStatus* pStatus, uint16_t* inputRegs);
 
 #endif
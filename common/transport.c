@@ -0,0 +1,154 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "transport.h"
+
+static int64_t transport_NowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//Count and time a transaction that started at llStartNs, and capture it.
+static int transport_Account(struct Transport* pTransport, const struct CaptureCall* pCall, int64_t llStartNs, int rc)
+{
+    int lError = -1 == rc ? errno : 0;
+    int64_t llBusyNs = transport_NowNs() - llStartNs;
+    struct CaptureFrames frames;
+
+    //Taken whether it's being captured or not, so they're never left over for the next.
+    bool bFrames = NULL != pTransport->pOps->pFrames && pTransport->pOps->pFrames(pTransport->pContext, &frames);
+
+    pTransport->llBusyNs += llBusyNs;
+    pTransport->lTransactions++;
+
+    if(-1 == rc)
+        pTransport->lErrors++;
+
+    if(NULL != pTransport->pCapture)
+        capture_Add(pTransport->pCapture, pCall, bFrames ? &frames : NULL, lError, (uint32_t)(llBusyNs / 1000));
+
+    if(-1 == rc)
+        errno = lError;
+
+    return rc;
+}
+
+void transport_Initialise(struct Transport* pTransport, uint8_t cType, const char* pName,
+                          const struct TransportOps* pOps, void* pContext)
+{
+    memset(pTransport, 0x00, sizeof(struct Transport));
+    pTransport->cType = cType;
+    pTransport->pOps = pOps;
+    pTransport->pContext = pContext;
+    snprintf(pTransport->name, sizeof(pTransport->name), "%s %s", transport_TypeName(cType), pName);
+}
+
+int transport_Connect(struct Transport* pTransport)
+{
+    return pTransport->pOps->pConnect(pTransport->pContext);
+}
+
+void transport_Free(struct Transport* pTransport)
+{
+    if(NULL != pTransport->pContext)
+        pTransport->pOps->pFree(pTransport->pContext);
+
+    pTransport->pContext = NULL;
+}
+
+void transport_SetCapture(struct Transport* pTransport, struct Capture* pCapture)
+{
+    pTransport->pCapture = pCapture;
+}
+
+int transport_SetSlave(struct Transport* pTransport, int lSlave)
+{
+    pTransport->lSlave = lSlave;
+    return pTransport->pOps->pSetSlave(pTransport->pContext, lSlave);
+}
+
+void transport_SetDebug(struct Transport* pTransport, bool bDebug)
+{
+    pTransport->pOps->pSetDebug(pTransport->pContext, bDebug);
+}
+
+int transport_ReadInputRegisters(struct Transport* pTransport, int lAddress, int lCount, uint16_t* pDest)
+{
+    struct CaptureCall call = { pTransport->lSlave, CAPTURE_FC_READ_INPUT, lAddress, lCount, pDest, 0, 0, NULL };
+    int64_t llStartNs = transport_NowNs();
+    return transport_Account(pTransport, &call, llStartNs, pTransport->pOps->pReadInput(pTransport->pContext, lAddress, lCount, pDest));
+}
+
+int transport_ReadRegisters(struct Transport* pTransport, int lAddress, int lCount, uint16_t* pDest)
+{
+    struct CaptureCall call = { pTransport->lSlave, CAPTURE_FC_READ_HOLDING, lAddress, lCount, pDest, 0, 0, NULL };
+    int64_t llStartNs = transport_NowNs();
+    return transport_Account(pTransport, &call, llStartNs, pTransport->pOps->pReadHolding(pTransport->pContext, lAddress, lCount, pDest));
+}
+
+int transport_WriteRegister(struct Transport* pTransport, int lAddress, uint16_t nValue)
+{
+    struct CaptureCall call = { pTransport->lSlave, CAPTURE_FC_WRITE_SINGLE, 0, 0, NULL, lAddress, 1, &nValue };
+    int64_t llStartNs = transport_NowNs();
+    return transport_Account(pTransport, &call, llStartNs, pTransport->pOps->pWriteSingle(pTransport->pContext, lAddress, nValue));
+}
+
+int transport_WriteRegisters(struct Transport* pTransport, int lAddress, int lCount, const uint16_t* pValues)
+{
+    struct CaptureCall call = { pTransport->lSlave, CAPTURE_FC_WRITE_MULTIPLE, 0, 0, NULL, lAddress, lCount, pValues };
+    int64_t llStartNs = transport_NowNs();
+    return transport_Account(pTransport, &call, llStartNs, pTransport->pOps->pWriteMultiple(pTransport->pContext, lAddress, lCount, pValues));
+}
+
+int transport_WriteAndReadRegisters(struct Transport* pTransport, int lWriteAddress, int lWriteCount, const uint16_t* pValues,
+                                    int lReadAddress, int lReadCount, uint16_t* pDest)
+{
+    struct CaptureCall call = { pTransport->lSlave, CAPTURE_FC_WRITE_AND_READ, lReadAddress, lReadCount, pDest, lWriteAddress, lWriteCount, pValues };
+    int64_t llStartNs = transport_NowNs();
+    return transport_Account(pTransport, &call, llStartNs,
+                             pTransport->pOps->pWriteAndRead(pTransport->pContext, lWriteAddress, lWriteCount, pValues,
+                                                             lReadAddress, lReadCount, pDest));
+}
+
+int transport_BroadcastRegisters(struct Transport* pTransport, int lAddress, int lCount, const uint16_t* pValues)
+{
+    struct CaptureCall call = { RTU_BROADCAST, 1 == lCount ? CAPTURE_FC_WRITE_SINGLE : CAPTURE_FC_WRITE_MULTIPLE, 0, 0, NULL, lAddress, lCount, pValues };
+    int64_t llStartNs = transport_NowNs();
+    return transport_Account(pTransport, &call, llStartNs, pTransport->pOps->pBroadcast(pTransport->pContext, lAddress, lCount, pValues));
+}
+
+const char* transport_StrError(const struct Transport* pTransport, int lError)
+{
+    return pTransport->pOps->pStrError(lError);
+}
+
+float transport_Rate(const struct Transport* pTransport)
+{
+    if(0 == pTransport->llBusyNs)
+        return 0.0f;
+
+    return (float)((double)pTransport->lTransactions * 1e9 / (double)pTransport->llBusyNs);
+}
+
+void transport_ResetStats(struct Transport* pTransport)
+{
+    pTransport->lTransactions = 0;
+    pTransport->lErrors = 0;
+    pTransport->llBusyNs = 0;
+}
+
+const char* transport_TypeName(uint8_t cType)
+{
+    switch(cType)
+    {
+        case TRANSPORT_RTU: return "RTU";
+        case TRANSPORT_TCP: return "TCP";
+        case TRANSPORT_REPLAY: return "Replay";
+        case TRANSPORT_CAPTURE: return "Capture";
+        default: return "Unknown";
+    }
+}
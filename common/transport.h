@@ -0,0 +1,99 @@
+
+//Register transport.
+//What the acquisition layer talks to the inverters through: register reads and writes on the
+//current slave, carried by whichever backend was picked at startup (RTU serial, MODBUS TCP via a
+//gateway, or replay from a file). Every transaction is timed, so each backend reports the rate
+//it actually achieves. Calls return -1 and set errno on failure, as libmodbus does.
+//Broadcasts go to every inverter in one frame, and nothing answers them.
+//Given a capture, every transaction is also kept there, whichever backend carried it.
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "capture.h"
+
+#define TRANSPORT_RTU     0
+#define TRANSPORT_TCP     1
+#define TRANSPORT_REPLAY  2
+#define TRANSPORT_CAPTURE 3
+
+#define TRANSPORT_NAME_MAX 80
+
+struct TransportOps
+{
+    int (*pConnect)(void* pContext);
+    void (*pFree)(void* pContext);                  //Closes too.
+    int (*pSetSlave)(void* pContext, int lSlave);
+    void (*pSetDebug)(void* pContext, bool bDebug);
+    int (*pReadInput)(void* pContext, int lAddress, int lCount, uint16_t* pDest);
+    int (*pReadHolding)(void* pContext, int lAddress, int lCount, uint16_t* pDest);
+    int (*pWriteSingle)(void* pContext, int lAddress, uint16_t nValue);
+    int (*pWriteMultiple)(void* pContext, int lAddress, int lCount, const uint16_t* pValues);
+    int (*pWriteAndRead)(void* pContext, int lWriteAddress, int lWriteCount, const uint16_t* pValues,
+                         int lReadAddress, int lReadCount, uint16_t* pDest);
+    int (*pBroadcast)(void* pContext, int lAddress, int lCount, const uint16_t* pValues);
+    const char* (*pStrError)(int lError);
+    bool (*pFrames)(void* pContext, struct CaptureFrames* pFrames);  //The last transaction's frames off the wire, once. NULL if never had.
+};
+
+struct Transport
+{
+    uint8_t cType;                    //TRANSPORT_*.
+    char name[TRANSPORT_NAME_MAX];    //e.g. "RTU /dev/ttyXRUSB0".
+    const struct TransportOps* pOps;
+    void* pContext;                   //The backend's own.
+    struct Capture* pCapture;         //Where transactions are kept, if anywhere.
+    int lSlave;                       //As last set.
+    uint32_t lTransactions;
+    uint32_t lErrors;
+    int64_t llBusyNs;                 //Total time spent in transactions.
+};
+
+void transport_Initialise(struct Transport* pTransport, uint8_t cType, const char* pName,
+                          const struct TransportOps* pOps, void* pContext);
+
+int transport_Connect(struct Transport* pTransport);
+
+/**
+ * Close and free the backend. The transport can't be used again until re-initialised.
+ */
+void transport_Free(struct Transport* pTransport);
+
+/**
+ * Keep every transaction from here on in pCapture, or stop if it's NULL.
+ */
+void transport_SetCapture(struct Transport* pTransport, struct Capture* pCapture);
+
+int transport_SetSlave(struct Transport* pTransport, int lSlave);
+void transport_SetDebug(struct Transport* pTransport, bool bDebug);
+
+int transport_ReadInputRegisters(struct Transport* pTransport, int lAddress, int lCount, uint16_t* pDest);
+int transport_ReadRegisters(struct Transport* pTransport, int lAddress, int lCount, uint16_t* pDest);
+int transport_WriteRegister(struct Transport* pTransport, int lAddress, uint16_t nValue);
+int transport_WriteRegisters(struct Transport* pTransport, int lAddress, int lCount, const uint16_t* pValues);
+int transport_WriteAndReadRegisters(struct Transport* pTransport, int lWriteAddress, int lWriteCount, const uint16_t* pValues,
+                                    int lReadAddress, int lReadCount, uint16_t* pDest);
+
+/**
+ * Write holding registers on every inverter at once, as slave 0. Returns once the frame's sent, as
+ * there's no reply to wait for, so whether it took has to be read back from each.
+ */
+int transport_BroadcastRegisters(struct Transport* pTransport, int lAddress, int lCount, const uint16_t* pValues);
+
+const char* transport_StrError(const struct Transport* pTransport, int lError);
+
+/**
+ * Transactions per second the backend has achieved so far, going flat out. Zero before the first.
+ */
+float transport_Rate(const struct Transport* pTransport);
+
+/**
+ * Clear the transaction counts and timing.
+ */
+void transport_ResetStats(struct Transport* pTransport);
+
+const char* transport_TypeName(uint8_t cType);
+
+#endif
@@ -3,40 +3,38 @@
 
 uint16_t utils_GetOffpeakChargingAmps(struct SystemStatus* pSystemStatus)
 {
-    //Intelligent charging calculation.
+    //Energy-based charging calculation, for when the batteries aren't reporting a state of charge.
     uint16_t nResult = GW_CFG_UTIL_AMPS_MOD;
 
-    /*if(pSystemStatus->nOffPeakChargeKwh > 0) //Don't do this unless we've measured an off-peak charge energy.
+    if(pSystemStatus->nOffPeakChargeKwh > 0) //Don't do this unless we've measured an off-peak charge energy.
     {
-        float fltBoostChargeEnergy = (float)(pSystemStatus->nAcchgegyToday - pSystemStatus->nOffPeakChargeKwh) *
-                                     GW_WORST_CASE_CHARGE_EFFICIENCY;
-        float fltBattUseEnergy = (float)(pSystemStatus->nBattuseToday / GW_WORST_CASE_CHARGE_EFFICIENCY);
-        float fltSolarEnergy = (float)pSystemStatus->nSolarToday;
-                
-        //If more was charged than discharge, go with lower cap (sidestep wrapping issues).
-        if(fltBoostChargeEnergy > fltBattUseEnergy)
-        {
+        float fltBoostChargeEnergy = (float)pSystemStatus->nAcchgegyToday - (float)pSystemStatus->nOffPeakChargeKwh;
+        float fltEnergyToCharge = (((float)pSystemStatus->nBattuseToday / GW_WORST_CASE_CHARGE_EFFICIENCY) -
+                                  (fltBoostChargeEnergy * GW_WORST_CASE_CHARGE_EFFICIENCY)) * GW_WH_MULTIPLIER;
+        float fltChargeCurrent = fltEnergyToCharge / CHARGE_VOLTAGE / CHARGE_HOURS;
+        
+        //If boost charging already covered it, go with the lower cap (sidestep wrapping issues).
+        if(fltChargeCurrent < (float)CHARGE_MIN_AMPS)
             nResult = CHARGE_MIN_AMPS;
-        }
+        else if(fltChargeCurrent > (float)GW_CFG_UTIL_AMPS_MAX)
+            nResult = GW_CFG_UTIL_AMPS_MAX;
         else
-        {
-            float fltEnergyToCharge = (fltBattUseEnergy - fltBoostChargeEnergy - fltSolarEnergy) * GW_WH_MULTIPLIER;
-            float fltChargeCurrent = fltEnergyToCharge / CHARGE_VOLTAGE / CHARGE_HOURS;
-        
-            //Charge current is shared by the inverters.
-            if(fltEnergyToCharge > 0)
-                nResult = (uint16_t)((fltChargeCurrent / (float)INVERTER_COUNT) + 0.5f);
-            else
-                nResult = 0;
-        }
+            nResult = (uint16_t)(fltChargeCurrent + 0.5f);
     }
     
-    //Sanity checks, spreading sane current values across the inverters.
-    if(nResult > (GW_CFG_UTIL_AMPS_MAX / INVERTER_COUNT))
-        nResult = (GW_CFG_UTIL_AMPS_MAX / INVERTER_COUNT);
-    else if(nResult < (CHARGE_MIN_AMPS / INVERTER_COUNT))
-        nResult = (CHARGE_MIN_AMPS / INVERTER_COUNT);*/
+    //Sanity checks.
+    if(nResult > GW_CFG_UTIL_AMPS_MAX)
+        nResult = GW_CFG_UTIL_AMPS_MAX;
+    else if(nResult < CHARGE_MIN_AMPS)
+        nResult = CHARGE_MIN_AMPS;
     
     return nResult;
 }
 
+int utils_MinutesUntilOffPeakEnd(int lHour, int lMin)
+{
+    int lNow = (lHour * 60) + lMin;
+    int lEnd = (SYSTEM_END_OFF_PEAK_H * 60) + SYSTEM_END_OFF_PEAK_M;
+    
+    return ((lEnd - lNow) + (24 * 60)) % (24 * 60);
+}
@@ -7,6 +7,7 @@
 #include "system_defs.h"
 
 uint16_t utils_GetOffpeakChargingAmps(struct SystemStatus* pSystemStatus);
+int utils_MinutesUntilOffPeakEnd(int lHour, int lMin);
 
 #endif
 
@@ -0,0 +1,359 @@
+
+//Accelerated replay of recorded history through the server's own switching and charging decisions.
+//Time comes from the records rather than the wall clock, so a day goes through in milliseconds.
+//The batteries are simulated from the recorded loads, so the controller sees the consequences of
+//its own decisions rather than whatever the real system did at the time.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "system_defs.h"
+#include "spf5000es_defs.h"
+#include "control.h"
+#include "reconcile.h"
+#include "history.h"
+#include "gridquality.h"
+
+#define REPLAY_MAX_GAP_S       60     /* Longer gaps between records aren't integrated. */
+#define REPLAY_PEAK_PENCE      30.0f  /* Default price per kWh. */
+#define REPLAY_OFF_PEAK_PENCE  7.5f
+
+struct Replay
+{
+    struct Controller controller;
+    struct GridQuality gridQuality;
+    struct SystemStatus status;
+    uint16_t holdingRegs[GW_HREG_COUNT];
+
+    bool bStarted;
+    bool bVerbose;
+    int32_t slStart;
+    int32_t slLast;
+    float fltBatteryWh;
+    float fltMinSoc;
+
+    //Totals.
+    double dblPeakGridWh;
+    double dblOffPeakGridWh;
+    double dblBatteryWh;
+    uint32_t lTransitions;
+    uint32_t lWrites;
+    uint32_t lRecords;
+    int32_t slStateSeconds[SYSTEM_STATE_BOOST + 1];
+};
+
+static const char* StateName(uint16_t nSystemState)
+{
+    switch(nSystemState)
+    {
+        case SYSTEM_STATE_PEAK: return "PEAK";
+        case SYSTEM_STATE_BYPASS: return "BYPASS";
+        case SYSTEM_STATE_OFF_PEAK: return "OFF-PEAK";
+        case SYSTEM_STATE_BOOST: return "BOOST";
+        default: return "GOD KNOWS!";
+    }
+}
+
+static void PrintTime(int32_t slTime)
+{
+    time_t rawtime = slTime;
+    struct tm timeinfo;
+    char timestamp[20];
+
+    localtime_r(&rawtime, &timeinfo);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &timeinfo);
+    printf("[%s] ", timestamp);
+}
+
+//Bring the simulated inverter's holding registers into line with the state, as the server would.
+static void Reconcile(struct Replay* pReplay, int32_t slNow)
+{
+    struct RegisterSetting desired[RECONCILE_MAX_SETTINGS];
+    struct ReconcileWrite writes[RECONCILE_MAX_SETTINGS];
+
+    uint8_t cDesired = reconcile_GetDesired(pReplay->status.nSystemState, control_ChargeLimit(&pReplay->controller, &pReplay->status, 0), desired);
+    uint8_t cWrites = reconcile_Diff(desired, cDesired, pReplay->holdingRegs, writes);
+
+    for(uint8_t i = 0; i < cWrites; i++)
+    {
+        if(pReplay->bVerbose)
+        {
+            PrintTime(slNow);
+            printf("Write %d register(s) from %d:", writes[i].nCount, writes[i].nAddress);
+
+            for(uint16_t j = 0; j < writes[i].nCount; j++)
+                printf(" %d", writes[i].nValues[j]);
+
+            printf("\n");
+        }
+
+        reconcile_Apply(&writes[i], pReplay->holdingRegs);
+        pReplay->lWrites++;
+    }
+}
+
+static void ApplyActions(struct Replay* pReplay, const struct ControlActions* pActions, const struct ControlTime* pTime)
+{
+    for(uint8_t i = 0; i < pActions->cCount; i++)
+    {
+        const struct ControlAction* pAction = &pActions->actions[i];
+
+        if(pReplay->bVerbose && CONTROL_SWITCH == pAction->cAction)
+        {
+            PrintTime(pTime->slNow);
+            printf("%s -> %s at %.1f%% SoC", StateName(pReplay->status.nSystemState), StateName(pAction->nState),
+                   100.0f * pReplay->fltBatteryWh / BATTERY_CAPACITY_WH);
+
+            if(SYSTEM_STATE_OFF_PEAK == pAction->nState)
+                printf(", charging at %d amps", pAction->nChargeCurrent);
+
+            printf(".\n");
+        }
+        else if(pReplay->bVerbose && CONTROL_CHARGE == pAction->cAction)
+        {
+            PrintTime(pTime->slNow);
+            printf("Re-planned at %d%% SoC to %d amps.\n", pReplay->status.nBatterySoc, pAction->nChargeCurrent);
+        }
+
+        if(CONTROL_SWITCH == pAction->cAction)
+            pReplay->lTransitions++;
+
+        //Instant, as far as the replay's concerned.
+        if(CONTROL_SWITCH == pAction->cAction && CONTROL_REASON_OVERLOAD == pAction->cReason)
+            overload_WriteCompleted(&pReplay->controller.overload, pTime->llNowMs);
+
+        //The other inverters' limits aren't in the image. Count their writes as the server would make them.
+        if(CONTROL_BALANCE == pAction->cAction)
+            pReplay->lWrites += __builtin_popcount(pAction->cInverters & 0xFE);
+
+        control_Apply(&pReplay->status, pAction);
+        Reconcile(pReplay, pTime->slNow);
+    }
+}
+
+//Run the simulated system from the last record to this one.
+static void Integrate(struct Replay* pReplay, const struct HistoryRecord* pRecord, bool bPeak)
+{
+    int32_t slElapsed = pRecord->slTime - pReplay->slLast;
+
+    if(slElapsed <= 0 || slElapsed > REPLAY_MAX_GAP_S)
+        return;
+
+    float fltHours = (float)slElapsed / 3600.0f;
+    float fltLoadWatts = 0.0f;
+    float fltGridWh = 0.0f;
+
+    for(int i = 0; i < INVERTER_COUNT; i++)
+        fltLoadWatts += (float)pRecord->nOutputWatts[i] / 10.0f;
+
+    float fltLoadWh = fltLoadWatts * fltHours;
+
+    pReplay->status.nBattchgAmps = 0;
+    //The state's picked up from the file, which could hold anything.
+    if(pReplay->status.nSystemState < sizeof(pReplay->slStateSeconds) / sizeof(pReplay->slStateSeconds[0]))
+        pReplay->slStateSeconds[pReplay->status.nSystemState] += slElapsed;
+
+    if(SYSTEM_STATE_PEAK == pReplay->status.nSystemState)
+    {
+        //Batteries first, falling back to the grid once they're flat.
+        float fltFromBattery = fltLoadWh < pReplay->fltBatteryWh ? fltLoadWh : pReplay->fltBatteryWh;
+        pReplay->fltBatteryWh -= fltFromBattery;
+        pReplay->dblBatteryWh += fltFromBattery;
+        fltGridWh = fltLoadWh - fltFromBattery;
+    }
+    else
+    {
+        fltGridWh = fltLoadWh;
+
+        if(SYSTEM_STATE_BYPASS != pReplay->status.nSystemState && pReplay->fltBatteryWh < BATTERY_CAPACITY_WH)
+        {
+            uint16_t nAmps = 0;
+
+            for(uint8_t i = 0; i < INVERTER_COUNT; i++)
+                nAmps += control_ChargeLimit(&pReplay->controller, &pReplay->status, i);
+
+            float fltChargeWh = (float)nAmps * CHARGE_VOLTAGE * fltHours;
+            float fltStoredWh = fltChargeWh * GW_WORST_CASE_CHARGE_EFFICIENCY;
+
+            if(pReplay->fltBatteryWh + fltStoredWh > BATTERY_CAPACITY_WH)
+            {
+                fltStoredWh = BATTERY_CAPACITY_WH - pReplay->fltBatteryWh;
+                fltChargeWh = fltStoredWh / GW_WORST_CASE_CHARGE_EFFICIENCY;
+            }
+
+            pReplay->fltBatteryWh += fltStoredWh;
+            pReplay->status.nBattchgAmps = control_ChargeLimit(&pReplay->controller, &pReplay->status, 0) * 10;
+            fltGridWh += fltChargeWh;
+        }
+    }
+
+    if(bPeak)
+        pReplay->dblPeakGridWh += fltGridWh;
+    else
+        pReplay->dblOffPeakGridWh += fltGridWh;
+}
+
+static void Step(struct Replay* pReplay, const struct HistoryRecord* pRecord)
+{
+    struct ControlSample sample;
+    struct ControlActions actions;
+
+    control_Clock(&sample.time, pRecord->slTime, (int64_t)pRecord->slTime * 1000);
+
+    if(!pReplay->bStarted)
+    {
+        //Pick up where the real system was.
+        pReplay->bStarted = true;
+        pReplay->slStart = pRecord->slTime;
+        pReplay->slLast = pRecord->slTime;
+        pReplay->status.nSystemState = pRecord->nSystemState;
+
+        if(pReplay->fltBatteryWh < 0.0f)
+            pReplay->fltBatteryWh = (float)pRecord->nBatterySoc * BATTERY_CAPACITY_WH / 100.0f;
+
+        pReplay->fltMinSoc = 100.0f;
+    }
+
+    Integrate(pReplay, pRecord, control_IsPeak(sample.time.lHour, sample.time.lMin));
+    pReplay->slLast = pRecord->slTime;
+    pReplay->lRecords++;
+
+    float fltSoc = 100.0f * pReplay->fltBatteryWh / BATTERY_CAPACITY_WH;
+
+    if(fltSoc < pReplay->fltMinSoc)
+        pReplay->fltMinSoc = fltSoc;
+
+    pReplay->status.nBatterySoc = (uint16_t)(fltSoc + 0.5f);
+    pReplay->status.nBatteryVolts = pRecord->nBatteryVolts;
+    pReplay->status.nGridVolts = pRecord->nGridVolts;
+    pReplay->status.nGridFreq = pRecord->nGridFreq;
+    pReplay->status.nAcchgegyToday = pRecord->nAcchgegyToday;
+    pReplay->status.nOutputWatts = pRecord->nOutputWatts[0];
+    pReplay->status.nLoadPercent = pRecord->nLoadPercent[0];
+
+    //Each inverter draws what it's allowed, while there's room in the batteries.
+    for(int i = 0; i < INVERTER_COUNT; i++)
+    {
+        sample.inverters[i].nOutputWatts = pRecord->nOutputWatts[i];
+        sample.inverters[i].nLoadPercent = pRecord->nLoadPercent[i];
+        sample.nChargeAmps[i] = pReplay->status.nBattchgAmps ? control_ChargeLimit(&pReplay->controller, &pReplay->status, i) * 10 : 0;
+    }
+
+    //Outages are dealt with as soon as they're seen, as the server does.
+    uint8_t cGrid = gridquality_Sample(&pReplay->gridQuality, pRecord->nGridVolts, pRecord->nGridFreq, sample.time.llNowMs);
+
+    if(GRIDQUALITY_NONE != cGrid)
+    {
+        control_Grid(&pReplay->controller, &pReplay->status, cGrid, sample.time.slNow, &actions);
+        ApplyActions(pReplay, &actions, &sample.time);
+    }
+
+    control_Step(&pReplay->controller, &pReplay->status, &sample, &actions);
+    ApplyActions(pReplay, &actions, &sample.time);
+}
+
+static bool ReplayFile(struct Replay* pReplay, const char* pPath)
+{
+    FILE* file = fopen(pPath, "r");
+
+    if(NULL == file)
+    {
+        printf("Failed to open %s\n", pPath);
+        return false;
+    }
+
+    char line[HISTORY_LINE_MAX];
+    struct HistoryRecord record;
+
+    while(fgets(line, sizeof(line), file))
+    {
+        //Skips the header, and anything cut short by a restart.
+        if(history_Parse(line, &record))
+            Step(pReplay, &record);
+    }
+
+    fclose(file);
+    return true;
+}
+
+static void Usage()
+{
+    printf("Usage: replay [-v] [-p peak pence/kWh] [-o off-peak pence/kWh] [-s start SoC%%] history.csv...\n");
+}
+
+int main(int argc, char* argv[])
+{
+    static struct Replay replay;
+    float fltPeakPence = REPLAY_PEAK_PENCE;
+    float fltOffPeakPence = REPLAY_OFF_PEAK_PENCE;
+    int opt;
+
+    replay.fltBatteryWh = -1.0f;
+
+    while((opt = getopt(argc, argv, "vp:o:s:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'v': replay.bVerbose = true; break;
+            case 'p': fltPeakPence = atof(optarg); break;
+            case 'o': fltOffPeakPence = atof(optarg); break;
+            case 's': replay.fltBatteryWh = atof(optarg) * BATTERY_CAPACITY_WH / 100.0f; break;
+            default: Usage(); return 1;
+        }
+    }
+
+    if(optind >= argc)
+    {
+        Usage();
+        return 1;
+    }
+
+    struct OverloadConfig overloadConfig;
+    overload_DefaultConfig(&overloadConfig);
+    control_Initialise(&replay.controller, &overloadConfig);
+    gridquality_Initialise(&replay.gridQuality);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for(int i = optind; i < argc; i++)
+    {
+        if(!ReplayFile(&replay, argv[i]))
+            return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if(0 == replay.lRecords)
+    {
+        printf("No records.\n");
+        return 1;
+    }
+
+    double dblWallS = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    int32_t slSpan = replay.slLast - replay.slStart;
+    double dblPeakKwh = replay.dblPeakGridWh / 1000.0;
+    double dblOffPeakKwh = replay.dblOffPeakGridWh / 1000.0;
+
+    printf("\n");
+    printf("Records\t\t%u over %.1f hours\n", replay.lRecords, slSpan / 3600.0f);
+    printf("Grid at peak\t%.2fkWh\n", dblPeakKwh);
+    printf("Grid off-peak\t%.2fkWh\n", dblOffPeakKwh);
+    printf("From batteries\t%.2fkWh\n", replay.dblBatteryWh / 1000.0);
+    printf("Cost\t\t£%.2f\n", (dblPeakKwh * fltPeakPence + dblOffPeakKwh * fltOffPeakPence) / 100.0);
+    printf("Lowest SoC\t%.1f%%\n", replay.fltMinSoc);
+    printf("Transitions\t%u\n", replay.lTransitions);
+    printf("Register writes\t%u\n", replay.lWrites);
+    printf("Overload trips\t%u\n", replay.controller.overload.lTrips);
+
+    for(uint16_t i = 0; i <= SYSTEM_STATE_BOOST; i++)
+        printf("Time %s\t%.1f hours\n", StateName(i), replay.slStateSeconds[i] / 3600.0f);
+
+    printf("Replayed in %.3fs (%.0fx real time)\n", dblWallS, dblWallS > 0.0 ? slSpan / dblWallS : 0.0);
+
+    return 0;
+}
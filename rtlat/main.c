@@ -0,0 +1,162 @@
+
+//Scheduling latency under load.
+//Wakes on a fixed period the way the MODBUS thread does, and histograms how late each wakeup is.
+//Run it with and without -r under -c/-i load to see what real-time mode buys on a given box.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "latency.h"
+#include "realtime.h"
+
+#define RTLAT_INTERVAL_US   1000
+#define RTLAT_SECONDS       10
+#define RTLAT_IO_BYTES      (64 * 1024)   /* Written and synced per I/O load pass. */
+#define RTLAT_IO_FILE       "rtlat.tmp"
+
+volatile bool bRunning = true;
+
+//Spins until told to stop.
+static void* cpu_thread(void* arg)
+{
+    volatile uint32_t lSink = 0;
+
+    while(bRunning)
+        lSink++;
+
+    return NULL;
+}
+
+//Writes and syncs a file over and over, for page cache and block layer churn.
+static void* io_thread(void* arg)
+{
+    static char buffer[RTLAT_IO_BYTES];
+    memset(buffer, 0x5A, sizeof(buffer));
+
+    int fd = open(RTLAT_IO_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if(fd < 0)
+    {
+        printf("Failed to open %s: %s\n", RTLAT_IO_FILE, strerror(errno));
+        return NULL;
+    }
+
+    while(bRunning)
+    {
+        if(write(fd, buffer, sizeof(buffer)) < 0 || fsync(fd) < 0 || lseek(fd, 0, SEEK_SET) < 0)
+            break;
+    }
+
+    close(fd);
+    unlink(RTLAT_IO_FILE);
+    return NULL;
+}
+
+static void Usage()
+{
+    printf("Usage: rtlat [-r priority] [-a CPU] [-c CPU load threads] [-i I/O load threads] [-u interval us] [-t seconds]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    struct RealtimeConfig config = { 0, REALTIME_ANY_CPU };
+    int lCpuLoad = 0;
+    int lIoLoad = 0;
+    int lIntervalUs = RTLAT_INTERVAL_US;
+    int lSeconds = RTLAT_SECONDS;
+    int opt;
+
+    while((opt = getopt(argc, argv, "r:a:c:i:u:t:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'r': config.lPriority = atoi(optarg); break;
+            case 'a': config.lCpu = atoi(optarg); break;
+            case 'c': lCpuLoad = atoi(optarg); break;
+            case 'i': lIoLoad = atoi(optarg); break;
+            case 'u': lIntervalUs = atoi(optarg); break;
+            case 't': lSeconds = atoi(optarg); break;
+            default: Usage(); return 1;
+        }
+    }
+
+    if(lIntervalUs <= 0 || lSeconds <= 0)
+    {
+        Usage();
+        return 1;
+    }
+
+    //Same order as the server: lock memory before any threads, and only the
+    //measuring thread goes real-time.
+    if(config.lPriority > 0 && !realtime_LockMemory())
+        printf("Failed to lock memory: %s\n", strerror(errno));
+
+    pthread_t threads[lCpuLoad + lIoLoad + 1];
+    int lThreads = 0;
+
+    for(int i = 0; i < lCpuLoad; i++)
+        pthread_create(&threads[lThreads++], NULL, cpu_thread, NULL);
+
+    for(int i = 0; i < lIoLoad; i++)
+        pthread_create(&threads[lThreads++], NULL, io_thread, NULL);
+
+    //After the load's started, or it'd inherit the policy and starve everything else.
+    if((config.lPriority > 0 || REALTIME_ANY_CPU != config.lCpu) && !realtime_Enter(&config))
+        printf("Failed to go real-time: %s\n", strerror(errno));
+
+    printf("Waking every %dus for %ds, priority %d, CPU %d, %d CPU and %d I/O load thread(s).\n",
+           lIntervalUs, lSeconds, config.lPriority, config.lCpu, lCpuLoad, lIoLoad);
+
+    struct LatencyHistogram histogram;
+    latency_Initialise(&histogram);
+
+    struct timespec next;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    int64_t llEndNs = ((int64_t)next.tv_sec * 1000000000) + next.tv_nsec + ((int64_t)lSeconds * 1000000000);
+
+    for(;;)
+    {
+        next.tv_nsec += (long)lIntervalUs * 1000;
+
+        while(next.tv_nsec >= 1000000000)
+        {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        int64_t llLateNs = ((int64_t)(now.tv_sec - next.tv_sec) * 1000000000) + (now.tv_nsec - next.tv_nsec);
+        latency_Record(&histogram, llLateNs > 0 ? (uint32_t)(llLateNs / 1000) : 0);
+
+        if(((int64_t)now.tv_sec * 1000000000) + now.tv_nsec >= llEndNs)
+            break;
+    }
+
+    bRunning = false;
+
+    for(int i = 0; i < lThreads; i++)
+        pthread_join(threads[i], NULL);
+
+    printf("%u wakeups, %uus mean, 50%% <=%uus, 99%% <=%uus, 99.9%% <=%uus, %uus max\n",
+           histogram.lCount, latency_MeanUs(&histogram), latency_Percentile(&histogram, 50.0f),
+           latency_Percentile(&histogram, 99.0f), latency_Percentile(&histogram, 99.9f), histogram.lMaxUs);
+
+    for(int i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        if(histogram.lBuckets[i])
+            printf("%8uus+\t%u\n", i ? (1u << i) : 0, histogram.lBuckets[i]);
+    }
+
+    return 0;
+}
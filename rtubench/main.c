@@ -0,0 +1,249 @@
+
+//RTU master benchmark.
+//Runs the same register reads through libmodbus and the native RTU master against a simulated
+//inverter on a pty, and reports what each costs the calling thread per transaction: CPU time,
+//context switches (each one a sleep and a wakeup) and wall time. The simulated inverter answers
+//at once unless given a baud rate, so what's left is the master's own overhead.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "invsim.h"
+#include "rtu.h"
+#include "rtutransport.h"
+#include "modbustransport.h"
+
+#define RTUBENCH_TRANSACTIONS 2000
+#define RTUBENCH_UNITS        2
+#define RTUBENCH_BAUD         9600     /* What the masters are set up for. Only timed on the sim side with -w. */
+
+volatile bool bRunning = true;
+struct InvSim sim;
+int lWireBaud = 0;                     //Responses take as long as they would on the wire at this rate. Zero for at once.
+
+static int64_t NowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//How long a request is, from its function code. Zero if there's not enough of it to say.
+static uint16_t RequestLength(const uint8_t* pFrame, uint16_t nFrame)
+{
+    if(nFrame < 2)
+        return 0;
+
+    switch(pFrame[1])
+    {
+        case 0x10: return nFrame < 7 ? 0 : 9 + pFrame[6];
+        case 0x17: return nFrame < 11 ? 0 : 13 + pFrame[10];
+        default: return 8;
+    }
+}
+
+//The simulated inverters on the master side of the pty, answering each request as soon as it's whole.
+static void* slave_thread(void* arg)
+{
+    int fd = *(int*)arg;
+    uint8_t frame[RTU_FRAME_MAX];
+    uint8_t response[RTU_FRAME_MAX];
+    uint16_t nFrame = 0;
+
+    while(bRunning)
+    {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+
+        if(poll(&pfd, 1, 100) <= 0)
+            continue;
+
+        ssize_t lRead = read(fd, frame + nFrame, sizeof(frame) - nFrame);
+
+        if(lRead <= 0)
+        {
+            usleep(1000);
+            continue;
+        }
+
+        nFrame += lRead;
+        uint16_t nLength = RequestLength(frame, nFrame);
+
+        if(0 == nLength || nFrame < nLength)
+            continue;
+
+        nFrame = 0;
+
+        if(rtu_Crc16(frame, nLength - 2) != (frame[nLength - 2] | (frame[nLength - 1] << 8)))
+            continue;
+
+        uint16_t nResponse = invsim_Request(&sim, frame[0], frame + 1, nLength - 3, response + 1);
+
+        if(0 == nResponse)
+            continue;
+
+        response[0] = frame[0];
+        uint16_t nCrc = rtu_Crc16(response, nResponse + 1);
+        response[nResponse + 1] = nCrc & 0xFF;
+        response[nResponse + 2] = nCrc >> 8;
+
+        if(lWireBaud)
+            usleep(((nResponse + 3) * 11 * 1000000) / lWireBaud);
+
+        if(write(fd, response, nResponse + 3) < 0)
+            break;
+    }
+
+    return NULL;
+}
+
+static int OpenPty(char* pSlave, size_t size)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if(fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0)
+        return -1;
+
+    snprintf(pSlave, size, "%s", ptsname(fd));
+
+    //Raw bytes, no echo or line discipline.
+    int lSlave = open(pSlave, O_RDWR | O_NOCTTY);
+    struct termios tio;
+
+    if(lSlave >= 0 && 0 == tcgetattr(lSlave, &tio))
+    {
+        cfmakeraw(&tio);
+        tcsetattr(lSlave, TCSANOW, &tio);
+    }
+
+    if(lSlave >= 0)
+        close(lSlave);
+
+    return fd;
+}
+
+static int64_t CpuUs(const struct rusage* pUsage)
+{
+    return (int64_t)(pUsage->ru_utime.tv_sec + pUsage->ru_stime.tv_sec) * 1000000 +
+           pUsage->ru_utime.tv_usec + pUsage->ru_stime.tv_usec;
+}
+
+static void Run(const char* pName, struct Transport* pTransport, int lTransactions)
+{
+    uint16_t regs[INPUT_REGISTER_COUNT];
+    struct rusage before;
+    struct rusage after;
+    int lFailed = 0;
+
+    if(-1 == transport_Connect(pTransport))
+    {
+        printf("%-10s failed to connect: %s\n", pName, transport_StrError(pTransport, errno));
+        return;
+    }
+
+    //Warm up, so the first transaction's setup isn't counted.
+    transport_SetSlave(pTransport, INVERTER_1_ID);
+    transport_ReadInputRegisters(pTransport, 0, INPUT_REGISTER_COUNT, regs);
+
+    getrusage(RUSAGE_THREAD, &before);
+    int64_t llStartNs = NowNs();
+
+    for(int i = 0; i < lTransactions; i++)
+    {
+        transport_SetSlave(pTransport, INVERTER_1_ID + i % RTUBENCH_UNITS);
+
+        if(-1 == transport_ReadInputRegisters(pTransport, 0, INPUT_REGISTER_COUNT, regs))
+            lFailed++;
+    }
+
+    int64_t llWallNs = NowNs() - llStartNs;
+    getrusage(RUSAGE_THREAD, &after);
+
+    long lSwitches = (after.ru_nvcsw - before.ru_nvcsw) + (after.ru_nivcsw - before.ru_nivcsw);
+
+    printf("%-10s %6d reads of %d, %4d failed  %8.1fus CPU  %5.2f wakeups  %8.1fus wall  per transaction\n",
+           pName, lTransactions, INPUT_REGISTER_COUNT, lFailed,
+           (double)(CpuUs(&after) - CpuUs(&before)) / lTransactions,
+           (double)lSwitches / lTransactions,
+           (double)llWallNs / 1000.0 / lTransactions);
+
+    transport_Free(pTransport);
+}
+
+static void Usage()
+{
+    printf("Usage: rtubench [-n transactions] [-m native|libmodbus] [-w wire baud]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    int lTransactions = RTUBENCH_TRANSACTIONS;
+    const char* pMaster = NULL;
+    char slave[128];
+    int opt;
+
+    while((opt = getopt(argc, argv, "n:m:w:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': lTransactions = atoi(optarg); break;
+            case 'm': pMaster = optarg; break;
+            case 'w': lWireBaud = atoi(optarg); break;
+            default: Usage(); return 1;
+        }
+    }
+
+    if(lTransactions <= 0)
+    {
+        Usage();
+        return 1;
+    }
+
+    int fd = OpenPty(slave, sizeof(slave));
+
+    if(fd < 0)
+    {
+        printf("Failed to create a pty: %s\n", strerror(errno));
+        return 1;
+    }
+
+    invsim_Initialise(&sim, RTUBENCH_UNITS, 50, 800, time(NULL), 0);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, slave_thread, &fd);
+
+    printf("Reading %d inverters on %s, %s.\n", RTUBENCH_UNITS, slave, lWireBaud ? "at wire speed" : "answered at once");
+
+    struct Transport transport;
+
+    if(NULL == pMaster || 0 == strcmp(pMaster, "libmodbus"))
+    {
+        if(modbustransport_InitialiseRtu(&transport, slave, RTUBENCH_BAUD))
+            Run("libmodbus", &transport, lTransactions);
+    }
+
+    if(NULL == pMaster || 0 == strcmp(pMaster, "native"))
+    {
+        struct RtuTransport rtu;
+        rtutransport_Initialise(&transport, &rtu, slave, RTUBENCH_BAUD);
+        Run("native", &transport, lTransactions);
+        printf("%-10s %.2f state machine wakeups, %u with gaps, %u timed out\n", "",
+               (double)rtu.master.lWakeups / rtu.master.lTransactions, rtu.master.lGaps, rtu.master.lTimeouts);
+    }
+
+    bRunning = false;
+    pthread_join(thread, NULL);
+    close(fd);
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+
+#include "gatewayserver.h"
+
+#define MBAP_LENGTH 7                 //Transaction, protocol, length and unit.
+
+#define GATEWAYSERVER_CLIENT_TIMEOUT 60   //Bin silent clients after this many seconds.
+
+static pthread_t gatewayThread;
+static bool bGatewayRunning = false;
+static int gatewaySocket;
+static int lGatewayPort;
+static struct Gateway* pServed;
+static atomic_int lGatewayClients;
+
+static bool ReceiveAll(int socket, uint8_t* pData, int lLength)
+{
+    return recv(socket, pData, lLength, MSG_WAITALL) == lLength;
+}
+
+static void* handle_gateway_client(void* arg)
+{
+    int socket = (int)(intptr_t)arg;
+    uint8_t request[MBAP_LENGTH + GATEWAY_PDU_MAX];
+    uint8_t response[MBAP_LENGTH + GATEWAY_PDU_MAX];
+
+    while(bGatewayRunning)
+    {
+        if(!ReceiveAll(socket, request, MBAP_LENGTH))
+            break;
+
+        //Length covers the unit and the PDU.
+        uint16_t nLength = (request[4] << 8) | request[5];
+
+        if(0 != request[2] || 0 != request[3] || nLength < 2 || nLength > GATEWAY_PDU_MAX + 1)
+            break;
+
+        if(!ReceiveAll(socket, request + MBAP_LENGTH, nLength - 1))
+            break;
+
+        uint16_t nResponse = gateway_Request(pServed, request[6], request + MBAP_LENGTH, nLength - 1, response + MBAP_LENGTH);
+
+        memcpy(response, request, 4);
+        response[4] = (uint8_t)((nResponse + 1) >> 8);
+        response[5] = (uint8_t)(nResponse + 1);
+        response[6] = request[6];
+
+        if(send(socket, response, MBAP_LENGTH + nResponse, MSG_NOSIGNAL) < 0)
+            break;
+    }
+
+    close(socket);
+    atomic_fetch_sub(&lGatewayClients, 1);
+    return NULL;
+}
+
+static void* handle_gateway(void* arg)
+{
+    printf("MODBUS gateway listening on port %d...\n", lGatewayPort);
+
+    while(bGatewayRunning)
+    {
+        int client_socket = accept(gatewaySocket, NULL, NULL);
+
+        if(-1 == client_socket)
+            continue;
+
+        if(atomic_load(&lGatewayClients) >= GATEWAYSERVER_MAX_CLIENTS)
+        {
+            printf("Too many MODBUS gateway clients\n");
+            close(client_socket);
+            continue;
+        }
+
+        //Small requests and responses. Don't hold them back.
+        int lOne = 1;
+        struct timeval timeout = { GATEWAYSERVER_CLIENT_TIMEOUT, 0 };
+        setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &lOne, sizeof(lOne));
+        setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        pthread_t clientThread;
+        atomic_fetch_add(&lGatewayClients, 1);
+
+        if(0 == pthread_create(&clientThread, NULL, handle_gateway_client, (void*)(intptr_t)client_socket))
+        {
+            pthread_detach(clientThread);
+        }
+        else
+        {
+            printf("Error creating MODBUS gateway client thread\n");
+            atomic_fetch_sub(&lGatewayClients, 1);
+            close(client_socket);
+        }
+    }
+
+    return NULL;
+}
+
+bool gatewayserver_init(int lPort, struct Gateway* pGateway)
+{
+    struct sockaddr_in server_addr;
+    int lOne = 1;
+
+    pServed = pGateway;
+    lGatewayPort = lPort;
+
+    if((gatewaySocket = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+    {
+        printf("Error creating MODBUS gateway socket\n");
+        return false;
+    }
+
+    setsockopt(gatewaySocket, SOL_SOCKET, SO_REUSEADDR, &lOne, sizeof(lOne));
+
+    memset(&server_addr, 0x00, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(lPort);
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+
+    if(bind(gatewaySocket, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1 ||
+       listen(gatewaySocket, GATEWAYSERVER_MAX_CLIENTS) == -1)
+    {
+        printf("Error binding MODBUS gateway to port %d\n", lPort);
+        close(gatewaySocket);
+        return false;
+    }
+
+    bGatewayRunning = true;
+
+    if(0 != pthread_create(&gatewayThread, NULL, handle_gateway, NULL))
+    {
+        printf("Error creating MODBUS gateway thread\n");
+        close(gatewaySocket);
+        bGatewayRunning = false;
+        return false;
+    }
+
+    return true;
+}
+
+void gatewayserver_deinit()
+{
+    if(!bGatewayRunning)
+        return;
+
+    bGatewayRunning = false;
+    shutdown(gatewaySocket, SHUT_RDWR);
+    close(gatewaySocket);
+    pthread_join(gatewayThread, NULL);
+}
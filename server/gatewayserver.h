@@ -0,0 +1,20 @@
+
+#ifndef GATEWAYSERVER_H
+#define GATEWAYSERVER_H
+
+#include <stdbool.h>
+#include "gateway.h"
+
+#define GATEWAYSERVER_MAX_CLIENTS 16   //Most MODBUS TCP clients connected at once.
+
+/**
+ * Serve MODBUS TCP on lPort from pGateway, in its own thread.
+ */
+bool gatewayserver_init(int lPort, struct Gateway* pGateway);
+
+/**
+ * Stop listening. Clients already connected are dropped as their threads next read.
+ */
+void gatewayserver_deinit();
+
+#endif
@@ -15,9 +15,33 @@
 
 #include <modbus.h>
 #include <errno.h>
+#include <semaphore.h>
 
 #include "utils.h"
+#include "reconcile.h"
+#include "forecast.h"
+#include "events.h"
+#include "gridquality.h"
+#include "cmdqueue.h"
+#include "schedule.h"
+#include "clocksync.h"
+#include "control.h"
+#include "history.h"
+#include "transport.h"
+#include "replaytransport.h"
+#include "capturetransport.h"
+#include "rtutransport.h"
+#include "comms_defs.h"
 #include "tcpserver.h"
+#include "modbustransport.h"
+#include "gateway.h"
+#include "gatewayserver.h"
+#include "latency.h"
+#include "faults.h"
+#include "snapshot.h"
+#include "broadcast.h"
+#include "pollplan.h"
+#include "realtime.h"
 
 bool bRunning = true;
 bool bLogging = true;
@@ -25,9 +49,30 @@ bool bMODBUSDebug = false;
 bool bDumpInputRegs = false;
 
 #define MODBUS_WAIT 150000
+#define MODBUS_DEVICE "/dev/ttyXRUSB0"
+#define MODBUS_BAUD   9600
+
+static_assert(BROADCAST_TURNAROUND_US >= MODBUS_WAIT, "Broadcasts need at least the usual gap before the read back");
 
 #define NUM_INVERTERS 8
 
+#define FORECAST_FILE "forecast.bin"
+#define SCHEDULE_FILE "schedule.bin"
+#define HISTORY_FILE  "history.csv"
+#define FAULTS_FILE   "faults.bin"
+#define SNAPSHOT_FILE "snapshot.bin"    //The latest. Each is also kept under its time.
+
+#define SNAPSHOT_REQUEST_NONE    0
+#define SNAPSHOT_REQUEST_TAKE    1
+#define SNAPSHOT_REQUEST_RESTORE 2
+
+#define SNAPSHOT_DIFFS_SHOWN 32
+
+#define INVERTERS_ALL ((1 << INVERTER_COUNT) - 1)
+
+#define GRID_FAST_SAMPLES 10      //Grid-only reads per pass while the grid is unstable.
+#define GRID_FAST_WAIT    50000
+
 enum ModbusState
 {
     INIT,
@@ -37,25 +82,99 @@ enum ModbusState
 };
 
 enum ModbusState modbusState = INIT;
-modbus_t *ctx;
+struct Transport transport;
+struct ReplayTransport replay;
+struct RtuTransport rtu;          //When built with RTU=NATIVE.
+struct CaptureTransport playback;
+struct Capture capture;           //The latest transactions, whichever transport.
+
+//Picked at startup. RTU on the RS485 adapter unless told otherwise.
+uint8_t cTransportType = TRANSPORT_RTU;
+const char* transportPath = MODBUS_DEVICE;    //Device, gateway host, replay or capture file.
+int lGatewayPort = MODBUSTRANSPORT_TCP_PORT;
+bool bRateReported = false;
+
+//MODBUS TCP gateway onto the register image. Off unless given a port.
+struct Gateway gateway;
+int lGatewayListenPort = 0;
+bool bGatewayWrites = false;      //Writes become commands for the control layer. Refused otherwise.
+
+//Real-time mode for the MODBUS thread. Off unless given a priority or CPU.
+struct RealtimeConfig realtimeConfig = { 0, REALTIME_ANY_CPU };
+struct LatencyHistogram wakeLatency;  //How late the MODBUS thread wakes from each pause.
+
+//Mode and charge limit changes broadcast to every inverter at once. Off unless asked for.
+bool bBroadcastWrites = false;
+struct LatencyHistogram broadcastWindow;  //How long the inverters could have disagreed after each.
+uint32_t lBroadcastsReaddressed;          //Broadcasts some inverter missed.
 
 struct SystemStatus status;
-uint16_t nInverterMode;
-uint16_t nChargeAmps;
-uint16_t nEndHour;
-bool bManualSwitchToGrid = false;
-bool bManualSwitchToBatts = false;
-bool bManualSwitchToBoost = false;
-int32_t slModeWriteTime;
+uint16_t holdingRegs[GW_HREG_COUNT];
+bool bFC23Supported = MODEL_FC_WRITE_AND_READ;
+struct LoadForecast forecast;
+struct Controller controller;
+struct GridQuality gridQuality;
+uint16_t inverterRegs[INVERTER_COUNT][INPUT_REGISTER_COUNT];   //Kept between passes, as not every register is read every pass.
+struct PollPlan masterPlan;        //Reads of the master's input registers, for what clients want.
+struct PollPlan slavePlan;         //The others only need what control does.
+struct CommandQueue commands;
+sem_t commandSem;                 //Posted with every command, to wake the MODBUS thread.
+uint32_t lCommandsDone;
+uint32_t lLastCommandUs;
+uint32_t lMaxCommandUs;
+struct ClockSync clockSync;
+struct Schedule schedule;
+pthread_mutex_t scheduleMutex = PTHREAD_MUTEX_INITIALIZER;   //Clients edit the schedule while the MODBUS thread runs it.
+char schedulePath[256];
+bool bSchedulePath = false;
+struct Faults faults;
+pthread_mutex_t faultsMutex = PTHREAD_MUTEX_INITIALIZER;     //Clients query faults while the MODBUS thread records them.
+char faultsPath[256];
+bool bFaultsPath = false;
+uint8_t cSnapshotRequest = SNAPSHOT_REQUEST_NONE;          //From the console, for the MODBUS thread.
+char snapshotRestorePath[256];
+pthread_mutex_t snapshotMutex = PTHREAD_MUTEX_INITIALIZER;
 
 static int lLoggingLastMin;
+static int32_t slHistoryLast;
                             
 
-uint16_t nLastInverterMode = 0xFFFF;
-uint16_t nLastSystemState = 0xFFFF;
-uint16_t nLastInverterState = 0xFFFF;
+struct EventEngine events;
 
 static void printft(const char* format, ...);
+static void printftlog(const char* filename, const char* format, ...);
+static uint32_t QueueCommand(uint16_t nCommandID, uint16_t nParam, uint16_t nOrigin);
+static void SaveSchedule();
+
+static const char* SystemStateName(uint16_t nSystemState)
+{
+    switch(nSystemState)
+    {
+        case SYSTEM_STATE_PEAK: return "PEAK";
+        case SYSTEM_STATE_BYPASS: return "BYPASS";
+        case SYSTEM_STATE_OFF_PEAK: return "OFF-PEAK";
+        case SYSTEM_STATE_BOOST: return "BOOST";
+        default: return "GOD KNOWS!";
+    }
+}
+
+static const char* InverterModeName(uint16_t nInverterMode)
+{
+    switch(nInverterMode)
+    {
+        case GW_CFG_MODE_BATTS: return "BATTERIES";
+        case GW_CFG_MODE_GRID: return "GRID";
+        default: return "GOD KNOWS!";
+    }
+}
+
+static const char* InverterStateName(uint16_t nInverterState)
+{
+    if(nInverterState < INVERTER_STATE_COUNT)
+        return GwInverterStatusStrings[nInverterState];
+        
+    return "UNKNOWN";
+}
 
 //Callbacks.
 void _tcpserver_GetStatus(uint8_t** ppStatus, uint32_t* pLength)
@@ -64,31 +183,120 @@ void _tcpserver_GetStatus(uint8_t** ppStatus, uint32_t* pLength)
     *pLength = sizeof(struct SystemStatus);
 }
 
-void _tcpserver_SetBatts()
+void _tcpserver_SetBatts(uint16_t nClient)
+{
+    printft("Remote user requested switch to batts (command %u).\n", QueueCommand(COMMAND_REQUEST_BATTS, 0, nClient));
+}
+
+void _tcpserver_SetGrid(uint16_t nClient)
 {
-    printft("Remote user requested switch to batts.\n");
-    bManualSwitchToGrid = false;
-    bManualSwitchToBatts = true;
-    bManualSwitchToBoost = false;
+    printft("Remote user requested switch to grid (command %u).\n", QueueCommand(COMMAND_REQUEST_GRID, 0, nClient));
+}
+
+void _tcpserver_SetBoost(uint16_t nClient)
+{
+    printft("Remote user requested switch to boost (command %u).\n", QueueCommand(COMMAND_REQUEST_BOOST, 0, nClient));
+}
+
+void _tcpserver_GetSchedule(struct ScheduleList* pList)
+{
+    pthread_mutex_lock(&scheduleMutex);
+    schedule_List(&schedule, pList);
+    pthread_mutex_unlock(&scheduleMutex);
+}
+
+uint32_t _tcpserver_AddSchedule(const struct ScheduledCommand* pCommand)
+{
+    uint32_t lScheduleId = 0;
+    
+    if(COMMAND_REQUEST_GRID == pCommand->nCommandID ||
+       COMMAND_REQUEST_BOOST == pCommand->nCommandID ||
+       (COMMAND_CHARGE_AMPS == pCommand->nCommandID && pCommand->nParam >= 1 && pCommand->nParam <= GW_CFG_UTIL_AMPS_MAX))
+    {
+        pthread_mutex_lock(&scheduleMutex);
+        lScheduleId = schedule_Add(&schedule, pCommand);
+        
+        if(0 != lScheduleId)
+            SaveSchedule();
+            
+        pthread_mutex_unlock(&scheduleMutex);
+    }
+    
+    if(0 != lScheduleId)
+        printft("Remote user scheduled command %u at %d for %ds every %ds (schedule %u).\n",
+                pCommand->nCommandID, pCommand->slStart, pCommand->slDuration, pCommand->slPeriod, lScheduleId);
+    else
+        printft("Remote user's schedule for command %u refused.\n", pCommand->nCommandID);
+        
+    return lScheduleId;
+}
+
+bool _tcpserver_CancelSchedule(uint32_t lScheduleId)
+{
+    pthread_mutex_lock(&scheduleMutex);
+    bool bCancelled = schedule_Cancel(&schedule, lScheduleId);
+    
+    if(bCancelled)
+        SaveSchedule();
+        
+    pthread_mutex_unlock(&scheduleMutex);
+    
+    printft(bCancelled ? "Remote user cancelled schedule %u.\n" : "Remote user tried to cancel unknown schedule %u.\n", lScheduleId);
+    
+    return bCancelled;
 }
 
-void _tcpserver_SetGrid()
+void _tcpserver_QueryFaults(const struct FaultQuery* pQuery, struct FaultList* pList)
 {
-    printft("Remote user requested switch to grid.\n");
-    bManualSwitchToGrid = true;
-    bManualSwitchToBatts = false;
-    bManualSwitchToBoost = false;
+    pthread_mutex_lock(&faultsMutex);
+    faults_Query(&faults, pQuery, pList);
+    pthread_mutex_unlock(&faultsMutex);
 }
 
-void _tcpserver_SetBoost()
+void _tcpserver_GetFaultCapture(uint32_t lFaultId, struct FaultCapture* pCapture)
 {
-    printft("Remote user requested switch to boost.\n");
-    bManualSwitchToGrid = false;
-    bManualSwitchToBatts = false;
-    bManualSwitchToBoost = true;
+    pthread_mutex_lock(&faultsMutex);
+    faults_Capture(&faults, lFaultId, pCapture);
+    pthread_mutex_unlock(&faultsMutex);
 }
 
 //Local functions.
+static int64_t MonotonicMs()
+{
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return ((int64_t)spec.tv_sec * 1000) + (spec.tv_nsec / 1000000);
+}
+
+static int64_t MonotonicUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void WakeModbus()
+{
+    sem_post(&commandSem);
+}
+
+//Queue a command for the MODBUS thread and wake it. Returns the command ID, or zero if the queue is full.
+static uint32_t QueueCommand(uint16_t nCommandID, uint16_t nParam, uint16_t nOrigin)
+{
+    uint32_t lCommandId = cmdqueue_Push(&commands, nCommandID, nParam, nOrigin, MonotonicUs());
+    
+    if(0 == lCommandId)
+    {
+        printft("Command queue is full! Dropped command %u.\n", nCommandID);
+    }
+    else
+    {
+        sem_post(&commandSem);
+    }
+    
+    return lCommandId;
+}
+
 //Printf with timestamp.
 static void printft(const char* format, ...)
 {
@@ -111,25 +319,9 @@ static void printft(const char* format, ...)
     va_end(args);
 }
 
-//Printf with timestamp and log to file.
-static void printftlog(const char* filename, const char* format, ...)
+//Path of a file in the 'invlogs/' directory in the user's home directory, creating the directory if needed.
+static bool GetLogPath(const char* filename, char* filepath, size_t size)
 {
-    va_list args;
-    va_start(args, format);
-
-    // Get the current time
-    time_t rawtime;
-    struct tm* timeinfo;
-    char timestamp[20];
-
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", timeinfo);
-
-    // Print the timestamp and the formatted message to the console
-    printf("[%s] ", timestamp);
-    vprintf(format, args);
-
     // Get the user's home directory
     const char* homeDir = getenv("HOME");
     if (homeDir == NULL)
@@ -147,16 +339,46 @@ static void printftlog(const char* filename, const char* format, ...)
     {
         if (mkdir(logDir, 0755) == -1) {
             printf("Error: Failed to create directory '%s': %s\n", logDir, strerror(errno));
-            va_end(args);
-            return;
+            return false;
         }
     }
 
     // Construct the full file path
-    char filepath[256];
-    if (snprintf(filepath, sizeof(filepath), "%s/%s", logDir, filename) >= sizeof(filepath))
+    if (snprintf(filepath, size, "%s/%s", logDir, filename) >= size)
     {
         printf("Error: File path is too long\n");
+        return false;
+    }
+    
+    return true;
+}
+
+//Printf with timestamp and log to file.
+static void printftlog(const char* filename, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+
+    // Get the current time
+    time_t rawtime;
+    struct tm* timeinfo;
+    char timestamp[20];
+
+    time(&rawtime);
+    timeinfo = localtime(&rawtime);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", timeinfo);
+
+    // Print the timestamp and the formatted message to the console. From a copy, as printing
+    // consumes the list on some ABIs (x86-64), and it's needed again for the file.
+    va_list args_console;
+    va_copy(args_console, args);
+    printf("[%s] ", timestamp);
+    vprintf(format, args_console);
+    va_end(args_console);
+
+    char filepath[256];
+    if (!GetLogPath(filename, filepath, sizeof(filepath)))
+    {
         va_end(args);
         return;
     }
@@ -174,10 +396,7 @@ static void printftlog(const char* filename, const char* format, ...)
     fprintf(file, "[%s] ", timestamp);
     
     // Write the formatted message to the file
-    va_list args_copy;
-    va_copy(args_copy, args);  // Create a copy of args to reuse
-    vfprintf(file, format, args_copy);
-    va_end(args_copy);
+    vfprintf(file, format, args);
 
     // Close the file
     fclose(file);
@@ -185,154 +404,763 @@ static void printftlog(const char* filename, const char* format, ...)
     va_end(args);
 }
 
-static void reinit()
+//Report events to the console, the events log and any subscribed clients.
+static void HandleEvent(struct EventEngine* pEngine, const struct SystemEvent* pEvent)
 {
-    printft("MODBUS comms reinit.\n");
+    switch(pEvent->nEventID)
+    {
+        case EVENT_SYSTEM_STATE_CHANGED:
+        {
+            printftlog("Events", "nSystemState changed to %s (%d)\n", SystemStateName(pEvent->nValue), pEvent->nValue);
+        }
+        break;
+        
+        case EVENT_INVERTER_MODE_CHANGED:
+        {
+            printftlog("Events", "nInverterMode changed to %s (%d)\n", InverterModeName(pEvent->nValue), pEvent->nValue);
+        }
+        break;
+        
+        case EVENT_INVERTER_STATE_CHANGED:
+        {
+            printftlog("Events", "nInverterState changed to %s (%d)\n", InverterStateName(pEvent->nValue), pEvent->nValue);
+        }
+        break;
+        
+        case EVENT_CHARGING_STOPPED:
+        {
+            //Record the off-peak charge completion time.
+            if(SYSTEM_STATE_OFF_PEAK == status.nSystemState)
+            {
+                status.slOffPeakChgComplete = pEvent->slTime;
+                printftlog("Events", "Off-peak charging completed.\n");
+            }
+        }
+        break;
+        
+        case EVENT_GRID_LOST:
+        {
+            printftlog("Events", "Grid lost! Grid volts down to %d.%dV.\n", pEvent->nValue / 10, pEvent->nValue % 10);
+        }
+        break;
+        
+        case EVENT_GRID_RESTORED:
+        {
+            printftlog("Events", "Grid restored at %d.%dV.\n", pEvent->nValue / 10, pEvent->nValue % 10);
+        }
+        break;
+        
+        case EVENT_LOAD_SURGE:
+        {
+            printftlog("Events", "Load surge from %dW to %dW.\n", pEvent->nPrevious / 10, pEvent->nValue / 10);
+        }
+        break;
+        
+        case EVENT_READINGS_STUCK:
+        {
+            printftlog("Events", "Battery volts stuck at %d. Stale readings?\n", pEvent->nValue);
+        }
+        break;
+    }
+    
+    tcpserver_PushEvent(pEvent);
+}
 
-    if(ctx != NULL)
+//Log, keep and pass on each change of an inverter's fault or warning.
+static void HandleFault(struct Faults* pFaults, const struct FaultRecord* pRecord)
+{
+    const char* pKind = FAULT_KIND_FAULT == pRecord->cKind ? "fault" : "warning";
+    
+    printftlog("Faults", "Inverter %d %s %02d \"%s\" %s (bits 0x%04X, DTC %d).\n", pRecord->cInverter + 1, pKind, pRecord->cCode,
+               faults_Describe(pRecord->cKind, pRecord->cCode), pRecord->bCleared ? "cleared" : "raised", pRecord->nBits, pRecord->nDtc);
+    
+    if(bFaultsPath && !faults_Append(pRecord, faultsPath))
     {
-        modbus_close(ctx);
-        modbus_free(ctx);
-        ctx = NULL;
+        printft("Failed to save %s %u.\n", pKind, pRecord->lFaultId);
     }
+    
+    struct SystemEvent event;
+    event.slTime = pRecord->slTime;
+    event.nEventID = FAULT_KIND_FAULT == pRecord->cKind ? EVENT_INVERTER_FAULT : EVENT_INVERTER_WARNING;
+    event.nValue = pRecord->bCleared ? 0 : pRecord->cCode;
+    event.nPrevious = pRecord->bCleared ? pRecord->cCode : 0;
+    event.nReserved = 0;
+    tcpserver_PushEvent(&event);
+}
+
+static void reinit()
+{
+    printft("MODBUS comms reinit.\n");
+
+    transport_Free(&transport);
 
     modbusState = INIT;
     sleep(1);
 }
 
-static void SetOvernightAmps()
+static bool CreateTransport()
 {
-    //Intelligent charging calculation.
-    status.nChargeCurrent = utils_GetOffpeakChargingAmps(&status);
+    switch(cTransportType)
+    {
+        case TRANSPORT_TCP: return modbustransport_InitialiseTcp(&transport, transportPath, lGatewayPort);
+        case TRANSPORT_REPLAY: replaytransport_Initialise(&transport, &replay, transportPath); return true;
+        case TRANSPORT_CAPTURE: capturetransport_Initialise(&transport, &playback, transportPath); return true;
+#if RTU_MASTER == RTU_MASTER_NATIVE
+        default: rtutransport_Initialise(&transport, &rtu, transportPath, MODBUS_BAUD); return true;
+#else
+        default: return modbustransport_InitialiseRtu(&transport, transportPath, MODBUS_BAUD);
+#endif
+    }
+}
+
+//Whether every inverter is meant to have the same charge limit, so one write can do for all.
+static bool SameChargeLimits()
+{
+    for(uint8_t i = 1; i < INVERTER_COUNT; i++)
+    {
+        if(control_ChargeLimit(&controller, &status, i) != control_ChargeLimit(&controller, &status, 0))
+            return false;
+    }
+    
+    return true;
+}
+
+//Write to every inverter in one frame, verified on each, and time how long they disagreed.
+static int BroadcastWrite(uint16_t nAddress, uint16_t nCount, const uint16_t* pValues)
+{
+    struct BroadcastResult result;
+    int rc = broadcast_Write(&transport, nAddress, nCount, pValues, &result);
+    
+    latency_Record(&broadcastWindow, result.lWindowUs);
     
-    if(modbus_write_register(ctx, GW_HREG_MAX_UTIL_AMPS, status.nChargeCurrent) < 0)
+    if(result.cReaddressed)
     {
-        printft("Failed to write steady util charging amps to config register: %s\n", modbus_strerror(errno));
+        lBroadcastsReaddressed++;
+        printft("Not every inverter took the broadcast to %d-%d (0x%02X). Wrote to them in turn.\n",
+                nAddress, nAddress + nCount - 1, result.cReaddressed);
     }
     
-    usleep(MODBUS_WAIT);
+    return rc;
+}
+
+//Bring the inverter's holding registers in line with the current system state,
+//writing only the registers that differ from the last observed image.
+//Returns the number of write transactions issued.
+static int Reconcile()
+{
+    struct RegisterSetting desired[RECONCILE_MAX_SETTINGS];
+    struct ReconcileWrite writes[RECONCILE_MAX_SETTINGS];
+    
+    uint16_t nChargeCurrent = control_ChargeLimit(&controller, &status, 0);
+    
+    uint8_t cDesired = reconcile_GetDesired(status.nSystemState, nChargeCurrent, desired);
+    uint8_t cWrites = reconcile_Diff(desired, cDesired, holdingRegs, writes);
+    
+    for(uint8_t i = 0; i < cWrites; i++)
+    {
+        struct ReconcileWrite* pWrite = &writes[i];
+        uint16_t readBack[GW_HREG_COUNT];
+        int rc = -1;
+        
+        //Only the state's own settings go to them all, never anything from the master's image, and the
+        //master's charge limit only if it's theirs too.
+        bool bBroadcast = bBroadcastWrites &&
+                          reconcile_Owned(desired, cDesired, pWrite) &&
+                          (GW_HREG_MAX_UTIL_AMPS < pWrite->nAddress ||
+                           GW_HREG_MAX_UTIL_AMPS >= pWrite->nAddress + pWrite->nCount ||
+                           SameChargeLimits());
+        
+        if(bBroadcast)
+        {
+            rc = BroadcastWrite(pWrite->nAddress, pWrite->nCount, pWrite->nValues);
+        }
+        else if(bFC23Supported)
+        {
+            //Write and read back in a single transaction.
+            rc = transport_WriteAndReadRegisters(&transport,
+                                                 pWrite->nAddress, pWrite->nCount, pWrite->nValues,
+                                                 pWrite->nAddress, pWrite->nCount, readBack);
+            
+            if(-1 == rc && EMBXILFUN == errno)
+            {
+                printft("Inverter doesn't support FC23 read/write. Falling back to plain writes.\n");
+                bFC23Supported = false;
+            }
+            else if(-1 != rc && 0 != memcmp(readBack, pWrite->nValues, pWrite->nCount * sizeof(uint16_t)))
+            {
+                printft("Holding registers %d-%d didn't read back as written.\n",
+                        pWrite->nAddress, pWrite->nAddress + pWrite->nCount - 1);
+                rc = -1;
+            }
+        }
+        
+        if(!bBroadcast && !bFC23Supported)
+        {
+            //Verified by the holding register image on the next pass instead.
+            if(1 == pWrite->nCount)
+                rc = transport_WriteRegister(&transport, pWrite->nAddress, pWrite->nValues[0]);
+            else
+                rc = transport_WriteRegisters(&transport, pWrite->nAddress, pWrite->nCount, pWrite->nValues);
+        }
+        
+        if(-1 == rc)
+        {
+            printft("Failed to write holding registers %d-%d: %s\n",
+                    pWrite->nAddress, pWrite->nAddress + pWrite->nCount - 1, transport_StrError(&transport, errno));
+        }
+        else
+        {
+            reconcile_Apply(pWrite, holdingRegs);
+            gateway_Update(&gateway, 0, true, pWrite->nAddress, pWrite->nCount, &holdingRegs[pWrite->nAddress], MonotonicMs());
+        }
+        
+        usleep(MODBUS_WAIT);
+    }
+    
+    return cWrites;
+}
+
+//Whether the holding register image already matches the current system state.
+static bool Reconciled()
+{
+    struct RegisterSetting desired[RECONCILE_MAX_SETTINGS];
+    struct ReconcileWrite writes[RECONCILE_MAX_SETTINGS];
+    
+    uint8_t cDesired = reconcile_GetDesired(status.nSystemState, control_ChargeLimit(&controller, &status, 0), desired);
+    return 0 == reconcile_Diff(desired, cDesired, holdingRegs, writes);
+}
+
+//Write each inverter's charge current limit to the inverters in cMask.
+static void WriteChargeLimits(uint8_t cMask)
+{
+    //All on the same limit, they can have it in one frame rather than in turn.
+    if(bBroadcastWrites && INVERTERS_ALL == (cMask & INVERTERS_ALL) && SameChargeLimits())
+    {
+        uint16_t nAmps = control_ChargeLimit(&controller, &status, 0);
+        
+        if(-1 == BroadcastWrite(GW_HREG_MAX_UTIL_AMPS, 1, &nAmps))
+        {
+            printft("Failed to broadcast util charging amps: %s\n", transport_StrError(&transport, errno));
+        }
+        else
+        {
+            holdingRegs[GW_HREG_MAX_UTIL_AMPS] = nAmps;
+            gateway_Update(&gateway, 0, true, GW_HREG_MAX_UTIL_AMPS, 1, &holdingRegs[GW_HREG_MAX_UTIL_AMPS], MonotonicMs());
+        }
+        
+        usleep(MODBUS_WAIT);
+        
+        //The rest of what the state wants of them.
+        if(SYSTEM_STATE_OFF_PEAK == status.nSystemState || SYSTEM_STATE_BOOST == status.nSystemState)
+            Reconcile();
+        
+        return;
+    }
+    
+    for(uint8_t i = 1; i < INVERTER_COUNT; i++)
+    {
+        if(cMask & (1 << i))
+        {
+            transport_SetSlave(&transport, INVERTER_1_ID + i);
+            
+            if(transport_WriteRegister(&transport, GW_HREG_MAX_UTIL_AMPS, control_ChargeLimit(&controller, &status, i)) < 0)
+            {
+                printft("Failed to write inverter %d util charging amps: %s\n", i + 1, transport_StrError(&transport, errno));
+            }
+            
+            usleep(MODBUS_WAIT);
+        }
+    }
+    
+    transport_SetSlave(&transport, INVERTER_1_ID);
+    
+    if(!(cMask & 1))
+        return;
+    
+    //The master goes through the holding register image like everything else, when the state says what its limit should be.
+    if(SYSTEM_STATE_OFF_PEAK == status.nSystemState || SYSTEM_STATE_BOOST == status.nSystemState)
+    {
+        Reconcile();
+    }
+    else
+    {
+        if(transport_WriteRegister(&transport, GW_HREG_MAX_UTIL_AMPS, status.nChargeCurrent) < 0)
+        {
+            printft("Failed to write util charging amps to config register: %s\n", transport_StrError(&transport, errno));
+        }
+        
+        usleep(MODBUS_WAIT);
+    }
+}
+
+//Append everything the controller judges by to the replayable history.
+static void RecordHistory(int32_t slNow)
+{
+    struct HistoryRecord record;
+    char line[HISTORY_LINE_MAX];
+    char filepath[256];
+    
+    record.slTime = slNow;
+    record.nSystemState = status.nSystemState;
+    record.nBatterySoc = status.nBatterySoc;
+    record.nBatteryVolts = status.nBatteryVolts;
+    record.nGridVolts = status.nGridVolts;
+    record.nGridFreq = status.nGridFreq;
+    record.nAcchgegyToday = status.nAcchgegyToday;
+    
+    for(int i = 0; i < INVERTER_COUNT; i++)
+    {
+        record.nOutputWatts[i] = inverterRegs[i][OUTPUT_WATTS_L];
+        record.nLoadPercent[i] = inverterRegs[i][LOAD_PERCENT];
+        record.nBattchgAmps[i] = inverterRegs[i][BATTCHG_AMPS];
+    }
+    
+    if(!history_Format(&record, line, sizeof(line)) || !GetLogPath(HISTORY_FILE, filepath, sizeof(filepath)))
+        return;
+        
+    FILE* file = fopen(filepath, "a");
+    
+    if(NULL == file)
+    {
+        printf("Error: Failed to open file '%s': %s\n", filepath, strerror(errno));
+        return;
+    }
+    
+    //New file. Say what the columns are.
+    if(0 == ftell(file))
+        fputs(HISTORY_HEADER, file);
+        
+    fputs(line, file);
+    fclose(file);
+}
+
+//Carry out what the controller decided.
+static void ApplyActions(const struct ControlActions* pActions)
+{
+    for(uint8_t i = 0; i < pActions->cCount; i++)
+    {
+        const struct ControlAction* pAction = &pActions->actions[i];
+        
+        control_Apply(&status, pAction);
+        
+        switch(pAction->cAction)
+        {
+            case CONTROL_SWITCH:
+            {
+                if(SYSTEM_STATE_OFF_PEAK == status.nSystemState || SYSTEM_STATE_BOOST == status.nSystemState)
+                    WriteChargeLimits(0xFF);
+                else
+                    Reconcile();
+                
+                switch(pAction->cReason)
+                {
+                    case CONTROL_REASON_OVERLOAD:
+                    {
+                        //Only timed if it took. Otherwise the next check will have another go.
+                        if(Reconciled())
+                        {
+                            overload_WriteCompleted(&controller.overload, MonotonicMs());
+                            printft("Overloaded! Switched to grid %ums after sampling.\n", controller.overload.lLastLatencyMs);
+                        }
+                        else
+                        {
+                            printft("Overloaded! Failed to switch to grid.\n");
+                        }
+                    }
+                    break;
+                    
+                    case CONTROL_REASON_OVERLOAD_CLEARED: printft("Overload cleared. Switched back to batts.\n"); break;
+                    case CONTROL_REASON_PEAK: printft("Switched to peak.\n"); break;
+                    case CONTROL_REASON_OFF_PEAK: printft("Switched to off-peak. Forecast use for the next 24h is %.1fkWh.\n", status.nForecastKwh / 10.0f); break;
+                    case CONTROL_REASON_OUTAGE: printft("Switched to batts due to the grid outage.\n"); break;
+                    case CONTROL_REASON_RESTORED: printft("Grid has stayed back. Switched back to grid.\n"); break;
+                    case CONTROL_REASON_COMMAND: printft("Switched to %s on request.\n", SystemStateName(status.nSystemState)); break;
+                }
+            }
+            break;
+            
+            case CONTROL_CHARGE:
+            {
+                WriteChargeLimits(0xFF);
+                
+                if(CONTROL_REASON_REPLAN == pAction->cReason)
+                    printft("Re-planned off-peak charging at %d%% SoC to %d amps.\n", status.nBatterySoc, status.nChargeCurrent);
+                else
+                    printft("Charging current set to %d amps on request.\n", status.nChargeCurrent);
+            }
+            break;
+            
+            case CONTROL_BALANCE:
+            {
+                WriteChargeLimits(pAction->cInverters);
+            }
+            break;
+            
+            case CONTROL_RECONCILE:
+            {
+                int lWrites = Reconcile();
+                
+                if(lWrites > 0)
+                {
+                    printft("Inverter settings weren't as expected. Rewrote %d holding register block(s).\n", lWrites);
+                }
+            }
+            break;
+        }
+    }
 }
 
-static void SetBoostAmps()
+//Set the inverter's clock to ours, leaving what was written in clockRegs. Returns true if it took.
+static bool SetClock(uint16_t* clockRegs)
 {
-    status.nChargeCurrent = GW_CFG_UTIL_AMPS_MAX;
+    int32_t slNow = time(NULL);
+    bool bSet = true;
     
-    if(modbus_write_register(ctx, GW_HREG_MAX_UTIL_AMPS, status.nChargeCurrent) < 0)
+    clocksync_ToRegisters(slNow, clockSync.bShortYear, clockRegs);
+    
+    if(transport_WriteRegisters(&transport, GW_HREG_TIME_Y, CLOCKSYNC_REG_COUNT, clockRegs) < 0)
+    {
+        printft("Failed to set the inverter's clock: %s\n", transport_StrError(&transport, errno));
+        bSet = false;
+    }
+    else
     {
-        printft("Failed to write max util charging amps to config register: %s\n", modbus_strerror(errno));
+        clocksync_Corrected(&clockSync, slNow);
     }
     
     usleep(MODBUS_WAIT);
+    return bSet;
+}
+
+//Measure the inverter's clock drift, and put it right if it's too far out or nonsense.
+//Only called when clocksync_Due, which limits how often either gets written.
+static void SyncClock()
+{
+    uint16_t clockRegs[CLOCKSYNC_REG_COUNT];
+    
+    int32_t slBefore = time(NULL);
+    int rc = transport_ReadRegisters(&transport, GW_HREG_TIME_Y, CLOCKSYNC_REG_COUNT, clockRegs);
+    int32_t slAfter = time(NULL);
+    usleep(MODBUS_WAIT);
+    
+    if(-1 == rc)
+    {
+        printft("Failed to read the inverter's clock: %s\n", transport_StrError(&transport, errno));
+        return;
+    }
+    
+    switch(clocksync_Measure(&clockSync, clockRegs, slBefore, slAfter))
+    {
+        case CLOCKSYNC_INVALID:
+        {
+            printft("Inverter's clock reads %d-%d-%d %d:%d:%d. Not a sensible date.\n",
+                    clockRegs[0], clockRegs[1], clockRegs[2], clockRegs[3], clockRegs[4], clockRegs[5]);
+            
+            //Its charge hours are meaningless until it's set.
+            if(SetClock(clockRegs))
+            {
+                printft("Set the inverter's clock to %d-%02d-%02d %02d:%02d:%02d.\n",
+                        clockRegs[0], clockRegs[1], clockRegs[2], clockRegs[3], clockRegs[4], clockRegs[5]);
+            }
+        }
+        break;
+        
+        case CLOCKSYNC_CORRECT:
+        {
+            int32_t slDrift = clockSync.slLastDrift;
+            printftlog("ClockDrift", "%d\n", slDrift);
+            
+            if(SetClock(clockRegs))
+            {
+                printft("Inverter's clock was %ds out. Set it to %02d:%02d:%02d.\n",
+                        slDrift, clockRegs[3], clockRegs[4], clockRegs[5]);
+            }
+        }
+        break;
+        
+        default:
+        {
+            printftlog("ClockDrift", "%d\n", clockSync.slLastDrift);
+        }
+    }
 }
 
-static void SetManualAmps(uint16_t nAmps)
+//Call with scheduleMutex held.
+static void SaveSchedule()
 {
-    if(nAmps <= GW_HREG_MAX_UTIL_AMPS)
+    if(bSchedulePath && !schedule_Save(&schedule, schedulePath))
     {
-        status.nChargeCurrent = nAmps;
+        printft("Failed to save the schedule to %s\n", schedulePath);
+    }
+}
 
-        if(modbus_write_register(ctx, GW_HREG_MAX_UTIL_AMPS, status.nChargeCurrent) < 0)
+//Scheduled commands go through the command queue like any other.
+static void HandleSchedule(struct Schedule* pSchedule, const struct ScheduledCommand* pCommand, bool bEnding)
+{
+    uint16_t nCommandID = pCommand->nCommandID;
+    uint16_t nParam = pCommand->nParam;
+    
+    //The end of a window goes back to batteries, or back to the planned charge current.
+    if(bEnding)
+    {
+        nCommandID = COMMAND_CHARGE_AMPS == nCommandID ? COMMAND_CHARGE_AMPS : COMMAND_REQUEST_BATTS;
+        nParam = 0;
+    }
+    
+    printft("Schedule %u %s (command %u).\n", pCommand->lScheduleId, bEnding ? "ended" : "started",
+            QueueCommand(nCommandID, nParam, CMDQUEUE_ORIGIN_SCHEDULE));
+}
+
+//Classify a grid sample, reporting outages straight away.
+static void SampleGrid(uint16_t nVolts, uint16_t nFreq, int64_t llNowMs)
+{
+    uint8_t cResult = gridquality_Sample(&gridQuality, nVolts, nFreq, llNowMs);
+    
+    if(GRIDQUALITY_NONE == cResult)
+        return;
+        
+    struct SystemEvent event;
+    event.slTime = time(NULL);
+    event.nEventID = GRIDQUALITY_OUTAGE == cResult ? EVENT_GRID_LOST : EVENT_GRID_RESTORED;
+    event.nValue = nVolts;
+    event.nPrevious = status.nGridVolts;
+    event.nReserved = 0;
+    
+    events.lEvents++;
+    HandleEvent(&events, &event);
+    
+    struct ControlActions actions;
+    control_Grid(&controller, &status, cResult, event.slTime, &actions);
+    ApplyActions(&actions);
+}
+
+//Carry out queued commands in order, reporting back how long each took.
+static void ServiceCommands()
+{
+    struct QueuedCommand command;
+    
+    while(cmdqueue_Pop(&commands, &command))
+    {
+        struct CommandResult result;
+        result.lCommandId = command.lCommandId;
+        result.nCommandID = command.nCommandID;
+        
+        struct ControlTime now;
+        struct ControlActions actions;
+        
+        control_Clock(&now, time(NULL), MonotonicMs());
+        result.nResult = control_Command(&controller, &status, command.nCommandID, command.nParam, &now, &actions);
+        ApplyActions(&actions);
+        
+        int64_t llLatencyUs = MonotonicUs() - command.llEnqueuedUs;
+        result.lLatencyUs = (uint32_t)llLatencyUs;
+        
+        if(COMMAND_RESULT_DONE == result.nResult)
         {
-            printft("Failed to write manual util charging amps to config register: %s\n", modbus_strerror(errno));
+            lCommandsDone++;
+            lLastCommandUs = result.lLatencyUs;
+            
+            if(result.lLatencyUs > lMaxCommandUs)
+                lMaxCommandUs = result.lLatencyUs;
+                
+            printft("Command %u (%u) done %.1fms after it was queued.\n", command.lCommandId, command.nCommandID, llLatencyUs / 1000.0);
+        }
+        else
+        {
+            printft("Command %u (%u) refused.\n", command.lCommandId, command.nCommandID);
         }
         
+        if(CMDQUEUE_ORIGIN_GATEWAY == command.nOrigin)
+        {
+            gateway_CommandResult(&gateway, command.lCommandId, result.nResult);
+        }
+        else if(CMDQUEUE_ORIGIN_CONSOLE != command.nOrigin)
+        {
+            tcpserver_SendCommandResult(command.nOrigin, &result);
+        }
+    }
+}
+
+//Read whatever the gateway's clients wanted that wasn't in the image. One transaction per fetch,
+//however many clients are waiting on it.
+static void ServiceFetches()
+{
+    struct GatewayFetch fetch;
+    
+    while(gateway_TakeFetch(&gateway, &fetch))
+    {
+        uint16_t values[GATEWAY_MAX_READ];
+        int rc;
+        
+        transport_SetSlave(&transport, INVERTER_1_ID + fetch.cUnit);
+        
+        if(fetch.bHolding)
+            rc = transport_ReadRegisters(&transport, fetch.nAddress, fetch.nCount, values);
+        else
+            rc = transport_ReadInputRegisters(&transport, fetch.nAddress, fetch.nCount, values);
+            
+        transport_SetSlave(&transport, INVERTER_1_ID);
+        gateway_FetchDone(&gateway, &fetch, -1 == rc ? NULL : values, MonotonicMs());
         usleep(MODBUS_WAIT);
     }
 }
 
-static void LimitChargingTimes()
+//Print what changed between two snapshots.
+static void PrintSnapshotDiff(const struct Snapshot* pFrom, const struct Snapshot* pTo)
 {
-    if(modbus_write_register(ctx, GW_HREG_UTIL_END_HOUR, GW_CFG_UTIL_TIME_OFFPEAK) < 0)
-    {
-        printft("Failed to write off-peak only charging config register: %s\n", modbus_strerror(errno));
-    }
+    struct SnapshotDiff diffs[SNAPSHOT_DIFFS_SHOWN];
+    uint16_t nDiffs = snapshot_Diff(pFrom, pTo, diffs, SNAPSHOT_DIFFS_SHOWN);
     
-    usleep(MODBUS_WAIT);
-}
-
-static void UnlimitChargingTimes()
-{
-    if(modbus_write_register(ctx, GW_HREG_UTIL_END_HOUR, GW_CFG_UTIL_TIME_ANY_TIME) < 0)
+    printft("%d holding register(s) changed since the snapshot at %d.\n", nDiffs, pFrom->slTime);
+    
+    for(uint16_t i = 0; i < nDiffs && i < SNAPSHOT_DIFFS_SHOWN; i++)
     {
-        printft("Failed to write any time charging config register: %s\n", modbus_strerror(errno));
+        printf("  Inverter %d register %2d: %5d -> %5d%s\n", diffs[i].cInverter + 1, diffs[i].nAddress,
+               diffs[i].nFrom, diffs[i].nTo, snapshot_Restorable(diffs[i].nAddress) ? "" : " (not restored)");
     }
-    
-    usleep(MODBUS_WAIT);
 }
 
-static void SwitchToBypass()
+//Take or restore a holding register snapshot, if the console asked for one.
+static void ServiceSnapshot()
 {
-    status.nSystemState = SYSTEM_STATE_BYPASS;
-    slModeWriteTime = time(NULL);
+    static struct Snapshot snapshot;
+    static struct Snapshot previous;
+    char path[256];
+    
+    pthread_mutex_lock(&snapshotMutex);
+    uint8_t cRequest = cSnapshotRequest;
+    cSnapshotRequest = SNAPSHOT_REQUEST_NONE;
+    strcpy(path, snapshotRestorePath);
+    pthread_mutex_unlock(&snapshotMutex);
     
-    if(modbus_write_register(ctx, GW_HREG_CFG_MODE, GW_CFG_MODE_GRID) < 0)
+    if(SNAPSHOT_REQUEST_TAKE == cRequest)
     {
-        printft("Failed to write grid mode (bypass) to config register: %s\n", modbus_strerror(errno));
+        char latestPath[256];
+        char filename[64];
+        time_t now = time(NULL);
+        struct tm timeinfo;
+        
+        int rc = snapshot_Take(&snapshot, &transport, now, MODBUS_WAIT);
+        
+        if(-1 == rc)
+        {
+            printft("Failed to take a snapshot: %s\n", transport_StrError(&transport, errno));
+            return;
+        }
+        
+        printft("Snapshot of %d inverter(s) taken in %d read(s).\n", INVERTER_COUNT, rc);
+        
+        if(!GetLogPath(SNAPSHOT_FILE, latestPath, sizeof(latestPath)))
+            return;
+        
+        if(snapshot_Load(&previous, latestPath))
+            PrintSnapshotDiff(&previous, &snapshot);
+        
+        localtime_r(&now, &timeinfo);
+        strftime(filename, sizeof(filename), "snapshot-%Y%m%d-%H%M%S.bin", &timeinfo);
+        
+        if(GetLogPath(filename, path, sizeof(path)) && snapshot_Save(&snapshot, path) && snapshot_Save(&snapshot, latestPath))
+            printft("Saved as %s.\n", path);
+        else
+            printft("Failed to save the snapshot.\n");
+    }
+    else if(SNAPSHOT_REQUEST_RESTORE == cRequest)
+    {
+        struct SnapshotRestore result;
+        
+        if(!snapshot_Load(&snapshot, path))
+        {
+            printft("No snapshot in %s.\n", path);
+            return;
+        }
+        
+        int rc = snapshot_Restore(&snapshot, &transport, MODBUS_WAIT, &result);
+        
+        printft("Restoring the snapshot from %d: %d register(s) differed, %d write(s), %d still different.\n",
+                snapshot.slTime, result.nChanged, result.nWrites, result.nMismatched);
+        
+        if(-1 == rc)
+            printft("Restore failed: %s\n", EINVAL == errno ? "snapshot is from another model or system" : transport_StrError(&transport, errno));
     }
-    
-    usleep(MODBUS_WAIT);
-    
-    //Enable the inverter's utility charging time limits to prevent unwanted charging.
-    LimitChargingTimes();
 }
 
-static void SwitchToPeak()
+//Sleep between bus transactions, waking early to carry out any commands or gateway fetches that come in.
+static void Pause(useconds_t lMicroseconds)
 {
-    status.nSystemState = SYSTEM_STATE_PEAK;
-    slModeWriteTime = time(NULL);
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += lMicroseconds / 1000000;
+    ts.tv_nsec += (long)(lMicroseconds % 1000000) * 1000;
     
-    if(modbus_write_register(ctx, GW_HREG_CFG_MODE, GW_CFG_MODE_BATTS) < 0)
+    if(ts.tv_nsec >= 1000000000)
     {
-        printft("Failed to write batt mode (peak) to config register: %s\n", modbus_strerror(errno));
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
     }
     
-    usleep(MODBUS_WAIT);
-    
-    //Enable the inverter's utility charging time limits to prevent unwanted charging.
-    LimitChargingTimes();
+    if(0 != sem_timedwait(&commandSem, &ts))
+    {
+        //Slept the whole pause. Anything past the deadline is the scheduler's doing.
+        if(ETIMEDOUT == errno)
+        {
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            int64_t llLateUs = ((int64_t)(now.tv_sec - ts.tv_sec) * 1000000) + ((now.tv_nsec - ts.tv_nsec) / 1000);
+            latency_Record(&wakeLatency, llLateUs > 0 ? (uint32_t)llLateUs : 0);
+        }
+    }
+    else
+    {
+        //One wake is enough for however many commands are queued.
+        while(0 == sem_trywait(&commandSem));
+        
+        if(PROCESS == modbusState)
+        {
+            ServiceCommands();
+            ServiceFetches();
+            ServiceSnapshot();
+        }
+    }
 }
 
-static void SwitchToOffPeak()
+void* modbus_thread(void* arg)
 {
-    status.nSystemState = SYSTEM_STATE_OFF_PEAK;
-    slModeWriteTime = time(NULL);
+    lLoggingLastMin = -1;
     
-    if(modbus_write_register(ctx, GW_HREG_CFG_MODE, GW_CFG_MODE_GRID) < 0)
+    if(realtimeConfig.lPriority > 0 || REALTIME_ANY_CPU != realtimeConfig.lCpu)
     {
-        printft("Failed to write grid mode (off peak) to config register: %s\n", modbus_strerror(errno));
+        if(realtime_Enter(&realtimeConfig))
+            printft("MODBUS thread running real-time at priority %d on CPU %d.\n", realtimeConfig.lPriority, realtimeConfig.lCpu);
+        else
+            printft("Failed to make the MODBUS thread real-time: %s\n", strerror(errno));
     }
     
-    usleep(MODBUS_WAIT);
+    char forecastPath[256];
+    bool bForecastPath = GetLogPath(FORECAST_FILE, forecastPath, sizeof(forecastPath));
     
-    //Disable the inverter's utility charging time limits to take advantage of the full off-peak.
-    UnlimitChargingTimes();
+    //Detectors over the sample stream. Raw register units.
+    events_Initialise(&events, HandleEvent);
+    events_Add(&events, EVENT_SYSTEM_STATE_CHANGED, DETECT_CHANGE, EVENT_FIELD(nSystemState), 0, 0);
+    events_Add(&events, EVENT_INVERTER_MODE_CHANGED, DETECT_CHANGE, EVENT_FIELD(nInverterMode), 0, 0);
+    events_Add(&events, EVENT_INVERTER_STATE_CHANGED, DETECT_CHANGE, EVENT_FIELD(nInverterState), 0, 0);
+    events_Add(&events, EVENT_CHARGING_STOPPED, DETECT_FALL, EVENT_FIELD(nBattchgAmps), 10, 3);     //Under 1A for 3 samples.
+    events_Add(&events, EVENT_LOAD_SURGE, DETECT_RATE, EVENT_FIELD(nOutputWatts), 5000, 0);         //Rising over 500W/s.
+    events_Add(&events, EVENT_READINGS_STUCK, DETECT_STUCK, EVENT_FIELD(nBatteryVolts), 0, 900);    //Unchanged for 15 mins.
     
-    //Set overnight (load balancing) amps.
-    SetOvernightAmps();
-}
-
-static void SwitchToBoost()
-{
-    status.nSystemState = SYSTEM_STATE_BOOST;
-    slModeWriteTime = time(NULL);
+    gridquality_Initialise(&gridQuality);
+    clocksync_Initialise(&clockSync);
     
-    if(modbus_write_register(ctx, GW_HREG_CFG_MODE, GW_CFG_MODE_GRID) < 0)
-    {
-        printft("Failed to write grid mode (boost) to config register: %s\n", modbus_strerror(errno));
-    }
+    struct OverloadConfig overloadConfig;
+    overload_DefaultConfig(&overloadConfig);
+    control_Initialise(&controller, &overloadConfig);
     
-    usleep(MODBUS_WAIT);
-
-    //Disable the inverter's utility charging time limits to allow any time charging.
-    UnlimitChargingTimes();
+    forecast_Initialise(&forecast);
+    pollplan_Build(&slavePlan, 0);
     
-    //Set boost amps.
-    SetBoostAmps();
-}
-
-void* modbus_thread(void* arg)
-{
-    lLoggingLastMin = -1;
+    if(bForecastPath && forecast_Load(&forecast, forecastPath))
+    {
+        printft("Loaded load forecast profile (%d half hours seen).\n", forecast.nSeen);
+    }
 
     while(modbusState != DIE)
     {
@@ -342,26 +1170,28 @@ void* modbus_thread(void* arg)
             {
                 modbusState = PROCESS;
 
-                //Create a MODBUS context on /dev/ttyXRUSB0
-                ctx = modbus_new_rtu("/dev/ttyXRUSB0", 9600, 'N', 8, 1);
-                if (ctx == NULL)
+                //Create a MODBUS transport on the RS485 adapter, gateway or file.
+                if (!CreateTransport())
                 {
                     printft("Could not create MODBUS context.\n");
                     reinit();
                 }
                 else
                 {
+                    transport_SetCapture(&transport, &capture);
+                    
                     //Connect to the MODBUS.
                     sleep(1);
-                    if (modbus_connect(ctx) == -1)
+                    if (transport_Connect(&transport) == -1)
                     {
-                        printft("Could not connect MODBUS slave.\n");
+                        printft("Could not connect MODBUS slave on %s: %s\n", transport.name, transport_StrError(&transport, errno));
                         reinit();
                     }
                     else
                     {
-                        modbus_set_slave(ctx, INVERTER_1_ID);
-                        printft("MODBUS initialised. Going to processing.\n");
+                        transport_SetSlave(&transport, INVERTER_1_ID);
+                        bRateReported = false;
+                        printft("MODBUS initialised on %s. Going to processing.\n", transport.name);
                     }
                 }
                 
@@ -371,7 +1201,7 @@ void* modbus_thread(void* arg)
 
             case PROCESS:
             {
-                modbus_set_debug(ctx, bMODBUSDebug);
+                transport_SetDebug(&transport, bMODBUSDebug);
                 
                 //Get the time.
                 time_t rawtime;
@@ -380,58 +1210,142 @@ void* modbus_thread(void* arg)
                 timeinfo = localtime(&rawtime);
                 int lHour = timeinfo->tm_hour;
                 int lMin = timeinfo->tm_min;
+                int lWday = timeinfo->tm_wday;
+                
+                //Timed commands.
+                pthread_mutex_lock(&scheduleMutex);
+                
+                if(schedule_Advance(&schedule, rawtime) > 0)
+                    SaveSchedule();
+                    
+                pthread_mutex_unlock(&scheduleMutex);
             
-                //Read input registers and holding register (inverter mode).
-                uint16_t inputRegs[INPUT_REGISTER_COUNT * NUM_INVERTERS];
-
+                //Sample the grid at a higher rate while it looks unstable.
+                for(int i = 0; i < GRID_FAST_SAMPLES && gridquality_Unstable(&gridQuality, MonotonicMs()); i++)
+                {
+                    uint16_t gridRegs[2];
+                    
+                    if(-1 == transport_ReadInputRegisters(&transport, GRID_VOLTS, 2, gridRegs))
+                        break;
+                        
+                    SampleGrid(gridRegs[0], gridRegs[1], MonotonicMs());
+                    usleep(GRID_FAST_WAIT);
+                }
+                
+                //Read the input registers control needs, plus any fields a client is showing or that are due
+                //to be logged. Registers left out keep their last values, and the gateway fetches them on demand.
+                uint32_t lInterest = tcpserver_Interest();
+                
+                if(bLogging && lMin % 5 == 0 && lMin != lLoggingLastMin)
+                    lInterest = STATUS_FIELD_ALL;
+                
+                if(lInterest != masterPlan.lFields || 0 == masterPlan.cBlocks)
+                    pollplan_Build(&masterPlan, lInterest);
+                
+                const uint16_t* inputRegs = inverterRegs[0];
                 int inputRegRead = 0;
 
-                for(int i = 0; i < NUM_INVERTERS; i++)
+                for(int i = 0; i < masterPlan.cBlocks && -1 != inputRegRead; i++)
                 {
-                    inputRegRead = modbus_read_input_registers(ctx, i * INPUT_REGISTER_COUNT, INPUT_REGISTER_COUNT, &inputRegs[i * INPUT_REGISTER_COUNT]);
-                    usleep(MODBUS_WAIT);
+                    const struct PollBlock* pBlock = &masterPlan.blocks[i];
+                    inputRegRead = transport_ReadInputRegisters(&transport, pBlock->nAddress, pBlock->nCount, &inverterRegs[0][pBlock->nAddress]);
+                    Pause(MODBUS_WAIT);
+                }
+                
+                int64_t llSampleMs = MonotonicMs();
+                
+                //Read the other paralleled inverters, so load can be judged per inverter.
+                for(int i = 1; i < INVERTER_COUNT && -1 != inputRegRead; i++)
+                {
+                    transport_SetSlave(&transport, INVERTER_1_ID + i);
                     
-                    if(-1 == inputRegRead) //Break on error.
-                        break;
+                    for(int j = 0; j < slavePlan.cBlocks && -1 != inputRegRead; j++)
+                    {
+                        const struct PollBlock* pBlock = &slavePlan.blocks[j];
+                        inputRegRead = transport_ReadInputRegisters(&transport, pBlock->nAddress, pBlock->nCount, &inverterRegs[i][pBlock->nAddress]);
+                        usleep(MODBUS_WAIT);
+                    }
                 }
                 
-                int holdingRegRead1 = modbus_read_registers(ctx, GW_HREG_CFG_MODE, 1, &nInverterMode);
-                usleep(MODBUS_WAIT);
-                int holdingRegRead2 = modbus_read_registers(ctx, GW_HREG_MAX_UTIL_AMPS, 1, &nChargeAmps);
-                usleep(MODBUS_WAIT);
-                int holdingRegRead3 = modbus_read_registers(ctx, GW_HREG_UTIL_END_HOUR, 1, &nEndHour);
+                transport_SetSlave(&transport, INVERTER_1_ID);
+                
+                int holdingRegRead = transport_ReadRegisters(&transport, 0, GW_HREG_COUNT, holdingRegs);
                 usleep(MODBUS_WAIT);
                 
                 if(-1 == inputRegRead ||
-                   -1 == holdingRegRead1 ||
-                   -1 == holdingRegRead2 ||
-                   -1 == holdingRegRead3 )
+                   -1 == holdingRegRead)
                 {
                     printft("Failed to read MODBUS registers");
                     break;
                 }
                 else
                 {
+                    //Serve the gateway's clients from this pass.
+                    gateway_Update(&gateway, 0, true, 0, GW_HREG_COUNT, holdingRegs, llSampleMs);
+                    
+                    for(int i = 0; i < INVERTER_COUNT; i++)
+                    {
+                        const struct PollPlan* pPlan = 0 == i ? &masterPlan : &slavePlan;
+                        
+                        for(int j = 0; j < pPlan->cBlocks; j++)
+                            gateway_Update(&gateway, i, false, pPlan->blocks[j].nAddress, pPlan->blocks[j].nCount, &inverterRegs[i][pPlan->blocks[j].nAddress], llSampleMs);
+                    }
+                    
+                    //Every inverter's faults and warnings, with the samples around them.
+                    pthread_mutex_lock(&faultsMutex);
+                    
+                    for(int i = 0; i < INVERTER_COUNT; i++)
+                        faults_Sample(&faults, i, inverterRegs[i], time(NULL), llSampleMs);
+                    
+                    pthread_mutex_unlock(&faultsMutex);
+                    
+                    //How fast this transport really goes, once there's a whole pass to judge by.
+                    if(!bRateReported)
+                    {
+                        bRateReported = true;
+                        printft("%s achieving %.1f transactions/s.\n", transport.name, transport_Rate(&transport));
+                    }
+                    
                     if(bDumpInputRegs)
                     {
+                        //The whole input space the master answers for, beyond its map too.
+                        uint16_t dumpRegs[INPUT_REGISTER_COUNT * NUM_INVERTERS];
+                        
                         bDumpInputRegs = false;
                         
-                        for (int j = 0; j < INPUT_REGISTER_COUNT * NUM_INVERTERS; j += 10)
+                        for(int i = 0; i < NUM_INVERTERS && -1 != inputRegRead; i++)
                         {
-                            printf("[%03d]", j);
+                            inputRegRead = transport_ReadInputRegisters(&transport, i * INPUT_REGISTER_COUNT, INPUT_REGISTER_COUNT, &dumpRegs[i * INPUT_REGISTER_COUNT]);
+                            usleep(MODBUS_WAIT);
+                        }
                         
-                            int remaining = (INPUT_REGISTER_COUNT * NUM_INVERTERS) - j;
-                            int cols = remaining < 10 ? remaining : 10;
-
-                            for (int k = 0; k < cols; k++)
+                        if(-1 == inputRegRead)
+                        {
+                            printft("Failed to read the extended input registers.\n");
+                            inputRegRead = 0;
+                        }
+                        else
+                        {
+                            gateway_Update(&gateway, 0, false, 0, INPUT_REGISTER_COUNT * NUM_INVERTERS, dumpRegs, MonotonicMs());
+                            
+                            for (int j = 0; j < INPUT_REGISTER_COUNT * NUM_INVERTERS; j += 10)
                             {
-                                printf("%6d", inputRegs[j + k]);
+                                printf("[%03d]", j);
+                            
+                                int remaining = (INPUT_REGISTER_COUNT * NUM_INVERTERS) - j;
+                                int cols = remaining < 10 ? remaining : 10;
+
+                                for (int k = 0; k < cols; k++)
+                                {
+                                    printf("%6d", dumpRegs[j + k]);
+                                }
+                                printf("\n");
                             }
-                            printf("\n");
                         }
                     }
                     
                     //Store relevant input register values.
+                    status.nInverterMode = holdingRegs[GW_HREG_CFG_MODE];
                     status.nInverterState = inputRegs[STATUS];
                     status.nSolarVolts = inputRegs[PV1_VOLTS];
                     status.nSolarWatts = inputRegs[PV1_CHARGE_WATTS_L];
@@ -439,6 +1353,7 @@ void* modbus_thread(void* arg)
                     status.nOutputApppwr = inputRegs[OUTPUT_APPPWR_L];
                     status.nAcChargeWattsL = inputRegs[AC_CHARGE_WATTS_L];
                     status.nBatteryVolts = inputRegs[BATTERY_VOLTS];
+                    status.nBatterySoc = inputRegs[BATTERY_SOC];
                     status.nBusVolts = inputRegs[BUS_VOLTS];
                     status.nGridVolts = inputRegs[GRID_VOLTS];
                     status.nGridFreq = inputRegs[GRID_FREQ];
@@ -462,6 +1377,23 @@ void* modbus_thread(void* arg)
                     status.nBattWatts = inputRegs[BATT_WATTS_L];
                     status.nInvFanspeed = inputRegs[INV_FANSPEED];
                     
+                    //Household load forecast, from every inverter's output. Output watts are 0.1W.
+                    int lSlot = forecast_SlotOf(lWday, lHour, lMin);
+                    uint32_t lLoadWatts = 0;
+                    
+                    for(int i = 0; i < INVERTER_COUNT; i++)
+                        lLoadWatts += inverterRegs[i][OUTPUT_WATTS_L];
+                    
+                    if(forecast_Sample(&forecast, rawtime, lSlot, (float)lLoadWatts / 10.0f))
+                    {
+                        status.nForecastKwh = (uint16_t)(forecast_Next24hKwh(&forecast, lSlot) * 10.0f);
+                        
+                        if(bForecastPath && !forecast_Save(&forecast, forecastPath))
+                        {
+                            printft("Failed to save load forecast to %s\n", forecastPath);
+                        }
+                    }
+                    
                     if(bLogging)
                     {
                         if (lMin % 5 == 0 && lMin != lLoggingLastMin)
@@ -474,6 +1406,7 @@ void* modbus_thread(void* arg)
                             printftlog("OutputApppwr", "%d\n", status.nOutputApppwr);
                             printftlog("AcChargeWattsL", "%d\n", status.nAcChargeWattsL);
                             printftlog("BatteryVolts", "%d\n", status.nBatteryVolts);
+                            printftlog("BatterySoc", "%d\n", status.nBatterySoc);
                             printftlog("BusVolts", "%d\n", status.nBusVolts);
                             printftlog("GridVolts", "%d\n", status.nGridVolts);
                             printftlog("GridFreq", "%d\n", status.nGridFreq);
@@ -499,210 +1432,54 @@ void* modbus_thread(void* arg)
                         
                             lLoggingLastMin = lMin;
                         }
+                        
+                        if(rawtime >= slHistoryLast + HISTORY_INTERVAL_S)
+                        {
+                            RecordHistory(rawtime);
+                            slHistoryLast = rawtime;
+                        }
                     }
                 }
                 
                 //Do general processing if reading the inverters went okay, using the values read from the master inverter.
                 if(PROCESS == modbusState)
                 {
-                    //Find and record the off-peak charge completion time.
-                    if(SYSTEM_STATE_OFF_PEAK == status.nSystemState)
-                    {
-                        if(status.nBattchgAmps > 0 && status.nBattchgAmps == 0)
-                        {
-                            status.slOffPeakChgComplete = time(NULL);
-                        }
-                    }
+                    SampleGrid(inputRegs[GRID_VOLTS], inputRegs[GRID_FREQ], llSampleMs);
                     
-                    //Manual switching.
-                    if(SYSTEM_STATE_OFF_PEAK != status.nSystemState)
-                    {
-                        //Grid.
-                        if(bManualSwitchToGrid)
-                        {
-                            bManualSwitchToGrid = false;
-                            SwitchToBypass();
-                            printft("Switched to grid due to override.\n");
-                        }
-                        
-                        //Batts.
-                        if(bManualSwitchToBatts)
-                        {
-                            bManualSwitchToBatts = false;
-                            SwitchToPeak();
-                            printft("Switched to batts due to override.\n");
-                        }
-                        
-                        //Boost.
-                        if(bManualSwitchToBoost)
-                        {
-                            bManualSwitchToBoost = false;
-                            SwitchToBoost();
-                            printft("Switched to boost due to override.\n");
-                        }
-                    }
+                    //Switching and charging decisions, judged on every inverter's load as soon as possible after sampling.
+                    struct ControlSample sample;
+                    struct ControlActions actions;
                     
-                    //Peak/off-peak switching.
-                    if ((lHour > SYSTEM_END_OFF_PEAK_H ||
-                         (lHour == SYSTEM_END_OFF_PEAK_H && lMin >= SYSTEM_END_OFF_PEAK_M)) &&
-                        (lHour < SYSTEM_START_OFF_PEAK_H ||
-                         (lHour == SYSTEM_START_OFF_PEAK_H && lMin <= SYSTEM_START_OFF_PEAK_M)))
-                    {
-                        //Switch to peak if off-peak?
-                        if(SYSTEM_STATE_OFF_PEAK == status.nSystemState)
-                        {
-                            //Store the morning's AC charge energy so any boost charging can be accounted for later.
-                            //TO DO: Stop guessing and read the other inverters!
-                            status.nOffPeakChargeKwh = status.nAcchgegyToday * INVERTER_COUNT;
-                        
-                            SwitchToPeak();
-                            printft("Switched to peak.\n");
-                        }
-                    }
-                    else
-                    {
-                        //Switch to off-peak if peak/bypassed?
-                        if(SYSTEM_STATE_OFF_PEAK != status.nSystemState)
-                        {
-                            SwitchToOffPeak();
-                            printft("Switched to off-peak.\n");
-                        }
-                    }
+                    control_Clock(&sample.time, time(NULL), llSampleMs);
                     
-                    //Final state check. (Note: inverter mode is read back from inverter on next pass).
-                    if(time(NULL) > slModeWriteTime + CHECK_MODE_TIMEOUT)
+                    for(int i = 0; i < INVERTER_COUNT; i++)
                     {
-                        switch(status.nSystemState)
-                        {
-                            case SYSTEM_STATE_PEAK:
-                            {
-                                if(GW_CFG_MODE_BATTS != nInverterMode)
-                                {
-                                    SwitchToPeak();
-                                    printft("Wasn't on batts as expected. Rewrote holding register.\n");
-                                }
-                                
-                                if(GW_CFG_UTIL_TIME_OFFPEAK != nEndHour)
-                                {
-                                    LimitChargingTimes();
-                                    printft("Charging times not limited as expected. Rewrote holding register.\n");
-                                }
-                            }
-                            break;
-                            
-                            case SYSTEM_STATE_BYPASS:
-                            {
-                                if(GW_CFG_MODE_GRID != nInverterMode)
-                                {
-                                    SwitchToBypass();
-                                    printft("Wasn't on grid as expected. Rewrote holding register.\n");
-                                }
-                                
-                                if(GW_CFG_UTIL_TIME_OFFPEAK != nEndHour)
-                                {
-                                    LimitChargingTimes();
-                                    printft("Charging times not limited as expected. Rewrote holding register.\n");
-                                }
-                            }
-                            break;
-                            
-                            case SYSTEM_STATE_OFF_PEAK:
-                            {
-                                if(GW_CFG_MODE_GRID != nInverterMode)
-                                {
-                                    SwitchToOffPeak();
-                                    printft("Wasn't on grid as expected. Rewrote holding register.\n");
-                                }
-                                
-                                if(GW_CFG_UTIL_TIME_ANY_TIME != nEndHour)
-                                {
-                                    UnlimitChargingTimes();
-                                    printft("Charging times not unlimited as expected. Rewrote holding register.\n");
-                                }
-                                
-                                if(status.nChargeCurrent != nChargeAmps)
-                                {
-                                    SetOvernightAmps();
-                                    printft("Charging amps not set as expected. Rewrote holding register.\n");
-                                }
-                            }
-                            break;
-                            
-                            case SYSTEM_STATE_BOOST:
-                            {
-                                if(GW_CFG_MODE_GRID != nInverterMode)
-                                {
-                                    SwitchToBoost();
-                                    printft("Wasn't on boost as expected. Rewrote holding register.\n");
-                                }
-                                
-                                if(GW_CFG_UTIL_TIME_ANY_TIME != nEndHour)
-                                {
-                                    UnlimitChargingTimes();
-                                    printft("Charging times not unlimited as expected. Rewrote holding register.\n");
-                                }
-                                
-                                if(status.nChargeCurrent != nChargeAmps)
-                                {
-                                    SetBoostAmps();
-                                    printft("Charging amps not as expected. Rewrote holding register.\n");
-                                }
-                            }
-                            break;
-                        }
+                        sample.inverters[i].nOutputWatts = inverterRegs[i][OUTPUT_WATTS_L];
+                        sample.inverters[i].nLoadPercent = inverterRegs[i][LOAD_PERCENT];
+                        sample.nChargeAmps[i] = inverterRegs[i][BATTCHG_AMPS];
                     }
                     
-                    //Print state changes.
-                    if(nLastInverterMode != nInverterMode)
-                    {
-                        printft("nInverterMode changed to ");
-                        switch(nInverterMode)
-                        {
-                            case GW_CFG_MODE_BATTS: printf("BATTERIES\n"); break;
-                            case GW_CFG_MODE_GRID: printf("GRID\n"); break;
-                            default: printf("GOD KNOWS! (%d)\n", nInverterMode); break;
-                        }
-                
-                        nLastInverterMode = nInverterMode;
-                    }
+                    control_Step(&controller, &status, &sample, &actions);
+                    ApplyActions(&actions);
                     
-                    if(nLastSystemState != status.nSystemState)
+                    //Keep the inverter's charge hours lined up with ours.
+                    if(clocksync_Due(&clockSync, time(NULL)))
                     {
-                        printft("nSystemState changed to ");
-                        switch(status.nSystemState)
-                        {
-                            case SYSTEM_STATE_PEAK: printf("PEAK\n"); break;
-                            case SYSTEM_STATE_BYPASS: printf("BYPASS\n"); break;
-                            case SYSTEM_STATE_OFF_PEAK: printf("OFF-PEAK\n"); break;
-                            case SYSTEM_STATE_BOOST: printf("BOOST\n"); break;
-                            default: printf("GOD KNOWS! (%d)\n", status.nSystemState); break;
-                        }
-                
-                        nLastSystemState = status.nSystemState;
+                        SyncClock();
                     }
                     
-                    if(nLastInverterState != status.nInverterState)
-                    {
-                        printft("nInverterState changed to ");
-                        if(status.nInverterState >= 0 && status.nInverterState < INVERTER_STATE_COUNT)
-                            printf("%s\n", GwInverterStatusStrings[status.nInverterState]);
-                        else
-                            printf("UNKNOWN (%d)\n", status.nInverterState);
-                            
-                        nLastInverterState = status.nInverterState;
-                    }
+                    //Edge detection, state change reporting etc.
+                    events_Process(&events, &status, time(NULL));
+                    
+                    //Subscribers see the sample and what was decided on it as soon as it's done.
+                    tcpserver_PushStatus(&status);
                 }
             }
             break;
 
             case DEINIT:
             {
-                if(ctx != NULL)
-                {
-                    modbus_close(ctx);
-                    modbus_free(ctx);
-                    ctx = NULL;
-                }
+                transport_Free(&transport);
                 
                 modbusState = DIE;
                 printft("MODBUS deinitialised.\n");
@@ -712,18 +1489,84 @@ void* modbus_thread(void* arg)
             default: {}
         }
         
-        usleep(MODBUS_WAIT);
+        Pause(MODBUS_WAIT);
     }
 
     return NULL;
 }
 
-int main()
+int main(int argc, char* argv[])
 {  
     char input;
     pthread_t thread_modbus;
+    int opt;
+
+    while((opt = getopt(argc, argv, "d:g:p:f:c:m:wr:a:b")) != -1)
+    {
+        switch(opt)
+        {
+            case 'd': cTransportType = TRANSPORT_RTU; transportPath = optarg; break;
+            case 'g': cTransportType = TRANSPORT_TCP; transportPath = optarg; break;
+            case 'p': lGatewayPort = atoi(optarg); break;
+            case 'f': cTransportType = TRANSPORT_REPLAY; transportPath = optarg; break;
+            case 'c': cTransportType = TRANSPORT_CAPTURE; transportPath = optarg; break;
+            case 'm': lGatewayListenPort = atoi(optarg); break;
+            case 'w': bGatewayWrites = true; break;
+            case 'r': realtimeConfig.lPriority = atoi(optarg); break;
+            case 'a': realtimeConfig.lCpu = atoi(optarg); break;
+            case 'b': bBroadcastWrites = true; break;
+            default:
+            {
+                printf("Usage: server [-d device | -g gateway host [-p port] | -f history file | -c capture file] [-m MODBUS TCP port [-w]]\n"
+                       "              [-r real-time priority] [-a CPU] [-b]\n");
+                return 1;
+            }
+        }
+    }
+    
+    printft("Built for the %s: %dA utility charging, overload trip at %dW.\n", MODEL_NAME, GW_CFG_UTIL_AMPS_MAX, OVERLOAD_TRIP_WATTS);
     
     memset(&status, 0x00, sizeof(struct SystemStatus));
+    cmdqueue_Initialise(&commands);
+    sem_init(&commandSem, 0, 0);
+    gateway_Initialise(&gateway, GATEWAY_MAX_AGE_MS, bGatewayWrites ? &commands : NULL, WakeModbus);
+    latency_Initialise(&wakeLatency);
+    latency_Initialise(&broadcastWindow);
+    capture_Initialise(&capture);
+    
+    //A gateway may well answer for slave 0, and nothing would read it.
+    if(bBroadcastWrites && TRANSPORT_TCP == cTransportType)
+    {
+        printft("Broadcast writes need the inverters on this bus. Writing to them in turn.\n");
+        bBroadcastWrites = false;
+    }
+    
+    //Everything's allocated statically or by now. Keep it all in memory.
+    if(realtimeConfig.lPriority > 0 && !realtime_LockMemory())
+    {
+        printft("Failed to lock memory: %s\n", strerror(errno));
+    }
+    
+    if(lGatewayListenPort > 0 && !gatewayserver_init(lGatewayListenPort, &gateway))
+    {
+        printft("MODBUS gateway not started.\n");
+    }
+    
+    schedule_Initialise(&schedule, HandleSchedule, time(NULL));
+    bSchedulePath = GetLogPath(SCHEDULE_FILE, schedulePath, sizeof(schedulePath));
+    
+    if(bSchedulePath && schedule_Load(&schedule, schedulePath))
+    {
+        printft("Loaded %d scheduled command(s).\n", schedule.cCount);
+    }
+    
+    faults_Initialise(&faults, HandleFault);
+    bFaultsPath = GetLogPath(FAULTS_FILE, faultsPath, sizeof(faultsPath));
+    
+    if(bFaultsPath && faults_Load(&faults, faultsPath))
+    {
+        printft("Loaded fault history up to %u.\n", faults.lNextId - 1);
+    }
 
     if(tcpserver_init())
     {
@@ -745,29 +1588,94 @@ int main()
                     case 's':
                     {
                         printf("---=== Status ===---\n");
-                        switch(nInverterMode)
+                        printf("nInverterMode\t%s (%d)\n", InverterModeName(status.nInverterMode), status.nInverterMode);
+                        printf("nSystemState\t%s (%d)\n", SystemStateName(status.nSystemState), status.nSystemState);
+                        printf("nInverterState\t%s (%d)\n", InverterStateName(status.nInverterState), status.nInverterState);
+                        
+                        printf("\n");
+                        printf("slModeWriteTime\t%d\n", controller.slModeWriteTime);
+                        printf("nForecastKwh\t%d\n", status.nForecastKwh);
+                        printf("slOffPeakChgComplete\t%d\n", status.slOffPeakChgComplete);
+                        printf("Events raised\t%u\n", events.lEvents);
+                        printf("Grid outages\t%u (%lldms total, %u samples)\n",
+                               gridQuality.lOutages, (long long)gridQuality.llOutageMs, gridQuality.lSamples);
+                        printf("Grid sags\t");
+                        for(int i = 0; i < GRIDQUALITY_BINS; i++) printf("%u ", gridQuality.lSags[i]);
+                        printf("\nGrid swells\t");
+                        for(int i = 0; i < GRIDQUALITY_BINS; i++) printf("%u ", gridQuality.lSwells[i]);
+                        printf("\nGrid freq\t");
+                        for(int i = 0; i < GRIDQUALITY_BINS; i++) printf("%u ", gridQuality.lFreqExcursions[i]);
+                        printf("\n");
+                        printf("Charge limits\t");
+                        for(int i = 0; i < INVERTER_COUNT; i++) printf("%dA ", controller.balancer.nLimits[i]);
+                        printf("(%s, %u adjustments)\n", controller.balancer.bActive ? "balancing" : "idle", controller.balancer.lAdjustments);
+                        printf("Commands done\t%u (last %uus, max %uus from queueing, %u dropped)\n",
+                               lCommandsDone, lLastCommandUs, lMaxCommandUs, atomic_load(&commands.lDropped));
+                        pthread_mutex_lock(&scheduleMutex);
+                        
+                        for(int i = 0; i < SCHEDULE_MAX_ENTRIES; i++)
                         {
-                            case GW_CFG_MODE_BATTS: printf("nInverterMode\tBATTERIES\n"); break;
-                            case GW_CFG_MODE_GRID: printf("nInverterMode\tGRID\n"); break;
-                            default: printf("nInverterMode\tGOD KNOWS! (%d)\n", nInverterMode); break;
+                            struct ScheduledCommand* pCommand = &schedule.entries[i].command;
+                            
+                            if(schedule.entries[i].bUsed)
+                                printf("Schedule %u\tcommand %u (%u) at %d for %ds every %ds%s\n",
+                                       pCommand->lScheduleId, pCommand->nCommandID, pCommand->nParam,
+                                       pCommand->slStart, pCommand->slDuration, pCommand->slPeriod,
+                                       schedule.entries[i].bEnding ? ", in progress" : "");
                         }
                         
-                        switch(status.nSystemState)
+                        pthread_mutex_unlock(&scheduleMutex);
+                        printf("Clock drift\t%ds (%.1fs/day, %u checks, %u corrections)\n",
+                               clockSync.slLastDrift, clockSync.fltDriftPerDay, clockSync.lChecks, clockSync.lCorrections);
+                        printf("Overload trips\t%u (last %ums, max %ums to switch)\n",
+                               controller.overload.lTrips, controller.overload.lLastLatencyMs, controller.overload.lMaxLatencyMs);
+                        printf("Transport\t%s, %.1f transactions/s (%u, %u failed)\n",
+                               transport.name, transport_Rate(&transport), transport.lTransactions, transport.lErrors);
+                        printf("Capture\t\t%u held of %u transactions\n", capture.lCount, capture.lTotal);
+                        
+                        if(TRANSPORT_CAPTURE == cTransportType)
                         {
-                            case SYSTEM_STATE_PEAK: printf("nSystemState\tPEAK\n"); break;
-                            case SYSTEM_STATE_BYPASS: printf("nSystemState\tBYPASS\n"); break;
-                            case SYSTEM_STATE_OFF_PEAK: printf("nSystemState\tOFF-PEAK\n"); break;
-                            case SYSTEM_STATE_BOOST: printf("nSystemState\tBOOST\n"); break;
-                            default: printf("nSystemState\tGOD KNOWS! (%d)\n", status.nSystemState); break;
+                            printf("Playback\t%u answered from the capture, %u not in it, %u times round\n",
+                                   playback.lMatched, playback.lUnmatched, playback.lLaps);
                         }
+#if RTU_MASTER == RTU_MASTER_NATIVE
+                        if(TRANSPORT_RTU == cTransportType)
+                        {
+                            printf("RTU master\t%.1f wakeups/transaction, %u with gaps, %u timed out\n",
+                                   rtu.master.lTransactions ? (float)rtu.master.lWakeups / rtu.master.lTransactions : 0.0f,
+                                   rtu.master.lGaps, rtu.master.lTimeouts);
+                        }
+#endif
+                        printf("Wakeup late\t%uus mean, 50%% <=%uus, 99%% <=%uus, %uus max (%u pauses)\n",
+                               latency_MeanUs(&wakeLatency), latency_Percentile(&wakeLatency, 50.0f),
+                               latency_Percentile(&wakeLatency, 99.0f), wakeLatency.lMaxUs, wakeLatency.lCount);
+                        printf("Late by 2^n us\t");
+                        for(int i = 0; i < LATENCY_BUCKETS; i++) printf("%u ", wakeLatency.lBuckets[i]);
+                        printf("\n");
+                        printf("Broadcasts\t%s, %u (%u written in turn), agreed within %uus mean, 99%% <=%uus, %uus max\n",
+                               bBroadcastWrites ? "On" : "Off", broadcastWindow.lCount, lBroadcastsReaddressed,
+                               latency_MeanUs(&broadcastWindow), latency_Percentile(&broadcastWindow, 99.0f), broadcastWindow.lMaxUs);
+                        printf("Polling\t\tFields 0x%08X, master %u reads of %u registers, others %u of %u\n",
+                               masterPlan.lFields, masterPlan.cBlocks, masterPlan.nRegisters, slavePlan.cBlocks, slavePlan.nRegisters);
+                        printf("Clients\t\t%u connected\n", tcpserver_ClientCount());
+                        printf("Gateway\t\t%u requests (%u hits, %u misses, %u coalesced, %u fetches, %u failed, %u writes)\n",
+                               gateway.lRequests, gateway.lHits, gateway.lMisses, gateway.lCoalesced,
+                               gateway.lFetches, gateway.lFailed, gateway.lWrites);
                         
-                        if(status.nInverterState >= 0 && status.nInverterState < INVERTER_STATE_COUNT)
-                            printf("nInverterState\t%s\n", GwInverterStatusStrings[status.nInverterState]);
-                        else
-                            printf("nInverterState\t UNKNOWN (%d)\n", status.nInverterState);
+                        struct FaultQuery faultQuery = { INT32_MIN, INT32_MAX, FAULT_ANY_CODE, FAULT_ANY_KIND, 0 };
+                        struct FaultList faultList;
+                        _tcpserver_QueryFaults(&faultQuery, &faultList);
+                        printf("Faults\t\t%u held", faultList.nMatches);
+                        
+                        for(int i = 0; i < faultList.nCount && i < 3; i++)
+                        {
+                            const struct FaultRecord* pRecord = &faultList.records[i];
+                            printf("%s inverter %d %s %02d %s at %d", i ? "," : ", latest", pRecord->cInverter + 1,
+                                   FAULT_KIND_FAULT == pRecord->cKind ? "fault" : "warning", pRecord->cCode,
+                                   pRecord->bCleared ? "cleared" : "raised", pRecord->slTime);
+                        }
                         
                         printf("\n");
-                        printf("slModeWriteTime\t%d\n", slModeWriteTime);
                         printf("The actual time\t%ld\n", time(NULL));
                     
                         printf("\n");
@@ -777,6 +1685,7 @@ int main()
                         printf("nOutputApppwr\t%d\n", status.nOutputApppwr);
                         printf("nAcChargeWattsL\t%d\n", status.nAcChargeWattsL);
                         printf("nBatteryVolts\t%d\n", status.nBatteryVolts);
+                        printf("nBatterySoc\t%d\n", status.nBatterySoc);
                         printf("nBusVolts\t%d\n", status.nBusVolts);
                         printf("nGridVolts\t%d\n", status.nGridVolts);
                         printf("nGridFreq\t%d\n", status.nGridFreq);
@@ -805,22 +1714,19 @@ int main()
                     
                     case 'g':
                     {
-                        printf("Forcing grid...\n");
-                        bManualSwitchToGrid = true;
+                        printf("Forcing grid (command %u)...\n", QueueCommand(COMMAND_REQUEST_GRID, 0, CMDQUEUE_ORIGIN_CONSOLE));
                     }
                     break;
                     
                     case 'b':
                     {
-                        printf("Forcing batteries...\n");
-                        bManualSwitchToBatts = true;
+                        printf("Forcing batteries (command %u)...\n", QueueCommand(COMMAND_REQUEST_BATTS, 0, CMDQUEUE_ORIGIN_CONSOLE));
                     }
                     break;
                     
                     case 'f':
                     {
-                        printf("Forcing boost...\n");
-                        bManualSwitchToBoost = true;
+                        printf("Forcing boost (command %u)...\n", QueueCommand(COMMAND_REQUEST_BOOST, 0, CMDQUEUE_ORIGIN_CONSOLE));
                     }
                     break;
                     
@@ -843,10 +1749,10 @@ int main()
                     {
                         uint16_t nAmps = 0;
                         
-                        if (scanf("%hd", &nAmps) == 1 && nAmps >= 1 && nAmps <= 80)
+                        if (scanf("%hu", &nAmps) == 1 && nAmps >= 1 && nAmps <= GW_CFG_UTIL_AMPS_MAX)
                         {
                             printf("Setting charge override to %d amps\n", nAmps);
-                            SetManualAmps(nAmps);
+                            QueueCommand(COMMAND_CHARGE_AMPS, nAmps, CMDQUEUE_ORIGIN_CONSOLE);
                             
                             if(status.nSystemState == SYSTEM_STATE_PEAK ||
                                status.nSystemState == SYSTEM_STATE_BYPASS)
@@ -856,7 +1762,7 @@ int main()
                         }
                         else
                         {
-                            printf("Invalid input. Please enter a number between 1 and 80.\n");
+                            printf("Invalid input. Please enter a number between 1 and %d.\n", GW_CFG_UTIL_AMPS_MAX);
                             // Clear the rest of the input buffer in case of invalid input
                             while ((input = getchar()) != '\n' && input != EOF);
                         }
@@ -870,6 +1776,56 @@ int main()
                     }
                     break;
                     
+                    case 'k':
+                    {
+                        printf("Taking a holding register snapshot...\n");
+                        pthread_mutex_lock(&snapshotMutex);
+                        cSnapshotRequest = SNAPSHOT_REQUEST_TAKE;
+                        pthread_mutex_unlock(&snapshotMutex);
+                        WakeModbus();
+                    }
+                    break;
+                    
+                    case 'r':
+                    {
+                        char filename[200];
+                        
+                        if(scanf("%199s", filename) == 1)
+                        {
+                            pthread_mutex_lock(&snapshotMutex);
+                            
+                            //Anything not given a path is in the log directory with the rest.
+                            if('/' == filename[0])
+                                snprintf(snapshotRestorePath, sizeof(snapshotRestorePath), "%s", filename);
+                            else
+                                GetLogPath(filename, snapshotRestorePath, sizeof(snapshotRestorePath));
+                            
+                            cSnapshotRequest = SNAPSHOT_REQUEST_RESTORE;
+                            pthread_mutex_unlock(&snapshotMutex);
+                            
+                            printf("Restoring holding registers from %s...\n", snapshotRestorePath);
+                            WakeModbus();
+                        }
+                    }
+                    break;
+                    
+                    case 'c':
+                    {
+                        char filename[64];
+                        char path[256];
+                        time_t now = time(NULL);
+                        struct tm timeinfo;
+                        
+                        localtime_r(&now, &timeinfo);
+                        strftime(filename, sizeof(filename), "capture-%Y%m%d-%H%M%S.cap", &timeinfo);
+                        
+                        if(GetLogPath(filename, path, sizeof(path)) && capture_Save(&capture, path))
+                            printf("Saved the last %u transactions as %s\n", capture.lCount, path);
+                        else
+                            printf("Failed to save the capture.\n");
+                    }
+                    break;
+                    
                     case '\n':
                     case '\r':
                         //Ignore whitespace.
@@ -886,7 +1842,10 @@ int main()
                         printf("l - Toggle logging\n");
                         printf("m - Toggle MODBUS debug\n");
                         printf("d - Dump next input registers\n");
-                        printf("a[1-80] - Override current util charge amps\n");
+                        printf("k - Snapshot holding registers, showing what changed\n");
+                        printf("r[file] - Restore holding registers from a snapshot\n");
+                        printf("c - Save the latest bus transactions for playback with -c\n");
+                        printf("a[1-%d] - Override current util charge amps\n", GW_CFG_UTIL_AMPS_MAX);
                         printf("--------------------------------\n");
                         break;
                     }
@@ -907,6 +1866,7 @@ int main()
     pthread_join(thread_modbus, NULL);
     printf("...MODBUS done...\n");
     tcpserver_deinit();
+    gatewayserver_deinit();
     printf("...TCP done. That's it.\n");
     return 0;
 }
@@ -0,0 +1,130 @@
+
+#include <stdio.h>
+#include <errno.h>
+#include <modbus.h>
+#include "modbustransport.h"
+
+static int modbustransport_Connect(void* pContext)
+{
+    return modbus_connect(pContext);
+}
+
+static void modbustransport_Free(void* pContext)
+{
+    modbus_close(pContext);
+    modbus_free(pContext);
+}
+
+static int modbustransport_SetSlave(void* pContext, int lSlave)
+{
+    return modbus_set_slave(pContext, lSlave);
+}
+
+static void modbustransport_SetDebug(void* pContext, bool bDebug)
+{
+    modbus_set_debug(pContext, bDebug);
+}
+
+static int modbustransport_ReadInput(void* pContext, int lAddress, int lCount, uint16_t* pDest)
+{
+    return modbus_read_input_registers(pContext, lAddress, lCount, pDest);
+}
+
+static int modbustransport_ReadHolding(void* pContext, int lAddress, int lCount, uint16_t* pDest)
+{
+    return modbus_read_registers(pContext, lAddress, lCount, pDest);
+}
+
+static int modbustransport_WriteSingle(void* pContext, int lAddress, uint16_t nValue)
+{
+    return modbus_write_register(pContext, lAddress, nValue);
+}
+
+static int modbustransport_WriteMultiple(void* pContext, int lAddress, int lCount, const uint16_t* pValues)
+{
+    return modbus_write_registers(pContext, lAddress, lCount, pValues);
+}
+
+static int modbustransport_WriteAndRead(void* pContext, int lWriteAddress, int lWriteCount, const uint16_t* pValues,
+                                        int lReadAddress, int lReadCount, uint16_t* pDest)
+{
+    return modbus_write_and_read_registers(pContext, lWriteAddress, lWriteCount, pValues, lReadAddress, lReadCount, pDest);
+}
+
+//libmodbus has no broadcast write, so the request's built here and sent raw, without waiting on a reply.
+static int modbustransport_Broadcast(void* pContext, int lAddress, int lCount, const uint16_t* pValues)
+{
+    uint8_t req[MODBUS_MAX_WRITE_REGISTERS * 2 + 7];
+    int lLength = 0;
+
+    if(lCount < 1 || lCount > MODBUS_MAX_WRITE_REGISTERS)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    req[lLength++] = MODBUS_BROADCAST_ADDRESS;
+    req[lLength++] = 1 == lCount ? MODBUS_FC_WRITE_SINGLE_REGISTER : MODBUS_FC_WRITE_MULTIPLE_REGISTERS;
+    req[lLength++] = lAddress >> 8;
+    req[lLength++] = lAddress & 0xFF;
+
+    if(1 == lCount)
+    {
+        req[lLength++] = pValues[0] >> 8;
+        req[lLength++] = pValues[0] & 0xFF;
+    }
+    else
+    {
+        req[lLength++] = lCount >> 8;
+        req[lLength++] = lCount & 0xFF;
+        req[lLength++] = lCount * 2;
+
+        for(int i = 0; i < lCount; i++)
+        {
+            req[lLength++] = pValues[i] >> 8;
+            req[lLength++] = pValues[i] & 0xFF;
+        }
+    }
+
+    return -1 == modbus_send_raw_request(pContext, req, lLength) ? -1 : lCount;
+}
+
+static const struct TransportOps modbusOps =
+{
+    modbustransport_Connect,
+    modbustransport_Free,
+    modbustransport_SetSlave,
+    modbustransport_SetDebug,
+    modbustransport_ReadInput,
+    modbustransport_ReadHolding,
+    modbustransport_WriteSingle,
+    modbustransport_WriteMultiple,
+    modbustransport_WriteAndRead,
+    modbustransport_Broadcast,
+    modbus_strerror,
+    NULL
+};
+
+bool modbustransport_InitialiseRtu(struct Transport* pTransport, const char* pDevice, int lBaud)
+{
+    modbus_t* ctx = modbus_new_rtu(pDevice, lBaud, 'N', 8, 1);
+
+    if(NULL == ctx)
+        return false;
+
+    transport_Initialise(pTransport, TRANSPORT_RTU, pDevice, &modbusOps, ctx);
+    return true;
+}
+
+bool modbustransport_InitialiseTcp(struct Transport* pTransport, const char* pHost, int lPort)
+{
+    char name[TRANSPORT_NAME_MAX];
+    modbus_t* ctx = modbus_new_tcp(pHost, lPort);
+
+    if(NULL == ctx)
+        return false;
+
+    snprintf(name, sizeof(name), "%s:%d", pHost, lPort);
+    transport_Initialise(pTransport, TRANSPORT_TCP, name, &modbusOps, ctx);
+    return true;
+}
@@ -0,0 +1,23 @@
+
+//libmodbus transports.
+//RTU on a local serial device, or MODBUS TCP to an RS485 gateway in front of the inverters.
+
+#ifndef MODBUSTRANSPORT_H
+#define MODBUSTRANSPORT_H
+
+#include <stdbool.h>
+#include "transport.h"
+
+#define MODBUSTRANSPORT_TCP_PORT 502
+
+/**
+ * Set up pTransport for RTU on pDevice at lBaud, 8N1. Returns false if libmodbus won't have it.
+ */
+bool modbustransport_InitialiseRtu(struct Transport* pTransport, const char* pDevice, int lBaud);
+
+/**
+ * Set up pTransport for MODBUS TCP to the gateway at pHost:lPort. Unit IDs are passed through as slave IDs.
+ */
+bool modbustransport_InitialiseTcp(struct Transport* pTransport, const char* pHost, int lPort);
+
+#endif
@@ -1,9 +1,15 @@
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <time.h>
 #include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
 #include <pthread.h>
 
 #include "tcpserver.h"
@@ -12,23 +18,267 @@
 #include "system_defs.h"
 
 #define PORT 20069
-#define MAX_CLIENTS 5
 
-#define CLIENT_TIMEOUT 30 //Bin clients after this many seconds.
+#define MAX_CONNECTIONS 4096 //Most clients connected at once. Slots are command origins, so below CMDQUEUE_ORIGIN_GATEWAY.
+
+#define CLIENT_TIMEOUT COMMS_TIMEOUT //Bin clients after this many seconds.
+
+#define MAX_PENDING 65536 //Bytes queued for a client that isn't reading before it's dropped.
+
+#define EPOLL_BATCH 64 //Most events taken per wait.
+
+#define RECEIVE_BUFFER 1024
+
+struct Client
+{
+    struct sdfComms comms;        //First, so the comms callbacks can find their client.
+    bool bEvents;                 //Subscribed to events.
+    bool bStatus;                 //Subscribed to status changes.
+    bool bInterest;               //Declared which status fields it shows. Everything, until it does.
+    uint32_t lInterest;           //STATUS_FIELD_BIT()s.
+    int socket;
+    uint16_t nSlot;
+    int64_t llLastUs;             //When it last sent us anything.
+    bool bPinged;                 //Sent a heartbeat since.
+    struct Client* pOlder;        //In order of last activity, so the next to time out is always first.
+    struct Client* pNewer;
+    pthread_mutex_t sendMutex;    //Events are sent from the MODBUS thread too.
+    uint8_t* pcPending;           //What the socket wouldn't take yet.
+    uint32_t lPending;
+    uint32_t lPendingSize;
+    bool bWriting;                //Waiting on EPOLLOUT to send pcPending.
+    bool bDrop;                   //Fell too far behind or failed a send. The server thread closes it.
+};
 
 pthread_t serverThread;
 bool bServerRunning = false;
 
 int server_socket;
 
+static int epoll_socket = -1;
+static int wake_socket = -1;      //eventfd written to stop the server thread.
+static bool bAcceptPaused = false;
+
+//Told apart from clients by epoll_event.data.ptr.
+static int listenTag;
+static int wakeTag;
+
+//Only the server thread adds and removes clients, holding clientsMutex so other threads can walk them.
+static struct Client* slots[MAX_CONNECTIONS];
+static uint16_t nNextSlot = 0;
+static uint32_t lClientCount = 0;
+static struct Client* pOldest = NULL;
+static struct Client* pNewest = NULL;
+static pthread_mutex_t clientsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct SystemStatus lastStatus; //As last pushed, so unchanged samples aren't.
+static bool bLastStatus = false;
+
+static int64_t MonotonicUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint16_t ClientSlot(struct sdfComms* psdcComms)
+{
+    return ((struct Client*)psdcComms)->nSlot;
+}
+
+static void WatchClient(struct Client* pClient, uint32_t lEvents)
+{
+    struct epoll_event event = { .events = lEvents, .data.ptr = pClient };
+    epoll_ctl(epoll_socket, EPOLL_CTL_MOD, pClient->socket, &event);
+}
+
+//Called with sendMutex held. The hangup wakes the server thread, which closes it.
+static void DropClient(struct Client* pClient)
+{
+    pClient->bDrop = true;
+    free(pClient->pcPending);
+    pClient->pcPending = NULL;
+    pClient->lPending = 0;
+    pClient->lPendingSize = 0;
+    shutdown(pClient->socket, SHUT_RDWR);
+}
+
+//Send as much of pcData as the socket takes now. Returns how much, or -1 if the client's gone.
+static int SendNow(struct Client* pClient, const uint8_t* pcData, uint32_t lLength)
+{
+    uint32_t lSent = 0;
+
+    while(lSent < lLength)
+    {
+        ssize_t slResult = send(pClient->socket, &pcData[lSent], lLength - lSent, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if(slResult >= 0)
+            lSent += slResult;
+        else if(EAGAIN == errno || EWOULDBLOCK == errno)
+            break;
+        else if(EINTR != errno)
+            return -1;
+    }
+
+    return lSent;
+}
+
+//Keep what wasn't sent until the socket will take it. Called with sendMutex held.
+static void Queue(struct Client* pClient, const uint8_t* pcData, uint32_t lLength)
+{
+    if(pClient->lPending + lLength > MAX_PENDING)
+    {
+        DropClient(pClient);
+        return;
+    }
+
+    if(pClient->lPending + lLength > pClient->lPendingSize)
+    {
+        uint32_t lSize = pClient->lPendingSize ? pClient->lPendingSize : RECEIVE_BUFFER;
+
+        while(lSize < pClient->lPending + lLength)
+            lSize *= 2;
+
+        uint8_t* pcPending = realloc(pClient->pcPending, lSize);
+
+        //Out of memory. The old buffer's left for DropClient to free.
+        if(NULL == pcPending)
+        {
+            DropClient(pClient);
+            return;
+        }
+
+        pClient->pcPending = pcPending;
+        pClient->lPendingSize = lSize;
+    }
+
+    memcpy(&pClient->pcPending[pClient->lPending], pcData, lLength);
+    pClient->lPending += lLength;
+
+    if(!pClient->bWriting)
+    {
+        pClient->bWriting = true;
+        WatchClient(pClient, EPOLLIN | EPOLLOUT);
+    }
+}
+
 void transmit_callback(struct sdfComms* psdcComms, uint8_t* pcData, uint16_t nLength)
 {
-    send(psdcComms->lID, pcData, nLength, 0);
+    struct Client* pClient = (struct Client*)psdcComms;
+
+    pthread_mutex_lock(&pClient->sendMutex);
+
+    if(!pClient->bDrop)
+    {
+        //Behind anything already waiting, or it would arrive out of order.
+        int lSent = pClient->bWriting ? 0 : SendNow(pClient, pcData, nLength);
+
+        if(lSent < 0)
+            DropClient(pClient);
+        else if(lSent < nLength)
+            Queue(pClient, &pcData[lSent], nLength - lSent);
+    }
+
+    pthread_mutex_unlock(&pClient->sendMutex);
+}
+
+//The socket will take more of what's waiting.
+static void FlushClient(struct Client* pClient)
+{
+    pthread_mutex_lock(&pClient->sendMutex);
+
+    if(!pClient->bDrop && pClient->lPending > 0)
+    {
+        int lSent = SendNow(pClient, pClient->pcPending, pClient->lPending);
+
+        if(lSent < 0)
+        {
+            DropClient(pClient);
+        }
+        else
+        {
+            pClient->lPending -= lSent;
+            memmove(pClient->pcPending, &pClient->pcPending[lSent], pClient->lPending);
+        }
+    }
+
+    if(0 == pClient->lPending && pClient->bWriting)
+    {
+        free(pClient->pcPending);
+        pClient->pcPending = NULL;
+        pClient->lPendingSize = 0;
+        pClient->bWriting = false;
+
+        if(!pClient->bDrop)
+            WatchClient(pClient, EPOLLIN);
+    }
+
+    pthread_mutex_unlock(&pClient->sendMutex);
+}
+
+static void SendSchedule(struct sdfComms* psdcComms)
+{
+    struct ScheduleList list;
+    _tcpserver_GetSchedule(&list);
+    Comms_SendObject(psdcComms, OBJECT_SCHEDULE, sizeof(struct ScheduleList), (uint8_t*)&list);
 }
 
 void objectReceived_callback(struct sdfComms* psdcComms, uint16_t nObjectID, uint16_t nLength, uint8_t* pcData)
 {
-    printf("Client socket %u sent us object ID %u unexpectedly.\n", psdcComms->lID, nObjectID);
+    switch(nObjectID)
+    {
+        case OBJECT_SCHEDULE_ADD:
+        {
+            struct ScheduledCommand command;
+            memcpy(&command, pcData, sizeof(command));
+            _tcpserver_AddSchedule(&command);
+            SendSchedule(psdcComms);
+        }
+        break;
+        
+        case OBJECT_SCHEDULE_CANCEL:
+        {
+            uint32_t lScheduleId;
+            memcpy(&lScheduleId, pcData, sizeof(lScheduleId));
+            _tcpserver_CancelSchedule(lScheduleId);
+            SendSchedule(psdcComms);
+        }
+        break;
+        
+        case OBJECT_FAULT_QUERY:
+        {
+            struct FaultQuery query;
+            struct FaultList list;
+            memcpy(&query, pcData, sizeof(query));
+            _tcpserver_QueryFaults(&query, &list);
+            Comms_SendObject(psdcComms, OBJECT_FAULT_LIST, sizeof(struct FaultList), (uint8_t*)&list);
+        }
+        break;
+        
+        case OBJECT_FAULT_CAPTURE_QUERY:
+        {
+            uint32_t lFaultId;
+            struct FaultCapture capture;
+            memcpy(&lFaultId, pcData, sizeof(lFaultId));
+            _tcpserver_GetFaultCapture(lFaultId, &capture);
+            Comms_SendObject(psdcComms, OBJECT_FAULT_CAPTURE, sizeof(struct FaultCapture), (uint8_t*)&capture);
+        }
+        break;
+        
+        case OBJECT_INTEREST:
+        {
+            uint32_t lInterest;
+            memcpy(&lInterest, pcData, sizeof(lInterest));
+            
+            pthread_mutex_lock(&clientsMutex);
+            ((struct Client*)psdcComms)->lInterest = lInterest & STATUS_FIELD_ALL;
+            ((struct Client*)psdcComms)->bInterest = true;
+            pthread_mutex_unlock(&clientsMutex);
+        }
+        break;
+        
+        default: printf("Client socket %u sent us object ID %u unexpectedly.\n", psdcComms->lID, nObjectID);
+    }
 }
 
 void commandReceived_callback(struct sdfComms* psdcComms, uint16_t nCommandID)
@@ -46,19 +296,53 @@ void commandReceived_callback(struct sdfComms* psdcComms, uint16_t nCommandID)
         
         case COMMAND_REQUEST_GRID:
         {
-            _tcpserver_SetGrid();
+            _tcpserver_SetGrid(ClientSlot(psdcComms));
         }
         break;
         
         case COMMAND_REQUEST_BATTS:
         {
-            _tcpserver_SetBatts();
+            _tcpserver_SetBatts(ClientSlot(psdcComms));
         }
         break;
         
         case COMMAND_REQUEST_BOOST:
         {
-            _tcpserver_SetBoost();
+            _tcpserver_SetBoost(ClientSlot(psdcComms));
+        }
+        break;
+        
+        case COMMAND_REQUEST_SCHEDULE:
+        {
+            SendSchedule(psdcComms);
+        }
+        break;
+        
+        case COMMAND_SUBSCRIBE_EVENTS:
+        {
+            pthread_mutex_lock(&clientsMutex);
+            ((struct Client*)psdcComms)->bEvents = true;
+            pthread_mutex_unlock(&clientsMutex);
+        }
+        break;
+        
+        case COMMAND_SUBSCRIBE_STATUS:
+        {
+            uint32_t lLength;
+            uint8_t* pStatus;
+            
+            //Held across the first send, so a push can't get in ahead of it with something newer.
+            pthread_mutex_lock(&clientsMutex);
+            ((struct Client*)psdcComms)->bStatus = true;
+            _tcpserver_GetStatus(&pStatus, &lLength);
+            Comms_SendObject(psdcComms, OBJECT_STATUS, lLength, pStatus);
+            pthread_mutex_unlock(&clientsMutex);
+        }
+        break;
+        
+        case COMMAND_HEARTBEAT:
+        {
+            //Hearing it was the point.
         }
         break;
     
@@ -75,6 +359,26 @@ bool lengthCheck_callback(struct sdfComms* psdcComms, uint16_t nObjectID, uint16
             return (nLength == sizeof(struct SystemStatus));
         }
         break;
+        
+        case OBJECT_SCHEDULE_ADD:
+        {
+            return (nLength == sizeof(struct ScheduledCommand));
+        }
+        break;
+        
+        case OBJECT_SCHEDULE_CANCEL:
+        case OBJECT_FAULT_CAPTURE_QUERY:
+        case OBJECT_INTEREST:
+        {
+            return (nLength == sizeof(uint32_t));
+        }
+        break;
+        
+        case OBJECT_FAULT_QUERY:
+        {
+            return (nLength == sizeof(struct FaultQuery));
+        }
+        break;
     
         default: printf("Client socket %u requested length check for unknown object %u.\n", psdcComms->lID, nObjectID);
     }
@@ -92,101 +396,408 @@ void error_callback(struct sdfComms* psdcComms, uint8_t cErrorCode)
     }
 }
 
-static void *handle_client(void *arg)
+
+//Take a new connection, or NULL if there are too many clients.
+static struct Client* AddClient(int client_socket)
 {
-    pthread_detach(pthread_self());
-    
-    int client_socket = *((int *)arg);
-    bool bClientRunning = true;
-    struct sdfComms sdcComms;
-    
-    Comms_Initialise(&sdcComms,
+    uint16_t nSlot = nNextSlot;
+    struct Client* pClient = NULL;
+
+    //Round from the last one taken, so a departed client's slot isn't straight away someone else's.
+    for(int i = 0; i < MAX_CONNECTIONS && NULL != slots[nSlot]; i++)
+        nSlot = (nSlot + 1) % MAX_CONNECTIONS;
+
+    if(NULL != slots[nSlot] || NULL == (pClient = calloc(1, sizeof(struct Client))))
+        return NULL;
+
+    Comms_Initialise(&pClient->comms,
                      client_socket,
                      transmit_callback,
                      objectReceived_callback,
                      commandReceived_callback,
                      lengthCheck_callback,
                      error_callback);
-    
-    printf("Client connected.\n");
 
-    struct timeval tv;
-    tv.tv_sec = CLIENT_TIMEOUT;
-    tv.tv_usec = 0;
-    setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
+    pClient->socket = client_socket;
+    pClient->nSlot = nSlot;
+    pClient->llLastUs = MonotonicUs();
+    pthread_mutex_init(&pClient->sendMutex, NULL);
+
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = pClient };
+
+    if(0 != epoll_ctl(epoll_socket, EPOLL_CTL_ADD, client_socket, &event))
+    {
+        pthread_mutex_destroy(&pClient->sendMutex);
+        free(pClient);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&clientsMutex);
+
+    slots[nSlot] = pClient;
+    pClient->pOlder = pNewest;
+
+    if(NULL != pNewest)
+        pNewest->pNewer = pClient;
+    else
+        pOldest = pClient;
+
+    pNewest = pClient;
+    lClientCount++;
+
+    pthread_mutex_unlock(&clientsMutex);
+
+    nNextSlot = (nSlot + 1) % MAX_CONNECTIONS;
+
+    return pClient;
+}
+
+//Called with clientsMutex held.
+static void Unlink(struct Client* pClient)
+{
+    if(NULL != pClient->pOlder)
+        pClient->pOlder->pNewer = pClient->pNewer;
+    else
+        pOldest = pClient->pNewer;
+
+    if(NULL != pClient->pNewer)
+        pClient->pNewer->pOlder = pClient->pOlder;
+    else
+        pNewest = pClient->pOlder;
+
+    pClient->pOlder = NULL;
+    pClient->pNewer = NULL;
+}
+
+//It's heard from, so it goes to the back of the queue to time out.
+static void Touch(struct Client* pClient)
+{
+    pthread_mutex_lock(&clientsMutex);
+
+    pClient->llLastUs = MonotonicUs();
+    pClient->bPinged = false;
+
+    if(pNewest != pClient)
+    {
+        Unlink(pClient);
+        pClient->pOlder = pNewest;
+        pNewest->pNewer = pClient;
+        pNewest = pClient;
+    }
+
+    pthread_mutex_unlock(&clientsMutex);
+}
+
+static void CloseClient(struct Client* pClient)
+{
+    // Stop events being pushed before closing the socket
+    pthread_mutex_lock(&clientsMutex);
+    Unlink(pClient);
+    slots[pClient->nSlot] = NULL;
+    lClientCount--;
+    pthread_mutex_unlock(&clientsMutex);
+
+    epoll_ctl(epoll_socket, EPOLL_CTL_DEL, pClient->socket, NULL);
+    close(pClient->socket);
+
+    Comms_Deinit(&pClient->comms);
+    pthread_mutex_destroy(&pClient->sendMutex);
+    free(pClient->pcPending);
+    free(pClient);
+
+    //A socket's free again.
+    if(bAcceptPaused)
+    {
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = &listenTag };
+        epoll_ctl(epoll_socket, EPOLL_CTL_MOD, server_socket, &event);
+        bAcceptPaused = false;
+    }
+
+    printf("Client socket closed\n");
+}
 
-    while(bClientRunning && bServerRunning && (COMMS_ERROR_NONE == Comms_LastError(&sdcComms)))
+static void AcceptClients()
+{
+    while(true)
     {
-        uint8_t buffer[1024];
-        memset(buffer, 0, sizeof(buffer));
+        // Accept a new connection
+        int client_socket = accept4(server_socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
 
-        // Read data from the client
-        int bytes_received = recv(client_socket, buffer, sizeof(buffer), 0);
-        if (bytes_received < 0)
+        if(client_socket >= 0)
+        {
+            if(NULL == AddClient(client_socket))
+            {
+                printf("Too many clients\n");
+                close(client_socket);
+            }
+            else
+            {
+                printf("Client connected.\n");
+            }
+        }
+        else if(EMFILE == errno || ENFILE == errno || ENOBUFS == errno || ENOMEM == errno)
+        {
+            //Level triggered, so the waiting connection would spin the loop. Leave it in the backlog until a client goes.
+            struct epoll_event event = { .events = 0, .data.ptr = &listenTag };
+            epoll_ctl(epoll_socket, EPOLL_CTL_MOD, server_socket, &event);
+            bAcceptPaused = true;
+
+            printf("Out of sockets, holding off new clients\n");
+            return;
+        }
+        else if(EINTR != errno && ECONNABORTED != errno)
+        {
+            if(EAGAIN != errno && EWOULDBLOCK != errno)
+                printf("Timeout/error\n");
+
+            return;
+        }
+    }
+}
+
+static void ReadClient(struct Client* pClient, uint8_t* pcBuffer)
+{
+    pthread_mutex_lock(&pClient->sendMutex);
+    bool bDrop = pClient->bDrop;
+    pthread_mutex_unlock(&pClient->sendMutex);
+
+    if(bDrop)
+    {
+        printf("Client fell too far behind.\n");
+        CloseClient(pClient);
+        return;
+    }
+
+    // Read data from the client
+    ssize_t bytes_received = recv(pClient->socket, pcBuffer, RECEIVE_BUFFER, 0);
+
+    if(bytes_received < 0)
+    {
+        if(EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)
         {
             printf("Client socket is dead.\n");
-            bClientRunning = false;
+            CloseClient(pClient);
         }
-        else if(0 == bytes_received)
+    }
+    else if(0 == bytes_received)
+    {
+        printf("Client closed the socket.\n");
+        CloseClient(pClient);
+    }
+    else
+    {
+        Touch(pClient);
+        Comms_Receive(&pClient->comms, pcBuffer, bytes_received);
+
+        if(COMMS_ERROR_NONE != Comms_LastError(&pClient->comms))
+            CloseClient(pClient);
+    }
+}
+
+//Check on clients that have gone quiet and close those that stayed that way. Returns milliseconds
+//until there's more to do, or forever if there are no clients.
+static int Sweep()
+{
+    int64_t llNowUs = MonotonicUs();
+    int64_t llNextUs = INT64_MAX;
+    struct Client* pNext;
+
+    //Quietest first, so only the ones due and the first that isn't need looking at.
+    for(struct Client* pClient = pOldest; NULL != pClient; pClient = pNext)
+    {
+        pNext = pClient->pNewer;
+
+        if(pClient->llLastUs + (int64_t)CLIENT_TIMEOUT * 1000000 <= llNowUs)
         {
-            printf("Client closed the socket.\n");
-            bClientRunning = false;
+            printf("Client socket is dead.\n");
+            CloseClient(pClient);
+            continue;
         }
-        else
+
+        if(pClient->llLastUs + (int64_t)CLIENT_TIMEOUT * 1000000 < llNextUs)
+            llNextUs = pClient->llLastUs + (int64_t)CLIENT_TIMEOUT * 1000000;
+
+        if(pClient->bPinged)
+            continue;
+
+        if(pClient->llLastUs + (int64_t)COMMS_HEARTBEAT_INTERVAL * 1000000 <= llNowUs)
         {
-            Comms_Receive(&sdcComms, buffer, bytes_received);
+            Comms_SendCommand(&pClient->comms, COMMAND_HEARTBEAT);
+            pClient->bPinged = true;
+            continue;
         }
-        
-        usleep(10000);
+
+        if(pClient->llLastUs + (int64_t)COMMS_HEARTBEAT_INTERVAL * 1000000 < llNextUs)
+            llNextUs = pClient->llLastUs + (int64_t)COMMS_HEARTBEAT_INTERVAL * 1000000;
+
+        break;
     }
-    
-    Comms_Deinit(&sdcComms);
 
-    // Close the client socket and exit the thread
-    close(client_socket);
-    printf("Client socket closed\n");
-    return NULL;
+    if(INT64_MAX == llNextUs)
+        return -1;
+
+    return llNextUs > llNowUs ? (int)((llNextUs - llNowUs) / 1000) + 1 : 0;
 }
 
 void *handle_server(void *arg)
 {
+    struct epoll_event events[EPOLL_BATCH];
+    uint8_t buffer[RECEIVE_BUFFER];
+
+    int lTimeout = -1;
+
     printf("Server listening on port %d...\n", PORT);
 
     while (bServerRunning)
     {
-        int client_socket;
+        int lEvents = epoll_wait(epoll_socket, events, EPOLL_BATCH, lTimeout);
 
-        // Accept a new connection
-        if ((client_socket = accept(server_socket, NULL, NULL)) == -1)
+        if(lEvents < 0 && EINTR != errno)
         {
-            printf("Timeout/error\n");
+            printf("Error waiting on sockets\n");
+            break;
         }
-        else
+
+        for(int i = 0; i < lEvents; i++)
         {
-            // Create a new thread to handle the connection
-            if (pthread_create(&serverThread, NULL, handle_client, &client_socket) != 0)
+            if(&wakeTag == events[i].data.ptr)
             {
-                printf("Error creating thread\n");
-                close(client_socket);
+                bServerRunning = false;
+            }
+            else if(&listenTag == events[i].data.ptr)
+            {
+                AcceptClients();
+            }
+            else
+            {
+                struct Client* pClient = events[i].data.ptr;
+
+                if(events[i].events & EPOLLOUT)
+                    FlushClient(pClient);
+
+                if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    ReadClient(pClient, buffer);
             }
         }
-        
-        usleep(10000);
+
+        lTimeout = Sweep();
     }
 
+    while(NULL != pOldest)
+        CloseClient(pOldest);
+
     close(server_socket);
     printf("Server socket closed\n");
     pthread_exit(NULL);
 }
 
+void tcpserver_PushEvent(const struct SystemEvent* pEvent)
+{
+    pthread_mutex_lock(&clientsMutex);
+
+    for(struct Client* pClient = pOldest; NULL != pClient; pClient = pClient->pNewer)
+    {
+        if(pClient->bEvents)
+        {
+            Comms_SendObject(&pClient->comms, OBJECT_EVENT, sizeof(struct SystemEvent), (uint8_t*)pEvent);
+        }
+    }
+
+    pthread_mutex_unlock(&clientsMutex);
+}
+
+void tcpserver_PushStatus(const struct SystemStatus* pStatus)
+{
+    pthread_mutex_lock(&clientsMutex);
+
+    if(!bLastStatus || 0 != memcmp(&lastStatus, pStatus, sizeof(struct SystemStatus)))
+    {
+        memcpy(&lastStatus, pStatus, sizeof(struct SystemStatus));
+        bLastStatus = true;
+
+        for(struct Client* pClient = pOldest; NULL != pClient; pClient = pClient->pNewer)
+        {
+            if(pClient->bStatus)
+            {
+                Comms_SendObject(&pClient->comms, OBJECT_STATUS, sizeof(struct SystemStatus), (uint8_t*)&lastStatus);
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&clientsMutex);
+}
+
+uint32_t tcpserver_Interest()
+{
+    uint32_t lInterest = 0;
+
+    pthread_mutex_lock(&clientsMutex);
+
+    for(struct Client* pClient = pOldest; NULL != pClient && STATUS_FIELD_ALL != lInterest; pClient = pClient->pNewer)
+    {
+        lInterest |= pClient->bInterest ? pClient->lInterest : STATUS_FIELD_ALL;
+    }
+
+    pthread_mutex_unlock(&clientsMutex);
+
+    return lInterest;
+}
+
+uint32_t tcpserver_ClientCount()
+{
+    pthread_mutex_lock(&clientsMutex);
+    uint32_t lCount = lClientCount;
+    pthread_mutex_unlock(&clientsMutex);
+
+    return lCount;
+}
+
+void tcpserver_SendCommandResult(uint16_t nClient, const struct CommandResult* pResult)
+{
+    pthread_mutex_lock(&clientsMutex);
+
+    if(nClient < MAX_CONNECTIONS && NULL != slots[nClient])
+    {
+        Comms_SendObject(&slots[nClient]->comms, OBJECT_COMMAND_RESULT, sizeof(struct CommandResult), (uint8_t*)pResult);
+    }
+
+    pthread_mutex_unlock(&clientsMutex);
+}
+
+//A Pi allows 1024 files by default, short of MAX_CONNECTIONS. Go as high as we're let.
+static void RaiseFileLimit()
+{
+    struct rlimit limit;
+
+    if(0 == getrlimit(RLIMIT_NOFILE, &limit) && limit.rlim_cur < MAX_CONNECTIONS + 64)
+    {
+        limit.rlim_cur = (RLIM_INFINITY == limit.rlim_max || limit.rlim_max > MAX_CONNECTIONS + 64) ? MAX_CONNECTIONS + 64 : limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
 bool tcpserver_init()
 {
     struct sockaddr_in server_addr;
-    
+    struct epoll_event event;
+    int lReuse = 1;
+
+    RaiseFileLimit();
+
+    if((epoll_socket = epoll_create1(EPOLL_CLOEXEC)) == -1 || (wake_socket = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+    {
+        printf("Error creating epoll\n");
+        return false;
+    }
+
+    event.events = EPOLLIN;
+    event.data.ptr = &wakeTag;
+    epoll_ctl(epoll_socket, EPOLL_CTL_ADD, wake_socket, &event);
+
     while(!bServerRunning)
     {
         // Create socket
-        if ((server_socket = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+        if ((server_socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1)
         {
             printf("Error creating socket\n");
             sleep(1);
@@ -198,6 +809,9 @@ bool tcpserver_init()
             server_addr.sin_port = htons(PORT);
             server_addr.sin_addr.s_addr = INADDR_ANY;
 
+            // Don't wait out TIME_WAIT from the last run
+            setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &lReuse, sizeof(lReuse));
+
             // Bind socket to address
             if (bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
                 printf("Error binding\n");
@@ -207,7 +821,10 @@ bool tcpserver_init()
             else
             {
                 // Listen for incoming connections
-                if (listen(server_socket, MAX_CLIENTS) == -1) {
+                event.events = EPOLLIN;
+                event.data.ptr = &listenTag;
+
+                if (listen(server_socket, SOMAXCONN) == -1 || epoll_ctl(epoll_socket, EPOLL_CTL_ADD, server_socket, &event) == -1) {
                     printf("Error listening\n");
                     close(server_socket);
                     sleep(1);
@@ -215,7 +832,7 @@ bool tcpserver_init()
                 else
                 {
                     bServerRunning = true;
-                
+
                     if(0 != pthread_create(&serverThread, NULL, &handle_server, NULL))
                     {
                         printf("Error creating server thread\n");
@@ -233,8 +850,19 @@ bool tcpserver_init()
 
 void tcpserver_deinit()
 {
-    bServerRunning = false;
-    close(server_socket);
-    pthread_cancel(serverThread);
-    pthread_join(serverThread, NULL);
+    uint64_t llWake = 1;
+
+    if(-1 == wake_socket)
+        return;
+
+    if(bServerRunning)
+    {
+        if(sizeof(llWake) == write(wake_socket, &llWake, sizeof(llWake)))
+            pthread_join(serverThread, NULL);
+    }
+
+    close(wake_socket);
+    close(epoll_socket);
+    wake_socket = -1;
+    epoll_socket = -1;
 }
@@ -1,8 +1,17 @@
 
+//Client server.
+//One thread serves every client from an epoll loop over non-blocking sockets, so an idle client
+//costs a socket and a small state object, not a thread. Whatever a socket won't take at once is
+//queued on the client and sent as it drains, and a client that stops reading is dropped rather
+//than allowed to hold up the thread sending to it. A client that's quiet for
+//COMMS_HEARTBEAT_INTERVAL seconds is sent a heartbeat, and closed if it still says nothing by
+//COMMS_TIMEOUT, so subscribers that only listen stay connected as long as they answer.
+
 #ifndef TCPSERVER_H
 #define TCPSERVER_H
 
 #include <stdbool.h>
+#include "system_defs.h"
 
 /**
  * Call to initialise and run the process thread.
@@ -14,10 +23,40 @@ bool tcpserver_init();
  */
 void tcpserver_deinit();
 
+/**
+ * Send an event to every client that has subscribed to events.
+ */
+void tcpserver_PushEvent(const struct SystemEvent* pEvent);
+
+/**
+ * Send the status to every client that has subscribed to it, if it's changed since the last time.
+ */
+void tcpserver_PushStatus(const struct SystemStatus* pStatus);
+
+/**
+ * Tell the client in slot nClient how its command went, if it's still connected.
+ */
+void tcpserver_SendCommandResult(uint16_t nClient, const struct CommandResult* pResult);
+
+/**
+ * The STATUS_FIELD_BIT()s any connected client wants, or zero if nobody's connected.
+ */
+uint32_t tcpserver_Interest();
+
+/**
+ * How many clients are connected.
+ */
+uint32_t tcpserver_ClientCount();
+
 // Callbacks.
 extern void _tcpserver_GetStatus();
-extern void _tcpserver_SetBatts();
-extern void _tcpserver_SetGrid();
-extern void _tcpserver_SetBoost();
+extern void _tcpserver_SetBatts(uint16_t nClient);
+extern void _tcpserver_SetGrid(uint16_t nClient);
+extern void _tcpserver_SetBoost(uint16_t nClient);
+extern void _tcpserver_GetSchedule(struct ScheduleList* pList);
+extern uint32_t _tcpserver_AddSchedule(const struct ScheduledCommand* pCommand);
+extern bool _tcpserver_CancelSchedule(uint32_t lScheduleId);
+extern void _tcpserver_QueryFaults(const struct FaultQuery* pQuery, struct FaultList* pList);
+extern void _tcpserver_GetFaultCapture(uint32_t lFaultId, struct FaultCapture* pCapture);
 
 #endif
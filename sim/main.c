@@ -0,0 +1,405 @@
+
+//SPF5000ES simulator.
+//Serves the simulated inverters as MODBUS RTU over a pty pair, and/or MODBUS TCP, so the server,
+//perftest and soak tests can run without any hardware at realistic bus timing.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "invsim.h"
+
+#define SIM_ADVANCE_US    100000   /* Model time step. */
+#define SIM_BAUD          9600
+#define SIM_FRAME_MAX     256
+#define SIM_SURGE_WATTS   12000    /* What 'o' adds to the load. Enough to overload two units. */
+#define SIM_SURGE_MS      10000
+
+#define SIM_EX_GATEWAY_NO_RESPONSE 0x0B
+
+struct InvSim sim;
+pthread_mutex_t simMutex = PTHREAD_MUTEX_INITIALIZER;
+bool bRunning = true;
+
+int lLatencyMs = 0;         //Extra turnaround time on every request.
+int lBaud = SIM_BAUD;       //RTU requests and responses take as long as they would on the wire at this rate.
+bool bVerbose = false;
+
+static int64_t MonotonicMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint16_t Crc16(const uint8_t* pData, uint16_t nLength)
+{
+    uint16_t nCrc = 0xFFFF;
+
+    for(uint16_t i = 0; i < nLength; i++)
+    {
+        nCrc ^= pData[i];
+
+        for(int j = 0; j < 8; j++)
+            nCrc = (nCrc & 1) ? (nCrc >> 1) ^ 0xA001 : nCrc >> 1;
+    }
+
+    return nCrc;
+}
+
+static uint16_t Request(uint8_t cSlave, const uint8_t* pRequest, uint16_t nLength, uint8_t* pResponse)
+{
+    pthread_mutex_lock(&simMutex);
+    uint16_t nResponse = invsim_Request(&sim, cSlave, pRequest, nLength, pResponse);
+    pthread_mutex_unlock(&simMutex);
+
+    if(bVerbose)
+        printf("Slave %d function 0x%02X: %d byte response\n", cSlave, pRequest[0], nResponse);
+
+    return nResponse;
+}
+
+static void* advance_thread(void* arg)
+{
+    while(bRunning)
+    {
+        pthread_mutex_lock(&simMutex);
+        invsim_Advance(&sim, time(NULL), MonotonicMs());
+        pthread_mutex_unlock(&simMutex);
+
+        usleep(SIM_ADVANCE_US);
+    }
+
+    return NULL;
+}
+
+//RTU over the master side of a pty. Frames end with 3.5 characters of silence.
+static void* rtu_thread(void* arg)
+{
+    int fd = *(int*)arg;
+    int lSilenceMs = (35 * 1000) / lBaud + 1;
+    uint8_t frame[SIM_FRAME_MAX];
+    uint8_t response[SIM_FRAME_MAX];
+    uint16_t nFrame = 0;
+
+    while(bRunning)
+    {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int rc = poll(&pfd, 1, nFrame ? lSilenceMs : 500);
+
+        if(rc > 0)
+        {
+            ssize_t lRead = read(fd, frame + nFrame, sizeof(frame) - nFrame);
+
+            if(lRead > 0)
+                nFrame += lRead;
+            else if(lRead < 0 && EIO == errno)
+                usleep(100000);   //Nobody has the other end open yet.
+
+            if(nFrame < sizeof(frame))
+                continue;
+        }
+
+        if(0 == nFrame)
+            continue;
+
+        //A whole frame. Anything too short or corrupt is ignored, as a real slave would.
+        if(nFrame >= 4 && Crc16(frame, nFrame - 2) == (frame[nFrame - 2] | (frame[nFrame - 1] << 8)))
+        {
+            uint16_t nResponse = Request(frame[0], frame + 1, nFrame - 3, response + 1);
+
+            if(nResponse > 0)
+            {
+                response[0] = frame[0];
+                uint16_t nCrc = Crc16(response, nResponse + 1);
+                response[nResponse + 1] = (uint8_t)nCrc;
+                response[nResponse + 2] = (uint8_t)(nCrc >> 8);
+
+                //Turnaround, then the time the response takes to go out on the wire. 11 bits per character.
+                usleep(lLatencyMs * 1000 + ((nResponse + 3) * 11 * 1000000) / lBaud);
+
+                if(write(fd, response, nResponse + 3) < 0)
+                    printf("RTU write failed: %s\n", strerror(errno));
+            }
+        }
+
+        nFrame = 0;
+    }
+
+    return NULL;
+}
+
+//MODBUS TCP. Unit 0xFF means the master, 0 is a broadcast, and missing units get the gateway exception.
+static void* tcp_client_thread(void* arg)
+{
+    int fd = (int)(intptr_t)arg;
+    uint8_t frame[7 + SIM_FRAME_MAX];
+    uint8_t response[7 + SIM_FRAME_MAX];
+
+    while(bRunning)
+    {
+        if(recv(fd, frame, 7, MSG_WAITALL) != 7)
+            break;
+
+        uint16_t nLength = (frame[4] << 8) | frame[5];
+
+        if(frame[2] != 0 || frame[3] != 0 || nLength < 2 || nLength > SIM_FRAME_MAX)
+            break;
+
+        if(recv(fd, frame + 7, nLength - 1, MSG_WAITALL) != nLength - 1)
+            break;
+
+        uint8_t cUnit = 0xFF == frame[6] ? INVERTER_1_ID : frame[6];
+        uint16_t nResponse = Request(cUnit, frame + 7, nLength - 1, response + 7);
+
+        if(0 == cUnit)
+            continue;
+
+        if(0 == nResponse)
+        {
+            response[7] = frame[7] | 0x80;
+            response[8] = SIM_EX_GATEWAY_NO_RESPONSE;
+            nResponse = 2;
+        }
+
+        memcpy(response, frame, 4);
+        response[4] = (uint8_t)((nResponse + 1) >> 8);
+        response[5] = (uint8_t)(nResponse + 1);
+        response[6] = frame[6];
+
+        if(lLatencyMs > 0)
+            usleep(lLatencyMs * 1000);
+
+        if(send(fd, response, 7 + nResponse, MSG_NOSIGNAL) < 0)
+            break;
+    }
+
+    close(fd);
+    return NULL;
+}
+
+static void* tcp_thread(void* arg)
+{
+    int lListen = *(int*)arg;
+
+    while(bRunning)
+    {
+        int fd = accept(lListen, NULL, NULL);
+
+        if(fd < 0)
+            continue;
+
+        int lOne = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &lOne, sizeof(lOne));
+
+        pthread_t thread;
+
+        if(0 == pthread_create(&thread, NULL, tcp_client_thread, (void*)(intptr_t)fd))
+            pthread_detach(thread);
+        else
+            close(fd);
+    }
+
+    return NULL;
+}
+
+static int OpenPty(const char* pLink)
+{
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if(fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0)
+    {
+        printf("Failed to create a pty: %s\n", strerror(errno));
+        return -1;
+    }
+
+    const char* pSlave = ptsname(fd);
+
+    //Raw bytes, no echo or line discipline.
+    int lSlave = open(pSlave, O_RDWR | O_NOCTTY);
+    struct termios tio;
+
+    if(lSlave >= 0 && 0 == tcgetattr(lSlave, &tio))
+    {
+        cfmakeraw(&tio);
+        tcsetattr(lSlave, TCSANOW, &tio);
+    }
+
+    if(lSlave >= 0)
+        close(lSlave);
+
+    if(NULL != pLink)
+    {
+        unlink(pLink);
+
+        if(symlink(pSlave, pLink) < 0)
+            printf("Failed to link %s to %s: %s\n", pLink, pSlave, strerror(errno));
+    }
+
+    printf("RTU on %s%s%s\n", pSlave, pLink ? " via " : "", pLink ? pLink : "");
+    return fd;
+}
+
+static int Listen(int lPort)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int lOne = 1;
+    struct sockaddr_in addr;
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &lOne, sizeof(lOne));
+    memset(&addr, 0x00, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(lPort);
+
+    if(fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0)
+    {
+        printf("Failed to listen on port %d: %s\n", lPort, strerror(errno));
+        return -1;
+    }
+
+    printf("MODBUS TCP on port %d\n", lPort);
+    return fd;
+}
+
+static void Usage()
+{
+    printf("Usage: sim [-r] [-p link] [-t port] [-n units] [-l latency ms] [-b baud] [-s SoC%%] [-w watts] [-v]\n");
+    printf("  -r  RTU over a pty.\n");
+    printf("  -p  RTU over a pty, symlinked to link (e.g. /tmp/ttySIM).\n");
+    printf("  -t  MODBUS TCP on port.\n");
+}
+
+int main(int argc, char* argv[])
+{
+    bool bRtu = false;
+    const char* pLink = NULL;
+    int lPort = 0;
+    int lUnits = INVERTER_COUNT;
+    int lSoc = 50;
+    int lWatts = 800;
+    int opt;
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    while((opt = getopt(argc, argv, "rp:t:n:l:b:s:w:v")) != -1)
+    {
+        switch(opt)
+        {
+            case 'r': bRtu = true; break;
+            case 'p': bRtu = true; pLink = optarg; break;
+            case 't': lPort = atoi(optarg); break;
+            case 'n': lUnits = atoi(optarg); break;
+            case 'l': lLatencyMs = atoi(optarg); break;
+            case 'b': lBaud = atoi(optarg) > 0 ? atoi(optarg) : SIM_BAUD; break;
+            case 's': lSoc = atoi(optarg); break;
+            case 'w': lWatts = atoi(optarg); break;
+            case 'v': bVerbose = true; break;
+            default: Usage(); return 1;
+        }
+    }
+
+    if(!bRtu && 0 == lPort)
+    {
+        Usage();
+        return 1;
+    }
+
+    invsim_Initialise(&sim, lUnits, lSoc, lWatts, time(NULL), MonotonicMs());
+    printf("Simulating %d inverter(s), slave IDs %d-%d, at %d%% SoC and %dW.\n",
+           sim.cUnits, INVERTER_1_ID, INVERTER_1_ID + sim.cUnits - 1, lSoc, lWatts);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, advance_thread, NULL);
+
+    int lPty = -1;
+    int lListen = -1;
+
+    if(bRtu && (lPty = OpenPty(pLink)) >= 0)
+        pthread_create(&thread, NULL, rtu_thread, &lPty);
+
+    if(lPort && (lListen = Listen(lPort)) >= 0)
+        pthread_create(&thread, NULL, tcp_thread, &lListen);
+
+    while(bRunning)
+    {
+        int input = getchar();
+
+        pthread_mutex_lock(&simMutex);
+
+        switch(input)
+        {
+            case EOF:
+            {
+                //No console. Run until killed.
+                pthread_mutex_unlock(&simMutex);
+                pause();
+                pthread_mutex_lock(&simMutex);
+            }
+            break;
+
+            case 'q':
+            {
+                bRunning = false;
+            }
+            break;
+
+            case 'g':
+            {
+                invsim_SetGrid(&sim, !sim.bGridUp);
+                printf("Grid %s.\n", sim.bGridUp ? "up" : "down");
+            }
+            break;
+
+            case 'o':
+            {
+                invsim_Surge(&sim, SIM_SURGE_WATTS, SIM_SURGE_MS);
+                printf("Surging by %dW for %dms.\n", SIM_SURGE_WATTS, SIM_SURGE_MS);
+            }
+            break;
+
+            case 's':
+            {
+                printf("---=== Simulator ===---\n");
+                printf("SoC\t\t%.1f%%\n", invsim_Soc(&sim));
+                printf("Grid\t\t%s\n", sim.bGridUp ? "up" : "down");
+                printf("Clock offset\t%ds\n", sim.slClockOffset);
+                printf("Requests\t%u (%u exceptions)\n", sim.lRequests, sim.lExceptions);
+
+                for(uint8_t i = 0; i < sim.cUnits; i++)
+                {
+                    struct InvSimUnit* pUnit = &sim.units[i];
+                    printf("Unit %d\t\tstate %s, mode %d, %dW, charging %d.%dA%s\n", INVERTER_1_ID + i,
+                           GwInverterStatusStrings[pUnit->inputRegs[STATUS]], pUnit->holdingRegs[GW_HREG_CFG_MODE],
+                           pUnit->inputRegs[OUTPUT_WATTS_L] / 10, pUnit->inputRegs[BATTCHG_AMPS] / 10,
+                           pUnit->inputRegs[BATTCHG_AMPS] % 10, pUnit->llTransferMs ? ", transferring" : "");
+                }
+
+                printf("\n");
+            }
+            break;
+        }
+
+        pthread_mutex_unlock(&simMutex);
+    }
+
+    if(lPty >= 0)
+        close(lPty);
+
+    if(lListen >= 0)
+        close(lListen);
+
+    return 0;
+}
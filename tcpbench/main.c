@@ -0,0 +1,269 @@
+
+//Client server benchmark.
+//Runs the server's TCP side in process, opens a crowd of clients to it over loopback that
+//subscribe to events and status and then say nothing, and reports what they cost: resident
+//memory and threads per client, CPU used while they sit idle, and how long an event or a status
+//change takes to reach all of them. The server's own chatter goes to /dev/null so it doesn't
+//swamp the report.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+
+#include "tcpserver.h"
+#include "comms_protocol.h"
+#include "comms_defs.h"
+#include "system_defs.h"
+
+#define TCPBENCH_CLIENTS 2000
+#define TCPBENCH_IDLE    10       /* Seconds the clients sit idle. Keep under the server's client timeout. */
+#define TCPBENCH_EVENTS  10       /* Events and status changes pushed to every client. */
+#define TCPBENCH_PORT    20069
+
+static FILE* report;
+
+static int64_t NowUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t CpuUs()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+//A number from /proc/self/status, such as VmRSS in kB or Threads.
+static long ProcStatus(const char* pName)
+{
+    char line[256];
+    long lValue = -1;
+    size_t length = strlen(pName);
+    FILE* file = fopen("/proc/self/status", "r");
+
+    while(NULL != file && NULL != fgets(line, sizeof(line), file))
+    {
+        if(0 == strncmp(line, pName, length) && ':' == line[length])
+            lValue = atol(&line[length + 1]);
+    }
+
+    if(NULL != file)
+        fclose(file);
+
+    return lValue;
+}
+
+static struct SystemStatus status;
+
+//Nothing from the server needs doing here.
+void _tcpserver_GetStatus(uint8_t** ppStatus, uint32_t* pLength)
+{
+    *ppStatus = (uint8_t*)&status;
+    *pLength = sizeof(status);
+}
+
+void _tcpserver_SetBatts(uint16_t nClient) {}
+void _tcpserver_SetGrid(uint16_t nClient) {}
+void _tcpserver_SetBoost(uint16_t nClient) {}
+void _tcpserver_GetSchedule(struct ScheduleList* pList) { memset(pList, 0x00, sizeof(struct ScheduleList)); }
+uint32_t _tcpserver_AddSchedule(const struct ScheduledCommand* pCommand) { return 0; }
+bool _tcpserver_CancelSchedule(uint32_t lScheduleId) { return false; }
+void _tcpserver_QueryFaults(const struct FaultQuery* pQuery, struct FaultList* pList) { memset(pList, 0x00, sizeof(struct FaultList)); }
+void _tcpserver_GetFaultCapture(uint32_t lFaultId, struct FaultCapture* pCapture) { memset(pCapture, 0x00, sizeof(struct FaultCapture)); }
+
+static int Connect()
+{
+    struct sockaddr_in addr;
+    uint8_t subscribe[COMMS_COMMAND_HEADER_LENGTH * 2] = { COMMS_MESSAGE_TYPE_COMMAND, COMMAND_SUBSCRIBE_EVENTS & 0xFF, COMMAND_SUBSCRIBE_EVENTS >> 8,
+                                                           COMMS_MESSAGE_TYPE_COMMAND, COMMAND_SUBSCRIBE_STATUS & 0xFF, COMMAND_SUBSCRIBE_STATUS >> 8 };
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(TCPBENCH_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if(fd < 0)
+        return -1;
+
+    if(0 != connect(fd, (struct sockaddr*)&addr, sizeof(addr)) || sizeof(subscribe) != send(fd, subscribe, sizeof(subscribe), 0))
+    {
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+//Read everything sent to the clients until lExpected bytes have arrived or it's gone quiet.
+static long long Drain(const int* pSockets, int lClients, long long llExpected)
+{
+    uint8_t buffer[4096];
+    long long llReceived = 0;
+    int64_t llQuietUs = NowUs();
+
+    while(llReceived < llExpected && NowUs() - llQuietUs < 2000000)
+    {
+        for(int i = 0; i < lClients; i++)
+        {
+            ssize_t slRead;
+
+            while((slRead = recv(pSockets[i], buffer, sizeof(buffer), 0)) > 0)
+            {
+                llReceived += slRead;
+                llQuietUs = NowUs();
+            }
+        }
+    }
+
+    return llReceived;
+}
+
+static void Usage()
+{
+    printf("Usage: tcpbench [-n clients] [-t idle seconds] [-e events]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    int lClients = TCPBENCH_CLIENTS;
+    int lIdle = TCPBENCH_IDLE;
+    int lEvents = TCPBENCH_EVENTS;
+    int opt;
+
+    while((opt = getopt(argc, argv, "n:t:e:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': lClients = atoi(optarg); break;
+            case 't': lIdle = atoi(optarg); break;
+            case 'e': lEvents = atoi(optarg); break;
+            default: Usage(); return 1;
+        }
+    }
+
+    //Both ends of every connection are ours.
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    if(limit.rlim_cur != RLIM_INFINITY && (rlim_t)lClients * 2 + 16 > limit.rlim_cur)
+    {
+        lClients = (limit.rlim_cur - 16) / 2;
+        printf("Only %d clients fit in the file limit.\n", lClients);
+    }
+
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    setvbuf(report, NULL, _IOLBF, 0);
+    freopen("/dev/null", "w", stdout);
+
+    int* pSockets = calloc(lClients, sizeof(int));
+    long lRssStart = ProcStatus("VmRSS");
+
+    if(!tcpserver_init())
+    {
+        fprintf(report, "Server didn't start.\n");
+        return 1;
+    }
+
+    long lRssServer = ProcStatus("VmRSS");
+    int64_t llStartUs = NowUs();
+    int lConnected = 0;
+
+    for(; lConnected < lClients; lConnected++)
+    {
+        if(-1 == (pSockets[lConnected] = Connect()))
+        {
+            fprintf(report, "Client %d failed to connect: %s\n", lConnected, strerror(errno));
+            break;
+        }
+    }
+
+    //Let the server catch up with the last of them.
+    for(int i = 0; i < 100 && tcpserver_ClientCount() < (uint32_t)lConnected; i++)
+        usleep(20000);
+
+    usleep(200000);
+
+    int64_t llConnectUs = NowUs() - llStartUs;
+    long long llStatusBytes = COMMS_OBJECT_HEADER_LENGTH + sizeof(struct SystemStatus);
+    long long llInitial = Drain(pSockets, lConnected, lConnected * llStatusBytes);
+    long lRssConnected = ProcStatus("VmRSS");
+
+    fprintf(report, "Clients      %d connected and subscribed in %.1fms, %u held by the server, %lld of %lld first status bytes arrived\n",
+            lConnected, llConnectUs / 1000.0, tcpserver_ClientCount(), llInitial, lConnected * llStatusBytes);
+    fprintf(report, "Memory       %ldkB at start, %ldkB serving, %ldkB with clients, %.2fkB per client\n",
+            lRssStart, lRssServer, lRssConnected, lConnected ? (double)(lRssConnected - lRssServer) / lConnected : 0.0);
+    fprintf(report, "Threads      %ld\n", ProcStatus("Threads"));
+
+    int64_t llCpuStart = CpuUs();
+    sleep(lIdle);
+    int64_t llIdleCpuUs = CpuUs() - llCpuStart;
+
+    fprintf(report, "Idle         %ds used %.1fms CPU (%.3f%%), %ldkB resident after\n",
+            lIdle, llIdleCpuUs / 1000.0, llIdleCpuUs / (lIdle * 10000.0), ProcStatus("VmRSS"));
+
+    struct SystemEvent event = { 0, 1, 0, 0, 0 };
+    int64_t llPushUs = 0;
+    llCpuStart = CpuUs();
+
+    for(int i = 0; i < lEvents; i++)
+    {
+        event.slTime = i;
+        llStartUs = NowUs();
+        tcpserver_PushEvent(&event);
+        llPushUs += NowUs() - llStartUs;
+    }
+
+    int64_t llPushCpuUs = CpuUs() - llCpuStart;
+    long long llExpected = (long long)lConnected * lEvents * (COMMS_OBJECT_HEADER_LENGTH + sizeof(struct SystemEvent));
+    long long llReceived = Drain(pSockets, lConnected, llExpected);
+
+    fprintf(report, "Events       %d to every client, %.2fms each to send to all (%.2fms CPU), %lld of %lld bytes arrived\n",
+            lEvents, lEvents ? llPushUs / 1000.0 / lEvents : 0.0, lEvents ? llPushCpuUs / 1000.0 / lEvents : 0.0,
+            llReceived, llExpected);
+
+    //The same sample twice over goes nowhere, so every other push is a repeat.
+    llPushUs = 0;
+    llCpuStart = CpuUs();
+
+    for(int i = 0; i < lEvents * 2; i++)
+    {
+        status.nBatterySoc = i / 2;
+        llStartUs = NowUs();
+        tcpserver_PushStatus(&status);
+        llPushUs += NowUs() - llStartUs;
+    }
+
+    llPushCpuUs = CpuUs() - llCpuStart;
+    llExpected = (long long)lConnected * lEvents * llStatusBytes;
+    llReceived = Drain(pSockets, lConnected, llExpected);
+
+    fprintf(report, "Status       %d changes and %d repeats, %.2fms each to send to all (%.2fms CPU), %lld of %lld bytes arrived\n",
+            lEvents, lEvents, lEvents ? llPushUs / 1000.0 / lEvents : 0.0, lEvents ? llPushCpuUs / 1000.0 / lEvents : 0.0,
+            llReceived, llExpected);
+    fprintf(report, "Memory       %ldkB resident at the end\n", ProcStatus("VmRSS"));
+
+    for(int i = 0; i < lConnected; i++)
+        close(pSockets[i]);
+
+    tcpserver_deinit();
+    free(pSockets);
+    fclose(report);
+
+    return 0;
+}
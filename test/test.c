@@ -2,6 +2,28 @@
 #include "test.h"
 #include "test_comms_protocol.h"
 #include "test_utils.h"
+#include "test_reconcile.h"
+#include "test_planner.h"
+#include "test_forecast.h"
+#include "test_overload.h"
+#include "test_events.h"
+#include "test_gridquality.h"
+#include "test_balance.h"
+#include "test_cmdqueue.h"
+#include "test_schedule.h"
+#include "test_clocksync.h"
+#include "test_control.h"
+#include "test_history.h"
+#include "test_invsim.h"
+#include "test_transport.h"
+#include "test_gateway.h"
+#include "test_latency.h"
+#include "test_faults.h"
+#include "test_snapshot.h"
+#include "test_broadcast.h"
+#include "test_rtu.h"
+#include "test_pollplan.h"
+#include "test_capture.h"
 
 uint32_t lTestsFailed = 0;
 uint32_t lTestsPassed = 0;
@@ -10,6 +32,28 @@ int main()
 {
     test_comms_protocol();
     test_utils();
+    test_reconcile();
+    test_planner();
+    test_forecast();
+    test_overload();
+    test_events();
+    test_gridquality();
+    test_balance();
+    test_cmdqueue();
+    test_schedule();
+    test_clocksync();
+    test_control();
+    test_history();
+    test_invsim();
+    test_transport();
+    test_gateway();
+    test_latency();
+    test_faults();
+    test_snapshot();
+    test_broadcast();
+    test_rtu();
+    test_pollplan();
+    test_capture();
     
     PRINT_TEST_RESULTS;
     
@@ -0,0 +1,107 @@
+
+#include "test.h"
+#include "test_balance.h"
+#include "balance.h"
+
+//A crude model of two paralleled units: each draws its limit scaled by its own gain (percent).
+static void Simulate(const struct ChargeBalancer* pBalancer, const uint16_t* pnGain, uint16_t* pnMeasured)
+{
+    for(uint8_t i = 0; i < pBalancer->cCount; i++)
+        pnMeasured[i] = (uint16_t)(pBalancer->nLimits[i] * pnGain[i] / 10);
+}
+
+static void test_balance_Deadband()
+{
+    struct ChargeBalancer balancer;
+    uint16_t nMeasured[2] = { 205, 195 };
+    
+    balance_Start(&balancer, 2, 20, 0);
+    ASSERT_EQUAL(balancer.nLimits[0], 20, "Started at the plan, = %u", balancer.nLimits[0]);
+    ASSERT_EQUAL(balancer.nLimits[1], 20, "Started at the plan, = %u", balancer.nLimits[1]);
+    
+    //Close enough. Nothing written.
+    ASSERT_EQUAL(balance_Update(&balancer, nMeasured, 1000), 0, "No writes within the deadband");
+    
+    //Way off, but too soon after the last adjustment.
+    nMeasured[0] = 100;
+    nMeasured[1] = 100;
+    ASSERT_EQUAL(balance_Update(&balancer, nMeasured, BALANCE_INTERVAL_S - 1), 0, "No writes before settling");
+    ASSERT_EQUAL(balance_Update(&balancer, nMeasured, BALANCE_INTERVAL_S), 3, "Both units adjusted after settling");
+    ASSERT_EQUAL(balancer.nLimits[0], 20 + BALANCE_MAX_STEP, "Step limited, = %u", balancer.nLimits[0]);
+    ASSERT_EQUAL(balance_Update(&balancer, nMeasured, BALANCE_INTERVAL_S + 1), 0, "Rate limited straight after");
+    
+    //Stopped does nothing.
+    balance_Stop(&balancer);
+    ASSERT_EQUAL(balance_Update(&balancer, nMeasured, 10000), 0, "Nothing while stopped");
+}
+
+static void test_balance_Converge()
+{
+    struct ChargeBalancer balancer;
+    uint16_t nGain[2] = { 120, 80 };    //Unit 1 over-draws by 20%, unit 2 under-draws by 20%.
+    uint16_t nMeasured[2];
+    uint32_t lWrites = 0;
+    int32_t slNow = 0;
+    
+    balance_Start(&balancer, 2, 20, slNow);
+    
+    for(int i = 0; i < 100; i++)
+    {
+        slNow += 10;
+        Simulate(&balancer, nGain, nMeasured);
+        uint8_t cChanged = balance_Update(&balancer, nMeasured, slNow);
+        
+        lWrites += (cChanged & 1) + ((cChanged >> 1) & 1);
+    }
+    
+    Simulate(&balancer, nGain, nMeasured);
+    
+    uint16_t nSpread = nMeasured[0] > nMeasured[1] ? nMeasured[0] - nMeasured[1] : nMeasured[1] - nMeasured[0];
+    int32_t slTotal = nMeasured[0] + nMeasured[1];
+    
+    ASSERT_EQUAL(nSpread <= BALANCE_SPREAD, true, "Spread within tolerance, = %u", nSpread);
+    ASSERT_EQUAL(slTotal >= 400 - 2 * BALANCE_DEADBAND && slTotal <= 400 + 2 * BALANCE_DEADBAND, true, "Total on plan, = %d", slTotal);
+    ASSERT_EQUAL(balancer.nLimits[0] < 20 && balancer.nLimits[1] > 20, true, "Trimmed opposite ways, = %u %u", balancer.nLimits[0], balancer.nLimits[1]);
+    ASSERT_EQUAL(lWrites <= 10, true, "Few writes to converge, = %u", lWrites);
+}
+
+static void test_balance_Limits()
+{
+    struct ChargeBalancer balancer;
+    uint16_t nMeasured[2] = { 0, 0 };
+    
+    //A unit that never draws anything can only be pushed so far.
+    balance_Start(&balancer, 2, 20, 0);
+    
+    for(int32_t slNow = 0; slNow < 10000; slNow += BALANCE_INTERVAL_S)
+        balance_Update(&balancer, nMeasured, slNow);
+        
+    ASSERT_EQUAL(balancer.nLimits[0], 20 + BALANCE_MAX_TRIM, "Trim capped, = %u", balancer.nLimits[0]);
+    
+    //New plan keeps the trim.
+    balance_SetPlan(&balancer, 25);
+    ASSERT_EQUAL(balancer.nLimits[0], 25 + BALANCE_MAX_TRIM, "Trim kept over a re-plan, = %u", balancer.nLimits[0]);
+    
+    //Never below the minimum or above the inverter's maximum.
+    balance_Start(&balancer, 2, CHARGE_MIN_AMPS, 0);
+    nMeasured[0] = 1000;
+    nMeasured[1] = 1000;
+    balance_Update(&balancer, nMeasured, BALANCE_INTERVAL_S);
+    ASSERT_EQUAL(balancer.nLimits[0], CHARGE_MIN_AMPS, "Not below the minimum, = %u", balancer.nLimits[0]);
+    
+    balance_Start(&balancer, 2, GW_CFG_UTIL_AMPS_MAX, 0);
+    nMeasured[0] = 0;
+    balance_Update(&balancer, nMeasured, BALANCE_INTERVAL_S);
+    ASSERT_EQUAL(balancer.nLimits[0], GW_CFG_UTIL_AMPS_MAX, "Not above the maximum, = %u", balancer.nLimits[0]);
+}
+
+void test_balance()
+{
+    PRINT_DEBUG("---=== Balance tests ===---\n");
+    
+    test_balance_Deadband();
+    test_balance_Converge();
+    test_balance_Limits();
+    
+    PRINT_DEBUG("---------------------------\n\n");
+}
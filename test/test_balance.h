@@ -0,0 +1,7 @@
+
+#ifndef TEST_BALANCE_H
+#define TEST_BALANCE_H
+
+void test_balance();
+
+#endif
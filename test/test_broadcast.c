@@ -0,0 +1,118 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "test.h"
+#include "test_broadcast.h"
+#include "replaytransport.h"
+#include "broadcast.h"
+
+#define TEST_BROADCAST_FILE "/tmp/test_broadcast.csv"
+
+static struct Transport transport;
+static struct ReplayTransport replay;
+static struct TransportOps ops;
+
+static void WriteHistory()
+{
+    FILE* pFile = fopen(TEST_BROADCAST_FILE, "w");
+    struct HistoryRecord record;
+    char line[HISTORY_LINE_MAX];
+
+    fputs(HISTORY_HEADER, pFile);
+    memset(&record, 0x00, sizeof(record));
+    record.slTime = 1790000000;
+    record.nSystemState = SYSTEM_STATE_PEAK;
+
+    history_Format(&record, line, sizeof(line));
+    fputs(line, pFile);
+    fclose(pFile);
+}
+
+//Only the master hears it.
+static int MissedBroadcast(void* pContext, int lAddress, int lCount, const uint16_t* pValues)
+{
+    memcpy(&((struct ReplayTransport*)pContext)->holdingRegs[0][lAddress], pValues, lCount * sizeof(uint16_t));
+    return lCount;
+}
+
+static int FailedBroadcast(void* pContext, int lAddress, int lCount, const uint16_t* pValues)
+{
+    errno = EIO;
+    return -1;
+}
+
+static void test_broadcast_Write()
+{
+    struct BroadcastResult result;
+    uint16_t settings[GW_HREG_UTIL_END_HOUR - GW_HREG_CFG_MODE + 1];
+
+    //Mode through charge hours, as reconciling would write them.
+    memcpy(settings, &replay.holdingRegs[0][GW_HREG_CFG_MODE], sizeof(settings));
+    settings[0] = GW_CFG_MODE_GRID;
+    settings[GW_HREG_UTIL_END_HOUR - GW_HREG_CFG_MODE] = GW_CFG_UTIL_TIME_ANY_TIME;
+
+    ASSERT_EQUAL(broadcast_Write(&transport, GW_HREG_CFG_MODE, sizeof(settings) / sizeof(settings[0]), settings, &result), 0, "Broadcast");
+    ASSERT_EQUAL(result.cAgreed, (1 << INVERTER_COUNT) - 1, "All took it");
+    ASSERT_EQUAL(result.cReaddressed, 0, "None written in turn");
+    ASSERT_EQUAL(result.cSweeps, 1, "One sweep");
+    ASSERT_EQUAL(result.lWindowUs >= BROADCAST_TURNAROUND_US, true, "Window, %uus", result.lWindowUs);
+    ASSERT_EQUAL(transport.lTransactions, 1 + INVERTER_COUNT, "One write, a read each");
+
+    for(int i = 0; i < INVERTER_COUNT; i++)
+    {
+        ASSERT_EQUAL(replay.holdingRegs[i][GW_HREG_CFG_MODE], GW_CFG_MODE_GRID, "Mode on %d", i);
+        ASSERT_EQUAL(replay.holdingRegs[i][GW_HREG_UTIL_END_HOUR], GW_CFG_UTIL_TIME_ANY_TIME, "Hours on %d", i);
+    }
+
+    ASSERT_EQUAL(replay.lSlave, INVERTER_1_ID, "Back on the master");
+
+    errno = 0;
+    ASSERT_EQUAL(broadcast_Write(&transport, GW_HREG_COUNT - 1, 2, settings, &result), -1, "Past the map");
+    ASSERT_EQUAL(errno, EINVAL, "Refused");
+}
+
+static void test_broadcast_Missed()
+{
+    struct BroadcastResult result;
+    uint16_t nAmps = 30;
+
+    ops.pBroadcast = MissedBroadcast;
+    transport_ResetStats(&transport);
+
+    ASSERT_EQUAL(broadcast_Write(&transport, GW_HREG_MAX_UTIL_AMPS, 1, &nAmps, &result), 0, "Made good");
+    ASSERT_EQUAL(result.cAgreed, 1, "Master took it");
+    ASSERT_EQUAL(result.cReaddressed, ((1 << INVERTER_COUNT) - 1) & ~1, "The rest written in turn");
+    ASSERT_EQUAL(result.cSweeps, BROADCAST_SWEEPS, "Every sweep");
+    ASSERT_EQUAL(replay.holdingRegs[INVERTER_COUNT - 1][GW_HREG_MAX_UTIL_AMPS], nAmps, "Last has it");
+
+    ops.pBroadcast = FailedBroadcast;
+    nAmps = 20;
+
+    ASSERT_EQUAL(broadcast_Write(&transport, GW_HREG_MAX_UTIL_AMPS, 1, &nAmps, &result), 0, "Made good unsent");
+    ASSERT_EQUAL(result.cSweeps, 0, "Nothing to sweep");
+    ASSERT_EQUAL(result.cReaddressed, (1 << INVERTER_COUNT) - 1, "All written in turn");
+    ASSERT_EQUAL(replay.holdingRegs[0][GW_HREG_MAX_UTIL_AMPS], nAmps, "Master has it");
+}
+
+void test_broadcast()
+{
+    PRINT_DEBUG("---=== Broadcast tests ===---\n");
+
+    WriteHistory();
+    replaytransport_Initialise(&transport, &replay, TEST_BROADCAST_FILE);
+    transport_Connect(&transport);
+
+    //Its own copy of the ops, to lose broadcasts with.
+    ops = *transport.pOps;
+    transport.pOps = &ops;
+
+    test_broadcast_Write();
+    test_broadcast_Missed();
+
+    transport_Free(&transport);
+    unlink(TEST_BROADCAST_FILE);
+
+    PRINT_DEBUG("---------------------------\n\n");
+}
@@ -0,0 +1,7 @@
+
+#ifndef TEST_BROADCAST_H
+#define TEST_BROADCAST_H
+
+void test_broadcast();
+
+#endif
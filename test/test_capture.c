@@ -0,0 +1,189 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "test.h"
+#include "test_capture.h"
+#include "capture.h"
+#include "capturetransport.h"
+
+#define TEST_CAPTURE_FILE "/tmp/test_capture.cap"
+
+static struct Capture capture;
+static struct CaptureTransport playback;
+
+static void test_capture_Frames()
+{
+    uint8_t frame[CAPTURE_FRAME_MAX];
+    uint16_t regs[3] = { 0x1234, 0x0002, 0xABCD };
+    struct CaptureCall read = { 1, CAPTURE_FC_READ_INPUT, 0x0011, 3, regs, 0, 0, NULL };
+    struct CaptureCall write = { 2, CAPTURE_FC_WRITE_MULTIPLE, 0, 0, NULL, 0x0026, 2, regs };
+    struct CaptureCall broadcast = { RTU_BROADCAST, CAPTURE_FC_WRITE_SINGLE, 0, 0, NULL, 1, 1, regs };
+    const uint8_t readRequest[] = { 0x01, 0x04, 0x00, 0x11, 0x00, 0x03 };
+    const uint8_t readResponse[] = { 0x01, 0x04, 0x06, 0x12, 0x34, 0x00, 0x02, 0xAB, 0xCD };
+    const uint8_t writeRequest[] = { 0x02, 0x10, 0x00, 0x26, 0x00, 0x02, 0x04, 0x12, 0x34, 0x00, 0x02 };
+    const uint8_t writeResponse[] = { 0x02, 0x10, 0x00, 0x26, 0x00, 0x02 };
+    const uint8_t exception[] = { 0x01, 0x84, 0x02 };
+
+    ASSERT_EQUAL(capture_Request(&read, frame), sizeof(readRequest), "Read request length");
+    ASSERT_EQUAL(memcmp(frame, readRequest, sizeof(readRequest)), 0, "Read request");
+    ASSERT_EQUAL(capture_Response(&read, 0, frame), sizeof(readResponse), "Read response length");
+    ASSERT_EQUAL(memcmp(frame, readResponse, sizeof(readResponse)), 0, "Read response");
+
+    ASSERT_EQUAL(capture_Request(&write, frame), sizeof(writeRequest), "Write request length");
+    ASSERT_EQUAL(memcmp(frame, writeRequest, sizeof(writeRequest)), 0, "Write request");
+    ASSERT_EQUAL(capture_Response(&write, 0, frame), sizeof(writeResponse), "Write response length");
+    ASSERT_EQUAL(memcmp(frame, writeResponse, sizeof(writeResponse)), 0, "Write response");
+
+    ASSERT_EQUAL(capture_Response(&read, RTU_ERRNO_BASE + 2, frame), sizeof(exception), "Exception length");
+    ASSERT_EQUAL(memcmp(frame, exception, sizeof(exception)), 0, "Exception response");
+    ASSERT_EQUAL(capture_Response(&read, ETIMEDOUT, frame), 0, "Nothing for a timeout");
+    ASSERT_EQUAL(capture_Response(&read, RTU_EBADCRC, frame), 0, "Nothing usable for a bad CRC");
+    ASSERT_EQUAL(capture_Request(&broadcast, frame), 6, "Broadcast request");
+    ASSERT_EQUAL(capture_Response(&broadcast, 0, frame), 0, "Nothing answers a broadcast");
+}
+
+static void test_capture_Ring()
+{
+    uint16_t regs[1];
+    struct CaptureCall call = { INVERTER_1_ID, CAPTURE_FC_READ_INPUT, 0, 1, regs, 0, 0, NULL };
+
+    capture_Initialise(&capture);
+
+    for(uint32_t i = 0; i < CAPTURE_MAX_RECORDS + 10; i++)
+    {
+        regs[0] = (uint16_t)i;
+        capture_Add(&capture, &call, NULL, 0, 100);
+    }
+
+    ASSERT_EQUAL(capture.lCount, CAPTURE_MAX_RECORDS, "Ring full");
+    ASSERT_EQUAL(capture.lTotal, CAPTURE_MAX_RECORDS + 10, "Total");
+    ASSERT_EQUAL(capture_Save(&capture, TEST_CAPTURE_FILE), true, "Saved");
+
+    struct CaptureRecord records[4];
+    uint32_t lCount = 0;
+    uint16_t nValue = 0;
+
+    ASSERT_EQUAL(capture_Load(records, 4, &lCount, TEST_CAPTURE_FILE), true, "Loaded");
+    ASSERT_EQUAL(lCount, 4, "As many as asked for");
+    ASSERT_EQUAL(capture_ResponseRegisters(&records[0], &nValue, 1), 1, "Registers in the response");
+    ASSERT_EQUAL(nValue, 10, "Oldest held first");
+    ASSERT_EQUAL(records[0].lDurationUs, 100, "Duration");
+    ASSERT_EQUAL(capture_Load(records, 4, &lCount, "/tmp/test_capture_missing.cap"), false, "No file");
+}
+
+static void test_capture_Wire()
+{
+    uint16_t regs[1] = { 0x1234 };
+    struct CaptureCall read = { 1, CAPTURE_FC_READ_INPUT, 0x0011, 1, regs, 0, 0, NULL };
+    const uint8_t request[] = { 0x01, 0x04, 0x00, 0x11, 0x00, 0x01, 0xAA, 0xBB };
+    const uint8_t response[] = { 0x01, 0x04, 0x02, 0x12, 0x34, 0xCC, 0xDD };
+    const uint8_t garbled[] = { 0x01, 0x04, 0x02, 0x99 };
+    struct CaptureFrames frames = { request, sizeof(request), response, sizeof(response) };
+
+    capture_Initialise(&capture);
+
+    //Off the wire, the frames are kept as they were, less the checksums.
+    capture_Add(&capture, &read, &frames, 0, 100);
+    ASSERT_EQUAL(capture.records[0].nRequest, sizeof(request) - 2, "Request without its checksum");
+    ASSERT_EQUAL(memcmp(capture.records[0].request, request, sizeof(request) - 2), 0, "Request as sent");
+    ASSERT_EQUAL(capture.records[0].nResponse, sizeof(response) - 2, "Response without its checksum");
+    ASSERT_EQUAL(memcmp(capture.records[0].response, response, sizeof(response) - 2), 0, "Response as answered");
+
+    //What came back from a failure is kept whole, as it's no frame.
+    frames.pResponse = garbled;
+    frames.nResponse = sizeof(garbled);
+    capture_Add(&capture, &read, &frames, RTU_EBADCRC, 100);
+    ASSERT_EQUAL(capture.records[1].nResponse, sizeof(garbled), "Garbled response kept whole, = %u", capture.records[1].nResponse);
+    ASSERT_EQUAL(memcmp(capture.records[1].response, garbled, sizeof(garbled)), 0, "As it came");
+}
+
+//What the server would have seen in the field: a pass, an exception, a timeout and a charge amps write.
+static void WriteCapture()
+{
+    uint16_t input[3] = { DISCHARGE, 0, 1234 };
+    uint16_t input2[3] = { BYPASS, 0, 4321 };
+    uint16_t nAmps = 30;
+    struct CaptureCall pass = { INVERTER_1_ID, CAPTURE_FC_READ_INPUT, 0, 3, input, 0, 0, NULL };
+    struct CaptureCall pass2 = { INVERTER_1_ID, CAPTURE_FC_READ_INPUT, 0, 3, input2, 0, 0, NULL };
+    struct CaptureCall holding = { INVERTER_1_ID, CAPTURE_FC_READ_HOLDING, 0, 2, NULL, 0, 0, NULL };
+    struct CaptureCall slave = { INVERTER_1_ID + 1, CAPTURE_FC_READ_INPUT, 0, 3, NULL, 0, 0, NULL };
+    struct CaptureCall write = { INVERTER_1_ID, CAPTURE_FC_WRITE_SINGLE, 0, 0, NULL, GW_HREG_MAX_UTIL_AMPS, 1, &nAmps };
+
+    capture_Initialise(&capture);
+    capture_Add(&capture, &pass, NULL, 0, 5000);
+    capture_Add(&capture, &holding, NULL, RTU_ERRNO_BASE + 2, 5000);
+    capture_Add(&capture, &slave, NULL, ETIMEDOUT, 500000);
+    capture_Add(&capture, &write, NULL, 0, 5000);
+    capture_Add(&capture, &pass2, NULL, 0, 5000);
+    capture_Save(&capture, TEST_CAPTURE_FILE);
+}
+
+static void test_capture_Playback()
+{
+    struct Transport transport;
+    uint16_t regs[3];
+
+    WriteCapture();
+    capturetransport_Initialise(&transport, &playback, TEST_CAPTURE_FILE);
+    transport_SetCapture(&transport, &capture);
+    capture_Initialise(&capture);
+
+    ASSERT_EQUAL(transport_Connect(&transport), 0, "Connected");
+    ASSERT_EQUAL(playback.lCount, 5, "Records");
+
+    transport_SetSlave(&transport, INVERTER_1_ID);
+    ASSERT_EQUAL(transport_ReadInputRegisters(&transport, 0, 3, regs), 3, "First pass");
+    ASSERT_EQUAL(regs[2], 1234, "Captured value");
+
+    ASSERT_EQUAL(transport_ReadRegisters(&transport, 0, 2, regs), -1, "Exception again");
+    ASSERT_EQUAL(errno, RTU_ERRNO_BASE + 2, "Same exception");
+
+    transport_SetSlave(&transport, INVERTER_1_ID + 1);
+    ASSERT_EQUAL(transport_ReadInputRegisters(&transport, 0, 3, regs), -1, "Timeout again");
+    ASSERT_EQUAL(errno, ETIMEDOUT, "Timed out");
+
+    //A different write to the field's isn't in the capture, but takes anyway and reads back.
+    transport_SetSlave(&transport, INVERTER_1_ID);
+    ASSERT_EQUAL(transport_WriteRegister(&transport, GW_HREG_MAX_UTIL_AMPS, 40), 1, "Write not captured");
+    ASSERT_EQUAL(transport_ReadRegisters(&transport, GW_HREG_MAX_UTIL_AMPS, 1, regs), 1, "Read not captured");
+    ASSERT_EQUAL(regs[0], 40, "Read back from what was written");
+
+    ASSERT_EQUAL(transport_ReadInputRegisters(&transport, 0, 3, regs), 3, "Second pass");
+    ASSERT_EQUAL(regs[0], BYPASS, "In the field's order");
+    ASSERT_EQUAL(regs[2], 4321, "Second value");
+    ASSERT_EQUAL(playback.lLaps, 1, "Round once");
+
+    ASSERT_EQUAL(transport_ReadInputRegisters(&transport, 0, 3, regs), 3, "Round again");
+    ASSERT_EQUAL(regs[2], 1234, "First again");
+    ASSERT_EQUAL(transport_ReadInputRegisters(&transport, 10, 2, regs), 2, "Not captured");
+    ASSERT_EQUAL(regs[0], 0, "Never seen reads as zero");
+
+    ASSERT_EQUAL(playback.lMatched, 5, "Answered from the capture");
+    ASSERT_EQUAL(playback.lUnmatched, 3, "Answered from the registers");
+    ASSERT_EQUAL(capture.lTotal, 8, "Playback captured too");
+    ASSERT_EQUAL(capture.records[1].lError, RTU_ERRNO_BASE + 2, "With its errors");
+
+    transport_Free(&transport);
+
+    capturetransport_Initialise(&transport, &playback, "/tmp/test_capture_missing.cap");
+    ASSERT_EQUAL(transport_Connect(&transport), -1, "Nothing to play");
+    ASSERT_EQUAL(errno, ENODATA, "No data");
+    ASSERT_EQUAL(transport_ReadInputRegisters(&transport, 0, 3, regs), -1, "Not connected");
+    ASSERT_EQUAL(errno, ENOTCONN, "Said so");
+    transport_Free(&transport);
+}
+
+void test_capture()
+{
+    printf("---=== Capture tests ===---\n");
+
+    test_capture_Frames();
+    test_capture_Ring();
+    test_capture_Wire();
+    test_capture_Playback();
+
+    remove(TEST_CAPTURE_FILE);
+
+    printf("---------------------------\n\n");
+}
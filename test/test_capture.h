@@ -0,0 +1,7 @@
+
+#ifndef TEST_CAPTURE_H
+#define TEST_CAPTURE_H
+
+void test_capture();
+
+#endif
@@ -0,0 +1,98 @@
+
+#include "test.h"
+#include "test_clocksync.h"
+#include "clocksync.h"
+#include <stdlib.h>
+#include <time.h>
+
+#define TEST_TIME 1718454645   /* 2024-06-15 12:30:45 UTC. */
+
+static void test_clocksync_Registers()
+{
+    uint16_t nRegs[CLOCKSYNC_REG_COUNT];
+    
+    clocksync_ToRegisters(TEST_TIME, false, nRegs);
+    ASSERT_EQUAL(nRegs[0], 2024, "Year, = %u", nRegs[0]);
+    ASSERT_EQUAL(nRegs[1], 6, "Month, = %u", nRegs[1]);
+    ASSERT_EQUAL(nRegs[2], 15, "Day, = %u", nRegs[2]);
+    ASSERT_EQUAL(nRegs[3], 12, "Hour, = %u", nRegs[3]);
+    ASSERT_EQUAL(nRegs[4], 30, "Minute, = %u", nRegs[4]);
+    ASSERT_EQUAL(nRegs[5], 45, "Second, = %u", nRegs[5]);
+    ASSERT_EQUAL(clocksync_FromRegisters(nRegs), TEST_TIME, "Round trip, = %d", clocksync_FromRegisters(nRegs));
+    
+    clocksync_ToRegisters(TEST_TIME, true, nRegs);
+    ASSERT_EQUAL(nRegs[0], 24, "Short year, = %u", nRegs[0]);
+    ASSERT_EQUAL(clocksync_FromRegisters(nRegs), TEST_TIME, "Short year round trip, = %d", clocksync_FromRegisters(nRegs));
+    
+    nRegs[1] = 13;
+    ASSERT_EQUAL(clocksync_FromRegisters(nRegs), -1, "Bad month rejected");
+    nRegs[1] = 6;
+    nRegs[0] = 0xFFFF;
+    ASSERT_EQUAL(clocksync_FromRegisters(nRegs), -1, "Bad year rejected");
+}
+
+static void test_clocksync_Measure()
+{
+    struct ClockSync sync;
+    uint16_t nRegs[CLOCKSYNC_REG_COUNT];
+    
+    clocksync_Initialise(&sync);
+    ASSERT_EQUAL(clocksync_Due(&sync, TEST_TIME), true, "Due straight away");
+    
+    //Inverter 10s fast, read over two seconds.
+    clocksync_ToRegisters(TEST_TIME + 11, false, nRegs);
+    ASSERT_EQUAL(clocksync_Measure(&sync, nRegs, TEST_TIME, TEST_TIME + 2), CLOCKSYNC_OK, "Small drift left alone");
+    ASSERT_EQUAL(sync.slLastDrift, 10, "Drift against the middle of the read, = %d", sync.slLastDrift);
+    ASSERT_EQUAL(clocksync_Due(&sync, TEST_TIME + 2 + CLOCKSYNC_CHECK_S - 1), false, "Not due again yet");
+    ASSERT_EQUAL(clocksync_Due(&sync, TEST_TIME + 2 + CLOCKSYNC_CHECK_S), true, "Due again after the interval");
+    
+    //A day later it has gained another 30s.
+    clocksync_ToRegisters(TEST_TIME + 86400 + 40, true, nRegs);
+    ASSERT_EQUAL(clocksync_Measure(&sync, nRegs, TEST_TIME + 86400, TEST_TIME + 86400), CLOCKSYNC_CORRECT, "Large drift corrected");
+    ASSERT_EQUAL(sync.bShortYear, true, "Noticed the short year");
+    ASSERT_EQUAL(sync.fltDriftPerDay > 29.9f && sync.fltDriftPerDay < 30.1f, true, "Drift rate, = %f", sync.fltDriftPerDay);
+    
+    //Slow is as bad as fast.
+    clocksync_Corrected(&sync, TEST_TIME + 86400);
+    ASSERT_EQUAL(sync.lCorrections, 1, "Correction counted, = %u", sync.lCorrections);
+    clocksync_ToRegisters(TEST_TIME + 86400 * 2 - CLOCKSYNC_MAX_DRIFT_S - 1, false, nRegs);
+    ASSERT_EQUAL(clocksync_Measure(&sync, nRegs, TEST_TIME + 86400 * 2, TEST_TIME + 86400 * 2), CLOCKSYNC_CORRECT, "Slow clock corrected");
+    ASSERT_EQUAL(sync.fltDriftPerDay < -30.9f && sync.fltDriftPerDay > -31.1f, true, "Rate from the correction, = %f", sync.fltDriftPerDay);
+    
+    nRegs[2] = 0;
+    ASSERT_EQUAL(clocksync_Measure(&sync, nRegs, TEST_TIME, TEST_TIME), CLOCKSYNC_INVALID, "Nonsense reported");
+    ASSERT_EQUAL(sync.bShortYear, false, "Four digit year kept");
+    
+    //Set back with the year as the inverter keeps it.
+    nRegs[0] = 26;
+    ASSERT_EQUAL(clocksync_Measure(&sync, nRegs, TEST_TIME, TEST_TIME), CLOCKSYNC_INVALID, "Nonsense again");
+    ASSERT_EQUAL(sync.bShortYear, true, "Two digit year noted from a nonsense date");
+}
+
+void test_clocksync()
+{
+    PRINT_DEBUG("---=== Clock sync tests ===---\n");
+    
+    //Registers are in local time. Pin it down.
+    char* pcTz = getenv("TZ");
+    char tz[64] = "";
+    bool bTz = NULL != pcTz;
+    
+    if(bTz)
+        snprintf(tz, sizeof(tz), "%s", pcTz);
+        
+    setenv("TZ", "UTC", 1);
+    tzset();
+    
+    test_clocksync_Registers();
+    test_clocksync_Measure();
+    
+    if(bTz)
+        setenv("TZ", tz, 1);
+    else
+        unsetenv("TZ");
+        
+    tzset();
+    
+    PRINT_DEBUG("------------------------------\n\n");
+}
@@ -0,0 +1,7 @@
+
+#ifndef TEST_CLOCKSYNC_H
+#define TEST_CLOCKSYNC_H
+
+void test_clocksync();
+
+#endif
@@ -0,0 +1,125 @@
+
+#include "test.h"
+#include "test_cmdqueue.h"
+#include "cmdqueue.h"
+#include <pthread.h>
+#include <sched.h>
+
+#define TEST_PRODUCERS           4
+#define TEST_COMMANDS_PER_THREAD 2000
+
+static struct CommandQueue threadQueue;
+
+static void test_cmdqueue_Order()
+{
+    struct CommandQueue queue;
+    struct QueuedCommand command;
+    
+    cmdqueue_Initialise(&queue);
+    ASSERT_EQUAL(cmdqueue_Pop(&queue, &command), false, "Empty to begin with");
+    
+    uint32_t lFirst = cmdqueue_Push(&queue, 2, 0, 1, 100);
+    uint32_t lSecond = cmdqueue_Push(&queue, 3, 42, CMDQUEUE_ORIGIN_CONSOLE, 200);
+    ASSERT_EQUAL(lFirst != 0, true, "First ID valid, = %u", lFirst);
+    ASSERT_EQUAL(lSecond > lFirst, true, "IDs increase, = %u, %u", lFirst, lSecond);
+    
+    ASSERT_EQUAL(cmdqueue_Pop(&queue, &command), true, "Popped first");
+    ASSERT_EQUAL(command.lCommandId, lFirst, "First out first, = %u", command.lCommandId);
+    ASSERT_EQUAL(command.nCommandID, 2, "First command, = %u", command.nCommandID);
+    ASSERT_EQUAL(command.nOrigin, 1, "First origin, = %u", command.nOrigin);
+    ASSERT_EQUAL(command.llEnqueuedUs, 100, "First enqueue time, = %lld", (long long)command.llEnqueuedUs);
+    
+    ASSERT_EQUAL(cmdqueue_Pop(&queue, &command), true, "Popped second");
+    ASSERT_EQUAL(command.lCommandId, lSecond, "Second out second, = %u", command.lCommandId);
+    ASSERT_EQUAL(command.nParam, 42, "Second param, = %u", command.nParam);
+    ASSERT_EQUAL(cmdqueue_Pop(&queue, &command), false, "Empty again");
+}
+
+static void test_cmdqueue_Full()
+{
+    struct CommandQueue queue;
+    struct QueuedCommand command;
+    
+    cmdqueue_Initialise(&queue);
+    
+    for(uint16_t i = 0; i < CMDQUEUE_SIZE; i++)
+        cmdqueue_Push(&queue, i, 0, 0, 0);
+        
+    ASSERT_EQUAL(cmdqueue_Push(&queue, 99, 0, 0, 0), 0, "Full queue refuses");
+    ASSERT_EQUAL(atomic_load(&queue.lDropped), 1, "Drop counted, = %u", atomic_load(&queue.lDropped));
+    
+    //Wrap around a few laps.
+    bool bInOrder = true;
+    
+    for(uint16_t i = 0; i < CMDQUEUE_SIZE * 4; i++)
+    {
+        cmdqueue_Pop(&queue, &command);
+        bInOrder &= (command.nCommandID == i);
+        bInOrder &= (0 != cmdqueue_Push(&queue, i + CMDQUEUE_SIZE, 0, 0, 0));
+    }
+    
+    ASSERT_EQUAL(bInOrder, true, "FIFO across laps");
+}
+
+static void* test_cmdqueue_Producer(void* arg)
+{
+    uint8_t cProducer = (uint8_t)(intptr_t)arg;
+    
+    for(uint16_t i = 0; i < TEST_COMMANDS_PER_THREAD; i++)
+    {
+        //Spin while full. The consumer is draining.
+        while(0 == cmdqueue_Push(&threadQueue, i, 0, cProducer, 0))
+            sched_yield();
+    }
+    
+    return NULL;
+}
+
+static void test_cmdqueue_Threads()
+{
+    pthread_t producers[TEST_PRODUCERS];
+    uint16_t nNext[TEST_PRODUCERS] = { 0 };
+    uint32_t lLastId = 0;
+    uint32_t lPopped = 0;
+    bool bOrdered = true;
+    struct QueuedCommand command;
+    
+    cmdqueue_Initialise(&threadQueue);
+    
+    for(intptr_t i = 0; i < TEST_PRODUCERS; i++)
+        pthread_create(&producers[i], NULL, test_cmdqueue_Producer, (void*)i);
+        
+    //Nothing lost, each producer's commands in the order it pushed them, IDs in queue order.
+    while(lPopped < TEST_PRODUCERS * TEST_COMMANDS_PER_THREAD)
+    {
+        if(cmdqueue_Pop(&threadQueue, &command))
+        {
+            bOrdered &= (command.nCommandID == nNext[command.nOrigin]++);
+            bOrdered &= (command.lCommandId > lLastId);
+            lLastId = command.lCommandId;
+            lPopped++;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+    
+    for(int i = 0; i < TEST_PRODUCERS; i++)
+        pthread_join(producers[i], NULL);
+        
+    ASSERT_EQUAL(lPopped, TEST_PRODUCERS * TEST_COMMANDS_PER_THREAD, "Every command popped, = %u", lPopped);
+    ASSERT_EQUAL(bOrdered, true, "Ordering preserved across producers");
+    ASSERT_EQUAL(cmdqueue_Pop(&threadQueue, &command), false, "Nothing left over");
+}
+
+void test_cmdqueue()
+{
+    PRINT_DEBUG("---=== Command queue tests ===---\n");
+    
+    test_cmdqueue_Order();
+    test_cmdqueue_Full();
+    test_cmdqueue_Threads();
+    
+    PRINT_DEBUG("---------------------------------\n\n");
+}
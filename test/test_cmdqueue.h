@@ -0,0 +1,7 @@
+
+#ifndef TEST_CMDQUEUE_H
+#define TEST_CMDQUEUE_H
+
+void test_cmdqueue();
+
+#endif
@@ -2,6 +2,7 @@
 #include "test.h"
 #include "test_comms_protocol.h"
 #include "comms_protocol.h"
+#include "system_defs.h"
 
 #define ID_BOB 0xAAAAAAAA
 #define ID_SUE 0x55555555
@@ -196,6 +197,147 @@ static void error_callback(struct sdfComms* psdcComms, uint8_t cErrorCode)
     lErrorCallbacks++;
 }
 
+#define STREAM_MAX_MESSAGES 8
+
+//What a receiver made of a stream, in order. Commands are kept with a length of zero.
+static uint16_t streamIDs[STREAM_MAX_MESSAGES];
+static uint16_t streamLengths[STREAM_MAX_MESSAGES];
+static uint8_t streamFirst[STREAM_MAX_MESSAGES];
+static int lStreamMessages = 0;
+static int lStreamErrors = 0;
+static uint8_t streamSent[2048];           //The last thing transmitted.
+static uint16_t nStreamSent = 0;
+static uint8_t streamPayload[2048];        //The last object received.
+
+static void stream_transmit_callback(struct sdfComms* psdcComms, uint8_t* pcData, uint16_t nLength)
+{
+    if(nLength <= sizeof(streamSent))
+    {
+        memcpy(streamSent, pcData, nLength);
+        nStreamSent = nLength;
+    }
+}
+
+static void stream_objectReceived_callback(struct sdfComms* psdcComms, uint16_t nObjectID, uint16_t nLength, uint8_t* pcData)
+{
+    if(lStreamMessages < STREAM_MAX_MESSAGES)
+    {
+        streamIDs[lStreamMessages] = nObjectID;
+        streamLengths[lStreamMessages] = nLength;
+        streamFirst[lStreamMessages] = pcData[0];
+    }
+    
+    if(nLength <= sizeof(streamPayload))
+        memcpy(streamPayload, pcData, nLength);
+    
+    lStreamMessages++;
+}
+
+static void stream_commandReceived_callback(struct sdfComms* psdcComms, uint16_t nCommandID)
+{
+    if(lStreamMessages < STREAM_MAX_MESSAGES)
+    {
+        streamIDs[lStreamMessages] = nCommandID;
+        streamLengths[lStreamMessages] = 0;
+    }
+    
+    lStreamMessages++;
+}
+
+static bool stream_lengthCheck_callback(struct sdfComms* psdcComms, uint16_t nObjectID, uint16_t nLength)
+{
+    return true;
+}
+
+static void stream_error_callback(struct sdfComms* psdcComms, uint8_t cErrorCode)
+{
+    lStreamErrors++;
+}
+
+static uint16_t StreamObject(uint8_t* pcBuffer, uint16_t nObjectID, uint16_t nLength, uint8_t cFill)
+{
+    pcBuffer[0] = COMMS_MESSAGE_TYPE_OBJECT;
+    memcpy(&pcBuffer[1], &nObjectID, sizeof(uint16_t));
+    memcpy(&pcBuffer[3], &nLength, sizeof(uint16_t));
+    memset(&pcBuffer[COMMS_OBJECT_HEADER_LENGTH], cFill, nLength);
+    
+    return COMMS_OBJECT_HEADER_LENGTH + nLength;
+}
+
+static uint16_t StreamCommand(uint8_t* pcBuffer, uint16_t nCommandID)
+{
+    pcBuffer[0] = COMMS_MESSAGE_TYPE_COMMAND;
+    memcpy(&pcBuffer[1], &nCommandID, sizeof(uint16_t));
+    
+    return COMMS_COMMAND_HEADER_LENGTH;
+}
+
+//Several messages back to back, arriving in one read as they do off a socket.
+static void test_comms_protocol_Stream()
+{
+    struct sdfComms comms;
+    uint8_t buffer[64];
+    uint16_t nLength = 0;
+    
+    Comms_Initialise(&comms, ID_BOB, stream_transmit_callback, stream_objectReceived_callback,
+                     stream_commandReceived_callback, stream_lengthCheck_callback, stream_error_callback);
+    
+    nLength += StreamObject(&buffer[nLength], OBJECT_ID_LOVE_MESSAGE, 7, 0x21);
+    nLength += StreamObject(&buffer[nLength], OBJECT_ID_LOVE_REPLY, 3, 0x42);
+    nLength += StreamCommand(&buffer[nLength], COMMAND_ID_LOVE_ME);
+    
+    Comms_Receive(&comms, buffer, nLength);
+    
+    ASSERT_EQUAL(lStreamErrors, 0, "No errors, = %d", lStreamErrors);
+    ASSERT_EQUAL(lStreamMessages, 3, "Three messages, = %d", lStreamMessages);
+    ASSERT_EQUAL(streamIDs[0], OBJECT_ID_LOVE_MESSAGE, "First object first");
+    ASSERT_EQUAL(streamLengths[0], 7, "All of it, = %u", streamLengths[0]);
+    ASSERT_EQUAL(streamFirst[0], 0x21, "Its own payload");
+    ASSERT_EQUAL(streamIDs[1], OBJECT_ID_LOVE_REPLY, "Then the second");
+    ASSERT_EQUAL(streamLengths[1], 3, "All of it, = %u", streamLengths[1]);
+    ASSERT_EQUAL(streamFirst[1], 0x42, "Its own payload");
+    ASSERT_EQUAL(streamIDs[2], COMMAND_ID_LOVE_ME, "Then the command, = 0x%04X", streamIDs[2]);
+    ASSERT_EQUAL(comms.cState, COMMS_STATE_MESSAGE_TYPE, "Ready for the next");
+    
+    Comms_Deinit(&comms);
+}
+
+//Objects past 255 bytes, such as the schedule list, through and back in one read.
+static void test_comms_protocol_Large()
+{
+    struct sdfComms comms;
+    struct ScheduleList list;
+    
+    memset(&list, 0x00, sizeof(list));
+    list.nCount = SCHEDULE_MAX_ENTRIES;
+    
+    for(int i = 0; i < SCHEDULE_MAX_ENTRIES; i++)
+    {
+        list.entries[i].lScheduleId = 1000 + i;
+        list.entries[i].slStart = 0x01020304 * (i + 1);
+    }
+    
+    lStreamMessages = 0;
+    lStreamErrors = 0;
+    
+    Comms_Initialise(&comms, ID_SUE, stream_transmit_callback, stream_objectReceived_callback,
+                     stream_commandReceived_callback, stream_lengthCheck_callback, stream_error_callback);
+    
+    Comms_SendObject(&comms, OBJECT_ID_LOVE_MESSAGE, sizeof(list), (uint8_t*)&list);
+    ASSERT_EQUAL(nStreamSent, COMMS_OBJECT_HEADER_LENGTH + sizeof(list), "Sent whole, = %u", nStreamSent);
+    
+    Comms_Receive(&comms, streamSent, nStreamSent);
+    
+    ASSERT_EQUAL(sizeof(list) > 255, true, "Bigger than a byte can count");
+    ASSERT_EQUAL(lStreamErrors, 0, "No errors, = %d", lStreamErrors);
+    ASSERT_EQUAL(lStreamMessages, 1, "One object, = %d", lStreamMessages);
+    ASSERT_EQUAL(streamLengths[0], sizeof(list), "All of it, = %u", streamLengths[0]);
+    ASSERT_EQUAL(memcmp(streamPayload, &list, sizeof(list)), 0, "Arrived as sent");
+    ASSERT_EQUAL(comms.cState, COMMS_STATE_MESSAGE_TYPE, "Ready for the next");
+    
+    Comms_Deinit(&comms);
+}
+
 void test_comms_protocol()
 {
     PRINT_DEBUG("---=== Comms protocol tests ===---\n");
@@ -301,6 +443,8 @@ void test_comms_protocol()
                  0,
                  sdcCommsSue.nPayloadWrite);
                  
+    test_comms_protocol_Stream();
+    test_comms_protocol_Large();
 
     PRINT_DEBUG("----------------------------------\n\n");
 }
@@ -0,0 +1,538 @@
+
+#include <string.h>
+#include "test.h"
+#include "test_control.h"
+#include "control.h"
+#include "gridquality.h"
+#include "schedule.h"
+#include "comms_defs.h"
+
+#define PROPERTY_STEPS              2000000
+#define PROPERTY_MAX_WRITES_PER_MIN 8     /* Switches, charge changes and trims the controller may make of its own accord in any minute. */
+
+static void Setup(struct Controller* pController, struct SystemStatus* pStatus, uint16_t nState)
+{
+    struct OverloadConfig config;
+    overload_DefaultConfig(&config);
+    control_Initialise(pController, &config);
+    pController->slModeWriteTime = 1000;
+    
+    memset(pStatus, 0x00, sizeof(struct SystemStatus));
+    pStatus->nSystemState = nState;
+    pStatus->nBatterySoc = 50;
+    pStatus->nBatteryVolts = 5200;
+}
+
+static void Sample(struct ControlSample* pSample, int32_t slNow, int lHour, int lMin, uint16_t nWatts)
+{
+    pSample->time.slNow = slNow;
+    pSample->time.llNowMs = (int64_t)slNow * 1000;
+    pSample->time.lHour = lHour;
+    pSample->time.lMin = lMin;
+    
+    for(int i = 0; i < INVERTER_COUNT; i++)
+    {
+        pSample->inverters[i].nOutputWatts = nWatts;
+        pSample->inverters[i].nLoadPercent = 0;
+        pSample->nChargeAmps[i] = 0;
+    }
+}
+
+static void test_control_Overload()
+{
+    struct Controller controller;
+    struct SystemStatus status;
+    struct ControlSample sample;
+    struct ControlActions actions;
+    
+    Setup(&controller, &status, SYSTEM_STATE_PEAK);
+    
+    Sample(&sample, 1000, 12, 0, 10000);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.cCount, 0, "Nothing to do under the limit, = %u", actions.cCount);
+    
+    Sample(&sample, 1001, 12, 0, OVERLOAD_TRIP_WATTS * 10);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.cCount, 1, "One action on overload, = %u", actions.cCount);
+    ASSERT_EQUAL(actions.actions[0].cAction, CONTROL_SWITCH, "Switched");
+    ASSERT_EQUAL(actions.actions[0].cReason, CONTROL_REASON_OVERLOAD, "Because of the overload");
+    ASSERT_EQUAL(actions.actions[0].nState, SYSTEM_STATE_BYPASS, "To the grid");
+    ASSERT_EQUAL(controller.slModeWriteTime, 1001, "Switch time noted, = %d", controller.slModeWriteTime);
+    status.nSystemState = SYSTEM_STATE_BYPASS;
+    overload_WriteCompleted(&controller.overload, sample.time.llNowMs);
+    
+    //Held while the load's still there, then released once it's gone and the hold's up.
+    Sample(&sample, 1002, 12, 0, 10000);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.cCount, 0, "Held, = %u", actions.cCount);
+    
+    Sample(&sample, 1001 + OVERLOAD_HOLD_S, 12, 0, 10000);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.cCount, 1, "Released after the hold, = %u", actions.cCount);
+    ASSERT_EQUAL(actions.actions[0].cReason, CONTROL_REASON_OVERLOAD_CLEARED, "Because it cleared");
+    ASSERT_EQUAL(actions.actions[0].nState, SYSTEM_STATE_PEAK, "Back to batts");
+    
+    //Already on the grid by request. Tripping doesn't change anything, and neither does the release.
+    Setup(&controller, &status, SYSTEM_STATE_BYPASS);
+    Sample(&sample, 1000, 12, 0, OVERLOAD_TRIP_WATTS * 10);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.cCount, 0, "No switch when bypassed, = %u", actions.cCount);
+    
+    Sample(&sample, 1000 + OVERLOAD_HOLD_S + 1, 12, 0, 0);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(controller.bOverloadBypass, false, "Not our bypass");
+    ASSERT_EQUAL(actions.actions[0].cAction, CONTROL_RECONCILE, "Only a check, = %u", actions.actions[0].cAction);
+}
+
+static void test_control_Switching()
+{
+    struct Controller controller;
+    struct SystemStatus status;
+    struct ControlSample sample;
+    struct ControlActions actions;
+    
+    Setup(&controller, &status, SYSTEM_STATE_PEAK);
+    
+    ASSERT_EQUAL(control_IsPeak(SYSTEM_START_OFF_PEAK_H, SYSTEM_START_OFF_PEAK_M), true, "Peak up to the start of off-peak");
+    ASSERT_EQUAL(control_IsPeak(SYSTEM_START_OFF_PEAK_H, SYSTEM_START_OFF_PEAK_M + 1), false, "Off-peak just after");
+    ASSERT_EQUAL(control_IsPeak(SYSTEM_END_OFF_PEAK_H, SYSTEM_END_OFF_PEAK_M), true, "Peak from the end of off-peak");
+    
+    //Into off-peak, with a planned current.
+    Sample(&sample, 1000, SYSTEM_START_OFF_PEAK_H, SYSTEM_START_OFF_PEAK_M + 1, 0);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.cCount, 1, "One action, = %u", actions.cCount);
+    ASSERT_EQUAL(actions.actions[0].nState, SYSTEM_STATE_OFF_PEAK, "Off-peak");
+    ASSERT_EQUAL(actions.actions[0].cReason, CONTROL_REASON_OFF_PEAK, "Because of the time");
+    ASSERT_EQUAL(actions.actions[0].nChargeCurrent, controller.planner.nAmps, "Charging at the plan, = %u", actions.actions[0].nChargeCurrent);
+    ASSERT_EQUAL(actions.actions[0].nChargeCurrent >= CHARGE_MIN_AMPS, true, "Charging at all");
+    status.nSystemState = SYSTEM_STATE_OFF_PEAK;
+    
+    //Nothing more until the check's due.
+    Sample(&sample, 1000 + CHECK_MODE_TIMEOUT, SYSTEM_START_OFF_PEAK_H, SYSTEM_START_OFF_PEAK_M + 1, 0);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.cCount, 0, "Nothing straight after, = %u", actions.cCount);
+    
+    Sample(&sample, 1001 + CHECK_MODE_TIMEOUT, SYSTEM_START_OFF_PEAK_H, SYSTEM_START_OFF_PEAK_M + 1, 0);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.cCount, 1, "Checked after the timeout, = %u", actions.cCount);
+    ASSERT_EQUAL(actions.actions[0].cAction, CONTROL_RECONCILE, "Reconcile");
+    
+    //Overload during off-peak is the grid's problem.
+    Sample(&sample, 1002 + CHECK_MODE_TIMEOUT, 1, 0, OVERLOAD_TRIP_WATTS * 10);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.actions[0].cAction, CONTROL_RECONCILE, "No switch on overload off-peak");
+    
+    //Back to peak, once that overload's hold is long over.
+    Sample(&sample, 1003 + CHECK_MODE_TIMEOUT + OVERLOAD_HOLD_S, SYSTEM_END_OFF_PEAK_H, SYSTEM_END_OFF_PEAK_M, 0);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.actions[actions.cCount - 1].nState, SYSTEM_STATE_PEAK, "Peak");
+    ASSERT_EQUAL(actions.actions[actions.cCount - 1].cReason, CONTROL_REASON_PEAK, "Because of the time");
+}
+
+static void test_control_Grid()
+{
+    struct Controller controller;
+    struct SystemStatus status;
+    struct ControlSample sample;
+    struct ControlActions actions;
+    
+    Setup(&controller, &status, SYSTEM_STATE_BYPASS);
+    
+    control_Grid(&controller, &status, GRIDQUALITY_OUTAGE, 1000, &actions);
+    ASSERT_EQUAL(actions.cCount, 1, "One action on outage, = %u", actions.cCount);
+    ASSERT_EQUAL(actions.actions[0].nState, SYSTEM_STATE_PEAK, "To batts");
+    ASSERT_EQUAL(actions.actions[0].cReason, CONTROL_REASON_OUTAGE, "Because of the outage");
+    control_Apply(&status, &actions.actions[0]);
+    
+    //Back, but not for long enough.
+    control_Grid(&controller, &status, GRIDQUALITY_RESTORED, 1010, &actions);
+    ASSERT_EQUAL(actions.cCount, 0, "Nothing straight away, = %u", actions.cCount);
+    
+    Sample(&sample, 1009 + CONTROL_RESTORE_HOLD_S, 12, 0, 0);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.actions[0].cAction, CONTROL_RECONCILE, "Still on batts during the hold");
+    
+    //Gone again, then back for good.
+    control_Grid(&controller, &status, GRIDQUALITY_OUTAGE, 1100, &actions);
+    ASSERT_EQUAL(actions.cCount, 0, "Already on batts, = %u", actions.cCount);
+    control_Grid(&controller, &status, GRIDQUALITY_RESTORED, 1200, &actions);
+    
+    Sample(&sample, 1199 + CONTROL_RESTORE_HOLD_S, 12, 0, 0);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.actions[0].cAction, CONTROL_RECONCILE, "Hold restarted by the second outage");
+    
+    Sample(&sample, 1200 + CONTROL_RESTORE_HOLD_S, 12, 0, 0);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.actions[0].cAction, CONTROL_SWITCH, "Switched after the hold");
+    ASSERT_EQUAL(actions.actions[0].nState, SYSTEM_STATE_BYPASS, "Back to the grid");
+    ASSERT_EQUAL(actions.actions[0].cReason, CONTROL_REASON_RESTORED, "Because it's back");
+    
+    //On batts by choice. An outage and restore don't change that.
+    Setup(&controller, &status, SYSTEM_STATE_PEAK);
+    control_Grid(&controller, &status, GRIDQUALITY_OUTAGE, 1000, &actions);
+    control_Grid(&controller, &status, GRIDQUALITY_RESTORED, 1010, &actions);
+    Sample(&sample, 1010 + CONTROL_RESTORE_HOLD_S, 12, 0, 0);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.actions[0].cAction, CONTROL_RECONCILE, "Stays on batts");
+}
+
+static void test_control_Commands()
+{
+    struct Controller controller;
+    struct SystemStatus status;
+    struct ControlSample sample;
+    struct ControlActions actions;
+    
+    Setup(&controller, &status, SYSTEM_STATE_PEAK);
+    Sample(&sample, 1000, 12, 0, 0);
+    
+    ASSERT_EQUAL(control_Command(&controller, &status, COMMAND_REQUEST_BOOST, 0, &sample.time, &actions), COMMAND_RESULT_DONE, "Boost done");
+    ASSERT_EQUAL(actions.actions[0].nState, SYSTEM_STATE_BOOST, "Boosting");
+    ASSERT_EQUAL(actions.actions[0].nChargeCurrent, GW_CFG_UTIL_AMPS_MAX, "Flat out, = %u", actions.actions[0].nChargeCurrent);
+    control_Apply(&status, &actions.actions[0]);
+    ASSERT_EQUAL(status.nChargeCurrent, GW_CFG_UTIL_AMPS_MAX, "Applied, = %u", status.nChargeCurrent);
+    
+    ASSERT_EQUAL(control_Command(&controller, &status, COMMAND_CHARGE_AMPS, GW_CFG_UTIL_AMPS_MAX + 1, &sample.time, &actions),
+                 COMMAND_RESULT_REFUSED, "Too many amps refused");
+    ASSERT_EQUAL(control_Command(&controller, &status, 0xFFFF, 0, &sample.time, &actions), COMMAND_RESULT_REFUSED, "Unknown command refused");
+    
+    //Overridden overload.
+    Setup(&controller, &status, SYSTEM_STATE_PEAK);
+    Sample(&sample, 1000, 12, 0, OVERLOAD_TRIP_WATTS * 10);
+    control_Step(&controller, &status, &sample, &actions);
+    control_Apply(&status, &actions.actions[0]);
+    ASSERT_EQUAL(control_Command(&controller, &status, COMMAND_REQUEST_BATTS, 0, &sample.time, &actions), COMMAND_RESULT_DONE, "Batts done");
+    ASSERT_EQUAL(controller.bOverloadBypass, false, "Overload forgotten");
+    control_Apply(&status, &actions.actions[0]);
+    ASSERT_EQUAL(status.nSystemState, SYSTEM_STATE_PEAK, "On batts");
+    
+    //Off-peak. No switching, but the charge current can be held by hand and handed back to the planner.
+    Sample(&sample, 2000, 1, 0, 0);
+    control_Step(&controller, &status, &sample, &actions);
+    control_Apply(&status, &actions.actions[0]);
+    ASSERT_EQUAL(status.nSystemState, SYSTEM_STATE_OFF_PEAK, "Off-peak");
+    ASSERT_EQUAL(control_Command(&controller, &status, COMMAND_REQUEST_BATTS, 0, &sample.time, &actions), COMMAND_RESULT_REFUSED, "Batts refused");
+    ASSERT_EQUAL(actions.cCount, 0, "No actions when refused, = %u", actions.cCount);
+    
+    ASSERT_EQUAL(control_Command(&controller, &status, COMMAND_CHARGE_AMPS, 30, &sample.time, &actions), COMMAND_RESULT_DONE, "Amps done");
+    ASSERT_EQUAL(actions.actions[0].cAction, CONTROL_CHARGE, "Charge");
+    control_Apply(&status, &actions.actions[0]);
+    ASSERT_EQUAL(control_ChargeLimit(&controller, &status, 1), 30, "Every inverter at the manual amps");
+    
+    status.nBatterySoc = 90;
+    Sample(&sample, 2000 + PLANNER_REPLAN_S, 1, 5, 0);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.actions[0].cAction, CONTROL_RECONCILE, "No re-plan over the manual amps");
+    
+    ASSERT_EQUAL(control_Command(&controller, &status, COMMAND_CHARGE_AMPS, 0, &sample.time, &actions), COMMAND_RESULT_DONE, "Back to plan");
+    ASSERT_EQUAL(actions.actions[0].nState, SYSTEM_STATE_OFF_PEAK, "Still off-peak");
+    ASSERT_EQUAL(controller.balancer.bActive, true, "Balancing again");
+}
+
+static void test_control_OverloadAtPeak()
+{
+    struct Controller controller;
+    struct SystemStatus status;
+    struct ControlSample sample;
+    struct ControlActions actions;
+    
+    //Heavy load from ten to the end of off-peak. It trips, but the grid's carrying it.
+    Setup(&controller, &status, SYSTEM_STATE_OFF_PEAK);
+    Sample(&sample, 1000, SYSTEM_END_OFF_PEAK_H, SYSTEM_END_OFF_PEAK_M - 10, OVERLOAD_TRIP_WATTS * 10);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(controller.overload.bTripped, true, "Tripped off-peak");
+    ASSERT_EQUAL(controller.overload.bAwaitingWrite, false, "No bypass write to time off-peak");
+    ASSERT_EQUAL(status.nSystemState, SYSTEM_STATE_OFF_PEAK, "Still off-peak");
+    
+    //Still there when off-peak ends, so it's the grid, not the batteries.
+    Sample(&sample, 1600, SYSTEM_END_OFF_PEAK_H, SYSTEM_END_OFF_PEAK_M, OVERLOAD_TRIP_WATTS * 10);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.cCount, 1, "One switch, = %u", actions.cCount);
+    ASSERT_EQUAL(actions.actions[0].nState, SYSTEM_STATE_BYPASS, "To the grid, = %u", actions.actions[0].nState);
+    ASSERT_EQUAL(actions.actions[0].cReason, CONTROL_REASON_OVERLOAD, "Because of the overload");
+    ASSERT_EQUAL(controller.bOverloadBypass, true, "Our bypass");
+    ASSERT_EQUAL(controller.overload.llSwitchMs, sample.time.llNowMs, "Timed from the switch, not the trip");
+    status.nAcchgegyToday = 12;
+    control_Apply(&status, &actions.actions[0]);
+    ASSERT_EQUAL(status.nOffPeakChargeKwh, 12 * INVERTER_COUNT, "Off-peak charge stored going straight to the grid, = %u", status.nOffPeakChargeKwh);
+    
+    Sample(&sample, 2140, SYSTEM_END_OFF_PEAK_H, SYSTEM_END_OFF_PEAK_M + 9, OVERLOAD_TRIP_WATTS * 10);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(status.nSystemState, SYSTEM_STATE_BYPASS, "Held while it lasts");
+    ASSERT_EQUAL(actions.actions[0].cAction, CONTROL_RECONCILE, "Only a check, = %u", actions.actions[0].cAction);
+    
+    //And back to batteries once it's been gone for the hold.
+    Sample(&sample, 2140 + OVERLOAD_HOLD_S, SYSTEM_END_OFF_PEAK_H + 1, 0, 0);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(actions.cCount, 1, "Released, = %u", actions.cCount);
+    ASSERT_EQUAL(actions.actions[0].nState, SYSTEM_STATE_PEAK, "Back to batts");
+    ASSERT_EQUAL(actions.actions[0].cReason, CONTROL_REASON_OVERLOAD_CLEARED, "Because it cleared");
+    
+    //Tripped while bypassed by hand, then the user asks for batteries. They get them, until it trips again.
+    Setup(&controller, &status, SYSTEM_STATE_BYPASS);
+    Sample(&sample, 1000, 12, 0, OVERLOAD_TRIP_WATTS * 10);
+    control_Step(&controller, &status, &sample, &actions);
+    control_Command(&controller, &status, COMMAND_REQUEST_BATTS, 0, &sample.time, &actions);
+    control_Apply(&status, &actions.actions[0]);
+    ASSERT_EQUAL(status.nSystemState, SYSTEM_STATE_PEAK, "Batts by request");
+    
+    Sample(&sample, 1001, 12, 0, 10000);
+    control_Step(&controller, &status, &sample, &actions);
+    ASSERT_EQUAL(status.nSystemState, SYSTEM_STATE_PEAK, "Left alone under the limit");
+    ASSERT_EQUAL(actions.cCount, 0, "No switch, = %u", actions.cCount);
+}
+
+static uint32_t Random(uint32_t* pSeed)
+{
+    //xorshift32. Deterministic, so any failure can be reproduced.
+    uint32_t x = *pSeed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *pSeed = x;
+    return x;
+}
+
+//Apply the actions, counting the writes the controller made of its own accord. Returns false if there were too many.
+static bool Carry(struct SystemStatus* pStatus, const struct ControlActions* pActions, int32_t slNow, int32_t* pslWrites, uint32_t* plWrite)
+{
+    bool bOk = true;
+    
+    for(uint8_t i = 0; i < pActions->cCount; i++)
+    {
+        const struct ControlAction* pAction = &pActions->actions[i];
+        
+        control_Apply(pStatus, pAction);
+        
+        if(CONTROL_RECONCILE == pAction->cAction || CONTROL_REASON_COMMAND == pAction->cReason)
+            continue;
+            
+        //Ring of the last few write times. The oldest must be a minute gone.
+        uint32_t lSlot = (*plWrite)++ % PROPERTY_MAX_WRITES_PER_MIN;
+        
+        if(*plWrite > PROPERTY_MAX_WRITES_PER_MIN && slNow - pslWrites[lSlot] < 60)
+            bOk = false;
+            
+        pslWrites[lSlot] = slNow;
+    }
+    
+    return bOk;
+}
+
+static void test_control_Properties()
+{
+    struct Controller controller;
+    struct SystemStatus status;
+    struct GridQuality grid;
+    struct ControlSample sample;
+    struct ControlActions actions;
+    int32_t slWrites[PROPERTY_MAX_WRITES_PER_MIN];
+    uint32_t lWrite = 0;
+    uint32_t lSeed = 0x5EED1234;
+    uint32_t lFailedStep = 0;
+    uint32_t lBattsOffPeak = 0;
+    uint32_t lTooManyWrites = 0;
+    uint32_t lBadAmps = 0;
+    uint32_t lOverflows = 0;
+    uint32_t lBattsTripped = 0;
+    uint32_t lSwitches = 0;
+    int32_t slNow = 1000;
+    uint16_t nWatts = 5000;
+    bool bGridFlapping = false;
+    
+    Setup(&controller, &status, SYSTEM_STATE_PEAK);
+    gridquality_Initialise(&grid);
+    
+    for(uint32_t lStep = 0; lStep < PROPERTY_STEPS; lStep++)
+    {
+        uint32_t r = Random(&lSeed);
+        
+        //Mostly a second or so between samples, with the odd longer gap.
+        slNow += 0 == (r & 0xFF) ? (int32_t)(r >> 24) : 1 + (int32_t)((r >> 8) & 3);
+        
+        int lMinuteOfDay = (slNow / 60) % 1440;
+        Sample(&sample, slNow, lMinuteOfDay / 60, lMinuteOfDay % 60, 0);
+        
+        //Load wanders, with surges.
+        r = Random(&lSeed);
+        nWatts = (uint16_t)((nWatts + (r & 0x3FF) - 0x1FF) & 0x7FFF);
+        
+        if(0 == (r >> 20) % 5000)
+            nWatts = OVERLOAD_TRIP_WATTS * 10 + 1000;
+            
+        for(int i = 0; i < INVERTER_COUNT; i++)
+        {
+            sample.inverters[i].nOutputWatts = nWatts;
+            sample.inverters[i].nLoadPercent = (uint16_t)(nWatts / 50);
+            sample.nChargeAmps[i] = (uint16_t)((r >> (8 * i)) & 0x3FF);
+        }
+        
+        status.nBatterySoc = (uint16_t)((Random(&lSeed) >> 8) % 101);
+        status.nBatteryVolts = 4800 + (uint16_t)(Random(&lSeed) % 800);
+        
+        //Now and again, a spell of the grid coming and going.
+        r = Random(&lSeed);
+        
+        if(0 == r % 20000)
+            bGridFlapping = !bGridFlapping;
+            
+        uint16_t nVolts = bGridFlapping && (r & 0x100) ? 0 : 2300;
+        uint8_t cGrid = gridquality_Sample(&grid, nVolts, GRID_NOMINAL_FREQ, sample.time.llNowMs);
+        
+        if(GRIDQUALITY_NONE != cGrid)
+        {
+            control_Grid(&controller, &status, cGrid, slNow, &actions);
+            
+            if(!Carry(&status, &actions, slNow, slWrites, &lWrite))
+                lTooManyWrites++;
+        }
+        
+        //And the odd command from a user.
+        if(0 == (r >> 8) % 10000)
+        {
+            uint16_t nCommandID = COMMAND_REQUEST_GRID + (uint16_t)((r >> 24) % 3);
+            
+            if(0 == (r >> 28) % 4)
+                control_Command(&controller, &status, COMMAND_CHARGE_AMPS, (uint16_t)((r >> 16) % 40), &sample.time, &actions);
+            else
+                control_Command(&controller, &status, nCommandID, 0, &sample.time, &actions);
+                
+            Carry(&status, &actions, slNow, slWrites, &lWrite);
+        }
+        
+        uint16_t nBefore = status.nSystemState;
+        
+        control_Step(&controller, &status, &sample, &actions);
+        
+        if(actions.cCount >= CONTROL_MAX_ACTIONS)
+            lOverflows++;
+            
+        if(!Carry(&status, &actions, slNow, slWrites, &lWrite))
+            lTooManyWrites++;
+            
+        if(status.nSystemState != nBefore)
+            lSwitches++;
+            
+        //Never on batteries during off-peak, whatever happened before.
+        if(!control_IsPeak(sample.time.lHour, sample.time.lMin) && SYSTEM_STATE_OFF_PEAK != status.nSystemState)
+            lBattsOffPeak++;
+            
+        //Never left on batteries with the overload engine tripped, unless there's no grid to go to.
+        if(SYSTEM_STATE_PEAK == status.nSystemState && controller.overload.bTripped && !controller.bOutageBatts)
+            lBattsTripped++;
+            
+        //Every inverter's limit within what it can do while charging.
+        if(SYSTEM_STATE_OFF_PEAK == status.nSystemState)
+        {
+            for(uint8_t i = 0; i < INVERTER_COUNT; i++)
+            {
+                uint16_t nLimit = control_ChargeLimit(&controller, &status, i);
+                
+                if(nLimit < CHARGE_MIN_AMPS || nLimit > GW_CFG_UTIL_AMPS_MAX)
+                    lBadAmps++;
+            }
+        }
+        
+        if(0 == lFailedStep && (lBattsOffPeak || lTooManyWrites || lBadAmps || lOverflows || lBattsTripped))
+            lFailedStep = lStep + 1;
+    }
+    
+    PRINT_DEBUG("    %u random steps, %u switches, %u overload trips, first failure at step %u\n",
+                PROPERTY_STEPS, lSwitches, controller.overload.lTrips, lFailedStep);
+    
+    ASSERT_EQUAL(lBattsOffPeak, 0, "Never on batts off-peak, = %u", lBattsOffPeak);
+    ASSERT_EQUAL(lTooManyWrites, 0, "Never more than %d writes a minute, = %u", PROPERTY_MAX_WRITES_PER_MIN, lTooManyWrites);
+    ASSERT_EQUAL(lBadAmps, 0, "Charge limits in range, = %u", lBadAmps);
+    ASSERT_EQUAL(lBattsTripped, 0, "Never on batts while tripped, = %u", lBattsTripped);
+    ASSERT_EQUAL(lOverflows, 0, "Room for every action, = %u", lOverflows);
+    ASSERT_EQUAL(lSwitches > 100 && controller.overload.lTrips > 0, true, "Exercised");
+}
+
+static struct Controller scheduleController;
+static struct SystemStatus scheduleStatus;
+static struct ControlSample scheduleSample;
+static struct ControlActions scheduleActions;
+
+//As the server's HandleSchedule does. The end of a window goes back to batteries, or back to the state's own amps.
+static void Scheduled(struct Schedule* pSchedule, const struct ScheduledCommand* pCommand, bool bEnding)
+{
+    uint16_t nCommandID = pCommand->nCommandID;
+    
+    if(bEnding)
+        nCommandID = COMMAND_CHARGE_AMPS == nCommandID ? COMMAND_CHARGE_AMPS : COMMAND_REQUEST_BATTS;
+        
+    Sample(&scheduleSample, pSchedule->slCurrent, 12, 0, 0);
+    control_Command(&scheduleController, &scheduleStatus, nCommandID, bEnding ? 0 : pCommand->nParam, &scheduleSample.time, &scheduleActions);
+    
+    for(uint8_t i = 0; i < scheduleActions.cCount; i++)
+        control_Apply(&scheduleStatus, &scheduleActions.actions[i]);
+}
+
+static void test_control_ScheduledAmps()
+{
+    struct Schedule schedule;
+    struct ScheduledCommand command = { 0, 1100, 60, 0, COMMAND_CHARGE_AMPS, 10 };
+    
+    //Boosting when a window of lower amps starts and ends. The boost current comes back.
+    Setup(&scheduleController, &scheduleStatus, SYSTEM_STATE_PEAK);
+    Sample(&scheduleSample, 1000, 12, 0, 0);
+    control_Command(&scheduleController, &scheduleStatus, COMMAND_REQUEST_BOOST, 0, &scheduleSample.time, &scheduleActions);
+    control_Apply(&scheduleStatus, &scheduleActions.actions[0]);
+    
+    schedule_Initialise(&schedule, Scheduled, 1000);
+    schedule_Add(&schedule, &command);
+    
+    schedule_Advance(&schedule, 1100);
+    ASSERT_EQUAL(control_ChargeLimit(&scheduleController, &scheduleStatus, 0), 10, "Window's amps while boosting");
+    
+    schedule_Advance(&schedule, 1160);
+    ASSERT_EQUAL(scheduleStatus.nSystemState, SYSTEM_STATE_BOOST, "Still boosting");
+    ASSERT_EQUAL(scheduleActions.cCount, 1, "One action, = %u", scheduleActions.cCount);
+    ASSERT_EQUAL(scheduleActions.actions[0].cAction, CONTROL_CHARGE, "Charge current put back");
+    ASSERT_EQUAL(control_ChargeLimit(&scheduleController, &scheduleStatus, 0), GW_CFG_UTIL_AMPS_MAX,
+                 "Boost amps at the end of the window, = %d", control_ChargeLimit(&scheduleController, &scheduleStatus, 0));
+    ASSERT_EQUAL(scheduleController.bManualAmps, false, "Not held by hand");
+    
+    //Starts on batteries and boosted part way through. The boost already took over, so the end leaves it be.
+    Setup(&scheduleController, &scheduleStatus, SYSTEM_STATE_PEAK);
+    schedule_Initialise(&schedule, Scheduled, 1000);
+    schedule_Add(&schedule, &command);
+    
+    schedule_Advance(&schedule, 1100);
+    ASSERT_EQUAL(control_ChargeLimit(&scheduleController, &scheduleStatus, 0), 10, "Window's amps on batteries");
+    
+    Sample(&scheduleSample, 1130, 12, 0, 0);
+    control_Command(&scheduleController, &scheduleStatus, COMMAND_REQUEST_BOOST, 0, &scheduleSample.time, &scheduleActions);
+    control_Apply(&scheduleStatus, &scheduleActions.actions[0]);
+    
+    schedule_Advance(&schedule, 1160);
+    ASSERT_EQUAL(scheduleActions.cCount, 0, "Nothing to put back, = %u", scheduleActions.cCount);
+    ASSERT_EQUAL(control_ChargeLimit(&scheduleController, &scheduleStatus, 0), GW_CFG_UTIL_AMPS_MAX,
+                 "Boost amps at the end of the window, = %d", control_ChargeLimit(&scheduleController, &scheduleStatus, 0));
+    
+    //Amps set by hand on batteries and then handed back. What it had before comes back.
+    Setup(&scheduleController, &scheduleStatus, SYSTEM_STATE_PEAK);
+    scheduleStatus.nChargeCurrent = 25;
+    control_Command(&scheduleController, &scheduleStatus, COMMAND_CHARGE_AMPS, 10, &scheduleSample.time, &scheduleActions);
+    control_Apply(&scheduleStatus, &scheduleActions.actions[0]);
+    control_Command(&scheduleController, &scheduleStatus, COMMAND_CHARGE_AMPS, 12, &scheduleSample.time, &scheduleActions);
+    control_Apply(&scheduleStatus, &scheduleActions.actions[0]);
+    control_Command(&scheduleController, &scheduleStatus, COMMAND_CHARGE_AMPS, 0, &scheduleSample.time, &scheduleActions);
+    control_Apply(&scheduleStatus, &scheduleActions.actions[0]);
+    ASSERT_EQUAL(scheduleStatus.nChargeCurrent, 25, "Peak's amps put back, = %d", scheduleStatus.nChargeCurrent);
+}
+
+void test_control()
+{
+    PRINT_DEBUG("---=== Control tests ===---\n");
+    
+    test_control_Overload();
+    test_control_Switching();
+    test_control_OverloadAtPeak();
+    test_control_Grid();
+    test_control_Commands();
+    test_control_ScheduledAmps();
+    test_control_Properties();
+    
+    PRINT_DEBUG("---------------------------\n\n");
+}
@@ -0,0 +1,7 @@
+
+#ifndef TEST_CONTROL_H
+#define TEST_CONTROL_H
+
+void test_control();
+
+#endif
@@ -0,0 +1,197 @@
+
+#include "test.h"
+#include "test_events.h"
+#include "events.h"
+#include <string.h>
+
+static struct SystemEvent lastEvent;
+static uint32_t lRaised;
+
+static void test_events_Raised(struct EventEngine* pEngine, const struct SystemEvent* pEvent)
+{
+    lastEvent = *pEvent;
+    lRaised++;
+}
+
+static void test_events_Setup(struct EventEngine* pEngine, struct SystemStatus* pStatus)
+{
+    memset(&lastEvent, 0x00, sizeof(lastEvent));
+    memset(pStatus, 0x00, sizeof(struct SystemStatus));
+    lRaised = 0;
+    events_Initialise(pEngine, test_events_Raised);
+}
+
+static void test_events_Change()
+{
+    struct EventEngine engine;
+    struct SystemStatus status;
+    
+    test_events_Setup(&engine, &status);
+    events_Add(&engine, EVENT_SYSTEM_STATE_CHANGED, DETECT_CHANGE, EVENT_FIELD(nSystemState), 0, 0);
+    
+    //First sample only primes.
+    status.nSystemState = SYSTEM_STATE_PEAK;
+    events_Process(&engine, &status, 100);
+    ASSERT_EQUAL(lRaised, 0, "Nothing raised on the first sample, = %u", lRaised);
+    
+    events_Process(&engine, &status, 102);
+    ASSERT_EQUAL(lRaised, 0, "Nothing raised without a change, = %u", lRaised);
+    
+    status.nSystemState = SYSTEM_STATE_OFF_PEAK;
+    events_Process(&engine, &status, 104);
+    ASSERT_EQUAL(lRaised, 1, "Change raised, = %u", lRaised);
+    ASSERT_EQUAL(lastEvent.nEventID, EVENT_SYSTEM_STATE_CHANGED, "Event ID, = %u", lastEvent.nEventID);
+    ASSERT_EQUAL(lastEvent.nValue, SYSTEM_STATE_OFF_PEAK, "Event value, = %u", lastEvent.nValue);
+    ASSERT_EQUAL(lastEvent.nPrevious, SYSTEM_STATE_PEAK, "Event previous value, = %u", lastEvent.nPrevious);
+    ASSERT_EQUAL(lastEvent.slTime, 104, "Event time, = %d", lastEvent.slTime);
+}
+
+static void test_events_Fall()
+{
+    struct EventEngine engine;
+    struct SystemStatus status;
+    
+    test_events_Setup(&engine, &status);
+    events_Add(&engine, EVENT_CHARGING_STOPPED, DETECT_FALL, EVENT_FIELD(nBattchgAmps), 10, 3);
+    
+    status.nBattchgAmps = 500;
+    events_Process(&engine, &status, 0);
+    
+    //Two low samples then a blip back up isn't enough.
+    status.nBattchgAmps = 0;
+    events_Process(&engine, &status, 2);
+    events_Process(&engine, &status, 4);
+    status.nBattchgAmps = 200;
+    events_Process(&engine, &status, 6);
+    ASSERT_EQUAL(lRaised, 0, "Debounced a short dip, = %u", lRaised);
+    
+    //Three in a row is.
+    status.nBattchgAmps = 5;
+    events_Process(&engine, &status, 8);
+    events_Process(&engine, &status, 10);
+    ASSERT_EQUAL(lRaised, 0, "Not raised before the debounce count, = %u", lRaised);
+    events_Process(&engine, &status, 12);
+    ASSERT_EQUAL(lRaised, 1, "Fall raised after debounce, = %u", lRaised);
+    
+    //Stays low. Only raised once.
+    status.nBattchgAmps = 0;
+    events_Process(&engine, &status, 14);
+    events_Process(&engine, &status, 16);
+    ASSERT_EQUAL(lRaised, 1, "Fall raised only once, = %u", lRaised);
+    
+    //Rising again doesn't raise a fall, but re-arms it.
+    status.nBattchgAmps = 300;
+    for(int32_t i = 0; i < 3; i++)
+        events_Process(&engine, &status, 18 + i * 2);
+    ASSERT_EQUAL(lRaised, 1, "Rise doesn't raise a fall detector, = %u", lRaised);
+    
+    status.nBattchgAmps = 0;
+    for(int32_t i = 0; i < 3; i++)
+        events_Process(&engine, &status, 24 + i * 2);
+    ASSERT_EQUAL(lRaised, 2, "Fall raised again after re-arming, = %u", lRaised);
+}
+
+static void test_events_Rise()
+{
+    struct EventEngine engine;
+    struct SystemStatus status;
+    
+    test_events_Setup(&engine, &status);
+    events_Add(&engine, EVENT_GRID_RESTORED, DETECT_RISE, EVENT_FIELD(nGridVolts), 2000, 0);
+    
+    status.nGridVolts = 0;
+    events_Process(&engine, &status, 0);
+    status.nGridVolts = 2000;
+    events_Process(&engine, &status, 2);
+    ASSERT_EQUAL(lRaised, 0, "Rise needs to exceed the threshold, = %u", lRaised);
+    status.nGridVolts = 2401;
+    events_Process(&engine, &status, 4);
+    ASSERT_EQUAL(lRaised, 1, "Plain rising edge raised straight away, = %u", lRaised);
+}
+
+static void test_events_Rate()
+{
+    struct EventEngine engine;
+    struct SystemStatus status;
+    
+    test_events_Setup(&engine, &status);
+    events_Add(&engine, EVENT_LOAD_SURGE, DETECT_RATE, EVENT_FIELD(nOutputWatts), 5000, 0);
+    
+    status.nOutputWatts = 10000;
+    events_Process(&engine, &status, 0);
+    
+    //+8000 over 2s is 4000/s. Not a surge.
+    status.nOutputWatts = 18000;
+    events_Process(&engine, &status, 2);
+    ASSERT_EQUAL(lRaised, 0, "Slow rise ignored, = %u", lRaised);
+    
+    //+12000 over 2s is 6000/s.
+    status.nOutputWatts = 30000;
+    events_Process(&engine, &status, 4);
+    ASSERT_EQUAL(lRaised, 1, "Fast rise raised, = %u", lRaised);
+    ASSERT_EQUAL(lastEvent.nPrevious, 18000, "Surge previous value, = %u", lastEvent.nPrevious);
+    
+    //Falls are never surges.
+    status.nOutputWatts = 0;
+    events_Process(&engine, &status, 5);
+    ASSERT_EQUAL(lRaised, 1, "Fast fall ignored, = %u", lRaised);
+}
+
+static void test_events_Stuck()
+{
+    struct EventEngine engine;
+    struct SystemStatus status;
+    
+    test_events_Setup(&engine, &status);
+    events_Add(&engine, EVENT_READINGS_STUCK, DETECT_STUCK, EVENT_FIELD(nBatteryVolts), 0, 900);
+    
+    status.nBatteryVolts = 5200;
+    for(int32_t slTime = 0; slTime < 900; slTime += 2)
+        events_Process(&engine, &status, slTime);
+    ASSERT_EQUAL(lRaised, 0, "Not stuck before the time, = %u", lRaised);
+    
+    for(int32_t slTime = 900; slTime < 2000; slTime += 2)
+        events_Process(&engine, &status, slTime);
+    ASSERT_EQUAL(lRaised, 1, "Stuck raised once, = %u", lRaised);
+    
+    //Moving again re-arms it.
+    status.nBatteryVolts = 5201;
+    events_Process(&engine, &status, 2000);
+    for(int32_t slTime = 2002; slTime < 3000; slTime += 2)
+        events_Process(&engine, &status, slTime);
+    ASSERT_EQUAL(lRaised, 2, "Stuck raised again after moving, = %u", lRaised);
+}
+
+static void test_events_Multiple()
+{
+    struct EventEngine engine;
+    struct SystemStatus status;
+    
+    test_events_Setup(&engine, &status);
+    
+    for(uint8_t i = 0; i < EVENTS_MAX_DETECTORS; i++)
+        ASSERT_EQUAL(events_Add(&engine, EVENT_SYSTEM_STATE_CHANGED, DETECT_CHANGE, EVENT_FIELD(nSystemState), 0, 0), true, "Added detector %u", i);
+        
+    ASSERT_EQUAL(events_Add(&engine, EVENT_SYSTEM_STATE_CHANGED, DETECT_CHANGE, EVENT_FIELD(nSystemState), 0, 0), false, "Engine full");
+    ASSERT_EQUAL(events_Add(&engine, EVENT_SYSTEM_STATE_CHANGED, DETECT_CHANGE, sizeof(struct SystemStatus) - 1, 0, 0), false, "Field out of bounds rejected");
+    
+    events_Process(&engine, &status, 0);
+    status.nSystemState = SYSTEM_STATE_BOOST;
+    events_Process(&engine, &status, 2);
+    ASSERT_EQUAL(lRaised, EVENTS_MAX_DETECTORS, "Every detector raised in one pass, = %u", lRaised);
+    ASSERT_EQUAL(engine.lEvents, EVENTS_MAX_DETECTORS, "Engine counted the events, = %u", engine.lEvents);
+}
+
+void test_events()
+{
+    PRINT_DEBUG("---=== Events tests ===---\n");
+    
+    test_events_Change();
+    test_events_Fall();
+    test_events_Rise();
+    test_events_Rate();
+    test_events_Stuck();
+    test_events_Multiple();
+    
+    PRINT_DEBUG("--------------------------\n\n");
+}
@@ -0,0 +1,7 @@
+
+#ifndef TEST_EVENTS_H
+#define TEST_EVENTS_H
+
+void test_events();
+
+#endif
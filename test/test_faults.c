@@ -0,0 +1,191 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "test.h"
+#include "test_faults.h"
+#include "faults.h"
+
+#define TEST_FAULTS_FILE "/tmp/test_faults.bin"
+
+static struct Faults faults;
+static uint32_t lRecorded;
+static struct FaultRecord lastRecord;
+
+static void Recorded(struct Faults* pFaults, const struct FaultRecord* pRecord)
+{
+    lRecorded++;
+    lastRecord = *pRecord;
+}
+
+static void Sample(uint16_t* pRegs, uint8_t cInverter, uint16_t nWatts, int32_t slNow)
+{
+    pRegs[OUTPUT_WATTS_L] = nWatts;
+    faults_Sample(&faults, cInverter, pRegs, slNow, (int64_t)slNow * 1000);
+}
+
+static void Query(struct FaultList* pList, int32_t slFrom, int32_t slTo, uint16_t nCode, uint8_t cKind)
+{
+    struct FaultQuery query = { slFrom, slTo, nCode, cKind, 0 };
+    faults_Query(&faults, &query, pList);
+}
+
+static void test_faults_Decode()
+{
+    uint16_t regs[INPUT_REGISTER_COUNT];
+    memset(regs, 0x00, sizeof(regs));
+    lRecorded = 0;
+    faults_Initialise(&faults, Recorded);
+
+    for(int i = 0; i < 10; i++)
+        Sample(regs, 1, 1000 + i, 100 + i);
+
+    ASSERT_EQUAL(lRecorded, 0, "Nothing while healthy");
+
+    //Motor inrush on the slave.
+    regs[FAULTVALUE] = FAULTS_CODE_BUS_HIGH;
+    regs[FAULTBIT] = 0x0001;
+    regs[DTC] = 7;
+    Sample(regs, 1, 52000, 110);
+    ASSERT_EQUAL(lRecorded, 1, "Raised");
+    ASSERT_EQUAL(lastRecord.lFaultId, 1, "First ID");
+    ASSERT_EQUAL(lastRecord.cInverter, 1, "On the slave");
+    ASSERT_EQUAL(lastRecord.cKind, FAULT_KIND_FAULT, "A fault");
+    ASSERT_EQUAL(lastRecord.cCode, FAULTS_CODE_BUS_HIGH, "Bus voltage too high");
+    ASSERT_EQUAL(lastRecord.bCleared, 0, "Not cleared");
+    ASSERT_EQUAL(lastRecord.nDtc, 7, "DTC kept");
+    ASSERT_EQUAL(strcmp(faults_Describe(FAULT_KIND_FAULT, FAULTS_CODE_BUS_LOW), "Bus voltage too low"), 0, "Named");
+    ASSERT_EQUAL(strcmp(faults_Describe(FAULT_KIND_WARNING, 200), "Unknown"), 0, "Unnamed");
+
+    Sample(regs, 1, 0, 111);
+    ASSERT_EQUAL(lRecorded, 1, "Still the same fault");
+
+    //A warning alongside it, then both clear.
+    regs[WARNVALUE] = 4;
+    Sample(regs, 1, 0, 112);
+    ASSERT_EQUAL(lastRecord.cKind, FAULT_KIND_WARNING, "Warning");
+    ASSERT_EQUAL(lastRecord.cCode, 4, "Low battery");
+
+    memset(regs, 0x00, sizeof(regs));
+    Sample(regs, 1, 0, 113);
+    ASSERT_EQUAL(lRecorded, 4, "Both cleared");
+    ASSERT_EQUAL(lastRecord.bCleared, 1, "Cleared");
+    ASSERT_EQUAL(lastRecord.cCode, 4, "With the code that cleared");
+
+    //Showing a fault when first seen counts.
+    regs[FAULTVALUE] = FAULTS_CODE_BUS_LOW;
+    Sample(regs, 0, 0, 114);
+    ASSERT_EQUAL(lRecorded, 5, "Raised on first sight");
+    ASSERT_EQUAL(lastRecord.cInverter, 0, "On the master");
+}
+
+static void test_faults_Capture()
+{
+    struct FaultCapture capture;
+
+    //Still from the decode test. Eight samples up to the fault, the last of them the fault's own.
+    ASSERT_EQUAL(faults_Capture(&faults, 1, &capture), true, "Captured");
+    ASSERT_EQUAL(capture.cInverter, 1, "Slave's samples");
+    ASSERT_EQUAL(capture.cPre, FAULT_PRE_SAMPLES, "Full lead up");
+    ASSERT_EQUAL(capture.samples[0].slOffsetMs, -7000, "Oldest first");
+    ASSERT_EQUAL(capture.samples[0].nOutputWatts, 1003, "Oldest watts");
+    ASSERT_EQUAL(capture.samples[FAULT_PRE_SAMPLES - 1].slOffsetMs, 0, "Fault's own sample");
+    ASSERT_EQUAL(capture.samples[FAULT_PRE_SAMPLES - 1].nOutputWatts, 52000, "Inrush");
+    ASSERT_EQUAL(capture.cPost, 3, "What followed so far");
+    ASSERT_EQUAL(capture.samples[FAULT_PRE_SAMPLES].slOffsetMs, 1000, "Next sample");
+
+    ASSERT_EQUAL(faults_Capture(&faults, 2, &capture), false, "Warnings aren't captured");
+    ASSERT_EQUAL(capture.lFaultId, 0, "Empty");
+
+    faults_Capture(&faults, 5, &capture);
+    ASSERT_EQUAL(capture.cPre, 1, "Only what's been seen");
+}
+
+static void test_faults_Query()
+{
+    uint16_t regs[INPUT_REGISTER_COUNT];
+    struct FaultList list;
+
+    memset(regs, 0x00, sizeof(regs));
+    faults_Initialise(&faults, NULL);
+
+    //Alternating bus high/low faults on the master, one raised and cleared every 10s.
+    for(int i = 0; i < 400; i++)
+    {
+        regs[FAULTVALUE] = (i % 2) ? 0 : ((i % 4) ? FAULTS_CODE_BUS_LOW : FAULTS_CODE_BUS_HIGH);
+        Sample(regs, 0, 0, 1000 + i * 5);
+    }
+
+    ASSERT_EQUAL(faults.lNextId, 401, "Every change recorded");
+
+    Query(&list, INT32_MIN, INT32_MAX, FAULT_ANY_CODE, FAULT_ANY_KIND);
+    ASSERT_EQUAL(list.nMatches, FAULTS_MAX_RECORDS, "Only so many held");
+    ASSERT_EQUAL(list.nCount, FAULT_LIST_MAX, "Only so many returned");
+    ASSERT_EQUAL(list.records[0].lFaultId, 400, "Newest first");
+
+    //Time range.
+    Query(&list, 1000 + 300 * 5, 1000 + 309 * 5, FAULT_ANY_CODE, FAULT_ANY_KIND);
+    ASSERT_EQUAL(list.nMatches, 10, "Ten in range");
+    ASSERT_EQUAL(list.records[0].slTime, 1000 + 309 * 5, "Ends at slTo");
+    ASSERT_EQUAL(list.records[9].slTime, 1000 + 300 * 5, "Starts at slFrom");
+
+    //By code. Raised and cleared records both carry it.
+    Query(&list, 1000 + 300 * 5, 1000 + 319 * 5, FAULTS_CODE_BUS_LOW, FAULT_ANY_KIND);
+    ASSERT_EQUAL(list.nMatches, 10, "Bus low raised and cleared five times in 20 samples");
+    ASSERT_EQUAL(list.records[0].cCode, FAULTS_CODE_BUS_LOW, "Right code");
+    ASSERT_EQUAL(list.records[0].lFaultId > list.records[1].lFaultId, true, "Newest first");
+
+    Query(&list, INT32_MIN, INT32_MAX, FAULTS_CODE_BUS_LOW, FAULT_KIND_WARNING);
+    ASSERT_EQUAL(list.nMatches, 0, "No such warnings");
+
+    Query(&list, INT32_MIN, 999, FAULT_ANY_CODE, FAULT_ANY_KIND);
+    ASSERT_EQUAL(list.nMatches, 0, "Nothing before");
+
+    //Oldest dropped from the chains too.
+    Query(&list, INT32_MIN, INT32_MAX, FAULTS_CODE_BUS_HIGH, FAULT_KIND_FAULT);
+    ASSERT_EQUAL(list.nMatches, FAULTS_MAX_RECORDS / 2, "Half of what's held");
+}
+
+static void test_faults_Persist()
+{
+    uint16_t regs[INPUT_REGISTER_COUNT];
+    struct FaultList list;
+
+    unlink(TEST_FAULTS_FILE);
+    memset(regs, 0x00, sizeof(regs));
+    faults_Initialise(&faults, NULL);
+    ASSERT_EQUAL(faults_Load(&faults, TEST_FAULTS_FILE), false, "No file");
+
+    for(uint32_t i = 1; i <= FAULTS_MAX_RECORDS + 10; i++)
+    {
+        struct FaultRecord record = { i, (int32_t)(2000 + i), 1, FAULT_KIND_WARNING, 10, 0, 0x0200, 0 };
+        faults_Append(&record, TEST_FAULTS_FILE);
+    }
+
+    ASSERT_EQUAL(faults_Load(&faults, TEST_FAULTS_FILE), true, "Loaded");
+    ASSERT_EQUAL(faults.lNextId, FAULTS_MAX_RECORDS + 11, "Carries on from the last");
+
+    Query(&list, INT32_MIN, INT32_MAX, 10, FAULT_KIND_WARNING);
+    ASSERT_EQUAL(list.nMatches, FAULTS_MAX_RECORDS, "Newest re-indexed");
+    ASSERT_EQUAL(list.records[0].nBits, 0x0200, "Intact");
+
+    //New records follow on.
+    regs[FAULTVALUE] = 1;
+    Sample(regs, 0, 0, 5000);
+    Query(&list, 5000, 5000, FAULT_ANY_CODE, FAULT_ANY_KIND);
+    ASSERT_EQUAL(list.records[0].lFaultId, FAULTS_MAX_RECORDS + 11, "Next ID");
+
+    unlink(TEST_FAULTS_FILE);
+}
+
+void test_faults()
+{
+    PRINT_DEBUG("---=== Faults tests ===---\n");
+
+    test_faults_Decode();
+    test_faults_Capture();
+    test_faults_Query();
+    test_faults_Persist();
+
+    PRINT_DEBUG("---------------------------\n\n");
+}
@@ -0,0 +1,7 @@
+
+#ifndef TEST_FAULTS_H
+#define TEST_FAULTS_H
+
+void test_faults();
+
+#endif
@@ -0,0 +1,83 @@
+
+#include "test.h"
+#include "test_forecast.h"
+#include "forecast.h"
+#include <string.h>
+#include <stdbool.h>
+
+#define TEST_FORECAST_FILE "/tmp/test_forecast.bin"
+
+//Feed a week of one-minute samples, with fltDayWatts from 07:00-23:00 and fltNightWatts overnight.
+static void FeedWeek(struct LoadForecast* pForecast, int32_t slStart, float fltDayWatts, float fltNightWatts)
+{
+    for(int32_t t = 0; t < 7 * 24 * 3600; t += 60)
+    {
+        int lDay = t / (24 * 3600);
+        int lHour = (t / 3600) % 24;
+        int lMin = (t / 60) % 60;
+        float fltWatts = (lHour >= 7 && lHour < 23) ? fltDayWatts : fltNightWatts;
+        
+        forecast_Sample(pForecast, slStart + t, forecast_SlotOf(lDay, lHour, lMin), fltWatts);
+    }
+}
+
+static void test_forecast_Learn()
+{
+    struct LoadForecast forecast;
+    float fltKwh;
+    
+    forecast_Initialise(&forecast);
+    
+    fltKwh = forecast_Next24hKwh(&forecast, 0);
+    ASSERT_EQUAL(fltKwh == 0.0f, true, "Nothing forecast before any samples");
+    
+    //Constant 1kW for a week. 24kWh a day.
+    FeedWeek(&forecast, 0, 1000.0f, 1000.0f);
+    fltKwh = forecast_Next24hKwh(&forecast, 0);
+    ASSERT_EQUAL(fltKwh > 23.5f && fltKwh < 24.5f, true, "Constant 1kW forecasts 24kWh, = %d Wh", (int)(fltKwh * 1000.0f));
+    ASSERT_EQUAL(forecast.nSeen >= FORECAST_SLOTS - 1, true, "The whole week was seen, = %d slots", forecast.nSeen);
+    
+    //Profile shape. 2kW day, 500W night, from 07:00. 16h * 2kW + 8h * 0.5kW = 36kWh after enough weeks.
+    for(int i = 0; i < 30; i++)
+        FeedWeek(&forecast, (i + 1) * 7 * 24 * 3600, 2000.0f, 500.0f);
+        
+    fltKwh = forecast_Next24hKwh(&forecast, forecast_SlotOf(1, 7, 0));
+    ASSERT_EQUAL(fltKwh > 35.5f && fltKwh < 36.5f, true, "Day/night profile forecasts 36kWh, = %d Wh", (int)(fltKwh * 1000.0f));
+    ASSERT_EQUAL(forecast.fltProfileWh[forecast_SlotOf(1, 12, 0)] > 990.0f, true, "Midday slot learned 1kWh per half hour");
+    ASSERT_EQUAL(forecast.fltProfileWh[forecast_SlotOf(1, 2, 0)] < 260.0f, true, "Night slot learned 250Wh per half hour");
+}
+
+static void test_forecast_Persist()
+{
+    struct LoadForecast forecast;
+    struct LoadForecast loaded;
+    bool bResult;
+    
+    forecast_Initialise(&forecast);
+    FeedWeek(&forecast, 0, 1500.0f, 300.0f);
+    
+    bResult = forecast_Save(&forecast, TEST_FORECAST_FILE);
+    ASSERT_EQUAL(bResult, true, "Saved the forecast");
+    ASSERT_EQUAL(sizeof(struct LoadForecast) < 4096, true, "Persisted state is a few KB, = %d bytes", (int)sizeof(struct LoadForecast));
+    
+    forecast_Initialise(&loaded);
+    bResult = forecast_Load(&loaded, TEST_FORECAST_FILE);
+    ASSERT_EQUAL(bResult, true, "Loaded the forecast");
+    ASSERT_EQUAL(memcmp(loaded.fltProfileWh, forecast.fltProfileWh, sizeof(forecast.fltProfileWh)), 0, "Loaded profile matches");
+    ASSERT_EQUAL(loaded.slSlot, -1, "Loaded forecast starts a fresh slot");
+    
+    bResult = forecast_Load(&loaded, "/tmp/no/such/forecast.bin");
+    ASSERT_EQUAL(bResult, false, "Missing file doesn't load");
+    
+    remove(TEST_FORECAST_FILE);
+}
+
+void test_forecast()
+{
+    PRINT_DEBUG("---=== Forecast tests ===---\n");
+    
+    test_forecast_Learn();
+    test_forecast_Persist();
+    
+    PRINT_DEBUG("----------------------------\n\n");
+}
@@ -0,0 +1,7 @@
+
+#ifndef TEST_FORECAST_H
+#define TEST_FORECAST_H
+
+void test_forecast();
+
+#endif
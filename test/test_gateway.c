@@ -0,0 +1,254 @@
+
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "test.h"
+#include "test_gateway.h"
+#include "gateway.h"
+#include "comms_defs.h"
+
+#define TEST_GATEWAY_READERS 3
+
+struct TestRequest
+{
+    uint8_t cUnitId;
+    uint8_t request[12];
+    uint16_t nLength;
+    uint8_t response[GATEWAY_PDU_MAX];
+    uint16_t nResponse;
+};
+
+static struct Gateway gateway;
+static struct CommandQueue queue;
+static int lWakes;
+
+static int64_t NowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void Wake()
+{
+    lWakes++;
+}
+
+static void Read(struct TestRequest* pRequest, uint8_t cUnitId, uint8_t cFunction, uint16_t nAddress, uint16_t nCount)
+{
+    uint8_t request[5] = { cFunction, nAddress >> 8, nAddress, nCount >> 8, nCount };
+
+    memcpy(pRequest->request, request, sizeof(request));
+    pRequest->nLength = sizeof(request);
+    pRequest->cUnitId = cUnitId;
+}
+
+static void Write(struct TestRequest* pRequest, uint8_t cUnitId, uint16_t nAddress, uint16_t nValue)
+{
+    Read(pRequest, cUnitId, GATEWAY_FC_WRITE_SINGLE, nAddress, nValue);
+}
+
+static void* Requester(void* arg)
+{
+    struct TestRequest* pRequest = arg;
+    pRequest->nResponse = gateway_Request(&gateway, pRequest->cUnitId, pRequest->request, pRequest->nLength, pRequest->response);
+    return NULL;
+}
+
+static uint16_t Serve(struct TestRequest* pRequest)
+{
+    Requester(pRequest);
+    return pRequest->nResponse;
+}
+
+//Until the gateway has seen lMisses misses and lWrites writes, so everything's queued that's going to be.
+static void WaitFor(uint32_t lMisses, uint32_t lWrites)
+{
+    bool bWaiting = true;
+
+    while(bWaiting)
+    {
+        pthread_mutex_lock(&gateway.mutex);
+        bWaiting = gateway.lMisses < lMisses || gateway.lWrites < lWrites;
+        pthread_mutex_unlock(&gateway.mutex);
+
+        if(bWaiting)
+            sched_yield();
+    }
+}
+
+static void test_gateway_Hits()
+{
+    struct TestRequest request;
+    uint16_t regs[INPUT_REGISTER_COUNT];
+
+    gateway_Initialise(&gateway, GATEWAY_MAX_AGE_MS, NULL, Wake);
+
+    for(int i = 0; i < INPUT_REGISTER_COUNT; i++)
+        regs[i] = 1000 + i;
+
+    gateway_Update(&gateway, 1, false, 0, INPUT_REGISTER_COUNT, regs, NowMs());
+
+    Read(&request, INVERTER_1_ID + 1, GATEWAY_FC_READ_INPUT, BATTERY_SOC, 2);
+    ASSERT_EQUAL(Serve(&request), 6, "Two registers");
+    ASSERT_EQUAL(request.response[1], 4, "Byte count");
+    ASSERT_EQUAL((request.response[2] << 8) | request.response[3], 1000 + BATTERY_SOC, "From the image");
+    ASSERT_EQUAL(gateway.lHits, 1, "A hit");
+    ASSERT_EQUAL(lWakes, 0, "Bus left alone");
+
+    Read(&request, INVERTER_1_ID + INVERTER_COUNT, GATEWAY_FC_READ_INPUT, 0, 1);
+    ASSERT_EQUAL(Serve(&request), 2, "No such inverter");
+    ASSERT_EQUAL(request.response[0], GATEWAY_FC_READ_INPUT | 0x80, "Exception");
+    ASSERT_EQUAL(request.response[1], GATEWAY_EX_TARGET_FAILED, "Target failed");
+
+    Read(&request, INVERTER_1_ID, GATEWAY_FC_READ_INPUT, GATEWAY_INPUT_SPACE - 1, 2);
+    Serve(&request);
+    ASSERT_EQUAL(request.response[1], GATEWAY_EX_ILLEGAL_ADDRESS, "Off the end");
+
+    Read(&request, INVERTER_1_ID, GATEWAY_FC_READ_HOLDING, 0, GATEWAY_MAX_READ + 1);
+    Serve(&request);
+    ASSERT_EQUAL(request.response[1], GATEWAY_EX_ILLEGAL_ADDRESS, "Too many");
+
+    Read(&request, INVERTER_1_ID, 0x01, 0, 1);
+    Serve(&request);
+    ASSERT_EQUAL(request.response[1], GATEWAY_EX_ILLEGAL_FUNCTION, "No coils");
+}
+
+static void test_gateway_Coalesce()
+{
+    pthread_t threads[TEST_GATEWAY_READERS];
+    struct TestRequest requests[TEST_GATEWAY_READERS];
+    struct GatewayFetch fetch;
+    uint16_t values[GATEWAY_MAX_READ];
+
+    gateway_Initialise(&gateway, GATEWAY_MAX_AGE_MS, NULL, Wake);
+    lWakes = 0;
+
+    //Overlapping misses on the slave's holding registers, which the server never polls.
+    for(int i = 0; i < TEST_GATEWAY_READERS; i++)
+    {
+        Read(&requests[i], INVERTER_1_ID + 1, GATEWAY_FC_READ_HOLDING, 10 + i * 5, 10);
+        pthread_create(&threads[i], NULL, Requester, &requests[i]);
+    }
+
+    WaitFor(TEST_GATEWAY_READERS, 0);
+    ASSERT_EQUAL(lWakes, TEST_GATEWAY_READERS, "MODBUS thread woken");
+    ASSERT_EQUAL(gateway_TakeFetch(&gateway, &fetch), true, "A fetch");
+    ASSERT_EQUAL(fetch.cUnit, 1, "For the slave");
+    ASSERT_EQUAL(fetch.bHolding, true, "Holding registers");
+    ASSERT_EQUAL(fetch.nAddress, 10, "From the lowest");
+    ASSERT_EQUAL(fetch.nCount, 20, "To the highest");
+    ASSERT_EQUAL(gateway_TakeFetch(&gateway, &fetch), false, "Only the one");
+
+    for(int i = 0; i < fetch.nCount; i++)
+        values[i] = fetch.nAddress + i;
+
+    gateway_FetchDone(&gateway, &fetch, values, NowMs());
+
+    for(int i = 0; i < TEST_GATEWAY_READERS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        ASSERT_EQUAL(requests[i].nResponse, 22, "Reader %d answered", i);
+        ASSERT_EQUAL((requests[i].response[2] << 8) | requests[i].response[3], 10 + i * 5, "Its own registers");
+    }
+
+    ASSERT_EQUAL(gateway.lFetches, 1, "One serial transaction");
+    ASSERT_EQUAL(gateway.lCoalesced, TEST_GATEWAY_READERS - 1, "The rest rode along");
+
+    //Now cached.
+    struct TestRequest again;
+    Read(&again, INVERTER_1_ID + 1, GATEWAY_FC_READ_HOLDING, 12, 5);
+    ASSERT_EQUAL(Serve(&again), 12, "Served");
+    ASSERT_EQUAL(gateway.lHits, 1, "From the cache");
+}
+
+static void test_gateway_Failures()
+{
+    pthread_t thread;
+    struct TestRequest request;
+    struct GatewayFetch fetch;
+    uint16_t regs[GW_HREG_COUNT] = { 0 };
+
+    gateway_Initialise(&gateway, 1000, NULL, Wake);
+
+    //Too old.
+    gateway_Update(&gateway, 0, true, 0, GW_HREG_COUNT, regs, NowMs() - 2000);
+    Read(&request, INVERTER_1_ID, GATEWAY_FC_READ_HOLDING, 0, 1);
+    pthread_create(&thread, NULL, Requester, &request);
+
+    WaitFor(1, 0);
+    ASSERT_EQUAL(gateway_TakeFetch(&gateway, &fetch), true, "Stale, so fetched");
+    gateway_FetchDone(&gateway, &fetch, NULL, NowMs());
+    pthread_join(thread, NULL);
+
+    ASSERT_EQUAL(request.nResponse, 2, "Failed read");
+    ASSERT_EQUAL(request.response[1], GATEWAY_EX_TARGET_FAILED, "Passed on");
+    ASSERT_EQUAL(gateway.lFailed, 1, "Counted");
+}
+
+static void test_gateway_Writes()
+{
+    pthread_t thread;
+    struct TestRequest request;
+    struct QueuedCommand command;
+
+    //Refused outright unless routed to the control layer.
+    gateway_Initialise(&gateway, GATEWAY_MAX_AGE_MS, NULL, Wake);
+    Write(&request, INVERTER_1_ID, GW_HREG_CFG_MODE, GW_CFG_MODE_GRID);
+    Serve(&request);
+    ASSERT_EQUAL(request.response[1], GATEWAY_EX_ILLEGAL_FUNCTION, "Read only");
+
+    cmdqueue_Initialise(&queue);
+    gateway_Initialise(&gateway, GATEWAY_MAX_AGE_MS, &queue, Wake);
+
+    Write(&request, INVERTER_1_ID, GW_HREG_CFG_MODE, GW_CFG_MODE_GRID);
+    pthread_create(&thread, NULL, Requester, &request);
+    WaitFor(0, 1);
+
+    ASSERT_EQUAL(cmdqueue_Pop(&queue, &command), true, "Queued");
+    ASSERT_EQUAL(command.nCommandID, COMMAND_REQUEST_GRID, "As a grid request");
+    ASSERT_EQUAL(command.nOrigin, CMDQUEUE_ORIGIN_GATEWAY, "From the gateway");
+
+    gateway_CommandResult(&gateway, command.lCommandId, COMMAND_RESULT_DONE);
+    pthread_join(thread, NULL);
+    ASSERT_EQUAL(request.nResponse, 5, "Echoed");
+    ASSERT_EQUAL(memcmp(request.response, request.request, 5), 0, "As sent");
+
+    Write(&request, GATEWAY_UNIT_SELF, GW_HREG_MAX_UTIL_AMPS, 30);
+    pthread_create(&thread, NULL, Requester, &request);
+    WaitFor(0, 2);
+
+    cmdqueue_Pop(&queue, &command);
+    ASSERT_EQUAL(command.nCommandID, COMMAND_CHARGE_AMPS, "Amps");
+    ASSERT_EQUAL(command.nParam, 30, "As written");
+
+    gateway_CommandResult(&gateway, command.lCommandId, COMMAND_RESULT_REFUSED);
+    pthread_join(thread, NULL);
+    ASSERT_EQUAL(request.response[1], GATEWAY_EX_DEVICE_FAILURE, "Refused");
+
+    Write(&request, INVERTER_1_ID, GW_HREG_CFG_MODE, 1);
+    Serve(&request);
+    ASSERT_EQUAL(request.response[1], GATEWAY_EX_ILLEGAL_VALUE, "No such mode");
+
+    Write(&request, INVERTER_1_ID, GW_HREG_UTIL_START_HOUR, 1);
+    Serve(&request);
+    ASSERT_EQUAL(request.response[1], GATEWAY_EX_ILLEGAL_ADDRESS, "Not a setting the control layer has");
+
+    Write(&request, INVERTER_1_ID + 1, GW_HREG_CFG_MODE, GW_CFG_MODE_GRID);
+    Serve(&request);
+    ASSERT_EQUAL(request.response[1], GATEWAY_EX_ILLEGAL_ADDRESS, "Master only");
+    ASSERT_EQUAL(cmdqueue_Pop(&queue, &command), false, "Nothing else queued");
+}
+
+void test_gateway()
+{
+    PRINT_DEBUG("---=== Gateway tests ===---\n");
+
+    test_gateway_Hits();
+    test_gateway_Coalesce();
+    test_gateway_Failures();
+    test_gateway_Writes();
+
+    PRINT_DEBUG("---------------------------\n\n");
+}
@@ -0,0 +1,7 @@
+
+#ifndef TEST_GATEWAY_H
+#define TEST_GATEWAY_H
+
+void test_gateway();
+
+#endif
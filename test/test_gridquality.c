@@ -0,0 +1,107 @@
+
+#include "test.h"
+#include "test_gridquality.h"
+#include "gridquality.h"
+
+#define TEST_VOLTS 2400
+#define TEST_FREQ  5000
+
+static void test_gridquality_Outage()
+{
+    struct GridQuality quality;
+    int64_t llNowMs = 0;
+    
+    gridquality_Initialise(&quality);
+    
+    ASSERT_EQUAL(gridquality_Sample(&quality, TEST_VOLTS, TEST_FREQ, llNowMs), GRIDQUALITY_NONE, "Healthy grid reports nothing");
+    ASSERT_EQUAL(gridquality_Unstable(&quality, llNowMs), false, "Healthy grid isn't unstable");
+    
+    //Detected on the very first bad sample.
+    llNowMs += 100;
+    ASSERT_EQUAL(gridquality_Sample(&quality, 0, 0, llNowMs), GRIDQUALITY_OUTAGE, "Outage on first zero sample");
+    ASSERT_EQUAL(quality.lOutages, 1, "One outage, = %u", quality.lOutages);
+    ASSERT_EQUAL(gridquality_Unstable(&quality, llNowMs), true, "Outage is unstable");
+    
+    llNowMs += 100;
+    ASSERT_EQUAL(gridquality_Sample(&quality, 0, 0, llNowMs), GRIDQUALITY_NONE, "Outage only reported once");
+    
+    //Flickers back, then drops again. Not restored.
+    for(int i = 0; i < GRID_RESTORE_SAMPLES - 1; i++)
+    {
+        llNowMs += 100;
+        ASSERT_EQUAL(gridquality_Sample(&quality, TEST_VOLTS, TEST_FREQ, llNowMs), GRIDQUALITY_NONE, "Not restored yet");
+    }
+    
+    llNowMs += 100;
+    gridquality_Sample(&quality, 500, 0, llNowMs);
+    
+    for(int i = 0; i < GRID_RESTORE_SAMPLES - 1; i++)
+    {
+        llNowMs += 100;
+        ASSERT_EQUAL(gridquality_Sample(&quality, TEST_VOLTS, TEST_FREQ, llNowMs), GRIDQUALITY_NONE, "Flicker restarted the count");
+    }
+    
+    llNowMs += 100;
+    ASSERT_EQUAL(gridquality_Sample(&quality, TEST_VOLTS, TEST_FREQ, llNowMs), GRIDQUALITY_RESTORED, "Restored after enough healthy samples");
+    ASSERT_EQUAL(quality.llOutageMs, llNowMs - 100, "Outage duration, = %lld", (long long)quality.llOutageMs);
+    ASSERT_EQUAL(quality.lOutages, 1, "Still one outage, = %u", quality.lOutages);
+    
+    //Stays in fast sampling for a while after.
+    ASSERT_EQUAL(gridquality_Unstable(&quality, llNowMs + 1000), true, "Unstable just after the outage");
+    ASSERT_EQUAL(gridquality_Unstable(&quality, llNowMs + GRID_FAST_HOLD_S * 1000), false, "Settled after the hold");
+}
+
+static void test_gridquality_Histograms()
+{
+    struct GridQuality quality;
+    int64_t llNowMs = 0;
+    
+    gridquality_Initialise(&quality);
+    
+    //A shallow sag, dipping just under the limit.
+    gridquality_Sample(&quality, GRID_SAG_VOLTS - 10, TEST_FREQ, llNowMs += 100);
+    gridquality_Sample(&quality, GRID_SAG_VOLTS - 20, TEST_FREQ, llNowMs += 100);
+    ASSERT_EQUAL(gridquality_Unstable(&quality, llNowMs), true, "Unstable during a sag");
+    ASSERT_EQUAL(quality.lSags[0], 0, "Sag not counted until it ends, = %u", quality.lSags[0]);
+    gridquality_Sample(&quality, TEST_VOLTS, TEST_FREQ, llNowMs += 100);
+    ASSERT_EQUAL(quality.lSags[0], 1, "Shallow sag in the first bin, = %u", quality.lSags[0]);
+    
+    //A deep sag, binned by its worst sample.
+    gridquality_Sample(&quality, GRID_SAG_VOLTS - 10, TEST_FREQ, llNowMs += 100);
+    gridquality_Sample(&quality, GRID_SAG_VOLTS - GRIDQUALITY_VOLTS_PER_BIN * 2 - 1, TEST_FREQ, llNowMs += 100);
+    gridquality_Sample(&quality, GRID_SAG_VOLTS - 10, TEST_FREQ, llNowMs += 100);
+    gridquality_Sample(&quality, TEST_VOLTS, TEST_FREQ, llNowMs += 100);
+    ASSERT_EQUAL(quality.lSags[2], 1, "Deep sag binned by its worst, = %u", quality.lSags[2]);
+    
+    //Way off the scale goes in the last bin.
+    gridquality_Sample(&quality, GRID_SWELL_VOLTS + 2000, TEST_FREQ, llNowMs += 100);
+    gridquality_Sample(&quality, TEST_VOLTS, TEST_FREQ, llNowMs += 100);
+    ASSERT_EQUAL(quality.lSwells[GRIDQUALITY_BINS - 1], 1, "Huge swell in the last bin, = %u", quality.lSwells[GRIDQUALITY_BINS - 1]);
+    
+    //Frequency either side of nominal.
+    gridquality_Sample(&quality, TEST_VOLTS, GRID_NOMINAL_FREQ + GRID_FREQ_TOLERANCE + 5, llNowMs += 100);
+    gridquality_Sample(&quality, TEST_VOLTS, TEST_FREQ, llNowMs += 100);
+    gridquality_Sample(&quality, TEST_VOLTS, GRID_NOMINAL_FREQ - GRID_FREQ_TOLERANCE - GRIDQUALITY_FREQ_PER_BIN - 5, llNowMs += 100);
+    gridquality_Sample(&quality, TEST_VOLTS, TEST_FREQ, llNowMs += 100);
+    ASSERT_EQUAL(quality.lFreqExcursions[0], 1, "High frequency excursion, = %u", quality.lFreqExcursions[0]);
+    ASSERT_EQUAL(quality.lFreqExcursions[1], 1, "Low frequency excursion, = %u", quality.lFreqExcursions[1]);
+    
+    //A sag that becomes an outage is only an outage.
+    gridquality_Sample(&quality, GRID_SAG_VOLTS - 10, TEST_FREQ, llNowMs += 100);
+    gridquality_Sample(&quality, 0, 0, llNowMs += 100);
+    for(int i = 0; i < GRID_RESTORE_SAMPLES; i++)
+        gridquality_Sample(&quality, TEST_VOLTS, TEST_FREQ, llNowMs += 100);
+    ASSERT_EQUAL(quality.lSags[0], 1, "Sag into outage not counted as a sag, = %u", quality.lSags[0]);
+    ASSERT_EQUAL(quality.lFreqExcursions[GRIDQUALITY_BINS - 1], 0, "Outage frequency not counted, = %u", quality.lFreqExcursions[GRIDQUALITY_BINS - 1]);
+    ASSERT_EQUAL(quality.lSamples, 18, "Samples counted, = %u", quality.lSamples);
+}
+
+void test_gridquality()
+{
+    PRINT_DEBUG("---=== Grid quality tests ===---\n");
+    
+    test_gridquality_Outage();
+    test_gridquality_Histograms();
+    
+    PRINT_DEBUG("--------------------------------\n\n");
+}
@@ -0,0 +1,7 @@
+
+#ifndef TEST_GRIDQUALITY_H
+#define TEST_GRIDQUALITY_H
+
+void test_gridquality();
+
+#endif
@@ -0,0 +1,56 @@
+
+#include <string.h>
+#include "test.h"
+#include "test_history.h"
+#include "history.h"
+
+static void test_history_RoundTrip()
+{
+    struct HistoryRecord record;
+    struct HistoryRecord parsed;
+    char line[HISTORY_LINE_MAX];
+    
+    memset(&record, 0x00, sizeof(record));
+    record.slTime = 1790000000;
+    record.nSystemState = SYSTEM_STATE_OFF_PEAK;
+    record.nBatterySoc = 42;
+    record.nBatteryVolts = 5210;
+    record.nGridVolts = 2398;
+    record.nGridFreq = 4999;
+    record.nAcchgegyToday = 65;
+    
+    for(int i = 0; i < INVERTER_COUNT; i++)
+    {
+        record.nOutputWatts[i] = 12345 + i;
+        record.nLoadPercent[i] = 250 + i;
+        record.nBattchgAmps[i] = 65535 - i;
+    }
+    
+    int lLength = history_Format(&record, line, sizeof(line));
+    ASSERT_EQUAL(lLength, (int)strlen(line), "Length returned, = %d", lLength);
+    ASSERT_EQUAL(line[lLength - 1], '\n', "One line");
+    ASSERT_EQUAL(history_Parse(line, &parsed), true, "Parsed");
+    ASSERT_EQUAL(memcmp(&record, &parsed, sizeof(record)), 0, "Same record back");
+    
+    //Too small.
+    ASSERT_EQUAL(history_Format(&record, line, 20), 0, "Doesn't fit");
+}
+
+static void test_history_Junk()
+{
+    struct HistoryRecord parsed;
+    
+    ASSERT_EQUAL(history_Parse(HISTORY_HEADER, &parsed), false, "Header skipped");
+    ASSERT_EQUAL(history_Parse("", &parsed), false, "Empty line skipped");
+    ASSERT_EQUAL(history_Parse("1790000000,0,50,5200", &parsed), false, "Truncated line skipped");
+}
+
+void test_history()
+{
+    PRINT_DEBUG("---=== History tests ===---\n");
+    
+    test_history_RoundTrip();
+    test_history_Junk();
+    
+    PRINT_DEBUG("---------------------------\n\n");
+}
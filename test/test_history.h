@@ -0,0 +1,7 @@
+
+#ifndef TEST_HISTORY_H
+#define TEST_HISTORY_H
+
+void test_history();
+
+#endif
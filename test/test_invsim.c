@@ -0,0 +1,165 @@
+
+#include <string.h>
+#include "test.h"
+#include "test_invsim.h"
+#include "invsim.h"
+#include "clocksync.h"
+
+#define TEST_INVSIM_NOW 1790000000
+
+static struct InvSim sim;
+static uint8_t response[INVSIM_PDU_MAX];
+
+static uint16_t WriteSingle(uint8_t cSlave, uint16_t nRegister, uint16_t nValue)
+{
+    uint8_t request[5] = { INVSIM_FC_WRITE_SINGLE, nRegister >> 8, nRegister, nValue >> 8, nValue };
+    return invsim_Request(&sim, cSlave, request, sizeof(request), response);
+}
+
+static uint16_t Read(uint8_t cSlave, uint8_t cFunction, uint16_t nAddress, uint16_t nCount)
+{
+    uint8_t request[5] = { cFunction, nAddress >> 8, nAddress, nCount >> 8, nCount };
+    return invsim_Request(&sim, cSlave, request, sizeof(request), response);
+}
+
+static uint16_t ResponseWord(int lIndex)
+{
+    return (response[2 + lIndex * 2] << 8) | response[3 + lIndex * 2];
+}
+
+static void test_invsim_Read()
+{
+    invsim_Initialise(&sim, 2, 50, 1000, TEST_INVSIM_NOW, 0);
+
+    ASSERT_EQUAL(Read(INVERTER_1_ID, INVSIM_FC_READ_INPUT, 0, 4), 10, "Four registers read");
+    ASSERT_EQUAL(response[1], 8, "Byte count");
+    ASSERT_EQUAL(ResponseWord(STATUS), DISCHARGE, "On batteries");
+    ASSERT_EQUAL(Read(INVERTER_1_ID + 1, INVSIM_FC_READ_INPUT, BATTERY_SOC, 1), 4, "Slave answers");
+    ASSERT_EQUAL(ResponseWord(0), 50, "Shared battery SoC");
+    ASSERT_EQUAL(Read(INVERTER_1_ID + 2, INVSIM_FC_READ_INPUT, 0, 1), 0, "No such slave, no reply");
+    ASSERT_EQUAL(Read(INVERTER_1_ID, INVSIM_FC_READ_HOLDING, GW_HREG_CFG_MODE, 1), 4, "Holding register read");
+    ASSERT_EQUAL(ResponseWord(0), GW_CFG_MODE_BATTS, "Batteries configured");
+}
+
+static void test_invsim_Exceptions()
+{
+    invsim_Initialise(&sim, 1, 50, 1000, TEST_INVSIM_NOW, 0);
+
+    ASSERT_EQUAL(Read(INVERTER_1_ID, INVSIM_FC_READ_INPUT, INPUT_REGISTER_COUNT, INPUT_REGISTER_COUNT), 2 + INPUT_REGISTER_COUNT * 2, "Past the documented map");
+    ASSERT_EQUAL(ResponseWord(0), 0, "Reads as zero");
+    ASSERT_EQUAL(Read(INVERTER_1_ID, INVSIM_FC_READ_INPUT, INVSIM_INPUT_SPACE - 1, 2), 2, "Off the end of the address space");
+    ASSERT_EQUAL(response[0], INVSIM_FC_READ_INPUT | 0x80, "Exception function");
+    ASSERT_EQUAL(response[1], INVSIM_EX_ILLEGAL_ADDRESS, "Illegal address");
+
+    ASSERT_EQUAL(WriteSingle(INVERTER_1_ID, GW_HREG_MAX_UTIL_AMPS, GW_CFG_UTIL_AMPS_MAX + 1), 2, "Too many amps");
+    ASSERT_EQUAL(response[1], INVSIM_EX_ILLEGAL_VALUE, "Illegal value");
+    ASSERT_EQUAL(sim.units[0].holdingRegs[GW_HREG_MAX_UTIL_AMPS], GW_CFG_UTIL_AMPS_MOD, "Not written");
+
+    uint8_t request[] = { 0x2B, 0x0E, 0x01, 0x00 };
+    ASSERT_EQUAL(invsim_Request(&sim, INVERTER_1_ID, request, sizeof(request), response), 2, "Unsupported function");
+    ASSERT_EQUAL(response[1], INVSIM_EX_ILLEGAL_FUNCTION, "Illegal function");
+    ASSERT_EQUAL(sim.lExceptions, 3, "Counted");
+}
+
+static void test_invsim_Transfer()
+{
+    invsim_Initialise(&sim, 1, 50, 1000, TEST_INVSIM_NOW, 0);
+
+    //Charging any time, so the result doesn't depend on the local hour.
+    WriteSingle(INVERTER_1_ID, GW_HREG_UTIL_END_HOUR, GW_CFG_UTIL_TIME_ANY_TIME);
+    ASSERT_EQUAL(WriteSingle(INVERTER_1_ID, GW_HREG_CFG_MODE, GW_CFG_MODE_GRID), 5, "Write echoed");
+    ASSERT_EQUAL(response[4], GW_CFG_MODE_GRID, "Value echoed");
+
+    invsim_Advance(&sim, TEST_INVSIM_NOW, 100);
+    ASSERT_EQUAL(sim.units[0].inputRegs[STATUS], DISCHARGE, "Still on batteries while transferring");
+
+    invsim_Advance(&sim, TEST_INVSIM_NOW + 2, 100 + INVSIM_TRANSFER_MS);
+    ASSERT_EQUAL(sim.units[0].inputRegs[STATUS], AC_CHG_BYP, "Bypassed and charging");
+    ASSERT_EQUAL(sim.units[0].inputRegs[BATTCHG_AMPS], GW_CFG_UTIL_AMPS_MOD * 10, "At the utility limit");
+
+    float fltSoc = invsim_Soc(&sim);
+    invsim_Advance(&sim, TEST_INVSIM_NOW + 62, 100 + INVSIM_TRANSFER_MS + 60000);
+    ASSERT_EQUAL(invsim_Soc(&sim) > fltSoc, true, "Charged, %.2f%% to %.2f%%", fltSoc, invsim_Soc(&sim));
+
+    //Grid gone. Straight back to batteries.
+    invsim_SetGrid(&sim, false);
+    invsim_Advance(&sim, TEST_INVSIM_NOW + 63, 100 + INVSIM_TRANSFER_MS + 61000);
+    ASSERT_EQUAL(sim.units[0].inputRegs[STATUS], DISCHARGE, "Batteries during an outage");
+    ASSERT_EQUAL(sim.units[0].inputRegs[GRID_VOLTS], 0, "No grid");
+}
+
+static void test_invsim_Overload()
+{
+    invsim_Initialise(&sim, 2, 50, 1000, TEST_INVSIM_NOW, 0);
+
+    //Over both units' ratings, on batteries.
+    invsim_Surge(&sim, INVSIM_RATED_WATTS * 2 + 1000, INVSIM_OVERLOAD_MS * 2);
+    invsim_Advance(&sim, TEST_INVSIM_NOW, 100);
+    ASSERT_EQUAL(sim.units[0].inputRegs[STATUS], DISCHARGE, "Carrying it for now");
+    ASSERT_EQUAL(sim.units[0].inputRegs[LOAD_PERCENT] > 1000, true, "Overloaded, %d", sim.units[0].inputRegs[LOAD_PERCENT]);
+
+    invsim_Advance(&sim, TEST_INVSIM_NOW + 3, 100 + INVSIM_OVERLOAD_MS);
+    ASSERT_EQUAL(sim.units[0].inputRegs[STATUS], FAULT, "Faulted");
+    ASSERT_EQUAL(sim.units[1].inputRegs[STATUS], FAULT, "Both");
+    ASSERT_EQUAL(sim.units[0].inputRegs[FAULTVALUE], INVSIM_FAULT_BUS_HIGH, "Bus voltage fault");
+
+    //Cleared by going to the grid.
+    WriteSingle(0, GW_HREG_CFG_MODE, GW_CFG_MODE_GRID);
+    invsim_Advance(&sim, TEST_INVSIM_NOW + 6, 200 + INVSIM_OVERLOAD_MS + INVSIM_TRANSFER_MS);
+    invsim_Advance(&sim, TEST_INVSIM_NOW + 6, 300 + INVSIM_OVERLOAD_MS + INVSIM_TRANSFER_MS * 2);
+    ASSERT_EQUAL(sim.units[0].inputRegs[FAULTVALUE], 0, "Fault cleared");
+    ASSERT_EQUAL(sim.units[0].inputRegs[STATUS] != FAULT, true, "Running");
+}
+
+static void test_invsim_Broadcast()
+{
+    invsim_Initialise(&sim, 3, 50, 1000, TEST_INVSIM_NOW, 0);
+
+    ASSERT_EQUAL(WriteSingle(0, GW_HREG_MAX_UTIL_AMPS, 25), 0, "Broadcasts aren't answered");
+
+    for(uint8_t i = 0; i < sim.cUnits; i++)
+        ASSERT_EQUAL(sim.units[i].holdingRegs[GW_HREG_MAX_UTIL_AMPS], 25, "Unit %d written", i);
+}
+
+static void test_invsim_WriteAndRead()
+{
+    invsim_Initialise(&sim, 1, 50, 1000, TEST_INVSIM_NOW, 0);
+
+    uint8_t request[] = { INVSIM_FC_WRITE_AND_READ, 0, GW_HREG_UTIL_START_HOUR, 0, 2,
+                          0, GW_HREG_UTIL_START_HOUR, 0, 2, 4, 0, 23, 0, 5 };
+
+    ASSERT_EQUAL(invsim_Request(&sim, INVERTER_1_ID, request, sizeof(request), response), 6, "Two registers back");
+    ASSERT_EQUAL(ResponseWord(0), 23, "Start hour written and read");
+    ASSERT_EQUAL(ResponseWord(1), 5, "End hour written and read");
+
+    //Setting the clock an hour ahead.
+    uint16_t timeRegs[6];
+    uint8_t clock[6 + 12] = { INVSIM_FC_WRITE_MULTIPLE, 0, GW_HREG_TIME_Y, 0, 6, 12 };
+    clocksync_ToRegisters(TEST_INVSIM_NOW + 3600, true, timeRegs);
+
+    for(int i = 0; i < 6; i++)
+    {
+        clock[6 + i * 2] = timeRegs[i] >> 8;
+        clock[7 + i * 2] = (uint8_t)timeRegs[i];
+    }
+
+    ASSERT_EQUAL(invsim_Request(&sim, INVERTER_1_ID, clock, sizeof(clock), response), 5, "Clock written");
+    ASSERT_EQUAL(sim.slClockOffset, 3600, "An hour ahead, = %d", sim.slClockOffset);
+
+    invsim_Advance(&sim, TEST_INVSIM_NOW + 10, 10000);
+    ASSERT_EQUAL(clocksync_FromRegisters(&sim.units[0].holdingRegs[GW_HREG_TIME_Y]), TEST_INVSIM_NOW + 3610, "Clock keeps time");
+}
+
+void test_invsim()
+{
+    PRINT_DEBUG("---=== Simulator tests ===---\n");
+
+    test_invsim_Read();
+    test_invsim_Exceptions();
+    test_invsim_Transfer();
+    test_invsim_Overload();
+    test_invsim_Broadcast();
+    test_invsim_WriteAndRead();
+
+    PRINT_DEBUG("---------------------------\n\n");
+}
@@ -0,0 +1,7 @@
+
+#ifndef TEST_INVSIM_H
+#define TEST_INVSIM_H
+
+void test_invsim();
+
+#endif
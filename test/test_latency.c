@@ -0,0 +1,55 @@
+
+#include "test.h"
+#include "test_latency.h"
+#include "latency.h"
+
+static void test_latency_Buckets()
+{
+    ASSERT_EQUAL(latency_Bucket(0), 0, "Zero");
+    ASSERT_EQUAL(latency_Bucket(1), 0, "Under 2us");
+    ASSERT_EQUAL(latency_Bucket(2), 1, "2us");
+    ASSERT_EQUAL(latency_Bucket(3), 1, "3us");
+    ASSERT_EQUAL(latency_Bucket(1000), 9, "1ms");
+    ASSERT_EQUAL(latency_Bucket(1024), 10, "1024us");
+    ASSERT_EQUAL(latency_Bucket(0xFFFFFFFF), LATENCY_BUCKETS - 1, "Everything beyond in the last");
+}
+
+static void test_latency_Percentiles()
+{
+    struct LatencyHistogram histogram;
+    latency_Initialise(&histogram);
+
+    ASSERT_EQUAL(latency_Percentile(&histogram, 50.0f), 0, "Nothing recorded");
+    ASSERT_EQUAL(latency_MeanUs(&histogram), 0, "No mean");
+
+    //98 quick wakeups, one slow and one very slow.
+    for(int i = 0; i < 98; i++)
+        latency_Record(&histogram, 10);
+
+    latency_Record(&histogram, 300);
+    latency_Record(&histogram, 5000000);
+
+    ASSERT_EQUAL(histogram.lCount, 100, "Counted");
+    ASSERT_EQUAL(histogram.lBuckets[3], 98, "Quick ones together");
+    ASSERT_EQUAL(histogram.lMaxUs, 5000000, "Max kept exactly");
+    ASSERT_EQUAL(latency_MeanUs(&histogram), (98 * 10 + 300 + 5000000) / 100, "Mean");
+    ASSERT_EQUAL(latency_Percentile(&histogram, 50.0f), 15, "Median's bucket top");
+    ASSERT_EQUAL(latency_Percentile(&histogram, 98.0f), 15, "98th still quick");
+    ASSERT_EQUAL(latency_Percentile(&histogram, 99.0f), 511, "99th the slow one");
+    ASSERT_EQUAL(latency_Percentile(&histogram, 100.0f), 5000000, "Past the last bucket is the max");
+    ASSERT_EQUAL(latency_Percentile(&histogram, 0.0f), 15, "0th is the first sample");
+
+    latency_Initialise(&histogram);
+    latency_Record(&histogram, 40);
+    ASSERT_EQUAL(latency_Percentile(&histogram, 99.0f), 40, "Never past the max");
+}
+
+void test_latency()
+{
+    PRINT_DEBUG("---=== Latency tests ===---\n");
+
+    test_latency_Buckets();
+    test_latency_Percentiles();
+
+    PRINT_DEBUG("---------------------------\n\n");
+}
@@ -0,0 +1,7 @@
+
+#ifndef TEST_LATENCY_H
+#define TEST_LATENCY_H
+
+void test_latency();
+
+#endif
@@ -0,0 +1,147 @@
+
+#include "test.h"
+#include "test_overload.h"
+#include "overload.h"
+#include <string.h>
+#include <stdbool.h>
+
+#define TEST_SAMPLE_MS 2000
+
+//Feed the same load (W, per inverter) for lSeconds, counting the actions raised.
+static void FeedLoad(struct OverloadEngine* pEngine,
+                     int64_t* pllNowMs,
+                     uint16_t nWatts1,
+                     uint16_t nWatts2,
+                     int32_t lSeconds,
+                     uint32_t* plTrips,
+                     uint32_t* plReleases)
+{
+    struct OverloadSample samples[2];
+    
+    memset(samples, 0x00, sizeof(samples));
+    samples[0].nOutputWatts = nWatts1 * 10;
+    samples[1].nOutputWatts = nWatts2 * 10;
+    
+    for(int64_t llEnd = *pllNowMs + (int64_t)lSeconds * 1000; *pllNowMs < llEnd; *pllNowMs += TEST_SAMPLE_MS)
+    {
+        switch(overload_Evaluate(pEngine, samples, 2, *pllNowMs))
+        {
+            case OVERLOAD_TRIP: (*plTrips)++; break;
+            case OVERLOAD_RELEASE: (*plReleases)++; break;
+        }
+    }
+}
+
+static void test_overload_TripAndRelease()
+{
+    struct OverloadConfig config;
+    struct OverloadEngine engine;
+    int64_t llNowMs = 0;
+    uint32_t lTrips = 0;
+    uint32_t lReleases = 0;
+    
+    overload_DefaultConfig(&config);
+    overload_Initialise(&engine, &config);
+    
+    //Normal load. Nothing happens.
+    FeedLoad(&engine, &llNowMs, 2000, 2000, 600, &lTrips, &lReleases);
+    ASSERT_EQUAL(lTrips, 0, "No trip under normal load, = %u", lTrips);
+    
+    //One inverter over the per-inverter limit trips straight away.
+    FeedLoad(&engine, &llNowMs, OVERLOAD_TRIP_WATTS, 1000, 10, &lTrips, &lReleases);
+    ASSERT_EQUAL(lTrips, 1, "Tripped once on one inverter overloading, = %u", lTrips);
+    ASSERT_EQUAL(engine.bTripped, true, "Engine is tripped");
+    
+    //Load drops between the thresholds. Hysteresis keeps holding, well past the hold time.
+    FeedLoad(&engine, &llNowMs, OVERLOAD_RELEASE_WATTS + 100, 1000, OVERLOAD_HOLD_S * 2, &lTrips, &lReleases);
+    ASSERT_EQUAL(lReleases, 0, "No release while load is between thresholds, = %u", lReleases);
+    ASSERT_EQUAL(lTrips, 1, "No repeated trips while held, = %u", lTrips);
+    ASSERT_EQUAL(engine.lExtensions, 0, "Staying high isn't an extension, = %u", engine.lExtensions);
+    
+    //Dips below release and comes back up. One extension, however many high samples follow.
+    FeedLoad(&engine, &llNowMs, 1000, 1000, 60, &lTrips, &lReleases);
+    FeedLoad(&engine, &llNowMs, OVERLOAD_RELEASE_WATTS + 100, 1000, 60, &lTrips, &lReleases);
+    ASSERT_EQUAL(engine.lExtensions, 1, "Coming back up is one extension, = %u", engine.lExtensions);
+    
+    //Load drops below release. Held for the hold time from the last high sample, then released.
+    FeedLoad(&engine, &llNowMs, 1000, 1000, OVERLOAD_HOLD_S - 10, &lTrips, &lReleases);
+    ASSERT_EQUAL(lReleases, 0, "Not released before the hold time, = %u", lReleases);
+    
+    FeedLoad(&engine, &llNowMs, 1000, 1000, 20, &lTrips, &lReleases);
+    ASSERT_EQUAL(lReleases, 1, "Released after the hold time, = %u", lReleases);
+    ASSERT_EQUAL(engine.bTripped, false, "Engine is no longer tripped");
+}
+
+static void test_overload_Total()
+{
+    struct OverloadConfig config;
+    struct OverloadEngine engine;
+    int64_t llNowMs = 0;
+    uint32_t lTrips = 0;
+    uint32_t lReleases = 0;
+    
+    overload_DefaultConfig(&config);
+    config.lTripTotalWatts = 8000;
+    config.lReleaseTotalWatts = 6000;
+    overload_Initialise(&engine, &config);
+    
+    //Neither inverter is over its own limit, but together they're over the total.
+    FeedLoad(&engine, &llNowMs, 4200, 4200, 10, &lTrips, &lReleases);
+    ASSERT_EQUAL(lTrips, 1, "Tripped on total load, = %u", lTrips);
+}
+
+static void test_overload_Percent()
+{
+    struct OverloadConfig config;
+    struct OverloadEngine engine;
+    struct OverloadSample samples[2];
+    
+    overload_DefaultConfig(&config);
+    overload_Initialise(&engine, &config);
+    
+    //Low watts but high load percent (e.g. a poor power factor motor).
+    memset(samples, 0x00, sizeof(samples));
+    samples[1].nLoadPercent = OVERLOAD_TRIP_PERCENT * 10;
+    ASSERT_EQUAL(overload_Evaluate(&engine, samples, 2, 0), OVERLOAD_TRIP, "Tripped on load percent");
+}
+
+static void test_overload_Latency()
+{
+    struct OverloadConfig config;
+    struct OverloadEngine engine;
+    struct OverloadSample samples[2];
+    
+    overload_DefaultConfig(&config);
+    overload_Initialise(&engine, &config);
+    
+    memset(samples, 0x00, sizeof(samples));
+    samples[0].nOutputWatts = 50000;
+    overload_Evaluate(&engine, samples, 2, 10000);
+    overload_SwitchIssued(&engine, 10000);
+    overload_WriteCompleted(&engine, 10350);
+    ASSERT_EQUAL(engine.lLastLatencyMs, 350, "Trip-to-write latency recorded, = %u", engine.lLastLatencyMs);
+    
+    //A second completion without a new trip doesn't count.
+    overload_WriteCompleted(&engine, 20000);
+    ASSERT_EQUAL(engine.lMaxLatencyMs, 350, "Max latency unchanged by stray completions, = %u", engine.lMaxLatencyMs);
+    
+    //Reset lets a fresh trip happen straight away.
+    overload_Reset(&engine);
+    ASSERT_EQUAL(overload_Evaluate(&engine, samples, 2, 20000), OVERLOAD_TRIP, "Trips again after a reset");
+    
+    //A trip with no switch issued (e.g. off-peak) leaves the next write untimed.
+    overload_WriteCompleted(&engine, 30000);
+    ASSERT_EQUAL(engine.lLastLatencyMs, 350, "No latency without a switch, = %u", engine.lLastLatencyMs);
+}
+
+void test_overload()
+{
+    PRINT_DEBUG("---=== Overload tests ===---\n");
+    
+    test_overload_TripAndRelease();
+    test_overload_Total();
+    test_overload_Percent();
+    test_overload_Latency();
+    
+    PRINT_DEBUG("----------------------------\n\n");
+}
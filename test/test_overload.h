@@ -0,0 +1,7 @@
+
+#ifndef TEST_OVERLOAD_H
+#define TEST_OVERLOAD_H
+
+void test_overload();
+
+#endif
@@ -0,0 +1,141 @@
+
+#include "test.h"
+#include "test_planner.h"
+#include "planner.h"
+#include <string.h>
+#include <stdbool.h>
+
+static void test_planner_CalculateAmps()
+{
+    uint16_t nResult;
+    
+    //50% of 10.24kWh at 51.2V, 80% efficient, over 5.5h less the margin (5h). 25A total, 13A each.
+    nResult = planner_CalculateAmps(50, 5120, 330, 0.8f);
+    ASSERT_EQUAL(nResult, 13, "Half full over five hours -> 13A per inverter, = %d", nResult);
+    
+    //Better measured efficiency plans a lower current.
+    nResult = planner_CalculateAmps(50, 5120, 330, 1.0f);
+    ASSERT_EQUAL(nResult, 10, "Half full, perfectly efficient -> 10A per inverter, = %d", nResult);
+    
+    //Full. Trickle for balancing.
+    nResult = planner_CalculateAmps(100, 5120, 330, 0.8f);
+    ASSERT_EQUAL(nResult, CHARGE_MIN_AMPS, "Full -> minimum amps, = %d", nResult);
+    
+    //Empty with almost no time left. Capped.
+    nResult = planner_CalculateAmps(0, 5120, 5, 0.8f);
+    ASSERT_EQUAL(nResult, GW_CFG_UTIL_AMPS_MAX, "Empty at the last minute -> capped at max, = %d", nResult);
+    
+    //Nonsense voltage and efficiency fall back to nominal values rather than blowing up.
+    nResult = planner_CalculateAmps(50, 0, 330, 0.0f);
+    ASSERT_EQUAL(nResult >= CHARGE_MIN_AMPS && nResult <= GW_CFG_UTIL_AMPS_MAX,
+                 true,
+                 "Sensible value from nonsense voltage and efficiency: %d",
+                 nResult);
+    
+    //The sane voltage range follows the model's bank, not a 48V one.
+    uint16_t nFallback = planner_CalculateAmps(50, 0, 330, 0.8f);
+    nResult = planner_CalculateAmps(50, MODEL_BATTERY_VOLTS * 100, 330, 0.8f);
+    ASSERT_EQUAL(nResult != nFallback, true, "Nominal bank voltage used, = %d", nResult);
+    nResult = planner_CalculateAmps(50, MODEL_BATTERY_VOLTS * 70, 330, 0.8f);
+    ASSERT_EQUAL(nResult, nFallback, "30%% under nominal falls back, = %d", nResult);
+    nResult = planner_CalculateAmps(50, MODEL_BATTERY_VOLTS * 130, 330, 0.8f);
+    ASSERT_EQUAL(nResult, nFallback, "30%% over nominal falls back, = %d", nResult);
+    
+    //Planned amps never go up as the SoC rises.
+    bool bMonotonic = true;
+    
+    for(uint16_t nSoc = 1; nSoc <= 100; nSoc++)
+    {
+        if(planner_CalculateAmps(nSoc, 5120, 330, 0.8f) > planner_CalculateAmps(nSoc - 1, 5120, 330, 0.8f))
+            bMonotonic = false;
+    }
+    
+    ASSERT_EQUAL(bMonotonic, true, "Planned amps never rise with SoC");
+}
+
+static void test_planner_Update()
+{
+    struct ChargePlanner planner;
+    struct SystemStatus status;
+    uint16_t chargeAmps[INVERTER_COUNT];
+    uint16_t nResult;
+    bool bChanged;
+    
+    memset(&status, 0x00, sizeof(struct SystemStatus));
+    memset(chargeAmps, 0x00, sizeof(chargeAmps));
+    status.nBatterySoc = 50;
+    status.nBatteryVolts = 5120;
+    
+    nResult = planner_Start(&planner, &status, 1000, 330);
+    ASSERT_EQUAL(nResult, 13, "Plan at the start of off-peak, = %d", nResult);
+    
+    //Not re-planned until the interval has passed.
+    status.nBatterySoc = 60;
+    bChanged = planner_Update(&planner, &status, chargeAmps, 1000 + PLANNER_REPLAN_S - 1, 325);
+    ASSERT_EQUAL(bChanged, false, "No re-plan before the interval");
+    
+    bChanged = planner_Update(&planner, &status, chargeAmps, 1000 + PLANNER_REPLAN_S, 325);
+    ASSERT_EQUAL(bChanged, true, "Re-planned after the interval with a higher SoC");
+    ASSERT_EQUAL(planner.nAmps < nResult, true, "Higher SoC plans lower amps, = %d", planner.nAmps);
+    
+    //Deliver 1.28kWh (25A at 51.2V for an hour, across the inverters) while SoC goes up 10% (1.024kWh). 80% efficient.
+    //Uneven, so the master's 5A alone would badly under-count it.
+    planner_Start(&planner, &status, 0, 330);
+    status.nBattchgAmps = 50;
+    chargeAmps[0] = 50;
+    chargeAmps[INVERTER_COUNT - 1] += 200;
+    
+    for(int32_t t = 10; t <= 3600; t += 10)
+        planner_Update(&planner, &status, chargeAmps, t, 330);
+        
+    ASSERT_EQUAL(planner.fltDeliveredWh > 1270.0f && planner.fltDeliveredWh < 1290.0f,
+                 true,
+                 "Delivered energy integrated, = %dWh",
+                 (int)planner.fltDeliveredWh);
+                 
+    status.nBatterySoc = 70;
+    planner_Update(&planner, &status, chargeAmps, 3600 + PLANNER_REPLAN_S, 270);
+    ASSERT_EQUAL(planner.fltEfficiency > 0.79f && planner.fltEfficiency < 0.81f,
+                 true,
+                 "Measured 80%% efficiency, = %d%%",
+                 (int)(planner.fltEfficiency * 100.0f));
+    
+}
+
+static void test_planner_NoSoc()
+{
+    struct ChargePlanner planner;
+    struct SystemStatus status;
+    uint16_t nResult;
+    
+    //No SoC reported. The energy-based estimate is for the bank, so it's shared by the inverters.
+    memset(&status, 0x00, sizeof(struct SystemStatus));
+    nResult = planner_Start(&planner, &status, 0, 330);
+    ASSERT_EQUAL(nResult,
+                 (GW_CFG_UTIL_AMPS_MOD + INVERTER_COUNT - 1) / INVERTER_COUNT,
+                 "No SoC falls back to the default split between inverters, = %d",
+                 nResult);
+    
+    //4.8kWh used, no boost. 18A for the bank, 9A each.
+    status.nOffPeakChargeKwh = 50;
+    status.nAcchgegyToday = 50;
+    status.nBattuseToday = 48;
+    nResult = planner_Start(&planner, &status, 0, 330);
+    ASSERT_EQUAL(nResult, (18 + INVERTER_COUNT - 1) / INVERTER_COUNT, "No SoC, 18A for the bank, = %d per inverter", nResult);
+    
+    //Hardly anything used. Still the minimum on each inverter.
+    status.nBattuseToday = 1;
+    nResult = planner_Start(&planner, &status, 0, 330);
+    ASSERT_EQUAL(nResult, CHARGE_MIN_AMPS, "No SoC, little used -> minimum amps, = %d", nResult);
+}
+
+void test_planner()
+{
+    PRINT_DEBUG("---=== Planner tests ===---\n");
+    
+    test_planner_CalculateAmps();
+    test_planner_Update();
+    test_planner_NoSoc();
+    
+    PRINT_DEBUG("---------------------------\n\n");
+}
@@ -0,0 +1,7 @@
+
+#ifndef TEST_PLANNER_H
+#define TEST_PLANNER_H
+
+void test_planner();
+
+#endif
@@ -0,0 +1,78 @@
+
+#include <stdio.h>
+#include "test.h"
+#include "test_pollplan.h"
+#include "pollplan.h"
+
+static void test_pollplan_Critical()
+{
+    struct PollPlan plan;
+
+    pollplan_Build(&plan, 0);
+
+    ASSERT_EQUAL(plan.lFields, 0, "No fields asked for");
+    ASSERT_EQUAL(plan.cBlocks, 1, "Critical registers are close enough for one read");
+    ASSERT_EQUAL(plan.blocks[0].nAddress, STATUS, "From the status");
+    ASSERT_EQUAL(plan.blocks[0].nAddress + plan.blocks[0].nCount, BATTCHG_AMPS + 1, "To the charge amps");
+    ASSERT_EQUAL(plan.nRegisters, BATTCHG_AMPS + 1, "Registers");
+    ASSERT_EQUAL(pollplan_Reads(&plan, DTC), true, "Faults read");
+    ASSERT_EQUAL(pollplan_Reads(&plan, INV_FANSPEED), false, "Fan speed left out");
+    ASSERT_EQUAL(pollplan_Critical(INV_FANSPEED), false, "Fan speed isn't critical");
+    ASSERT_EQUAL(pollplan_Critical(GRID_VOLTS), true, "Grid volts are");
+}
+
+static void test_pollplan_Fields()
+{
+    struct PollPlan plan;
+
+    ASSERT_EQUAL(pollplan_FieldRegister(STATUS_FIELD_SOLAR_TODAY), EGY1GEN_TODAY_L, "Solar today");
+    ASSERT_EQUAL(pollplan_FieldRegister(STATUS_FIELD_INV_FANSPEED), INV_FANSPEED, "Fan speed");
+
+    pollplan_Build(&plan, STATUS_FIELD_BIT(STATUS_FIELD_INV_FANSPEED));
+
+    ASSERT_EQUAL(plan.cBlocks, 1, "Fan speed merges in");
+    ASSERT_EQUAL(plan.nRegisters, INV_FANSPEED + 1, "Read up to the fan speed");
+    ASSERT_EQUAL(pollplan_Reads(&plan, INV_FANSPEED), true, "Fan speed read");
+
+    pollplan_Build(&plan, STATUS_FIELD_ALL | 0x80000000);
+
+    ASSERT_EQUAL(plan.lFields, STATUS_FIELD_ALL, "Unknown fields dropped");
+
+    for(uint8_t i = 0; i < STATUS_FIELD_COUNT; i++)
+    {
+        ASSERT_EQUAL(pollplan_Reads(&plan, pollplan_FieldRegister(i)), true, "Field %u read", i);
+    }
+}
+
+static void test_pollplan_Bounds()
+{
+    struct PollPlan plan;
+
+    //Every block keeps within the map and a single read, and blocks never touch.
+    for(uint8_t i = 0; i < STATUS_FIELD_COUNT; i++)
+    {
+        pollplan_Build(&plan, STATUS_FIELD_BIT(i));
+
+        for(uint8_t j = 0; j < plan.cBlocks; j++)
+        {
+            ASSERT_EQUAL(plan.blocks[j].nAddress + plan.blocks[j].nCount <= INPUT_REGISTER_COUNT, true, "Field %u block %u in the map", i, j);
+            ASSERT_EQUAL(plan.blocks[j].nCount <= MODEL_MAX_READ, true, "Field %u block %u readable", i, j);
+
+            if(j > 0)
+            {
+                ASSERT_EQUAL(plan.blocks[j].nAddress > plan.blocks[j - 1].nAddress + plan.blocks[j - 1].nCount + POLLPLAN_MERGE_GAP, true, "Field %u block %u apart", i, j);
+            }
+        }
+    }
+}
+
+void test_pollplan()
+{
+    printf("---=== Poll plan tests ===---\n");
+
+    test_pollplan_Critical();
+    test_pollplan_Fields();
+    test_pollplan_Bounds();
+
+    printf("---------------------------\n\n");
+}
@@ -0,0 +1,7 @@
+
+#ifndef TEST_POLLPLAN_H
+#define TEST_POLLPLAN_H
+
+void test_pollplan();
+
+#endif
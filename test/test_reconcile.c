@@ -0,0 +1,157 @@
+
+#include "test.h"
+#include "test_reconcile.h"
+#include "reconcile.h"
+#include <string.h>
+#include <stdbool.h>
+
+static void SetHoldingRegs(uint16_t* pHoldingRegs, uint16_t nMode, uint16_t nEndHour, uint16_t nAmps)
+{
+    memset(pHoldingRegs, 0x00, GW_HREG_COUNT * sizeof(uint16_t));
+    pHoldingRegs[GW_HREG_CFG_MODE] = nMode;
+    pHoldingRegs[GW_HREG_UTIL_START_HOUR] = 0;
+    pHoldingRegs[GW_HREG_UTIL_END_HOUR] = nEndHour;
+    pHoldingRegs[GW_HREG_MAX_UTIL_AMPS] = nAmps;
+}
+
+static void test_reconcile_GetDesired()
+{
+    struct RegisterSetting desired[RECONCILE_MAX_SETTINGS];
+    uint8_t cCount;
+    
+    cCount = reconcile_GetDesired(SYSTEM_STATE_PEAK, 25, desired);
+    ASSERT_EQUAL(cCount, 2, "Peak cares about two registers, = %d", cCount);
+    ASSERT_EQUAL(desired[0].nValue, GW_CFG_MODE_BATTS, "Peak wants batts mode");
+    ASSERT_EQUAL(desired[1].nValue, GW_CFG_UTIL_TIME_OFFPEAK, "Peak wants charging times limited");
+    
+    cCount = reconcile_GetDesired(SYSTEM_STATE_OFF_PEAK, 25, desired);
+    ASSERT_EQUAL(cCount, 3, "Off-peak cares about three registers, = %d", cCount);
+    ASSERT_EQUAL(desired[2].nRegister, GW_HREG_MAX_UTIL_AMPS, "Off-peak sets util amps");
+    ASSERT_EQUAL(desired[2].nValue, 25, "Off-peak util amps come from the charge current, = %d", desired[2].nValue);
+    
+    cCount = reconcile_GetDesired(SYSTEM_STATE_NO_CHANGE, 25, desired);
+    ASSERT_EQUAL(cCount, 0, "Unknown state has no settings, = %d", cCount);
+    
+    //Every state's settings should be in ascending register order.
+    for(uint16_t nState = SYSTEM_STATE_PEAK; nState <= SYSTEM_STATE_BOOST; nState++)
+    {
+        bool bAscending = true;
+        cCount = reconcile_GetDesired(nState, 25, desired);
+        
+        for(uint8_t i = 1; i < cCount; i++)
+        {
+            if(desired[i].nRegister <= desired[i - 1].nRegister)
+                bAscending = false;
+        }
+        
+        ASSERT_EQUAL(bAscending, true, "State %d settings are in ascending register order", nState);
+    }
+}
+
+static void test_reconcile_Diff()
+{
+    struct RegisterSetting desired[RECONCILE_MAX_SETTINGS];
+    struct ReconcileWrite writes[RECONCILE_MAX_SETTINGS];
+    uint16_t holdingRegs[GW_HREG_COUNT];
+    uint8_t cDesired;
+    uint8_t cWrites;
+    
+    //Already as desired. No writes.
+    SetHoldingRegs(holdingRegs, GW_CFG_MODE_BATTS, GW_CFG_UTIL_TIME_OFFPEAK, 40);
+    cDesired = reconcile_GetDesired(SYSTEM_STATE_PEAK, 40, desired);
+    cWrites = reconcile_Diff(desired, cDesired, holdingRegs, writes);
+    ASSERT_EQUAL(cWrites, 0, "No writes when the inverter matches, = %d", cWrites);
+    
+    //Only the mode differs. One single register write.
+    SetHoldingRegs(holdingRegs, GW_CFG_MODE_GRID, GW_CFG_UTIL_TIME_OFFPEAK, 40);
+    cWrites = reconcile_Diff(desired, cDesired, holdingRegs, writes);
+    ASSERT_EQUAL(cWrites, 1, "One write when only the mode differs, = %d", cWrites);
+    ASSERT_EQUAL(writes[0].nAddress, GW_HREG_CFG_MODE, "Write is to the mode register");
+    ASSERT_EQUAL(writes[0].nCount, 1, "Write is a single register, = %d", writes[0].nCount);
+    ASSERT_EQUAL(writes[0].nValues[0], GW_CFG_MODE_BATTS, "Write sets batts mode");
+    
+    //Peak to off-peak. The registers between the mode and end hour aren't the state's, so three writes.
+    SetHoldingRegs(holdingRegs, GW_CFG_MODE_BATTS, GW_CFG_UTIL_TIME_OFFPEAK, 40);
+    holdingRegs[GW_HREG_UTIL_END_HOUR - 1] = 0x1234;
+    cDesired = reconcile_GetDesired(SYSTEM_STATE_OFF_PEAK, 20, desired);
+    cWrites = reconcile_Diff(desired, cDesired, holdingRegs, writes);
+    ASSERT_EQUAL(cWrites, 3, "Peak to off-peak is three writes, = %d", cWrites);
+    ASSERT_EQUAL(writes[0].nAddress, GW_HREG_CFG_MODE, "First write is to the mode register");
+    ASSERT_EQUAL(writes[0].nCount, 1, "First write is a single register, = %d", writes[0].nCount);
+    ASSERT_EQUAL(writes[0].nValues[0], GW_CFG_MODE_GRID, "First write sets grid mode");
+    ASSERT_EQUAL(writes[1].nAddress, GW_HREG_UTIL_END_HOUR, "Second write is to the end hour, not across the start hour");
+    ASSERT_EQUAL(writes[1].nCount, 1, "Second write is a single register, = %d", writes[1].nCount);
+    ASSERT_EQUAL(writes[1].nValues[0], GW_CFG_UTIL_TIME_ANY_TIME, "Second write unlimits charging times");
+    ASSERT_EQUAL(writes[2].nAddress, GW_HREG_MAX_UTIL_AMPS, "Third write is to the util amps register");
+    ASSERT_EQUAL(writes[2].nValues[0], 20, "Third write sets the charge current");
+    
+    //Applying the writes leaves nothing more to do.
+    for(uint8_t i = 0; i < cWrites; i++)
+        reconcile_Apply(&writes[i], holdingRegs);
+    
+    cWrites = reconcile_Diff(desired, cDesired, holdingRegs, writes);
+    ASSERT_EQUAL(cWrites, 0, "No writes after applying them, = %d", cWrites);
+    ASSERT_EQUAL(holdingRegs[GW_HREG_UTIL_END_HOUR - 1], 0x1234, "Unowned register unchanged after applying");
+    
+    //Settings on neighbouring registers are still written one at a time, skipping any already right.
+    struct RegisterSetting neighbours[3] = { { 10, 1 }, { 11, 2 }, { 12, 3 } };
+    memset(holdingRegs, 0x00, sizeof(holdingRegs));
+    holdingRegs[11] = 2;
+    cWrites = reconcile_Diff(neighbours, 3, holdingRegs, writes);
+    ASSERT_EQUAL(cWrites, 2, "Neighbouring settings are a write each, = %d", cWrites);
+    ASSERT_EQUAL(writes[0].nAddress, 10, "First write is the first setting, = %d", writes[0].nAddress);
+    ASSERT_EQUAL(writes[1].nAddress, 12, "Second write skips the one already right, = %d", writes[1].nAddress);
+    ASSERT_EQUAL(writes[1].nCount, 1, "Second write is a single register, = %d", writes[1].nCount);
+}
+
+static void test_reconcile_Owned()
+{
+    struct RegisterSetting desired[RECONCILE_MAX_SETTINGS];
+    struct ReconcileWrite writes[RECONCILE_MAX_SETTINGS];
+    uint16_t holdingRegs[GW_HREG_COUNT];
+    uint32_t r = 12345;
+    bool bOwned = true;
+    
+    //Whatever the image holds, every write carries only the state's settings, so any of them can be broadcast.
+    for(int lStep = 0; lStep < 10000; lStep++)
+    {
+        uint16_t nState = lStep % (SYSTEM_STATE_BOOST + 1);
+        uint8_t cDesired = reconcile_GetDesired(nState, 25, desired);
+        
+        for(uint16_t i = 0; i < GW_HREG_COUNT; i++)
+        {
+            r = r * 1103515245 + 12345;
+            holdingRegs[i] = (r >> 16) % 4;
+        }
+        
+        uint8_t cWrites = reconcile_Diff(desired, cDesired, holdingRegs, writes);
+        
+        for(uint8_t i = 0; i < cWrites; i++)
+        {
+            if(!reconcile_Owned(desired, cDesired, &writes[i]))
+                bOwned = false;
+        }
+    }
+    
+    ASSERT_EQUAL(bOwned, true, "Every write is the state's own settings");
+    
+    //A write padded from the image isn't.
+    struct ReconcileWrite padded = { GW_HREG_CFG_MODE, 2, { GW_CFG_MODE_GRID, 0x1234 } };
+    uint8_t cDesired = reconcile_GetDesired(SYSTEM_STATE_OFF_PEAK, 25, desired);
+    ASSERT_EQUAL(reconcile_Owned(desired, cDesired, &padded), false, "Unowned register found");
+    padded.nCount = 1;
+    ASSERT_EQUAL(reconcile_Owned(desired, cDesired, &padded), true, "Mode alone is owned");
+    padded.nValues[0] = GW_CFG_MODE_BATTS;
+    ASSERT_EQUAL(reconcile_Owned(desired, cDesired, &padded), false, "Not the state's setting");
+}
+
+void test_reconcile()
+{
+    PRINT_DEBUG("---=== Reconcile tests ===---\n");
+    
+    test_reconcile_GetDesired();
+    test_reconcile_Diff();
+    test_reconcile_Owned();
+    
+    PRINT_DEBUG("-----------------------------\n\n");
+}
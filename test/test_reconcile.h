@@ -0,0 +1,7 @@
+
+#ifndef TEST_RECONCILE_H
+#define TEST_RECONCILE_H
+
+void test_reconcile();
+
+#endif
@@ -0,0 +1,200 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include "test.h"
+#include "test_rtu.h"
+#include "rtu.h"
+
+#define TEST_RTU_BAUD 9600
+#define TEST_RTU_NOW  1000000000000LL
+
+static struct RtuMaster master;
+static int fds[2];    //The master's end, and the slave's played here.
+
+//The bitwise CRC the table stands in for.
+static uint16_t Crc16(const uint8_t* pData, uint16_t nLength)
+{
+    uint16_t nCrc = 0xFFFF;
+
+    for(uint16_t i = 0; i < nLength; i++)
+    {
+        nCrc ^= pData[i];
+
+        for(int j = 0; j < 8; j++)
+            nCrc = (nCrc & 1) ? (nCrc >> 1) ^ 0xA001 : nCrc >> 1;
+    }
+
+    return nCrc;
+}
+
+//Answer as the slave, CRC and all.
+static void Respond(const uint8_t* pFrame, uint16_t nLength)
+{
+    uint8_t frame[RTU_FRAME_MAX];
+    memcpy(frame, pFrame, nLength);
+
+    uint16_t nCrc = Crc16(frame, nLength);
+    frame[nLength] = nCrc & 0xFF;
+    frame[nLength + 1] = nCrc >> 8;
+
+    ASSERT_EQUAL(write(fds[1], frame, nLength + 2), nLength + 2, "Responded");
+}
+
+static void Drain()
+{
+    uint8_t frame[RTU_FRAME_MAX];
+    while(read(fds[1], frame, sizeof(frame)) > 0);
+}
+
+static void test_rtu_Crc()
+{
+    uint8_t request[] = { 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A };
+    uint8_t data[RTU_FRAME_MAX];
+
+    ASSERT_EQUAL(rtu_Crc16(request, sizeof(request)), 0xCDC5, "Known frame");
+    ASSERT_EQUAL(rtu_Crc16(request, 0), 0xFFFF, "Nothing");
+
+    for(int i = 0; i < RTU_FRAME_MAX; i++)
+        data[i] = (uint8_t)(i * 37 + 11);
+
+    ASSERT_EQUAL(rtu_Crc16(data, sizeof(data)), Crc16(data, sizeof(data)), "Table agrees with bitwise");
+}
+
+static void test_rtu_Read()
+{
+    uint8_t pdu[] = { 0x04, 0x00, 0x10, 0x00, 0x02 };
+    uint8_t frame[RTU_FRAME_MAX];
+    uint8_t response[] = { 0x01, 0x04, 0x04, 0x12, 0x34, 0x56, 0x78 };
+    uint16_t nLength = 0;
+    int64_t llNowNs = TEST_RTU_NOW;
+
+    ASSERT_EQUAL(rtu_Start(&master, 1, pdu, sizeof(pdu), llNowNs), 0, "Started");
+    ASSERT_EQUAL(master.state, RTU_AWAITING, "Sent at once on a quiet bus");
+    ASSERT_EQUAL(rtu_Events(&master), POLLIN, "Waiting to read");
+    ASSERT_EQUAL(rtu_Deadline(&master), master.llBusyNs + RTU_RESPONSE_TIMEOUT_NS, "Response timeout");
+
+    ASSERT_EQUAL(read(fds[1], frame, sizeof(frame)), 8, "Whole frame out");
+    ASSERT_EQUAL(frame[0], 1, "Slave");
+    ASSERT_EQUAL(memcmp(&frame[1], pdu, sizeof(pdu)), 0, "PDU");
+    ASSERT_EQUAL(frame[6] | (frame[7] << 8), Crc16(frame, 6), "CRC, low byte first");
+    ASSERT_EQUAL(rtu_Start(&master, 1, pdu, sizeof(pdu), llNowNs), -1, "One at a time");
+
+    //Half now, half later, as an adapter might hand it over.
+    uint16_t nCrc = Crc16(response, sizeof(response));
+    memcpy(frame, response, sizeof(response));
+    frame[sizeof(response)] = nCrc & 0xFF;
+    frame[sizeof(response) + 1] = nCrc >> 8;
+
+    llNowNs += 20000000;
+    write(fds[1], frame, 4);
+    ASSERT_EQUAL(rtu_Service(&master, POLLIN, llNowNs), false, "Part way");
+    ASSERT_EQUAL(master.state, RTU_RECEIVING, "Receiving");
+    ASSERT_EQUAL(master.nExpected, 9, "Length from the header");
+    ASSERT_EQUAL(rtu_Deadline(&master), llNowNs + RTU_FRAME_GAP_NS, "Frame gap");
+
+    llNowNs += 1000000;
+    write(fds[1], frame + 4, 5);
+    ASSERT_EQUAL(rtu_Service(&master, POLLIN, llNowNs), true, "Finished");
+    ASSERT_EQUAL(master.state, RTU_DONE, "Done");
+    ASSERT_EQUAL(master.lGaps, 0, "No gap to speak of");
+
+    const uint8_t* pResponse = rtu_ResponsePdu(&master, &nLength);
+    ASSERT_EQUAL(nLength, 6, "PDU length");
+    ASSERT_EQUAL(pResponse[2], 0x12, "Data");
+    ASSERT_EQUAL(pResponse[5], 0x78, "All of it");
+
+    rtu_Reset(&master);
+    ASSERT_EQUAL(master.state, RTU_IDLE, "Idle again");
+}
+
+static void test_rtu_Silence()
+{
+    uint8_t pdu[] = { 0x06, 0x00, 0x01, 0x00, 0x02 };
+    int64_t llNowNs = master.llBusyNs + master.llT35Ns / 2;
+
+    ASSERT_EQUAL(master.llT35Ns, 11 * 1000000000LL / TEST_RTU_BAUD * 7 / 2, "3.5 characters");
+    ASSERT_EQUAL(rtu_Start(&master, 1, pdu, sizeof(pdu), llNowNs), 0, "Started");
+    ASSERT_EQUAL(master.state, RTU_SILENCE, "Waits for the bus to go quiet");
+    ASSERT_EQUAL(rtu_Events(&master), 0, "Only on time");
+    ASSERT_EQUAL(rtu_Deadline(&master), master.llBusyNs + master.llT35Ns, "Until 3.5 characters after");
+
+    ASSERT_EQUAL(rtu_Service(&master, 0, llNowNs + 1), false, "Too soon");
+    ASSERT_EQUAL(master.state, RTU_SILENCE, "Still waiting");
+    ASSERT_EQUAL(rtu_Service(&master, 0, rtu_Deadline(&master)), false, "Sent");
+    ASSERT_EQUAL(master.state, RTU_AWAITING, "Awaiting");
+    Drain();
+
+    //Nothing comes back.
+    ASSERT_EQUAL(rtu_Service(&master, 0, rtu_Deadline(&master)), true, "Timed out");
+    ASSERT_EQUAL(master.lError, ETIMEDOUT, "Timeout");
+    ASSERT_EQUAL(master.lTimeouts, 1, "Counted");
+    ASSERT_EQUAL(rtu_Run(&master), -1, "Run reports it");
+    ASSERT_EQUAL(errno, ETIMEDOUT, "As errno");
+    rtu_Reset(&master);
+}
+
+static void test_rtu_Errors()
+{
+    uint8_t pdu[] = { 0x03, 0x00, 0x10, 0x00, 0x01 };
+    uint8_t exception[] = { 0x01, 0x83, 0x02 };
+    uint8_t other[] = { 0x02, 0x03, 0x02, 0x00, 0x01 };
+    uint8_t frame[] = { 0x01, 0x03, 0x02, 0x00, 0x01, 0x00, 0x00 };
+    int64_t llNowNs = TEST_RTU_NOW * 2;
+
+    rtu_Start(&master, 1, pdu, sizeof(pdu), llNowNs);
+    Drain();
+    Respond(exception, sizeof(exception));
+    ASSERT_EQUAL(rtu_Service(&master, POLLIN, llNowNs), true, "Exception");
+    ASSERT_EQUAL(master.lError, RTU_ERRNO_BASE + 2, "Illegal data address, as libmodbus has it");
+    ASSERT_EQUAL(strcmp(rtu_StrError(master.lError), "Illegal data address"), 0, "Described");
+    rtu_Reset(&master);
+
+    llNowNs += 1000000000LL;
+    rtu_Start(&master, 1, pdu, sizeof(pdu), llNowNs);
+    Drain();
+    Respond(other, sizeof(other));
+    ASSERT_EQUAL(rtu_Service(&master, POLLIN, llNowNs), true, "Wrong slave");
+    ASSERT_EQUAL(master.lError, RTU_EBADSLAVE, "Refused");
+    rtu_Reset(&master);
+
+    llNowNs += 1000000000LL;
+    rtu_Start(&master, 1, pdu, sizeof(pdu), llNowNs);
+    Drain();
+    write(fds[1], frame, sizeof(frame));
+    ASSERT_EQUAL(rtu_Service(&master, POLLIN, llNowNs), true, "Corrupt");
+    ASSERT_EQUAL(master.lError, RTU_EBADCRC, "Bad CRC");
+    rtu_Reset(&master);
+
+    //Nothing answers a broadcast.
+    llNowNs += 1000000000LL;
+    ASSERT_EQUAL(rtu_Start(&master, RTU_BROADCAST, pdu, sizeof(pdu), llNowNs), 0, "Broadcast");
+    ASSERT_EQUAL(master.state, RTU_DONE, "Done once sent");
+    ASSERT_EQUAL(rtu_Run(&master), 0, "Nothing to run");
+    rtu_Reset(&master);
+    Drain();
+}
+
+void test_rtu()
+{
+    PRINT_DEBUG("---=== RTU tests ===---\n");
+
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    rtu_Initialise(&master, fds[0], TEST_RTU_BAUD);
+
+    test_rtu_Crc();
+    test_rtu_Read();
+    test_rtu_Silence();
+    test_rtu_Errors();
+
+    close(fds[0]);
+    close(fds[1]);
+
+    PRINT_DEBUG("---------------------------\n\n");
+}
@@ -0,0 +1,7 @@
+
+#ifndef TEST_RTU_H
+#define TEST_RTU_H
+
+void test_rtu();
+
+#endif
@@ -0,0 +1,179 @@
+
+#include "test.h"
+#include "test_schedule.h"
+#include "schedule.h"
+#include <stdio.h>
+
+#define TEST_T0   1700000000
+#define TEST_FILE "test_schedule.bin"
+
+static uint32_t lStarts;
+static uint32_t lEnds;
+static int32_t slLastFired;
+static struct ScheduledCommand lastFired;
+
+static void test_schedule_Fired(struct Schedule* pSchedule, const struct ScheduledCommand* pCommand, bool bEnding)
+{
+    if(bEnding)
+        lEnds++;
+    else
+        lStarts++;
+        
+    slLastFired = pSchedule->slCurrent;
+    lastFired = *pCommand;
+}
+
+static void test_schedule_Setup(struct Schedule* pSchedule)
+{
+    lStarts = 0;
+    lEnds = 0;
+    slLastFired = 0;
+    schedule_Initialise(pSchedule, test_schedule_Fired, TEST_T0);
+}
+
+static struct ScheduledCommand Command(int32_t slStart, int32_t slDuration, int32_t slPeriod)
+{
+    struct ScheduledCommand command;
+    command.lScheduleId = 0;
+    command.slStart = slStart;
+    command.slDuration = slDuration;
+    command.slPeriod = slPeriod;
+    command.nCommandID = 2;
+    command.nParam = 0;
+    
+    return command;
+}
+
+static void test_schedule_OneShot()
+{
+    struct Schedule schedule;
+    test_schedule_Setup(&schedule);
+    
+    //Near, and far enough to cascade down from the top level.
+    struct ScheduledCommand near = Command(TEST_T0 + 10, 0, 0);
+    struct ScheduledCommand far = Command(TEST_T0 + 300000, 0, 0);
+    uint32_t lNear = schedule_Add(&schedule, &near);
+    schedule_Add(&schedule, &far);
+    ASSERT_EQUAL(lNear, 1, "First ID, = %u", lNear);
+    ASSERT_EQUAL(schedule.cCount, 2, "Two entries, = %u", schedule.cCount);
+    
+    schedule_Advance(&schedule, TEST_T0 + 9);
+    ASSERT_EQUAL(lStarts, 0, "Not due yet, = %u", lStarts);
+    schedule_Advance(&schedule, TEST_T0 + 10);
+    ASSERT_EQUAL(lStarts, 1, "Due on time, = %u", lStarts);
+    ASSERT_EQUAL(slLastFired, TEST_T0 + 10, "Fired on its tick, = %d", slLastFired);
+    ASSERT_EQUAL(schedule.cCount, 1, "One-shot removed, = %u", schedule.cCount);
+    
+    //Small enough steps to tick through every level's cascades.
+    for(int32_t slNow = TEST_T0 + 11; slNow < TEST_T0 + 300000; slNow += 1000)
+        schedule_Advance(&schedule, slNow);
+        
+    ASSERT_EQUAL(lStarts, 1, "Far entry not early, = %u", lStarts);
+    schedule_Advance(&schedule, TEST_T0 + 300000);
+    ASSERT_EQUAL(lStarts, 2, "Far entry due, = %u", lStarts);
+    ASSERT_EQUAL(slLastFired, TEST_T0 + 300000, "Far entry exactly on time, = %d", slLastFired);
+    ASSERT_EQUAL(schedule.cCount, 0, "Empty, = %u", schedule.cCount);
+}
+
+static void test_schedule_Window()
+{
+    struct Schedule schedule;
+    test_schedule_Setup(&schedule);
+    
+    //Two hours, every week.
+    struct ScheduledCommand window = Command(TEST_T0 + 3600, 7200, 604800);
+    schedule_Add(&schedule, &window);
+    
+    schedule_Advance(&schedule, TEST_T0 + 3600);
+    ASSERT_EQUAL(lStarts, 1, "Window started, = %u", lStarts);
+    schedule_Advance(&schedule, TEST_T0 + 3600 + 7199);
+    ASSERT_EQUAL(lEnds, 0, "Not ended early, = %u", lEnds);
+    schedule_Advance(&schedule, TEST_T0 + 3600 + 7200);
+    ASSERT_EQUAL(lEnds, 1, "Window ended, = %u", lEnds);
+    ASSERT_EQUAL(lastFired.slStart, TEST_T0 + 3600, "End reports its window, = %d", lastFired.slStart);
+    
+    //A week later (one big jump, rebuilding the wheel), it happens again.
+    schedule_Advance(&schedule, TEST_T0 + 3600 + 604800 + 60);
+    ASSERT_EQUAL(lStarts, 2, "Started again the next week, = %u", lStarts);
+    ASSERT_EQUAL(schedule.cCount, 1, "Still scheduled, = %u", schedule.cCount);
+    
+    //Skip a whole week's window while "off".
+    schedule_Advance(&schedule, TEST_T0 + 3600 + 604800 * 2 + 7200 + 10);
+    ASSERT_EQUAL(lEnds, 2, "The window in progress ended, = %u", lEnds);
+    ASSERT_EQUAL(lStarts, 2, "Missed window skipped, = %u", lStarts);
+    ASSERT_EQUAL(schedule.entries[0].command.slStart, TEST_T0 + 3600 + 604800 * 3, "Moved on to the next week, = %d",
+                 schedule.entries[0].command.slStart);
+}
+
+static void test_schedule_Cancel()
+{
+    struct Schedule schedule;
+    struct ScheduleList list;
+    test_schedule_Setup(&schedule);
+    
+    struct ScheduledCommand command = Command(TEST_T0 + 100, 0, 0);
+    struct ScheduledCommand invalid = Command(TEST_T0 + 100, 600, 600);
+    ASSERT_EQUAL(schedule_Add(&schedule, &invalid), 0, "Window as long as its period refused");
+    
+    uint32_t lIds[SCHEDULE_MAX_ENTRIES];
+    
+    for(int i = 0; i < SCHEDULE_MAX_ENTRIES; i++)
+        lIds[i] = schedule_Add(&schedule, &command);
+        
+    ASSERT_EQUAL(schedule_Add(&schedule, &command), 0, "Full schedule refuses");
+    ASSERT_EQUAL(schedule_Cancel(&schedule, lIds[5]), true, "Cancelled one");
+    ASSERT_EQUAL(schedule_Cancel(&schedule, lIds[5]), false, "Can't cancel twice");
+    ASSERT_EQUAL(schedule_Cancel(&schedule, lIds[0]), true, "Cancelled the list tail");
+    ASSERT_EQUAL(schedule_Cancel(&schedule, lIds[SCHEDULE_MAX_ENTRIES - 1]), true, "Cancelled the list head");
+    
+    schedule_List(&schedule, &list);
+    ASSERT_EQUAL(list.nCount, SCHEDULE_MAX_ENTRIES - 3, "Listed, = %u", list.nCount);
+    
+    schedule_Advance(&schedule, TEST_T0 + 100);
+    ASSERT_EQUAL(lStarts, SCHEDULE_MAX_ENTRIES - 3, "Only the rest fired, = %u", lStarts);
+}
+
+static void test_schedule_Persist()
+{
+    struct Schedule schedule;
+    struct Schedule loaded;
+    struct ScheduleList list;
+    test_schedule_Setup(&schedule);
+    
+    struct ScheduledCommand first = Command(TEST_T0 + 100, 0, 0);
+    struct ScheduledCommand second = Command(TEST_T0 + 200, 60, 86400);
+    second.nCommandID = 7;
+    second.nParam = 30;
+    schedule_Add(&schedule, &first);
+    uint32_t lSecond = schedule_Add(&schedule, &second);
+    schedule_Cancel(&schedule, 1);
+    
+    ASSERT_EQUAL(schedule_Save(&schedule, TEST_FILE), true, "Saved");
+    
+    test_schedule_Setup(&loaded);
+    ASSERT_EQUAL(schedule_Load(&loaded, TEST_FILE), true, "Loaded");
+    schedule_List(&loaded, &list);
+    ASSERT_EQUAL(list.nCount, 1, "Loaded one entry, = %u", list.nCount);
+    ASSERT_EQUAL(list.entries[0].lScheduleId, lSecond, "Kept its ID, = %u", list.entries[0].lScheduleId);
+    ASSERT_EQUAL(list.entries[0].nParam, 30, "Kept its param, = %u", list.entries[0].nParam);
+    
+    struct ScheduledCommand third = Command(TEST_T0 + 300, 0, 0);
+    ASSERT_EQUAL(schedule_Add(&loaded, &third), lSecond + 1, "IDs carry on");
+    
+    schedule_Advance(&loaded, TEST_T0 + 200);
+    ASSERT_EQUAL(lStarts, 1, "Loaded entry fires, = %u", lStarts);
+    
+    remove(TEST_FILE);
+}
+
+void test_schedule()
+{
+    PRINT_DEBUG("---=== Schedule tests ===---\n");
+    
+    test_schedule_OneShot();
+    test_schedule_Window();
+    test_schedule_Cancel();
+    test_schedule_Persist();
+    
+    PRINT_DEBUG("----------------------------\n\n");
+}
@@ -0,0 +1,7 @@
+
+#ifndef TEST_SCHEDULE_H
+#define TEST_SCHEDULE_H
+
+void test_schedule();
+
+#endif
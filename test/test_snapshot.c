@@ -0,0 +1,132 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "test.h"
+#include "test_snapshot.h"
+#include "replaytransport.h"
+#include "snapshot.h"
+
+#define TEST_SNAPSHOT_HISTORY "/tmp/test_snapshot.csv"
+#define TEST_SNAPSHOT_FILE    "/tmp/test_snapshot.bin"
+
+static struct Transport transport;
+static struct ReplayTransport replay;
+static struct Snapshot before;
+static struct Snapshot after;
+
+static void WriteHistory()
+{
+    FILE* pFile = fopen(TEST_SNAPSHOT_HISTORY, "w");
+    struct HistoryRecord record;
+    char line[HISTORY_LINE_MAX];
+
+    fputs(HISTORY_HEADER, pFile);
+    memset(&record, 0x00, sizeof(record));
+    record.slTime = 1790000000;
+    record.nSystemState = SYSTEM_STATE_PEAK;
+
+    history_Format(&record, line, sizeof(line));
+    fputs(line, pFile);
+    fclose(pFile);
+}
+
+//The replay clock ticks between snapshots, and restore leaves it alone anyway.
+static void SameClock(struct Snapshot* pTo, const struct Snapshot* pFrom)
+{
+    for(int i = 0; i < INVERTER_COUNT; i++)
+        memcpy(&pTo->regs[i][GW_HREG_TIME_Y], &pFrom->regs[i][GW_HREG_TIME_Y], 6 * sizeof(uint16_t));
+}
+
+static void test_snapshot_TakeAndDiff()
+{
+    struct SnapshotDiff diffs[8];
+
+    ASSERT_EQUAL(snapshot_Take(&before, &transport, 1790000000, 0), INVERTER_COUNT, "One read per inverter");
+    ASSERT_EQUAL(before.cInverters, INVERTER_COUNT, "Inverters");
+    ASSERT_EQUAL(before.nModel, INVERTER_MODEL, "Model");
+    ASSERT_EQUAL(before.regs[0][GW_HREG_CFG_MODE], GW_CFG_MODE_BATTS, "Mode read");
+
+    transport_SetSlave(&transport, INVERTER_1_ID);
+    transport_WriteRegister(&transport, 10, 1010);
+    transport_WriteRegister(&transport, 13, 1313);
+    transport_WriteRegister(&transport, 40, 4040);
+    transport_WriteRegister(&transport, GW_HREG_CFG_MODE, GW_CFG_MODE_GRID);
+    transport_SetSlave(&transport, INVERTER_1_ID + 1);
+    transport_WriteRegister(&transport, 20, 2020);
+
+    ASSERT_EQUAL(snapshot_Take(&after, &transport, 1790000060, 0), INVERTER_COUNT, "Taken again");
+    SameClock(&after, &before);
+
+    ASSERT_EQUAL(snapshot_Diff(&before, &after, diffs, 8), 5, "Differences");
+    ASSERT_EQUAL(diffs[0].cInverter, 0, "First inverter");
+    ASSERT_EQUAL(diffs[0].nAddress, GW_HREG_CFG_MODE, "Mode first");
+    ASSERT_EQUAL(diffs[1].nAddress, 10, "Then in order");
+    ASSERT_EQUAL(diffs[1].nFrom, before.regs[0][10], "From");
+    ASSERT_EQUAL(diffs[1].nTo, 1010, "To");
+    ASSERT_EQUAL(diffs[4].cInverter, 1, "Second inverter");
+    ASSERT_EQUAL(diffs[4].nAddress, 20, "Its register");
+
+    ASSERT_EQUAL(snapshot_Diff(&before, &after, diffs, 2), 5, "All counted when truncated");
+    ASSERT_EQUAL(snapshot_Diff(&before, &before, diffs, 8), 0, "Nothing against itself");
+}
+
+static void test_snapshot_Restore()
+{
+    struct SnapshotRestore result;
+    struct Snapshot restored;
+
+    transport_ResetStats(&transport);
+    ASSERT_EQUAL(snapshot_Restore(&before, &transport, 0, &result), 0, "Restored");
+    ASSERT_EQUAL(result.nChanged, 4, "Mode not counted");
+    ASSERT_EQUAL(result.nWrites, 3, "10 and 13 merged");
+    ASSERT_EQUAL(result.nMismatched, 0, "Verified");
+    ASSERT_EQUAL(transport.lTransactions, 3 + 2 * INVERTER_COUNT, "Writes plus a read before and after");
+
+    snapshot_Take(&restored, &transport, 1790000120, 0);
+    SameClock(&restored, &before);
+    ASSERT_EQUAL(restored.regs[0][13], before.regs[0][13], "Back");
+    ASSERT_EQUAL(restored.regs[1][20], before.regs[1][20], "Back on the slave");
+    ASSERT_EQUAL(restored.regs[0][GW_HREG_CFG_MODE], GW_CFG_MODE_GRID, "Mode left to the server");
+
+    ASSERT_EQUAL(snapshot_Restore(&before, &transport, 0, &result), 0, "Again");
+    ASSERT_EQUAL(result.nWrites, 0, "Nothing to write");
+
+    restored = before;
+    restored.nModel = INVERTER_MODEL + 1;
+    errno = 0;
+    ASSERT_EQUAL(snapshot_Restore(&restored, &transport, 0, &result), -1, "Another model");
+    ASSERT_EQUAL(errno, EINVAL, "Refused");
+}
+
+static void test_snapshot_SaveLoad()
+{
+    struct Snapshot loaded;
+
+    ASSERT_EQUAL(snapshot_Save(&before, TEST_SNAPSHOT_FILE), true, "Saved");
+    memset(&loaded, 0x00, sizeof(loaded));
+    ASSERT_EQUAL(snapshot_Load(&loaded, TEST_SNAPSHOT_FILE), true, "Loaded");
+    ASSERT_EQUAL(memcmp(&loaded, &before, sizeof(loaded)), 0, "Same");
+
+    unlink(TEST_SNAPSHOT_FILE);
+    ASSERT_EQUAL(snapshot_Load(&loaded, TEST_SNAPSHOT_FILE), false, "No file");
+}
+
+void test_snapshot()
+{
+    PRINT_DEBUG("---=== Snapshot tests ===---\n");
+
+    WriteHistory();
+    replaytransport_Initialise(&transport, &replay, TEST_SNAPSHOT_HISTORY);
+    transport_Connect(&transport);
+
+    test_snapshot_TakeAndDiff();
+    test_snapshot_Restore();
+    test_snapshot_SaveLoad();
+
+    transport_Free(&transport);
+    unlink(TEST_SNAPSHOT_HISTORY);
+
+    PRINT_DEBUG("---------------------------\n\n");
+}
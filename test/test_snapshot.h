@@ -0,0 +1,7 @@
+
+#ifndef TEST_SNAPSHOT_H
+#define TEST_SNAPSHOT_H
+
+void test_snapshot();
+
+#endif
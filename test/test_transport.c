@@ -0,0 +1,119 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "test.h"
+#include "test_transport.h"
+#include "replaytransport.h"
+
+#define TEST_TRANSPORT_FILE "/tmp/test_transport.csv"
+
+static struct Transport transport;
+static struct ReplayTransport replay;
+
+static void WriteHistory(int lRecords)
+{
+    FILE* pFile = fopen(TEST_TRANSPORT_FILE, "w");
+    struct HistoryRecord record;
+    char line[HISTORY_LINE_MAX];
+
+    fputs(HISTORY_HEADER, pFile);
+    memset(&record, 0x00, sizeof(record));
+
+    for(int i = 0; i < lRecords; i++)
+    {
+        record.slTime = 1790000000 + i * HISTORY_INTERVAL_S;
+        record.nSystemState = i ? SYSTEM_STATE_OFF_PEAK : SYSTEM_STATE_PEAK;
+        record.nBatterySoc = 40 + i;
+        record.nOutputWatts[1] = 1000 + i;
+        record.nBattchgAmps[1] = i * 100;
+
+        history_Format(&record, line, sizeof(line));
+        fputs(line, pFile);
+    }
+
+    fclose(pFile);
+}
+
+static void test_transport_Replay()
+{
+    uint16_t regs[INPUT_REGISTER_COUNT * 2];
+
+    WriteHistory(2);
+    replaytransport_Initialise(&transport, &replay, TEST_TRANSPORT_FILE);
+    ASSERT_EQUAL(strcmp(transport.name, "Replay " TEST_TRANSPORT_FILE), 0, "Named, %s", transport.name);
+    ASSERT_EQUAL(transport_Connect(&transport), 0, "Connected");
+
+    //Each pass starts with the master's first block, and steps on a record.
+    transport_SetSlave(&transport, INVERTER_1_ID);
+    ASSERT_EQUAL(transport_ReadInputRegisters(&transport, 0, INPUT_REGISTER_COUNT, regs), INPUT_REGISTER_COUNT, "Master read");
+    ASSERT_EQUAL(regs[BATTERY_SOC], 40, "First record");
+    ASSERT_EQUAL(regs[STATUS], DISCHARGE, "On batteries at peak");
+    ASSERT_EQUAL(transport_ReadInputRegisters(&transport, INPUT_REGISTER_COUNT, INPUT_REGISTER_COUNT, regs), INPUT_REGISTER_COUNT, "Past the recorded map");
+    ASSERT_EQUAL(regs[0], 0, "Reads as zero");
+
+    transport_SetSlave(&transport, INVERTER_1_ID + 1);
+    transport_ReadInputRegisters(&transport, 0, INPUT_REGISTER_COUNT, regs);
+    ASSERT_EQUAL(regs[OUTPUT_WATTS_L], 1000, "Slave's own watts");
+
+    transport_SetSlave(&transport, INVERTER_1_ID);
+    transport_ReadInputRegisters(&transport, 0, INPUT_REGISTER_COUNT, regs);
+    ASSERT_EQUAL(regs[BATTERY_SOC], 41, "Next pass, next record");
+
+    transport_SetSlave(&transport, INVERTER_1_ID + 1);
+    transport_ReadInputRegisters(&transport, 0, INPUT_REGISTER_COUNT, regs);
+    ASSERT_EQUAL(regs[STATUS], AC_CHG_BYP, "Slave charging off-peak");
+
+    transport_SetSlave(&transport, INVERTER_1_ID);
+    transport_ReadInputRegisters(&transport, 0, INPUT_REGISTER_COUNT, regs);
+    ASSERT_EQUAL(regs[BATTERY_SOC], 40, "Round again");
+    ASSERT_EQUAL(replay.lLaps, 1, "One lap");
+
+    //Writes are kept.
+    ASSERT_EQUAL(transport_WriteRegister(&transport, GW_HREG_CFG_MODE, GW_CFG_MODE_GRID), 1, "Written");
+    ASSERT_EQUAL(transport_ReadRegisters(&transport, 0, GW_HREG_COUNT, regs), GW_HREG_COUNT, "Holding read");
+    ASSERT_EQUAL(regs[GW_HREG_CFG_MODE], GW_CFG_MODE_GRID, "Read back");
+    ASSERT_EQUAL(regs[GW_HREG_TIME_Y] > 0, true, "Clock set");
+
+    uint16_t amps[] = { 0, 30 };
+    ASSERT_EQUAL(transport_WriteAndReadRegisters(&transport, GW_HREG_MAX_UTIL_AMPS - 1, 2, amps, GW_HREG_MAX_UTIL_AMPS, 1, regs), 1, "Written and read");
+    ASSERT_EQUAL(regs[0], 30, "Read back in one");
+
+    //Nobody there.
+    transport_SetSlave(&transport, INVERTER_1_ID + INVERTER_COUNT);
+    ASSERT_EQUAL(transport_ReadInputRegisters(&transport, 0, 1, regs), -1, "No such slave");
+    ASSERT_EQUAL(errno, ETIMEDOUT, "Timed out");
+
+    ASSERT_EQUAL(transport.lTransactions, 10, "Every transaction counted, = %u", transport.lTransactions);
+    ASSERT_EQUAL(transport.lErrors, 1, "And the failure");
+    ASSERT_EQUAL(transport_Rate(&transport) > 0.0f, true, "Rate, %.0f/s", transport_Rate(&transport));
+
+    transport_Free(&transport);
+}
+
+static void test_transport_NoRecords()
+{
+    WriteHistory(0);
+    replaytransport_Initialise(&transport, &replay, TEST_TRANSPORT_FILE);
+    ASSERT_EQUAL(transport_Connect(&transport), -1, "Nothing to replay");
+    ASSERT_EQUAL(errno, ENODATA, "No data");
+    ASSERT_EQUAL(transport_Rate(&transport), 0.0f, "No rate yet");
+    transport_Free(&transport);
+
+    unlink(TEST_TRANSPORT_FILE);
+    replaytransport_Initialise(&transport, &replay, TEST_TRANSPORT_FILE);
+    ASSERT_EQUAL(transport_Connect(&transport), -1, "No file");
+    ASSERT_EQUAL(errno, ENOENT, "Not found");
+    transport_Free(&transport);
+}
+
+void test_transport()
+{
+    PRINT_DEBUG("---=== Transport tests ===---\n");
+
+    test_transport_Replay();
+    test_transport_NoRecords();
+
+    PRINT_DEBUG("---------------------------\n\n");
+}
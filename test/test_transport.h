@@ -0,0 +1,7 @@
+
+#ifndef TEST_TRANSPORT_H
+#define TEST_TRANSPORT_H
+
+void test_transport();
+
+#endif
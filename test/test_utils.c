@@ -100,11 +100,26 @@ static void test_utils_GetOffpeakChargingAmps()
     ASSERT_EQUAL(nResult, 2, "Lots used but met by boost charging. Capped at 2A, = %d", nResult);
 }
 
+static void test_utils_MinutesUntilOffPeakEnd()
+{
+    int lResult;
+    
+    lResult = utils_MinutesUntilOffPeakEnd(SYSTEM_START_OFF_PEAK_H, SYSTEM_START_OFF_PEAK_M);
+    ASSERT_EQUAL(lResult, 360, "Whole off-peak left at the start of off-peak, = %d", lResult);
+    
+    lResult = utils_MinutesUntilOffPeakEnd(0, 0);
+    ASSERT_EQUAL(lResult, 330, "Five and a half hours left at midnight, = %d", lResult);
+    
+    lResult = utils_MinutesUntilOffPeakEnd(SYSTEM_END_OFF_PEAK_H, SYSTEM_END_OFF_PEAK_M);
+    ASSERT_EQUAL(lResult, 0, "Nothing left at the end of off-peak, = %d", lResult);
+}
+
 void test_utils()
 {
     PRINT_DEBUG("---=== Utils tests ===---\n");
     
     test_utils_GetOffpeakChargingAmps();
+    test_utils_MinutesUntilOffPeakEnd();
     
     PRINT_DEBUG("-------------------------\n\n");
 }